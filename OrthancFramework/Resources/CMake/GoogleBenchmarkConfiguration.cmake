@@ -0,0 +1,41 @@
+# Orthanc - A Lightweight, RESTful DICOM Store
+# Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+# Department, University Hospital of Liege, Belgium
+# Copyright (C) 2017-2022 Osimis S.A., Belgium
+# Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+#
+# This program is free software: you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public License
+# as published by the Free Software Foundation, either version 3 of
+# the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this program. If not, see
+# <http://www.gnu.org/licenses/>.
+
+
+# Google Benchmark is only used by the optional "Benchmarks" target,
+# which is never part of the releases: Only the system-wide version
+# of the library is supported (e.g. "libbenchmark-dev" on Debian)
+
+find_path(GOOGLE_BENCHMARK_INCLUDE_DIR
+  NAMES benchmark/benchmark.h
+  )
+
+find_library(GOOGLE_BENCHMARK_LIBRARY
+  NAMES benchmark
+  )
+
+if (NOT GOOGLE_BENCHMARK_INCLUDE_DIR OR
+    NOT GOOGLE_BENCHMARK_LIBRARY)
+  message(FATAL_ERROR "Please install the libbenchmark-dev package")
+endif()
+
+include_directories(${GOOGLE_BENCHMARK_INCLUDE_DIR})
+
+set(GOOGLE_BENCHMARK_LIBRARIES ${GOOGLE_BENCHMARK_LIBRARY})
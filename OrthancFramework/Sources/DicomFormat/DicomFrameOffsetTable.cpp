@@ -0,0 +1,639 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "DicomFrameOffsetTable.h"
+
+#include "../OrthancException.h"
+#include "../Toolbox.h"
+#include "DicomStreamReader.h"
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cassert>
+#include <string.h>
+
+
+static const char* const SERIALIZATION_MAGIC = "DFOT";
+static const uint32_t SERIALIZATION_VERSION = 2;
+
+
+namespace Orthanc
+{
+  namespace
+  {
+    class HeaderVisitor : public DicomStreamReader::IVisitor
+    {
+    private:
+      bool                 hasTransferSyntax_;
+      DicomTransferSyntax  transferSyntax_;
+      std::string          numberOfFrames_;
+      bool                 hasPixelData_;
+      uint64_t             pixelDataOffset_;
+
+    public:
+      HeaderVisitor() :
+        hasTransferSyntax_(false),
+        transferSyntax_(DicomTransferSyntax_LittleEndianImplicit),  // Dummy
+        hasPixelData_(false),
+        pixelDataOffset_(0)
+      {
+      }
+
+      virtual void VisitMetaHeaderTag(const DicomTag& tag,
+                                      const ValueRepresentation& vr,
+                                      const std::string& value) ORTHANC_OVERRIDE
+      {
+      }
+
+      virtual void VisitTransferSyntax(DicomTransferSyntax transferSyntax) ORTHANC_OVERRIDE
+      {
+        hasTransferSyntax_ = true;
+        transferSyntax_ = transferSyntax;
+      }
+
+      virtual bool VisitDatasetTag(const DicomTag& tag,
+                                   const ValueRepresentation& vr,
+                                   const std::string& value,
+                                   bool isLittleEndian,
+                                   uint64_t fileOffset) ORTHANC_OVERRIDE
+      {
+        if (tag == DICOM_TAG_NUMBER_OF_FRAMES)
+        {
+          numberOfFrames_ = Toolbox::StripSpaces(value);
+        }
+        else if (tag == DICOM_TAG_PIXEL_DATA)
+        {
+          hasPixelData_ = true;
+          pixelDataOffset_ = fileOffset;
+        }
+
+        // Stop processing once pixel data has been reached
+        return (tag < DICOM_TAG_PIXEL_DATA);
+      }
+
+      bool LookupTransferSyntax(DicomTransferSyntax& target) const
+      {
+        target = transferSyntax_;
+        return hasTransferSyntax_;
+      }
+
+      bool LookupPixelDataOffset(uint64_t& target) const
+      {
+        target = pixelDataOffset_;
+        return hasPixelData_;
+      }
+
+      const std::string& GetNumberOfFrames() const
+      {
+        return numberOfFrames_;
+      }
+    };
+  }
+
+
+  bool DicomFrameOffsetTable::IsEncapsulatedTransferSyntax(DicomTransferSyntax transferSyntax)
+  {
+    return (transferSyntax != DicomTransferSyntax_LittleEndianImplicit &&
+            transferSyntax != DicomTransferSyntax_LittleEndianExplicit &&
+            transferSyntax != DicomTransferSyntax_BigEndianExplicit &&
+            transferSyntax != DicomTransferSyntax_DeflatedLittleEndianExplicit);
+  }
+
+
+  static bool IsVideoTransferSyntax(DicomTransferSyntax transferSyntax)
+  {
+    // Same rule as in "DicomFrameIndex::GetFramesCount()": A video is
+    // considered as one single frame, whatever its number of fragments
+    return (transferSyntax == DicomTransferSyntax_MPEG2MainProfileAtMainLevel ||
+            transferSyntax == DicomTransferSyntax_MPEG2MainProfileAtHighLevel ||
+            transferSyntax == DicomTransferSyntax_MPEG4HighProfileLevel4_1 ||
+            transferSyntax == DicomTransferSyntax_MPEG4BDcompatibleHighProfileLevel4_1 ||
+            transferSyntax == DicomTransferSyntax_MPEG4HighProfileLevel4_2_For2DVideo ||
+            transferSyntax == DicomTransferSyntax_MPEG4HighProfileLevel4_2_For3DVideo ||
+            transferSyntax == DicomTransferSyntax_MPEG4StereoHighProfileLevel4_2 ||
+            transferSyntax == DicomTransferSyntax_HEVCMainProfileLevel5_1 ||
+            transferSyntax == DicomTransferSyntax_HEVCMain10ProfileLevel5_1);
+  }
+
+
+  static uint32_t ReadLittleEndian32(const uint8_t* p)
+  {
+    return (static_cast<uint32_t>(p[0]) |
+            (static_cast<uint32_t>(p[1]) << 8) |
+            (static_cast<uint32_t>(p[2]) << 16) |
+            (static_cast<uint32_t>(p[3]) << 24));
+  }
+
+
+  static uint64_t ReadLittleEndian64(const uint8_t* p)
+  {
+    return (static_cast<uint64_t>(ReadLittleEndian32(p)) |
+            (static_cast<uint64_t>(ReadLittleEndian32(p + 4)) << 32));
+  }
+
+
+  static bool IsTag(const uint8_t* p,
+                    uint16_t group,
+                    uint16_t element)
+  {
+    // Encapsulated transfer syntaxes are always little endian
+    return (p[0] == (group & 0xff) &&
+            p[1] == (group >> 8) &&
+            p[2] == (element & 0xff) &&
+            p[3] == (element >> 8));
+  }
+
+
+  static void WriteLittleEndian32(std::string& target,
+                                  uint32_t value)
+  {
+    for (unsigned int i = 0; i < 4; i++)
+    {
+      target.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+  }
+
+
+  static void WriteLittleEndian64(std::string& target,
+                                  uint64_t value)
+  {
+    WriteLittleEndian32(target, static_cast<uint32_t>(value & 0xffffffffu));
+    WriteLittleEndian32(target, static_cast<uint32_t>(value >> 32));
+  }
+
+
+  void DicomFrameOffsetTable::Clear()
+  {
+    fileSize_ = 0;
+    sourceUuid_.clear();
+    transferSyntax_ = DicomTransferSyntax_LittleEndianExplicit;
+    fragmentsOffset_.clear();
+    fragmentsLength_.clear();
+    framesStart_.clear();
+  }
+
+
+  void DicomFrameOffsetTable::AssignFragmentsToFrames(unsigned int countFrames,
+                                                      const std::vector<uint32_t>& basicOffsetTable)
+  {
+    // This implements the same heuristics as the "FragmentIndex"
+    // class of "DicomFrameIndex", in order to return the same frames
+
+    assert(fragmentsOffset_.size() == fragmentsLength_.size());
+    const size_t countFragments = fragmentsOffset_.size();
+
+    framesStart_.clear();
+
+    if (countFrames == 0)
+    {
+      return;
+    }
+    else if (countFragments < countFrames)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+    else if (countFragments == countFrames)
+    {
+      // Simple case: There is one fragment per frame
+      framesStart_.resize(countFrames);
+      for (unsigned int i = 0; i < countFrames; i++)
+      {
+        framesStart_[i] = i;
+      }
+    }
+    else if (countFrames == 1)
+    {
+      // All the fragments belong to the single frame
+      framesStart_.push_back(0);
+    }
+    else
+    {
+      // Use the basic offset table, whose values are relative to the
+      // first byte of the item header of the first fragment
+      if (basicOffsetTable.size() != countFrames ||
+          basicOffsetTable[0] != 0)
+      {
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+
+      const uint64_t origin = fragmentsOffset_[0] - 8;
+
+      framesStart_.reserve(countFrames);
+
+      for (size_t i = 0; i < countFragments && framesStart_.size() < countFrames; i++)
+      {
+        const uint64_t offset = fragmentsOffset_[i] - 8 - origin;
+        if (offset == basicOffsetTable[framesStart_.size()])
+        {
+          framesStart_.push_back(static_cast<uint32_t>(i));
+        }
+        else if (offset > basicOffsetTable[framesStart_.size()])
+        {
+          // The offset table doesn't point to the start of a fragment
+          throw OrthancException(ErrorCode_BadFileFormat);
+        }
+      }
+
+      if (framesStart_.size() != countFrames)
+      {
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+    }
+  }
+
+
+  size_t DicomFrameOffsetTable::GetFrameEndFragment(unsigned int frame) const
+  {
+    assert(frame < framesStart_.size());
+
+    if (frame + 1 == framesStart_.size())
+    {
+      return fragmentsOffset_.size();
+    }
+    else
+    {
+      return framesStart_[frame + 1];
+    }
+  }
+
+
+  DicomFrameOffsetTable::DicomFrameOffsetTable()
+  {
+    Clear();
+  }
+
+
+  bool DicomFrameOffsetTable::Parse(const void* dicom,
+                                    size_t size)
+  {
+    Clear();
+
+    HeaderVisitor visitor;
+
+    try
+    {
+      boost::iostreams::array_source source(reinterpret_cast<const char*>(dicom), size);
+      boost::iostreams::stream<boost::iostreams::array_source> stream(source);
+
+      DicomStreamReader reader(stream);
+      reader.Consume(visitor);
+    }
+    catch (OrthancException&)
+    {
+      // Invalid DICOM file, or unsupported transfer syntax
+      return false;
+    }
+
+    DicomTransferSyntax transferSyntax;
+    uint64_t pixelDataOffset;
+
+    if (!visitor.LookupTransferSyntax(transferSyntax) ||
+        !IsEncapsulatedTransferSyntax(transferSyntax) ||
+        !visitor.LookupPixelDataOffset(pixelDataOffset))
+    {
+      return false;
+    }
+
+    unsigned int countFrames = 1;
+
+    if (!IsVideoTransferSyntax(transferSyntax) &&
+        !visitor.GetNumberOfFrames().empty())
+    {
+      int tmp;
+      try
+      {
+        tmp = boost::lexical_cast<int>(visitor.GetNumberOfFrames());
+      }
+      catch (boost::bad_lexical_cast&)
+      {
+        return false;
+      }
+
+      if (tmp < 0)
+      {
+        return false;
+      }
+      else
+      {
+        countFrames = static_cast<unsigned int>(tmp);
+      }
+    }
+
+    /**
+     * The header of an encapsulated pixel data is made of the tag
+     * (4 bytes), the "OB" value representation with 2 reserved bytes
+     * (4 bytes), and the undefined length (4 bytes).
+     * http://dicom.nema.org/medical/dicom/current/output/chtml/part05/sect_A.4.html
+     **/
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(dicom);
+
+    if (pixelDataOffset + 12 > size ||
+        !IsTag(p + pixelDataOffset, 0x7fe0, 0x0010) ||
+        ReadLittleEndian32(p + pixelDataOffset + 8) != 0xffffffffu)
+    {
+      return false;
+    }
+
+    std::vector<uint32_t> basicOffsetTable;
+    bool isFirstItem = true;
+    bool hasDelimitation = false;
+
+    uint64_t pos = pixelDataOffset + 12;
+    while (pos + 8 <= size)
+    {
+      if (IsTag(p + pos, 0xfffe, 0xe0dd))  // Sequence delimitation item
+      {
+        hasDelimitation = true;
+        break;
+      }
+      else if (!IsTag(p + pos, 0xfffe, 0xe000))  // Item
+      {
+        return false;
+      }
+
+      const uint32_t length = ReadLittleEndian32(p + pos + 4);
+      if (length == 0xffffffffu ||
+          pos + 8 + length > size)
+      {
+        return false;
+      }
+
+      if (isFirstItem)
+      {
+        // The first item is the basic offset table
+        if (length % 4 != 0)
+        {
+          return false;
+        }
+
+        basicOffsetTable.resize(length / 4);
+        for (size_t i = 0; i < basicOffsetTable.size(); i++)
+        {
+          basicOffsetTable[i] = ReadLittleEndian32(p + pos + 8 + 4 * i);
+        }
+
+        isFirstItem = false;
+      }
+      else
+      {
+        fragmentsOffset_.push_back(pos + 8);
+        fragmentsLength_.push_back(length);
+      }
+
+      pos += 8 + length;
+    }
+
+    if (!hasDelimitation ||
+        isFirstItem)
+    {
+      Clear();
+      return false;
+    }
+
+    try
+    {
+      AssignFragmentsToFrames(countFrames, basicOffsetTable);
+    }
+    catch (OrthancException&)
+    {
+      Clear();
+      return false;
+    }
+
+    fileSize_ = size;
+    transferSyntax_ = transferSyntax;
+    return true;
+  }
+
+
+  bool DicomFrameOffsetTable::Parse(const std::string& dicom)
+  {
+    return Parse(dicom.empty() ? NULL : dicom.c_str(), dicom.size());
+  }
+
+
+  MimeType DicomFrameOffsetTable::GetFrameMimeType() const
+  {
+    // Same rule as in "ParsedDicomFile::GetRawFrame()"
+    switch (transferSyntax_)
+    {
+      case DicomTransferSyntax_JPEGProcess1:
+        return MimeType_Jpeg;
+
+      case DicomTransferSyntax_JPEG2000LosslessOnly:
+      case DicomTransferSyntax_JPEG2000:
+        return MimeType_Jpeg2000;
+
+      default:
+        return MimeType_Binary;
+    }
+  }
+
+
+  uint64_t DicomFrameOffsetTable::GetFrameSize(unsigned int frame) const
+  {
+    if (frame >= framesStart_.size())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    uint64_t size = 0;
+
+    const size_t end = GetFrameEndFragment(frame);
+    for (size_t i = framesStart_[frame]; i < end; i++)
+    {
+      size += fragmentsLength_[i];
+    }
+
+    return size;
+  }
+
+
+  void DicomFrameOffsetTable::GetFrameRange(uint64_t& start,
+                                            uint64_t& end,
+                                            unsigned int frame) const
+  {
+    if (frame >= framesStart_.size())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    const size_t last = GetFrameEndFragment(frame) - 1;
+
+    start = fragmentsOffset_[framesStart_[frame]];
+    end = fragmentsOffset_[last] + fragmentsLength_[last];
+  }
+
+
+  void DicomFrameOffsetTable::ExtractFrame(std::string& target,
+                                           unsigned int frame,
+                                           const void* buffer,
+                                           size_t bufferSize,
+                                           uint64_t bufferOffset) const
+  {
+    uint64_t start, end;
+    GetFrameRange(start, end, frame);
+
+    if (start < bufferOffset ||
+        end > bufferOffset + bufferSize)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "The buffer doesn't contain the frame of interest");
+    }
+
+    target.resize(static_cast<size_t>(GetFrameSize(frame)));
+
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(buffer);
+
+    size_t pos = 0;
+    const size_t last = GetFrameEndFragment(frame);
+    for (size_t i = framesStart_[frame]; i < last; i++)
+    {
+      if (fragmentsLength_[i] > 0)
+      {
+        assert(pos + fragmentsLength_[i] <= target.size());
+        memcpy(&target[pos], source + (fragmentsOffset_[i] - bufferOffset), fragmentsLength_[i]);
+        pos += fragmentsLength_[i];
+      }
+    }
+
+    assert(pos == target.size());
+  }
+
+
+  void DicomFrameOffsetTable::Serialize(std::string& target) const
+  {
+    assert(fragmentsOffset_.size() == fragmentsLength_.size());
+
+    const std::string uid(GetTransferSyntaxUid(transferSyntax_));
+
+    target.clear();
+    target.reserve(36 + sourceUuid_.size() + uid.size() + 4 * framesStart_.size() + 12 * fragmentsOffset_.size());
+
+    target.append(SERIALIZATION_MAGIC, 4);
+    WriteLittleEndian32(target, SERIALIZATION_VERSION);
+    WriteLittleEndian64(target, fileSize_);
+    WriteLittleEndian32(target, static_cast<uint32_t>(sourceUuid_.size()));
+    target.append(sourceUuid_);
+    WriteLittleEndian32(target, static_cast<uint32_t>(uid.size()));
+    target.append(uid);
+    WriteLittleEndian32(target, static_cast<uint32_t>(framesStart_.size()));
+    WriteLittleEndian32(target, static_cast<uint32_t>(fragmentsOffset_.size()));
+
+    for (size_t i = 0; i < framesStart_.size(); i++)
+    {
+      WriteLittleEndian32(target, framesStart_[i]);
+    }
+
+    for (size_t i = 0; i < fragmentsOffset_.size(); i++)
+    {
+      WriteLittleEndian64(target, fragmentsOffset_[i]);
+      WriteLittleEndian32(target, fragmentsLength_[i]);
+    }
+  }
+
+
+  void DicomFrameOffsetTable::Unserialize(const std::string& source)
+  {
+    Clear();
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(source.c_str());
+
+    if (source.size() < 20 ||
+        source.compare(0, 4, SERIALIZATION_MAGIC) != 0 ||
+        ReadLittleEndian32(p + 4) != SERIALIZATION_VERSION)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat, "Not a serialized table of frame offsets");
+    }
+
+    const uint64_t fileSize = ReadLittleEndian64(p + 8);
+    const uint32_t sourceUuidLength = ReadLittleEndian32(p + 16);
+
+    if (source.size() < 32 + static_cast<uint64_t>(sourceUuidLength))
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    const std::string sourceUuid = source.substr(20, sourceUuidLength);
+
+    size_t pos = 20 + sourceUuidLength;
+    const uint32_t uidLength = ReadLittleEndian32(p + pos);
+    pos += 4;
+
+    if (source.size() < pos + 8 + static_cast<uint64_t>(uidLength))
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    DicomTransferSyntax transferSyntax;
+    if (!LookupTransferSyntax(transferSyntax, source.substr(pos, uidLength)))
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    pos += uidLength;
+    const uint32_t countFrames = ReadLittleEndian32(p + pos);
+    const uint32_t countFragments = ReadLittleEndian32(p + pos + 4);
+    pos += 8;
+
+    if (source.size() != pos + 4 * static_cast<uint64_t>(countFrames) + 12 * static_cast<uint64_t>(countFragments))
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    framesStart_.resize(countFrames);
+    for (uint32_t i = 0; i < countFrames; i++, pos += 4)
+    {
+      framesStart_[i] = ReadLittleEndian32(p + pos);
+
+      if (framesStart_[i] >= countFragments ||
+          (i > 0 && framesStart_[i] <= framesStart_[i - 1]))
+      {
+        Clear();
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+    }
+
+    fragmentsOffset_.resize(countFragments);
+    fragmentsLength_.resize(countFragments);
+    for (uint32_t i = 0; i < countFragments; i++, pos += 12)
+    {
+      fragmentsOffset_[i] = ReadLittleEndian64(p + pos);
+      fragmentsLength_[i] = ReadLittleEndian32(p + pos + 8);
+
+      if (fragmentsOffset_[i] + fragmentsLength_[i] > fileSize)
+      {
+        Clear();
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+    }
+
+    assert(pos == source.size());
+
+    fileSize_ = fileSize;
+    sourceUuid_ = sourceUuid;
+    transferSyntax_ = transferSyntax;
+  }
+}
@@ -0,0 +1,140 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../Enumerations.h"
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Orthanc
+{
+  /**
+   * This class indexes the location of the frames inside the
+   * encapsulated pixel data of a DICOM file (i.e. for compressed
+   * transfer syntaxes). Contrarily to "DicomFrameIndex", it does not
+   * rely on DCMTK: The table is built by scanning the headers of the
+   * items of the pixel sequence, and it only stores byte offsets
+   * relative to the beginning of the DICOM file. This makes it
+   * possible to extract one frame by reading only a range of the
+   * file, and to serialize the table as a compact binary buffer.
+   **/
+  class ORTHANC_PUBLIC DicomFrameOffsetTable : public boost::noncopyable
+  {
+  private:
+    uint64_t               fileSize_;
+    std::string            sourceUuid_;
+    DicomTransferSyntax    transferSyntax_;
+    std::vector<uint64_t>  fragmentsOffset_;  // Offset of the content of each fragment in the file
+    std::vector<uint32_t>  fragmentsLength_;
+    std::vector<uint32_t>  framesStart_;      // Index of the first fragment of each frame
+
+    void Clear();
+
+    void AssignFragmentsToFrames(unsigned int countFrames,
+                                 const std::vector<uint32_t>& basicOffsetTable);
+
+    size_t GetFrameEndFragment(unsigned int frame) const;
+
+  public:
+    DicomFrameOffsetTable();
+
+    /**
+     * Scan the DICOM file stored in the given memory buffer. Returns
+     * "false" if the DICOM file has no encapsulated pixel data, or if
+     * the frames cannot be located unambiguously (in which case, the
+     * caller must fallback to DCMTK).
+     **/
+    bool Parse(const void* dicom,
+               size_t size);
+
+    bool Parse(const std::string& dicom);
+
+    uint64_t GetFileSize() const
+    {
+      return fileSize_;
+    }
+
+    /**
+     * Identifier of the file from which the table was computed
+     * (typically the UUID of the DICOM attachment). It is stored in
+     * the serialized table, so that a table that was computed for
+     * another version of the file can be detected. "Parse()" clears
+     * this identifier.
+     **/
+    void SetSourceUuid(const std::string& uuid)
+    {
+      sourceUuid_ = uuid;
+    }
+
+    const std::string& GetSourceUuid() const
+    {
+      return sourceUuid_;
+    }
+
+    DicomTransferSyntax GetTransferSyntax() const
+    {
+      return transferSyntax_;
+    }
+
+    unsigned int GetFramesCount() const
+    {
+      return static_cast<unsigned int>(framesStart_.size());
+    }
+
+    // MIME type of the raw frames, as in "ParsedDicomFile::GetRawFrame()"
+    MimeType GetFrameMimeType() const;
+
+    uint64_t GetFrameSize(unsigned int frame) const;
+
+    /**
+     * Get the range of bytes of the DICOM file (the "end" being
+     * exclusive) that contains all the fragments of the given frame.
+     **/
+    void GetFrameRange(uint64_t& start,
+                       uint64_t& end,
+                       unsigned int frame) const;
+
+    /**
+     * Copy the content of the given frame, given a buffer that
+     * contains the bytes of the DICOM file starting at offset
+     * "bufferOffset" (this is typically the start of the range
+     * returned by "GetFrameRange()", or zero for the full file).
+     **/
+    void ExtractFrame(std::string& target,
+                      unsigned int frame,
+                      const void* buffer,
+                      size_t bufferSize,
+                      uint64_t bufferOffset) const;
+
+    void Serialize(std::string& target) const;
+
+    void Unserialize(const std::string& source);
+
+    // Whether the pixel data is stored as a sequence of fragments
+    static bool IsEncapsulatedTransferSyntax(DicomTransferSyntax transferSyntax);
+  };
+}
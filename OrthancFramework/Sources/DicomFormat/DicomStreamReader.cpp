@@ -703,5 +703,138 @@ namespace Orthanc
     boost::iostreams::stream<boost::iostreams::array_source> stream(source);
     return PixelDataVisitor::LookupPixelDataOffset(offset, stream);
   }
+
+
+  class DicomStreamReader::MetaHeaderVisitor : public DicomStreamReader::IVisitor
+  {
+  private:
+    std::string          sopClassUid_;
+    std::string          sopInstanceUid_;
+    bool                 hasTransferSyntax_;
+    DicomTransferSyntax  transferSyntax_;
+
+  public:
+    MetaHeaderVisitor() :
+      hasTransferSyntax_(false),
+      transferSyntax_(DicomTransferSyntax_LittleEndianImplicit)  // Dummy
+    {
+    }
+
+    virtual void VisitMetaHeaderTag(const DicomTag& tag,
+                                    const ValueRepresentation& vr,
+                                    const std::string& value) ORTHANC_OVERRIDE
+    {
+      static const DicomTag MEDIA_STORAGE_SOP_CLASS_UID(0x0002, 0x0002);
+      static const DicomTag MEDIA_STORAGE_SOP_INSTANCE_UID(0x0002, 0x0003);
+
+      if (tag == MEDIA_STORAGE_SOP_CLASS_UID)
+      {
+        sopClassUid_ = value;
+      }
+      else if (tag == MEDIA_STORAGE_SOP_INSTANCE_UID)
+      {
+        sopInstanceUid_ = value;
+      }
+    }
+
+    virtual void VisitTransferSyntax(DicomTransferSyntax transferSyntax) ORTHANC_OVERRIDE
+    {
+      hasTransferSyntax_ = true;
+      transferSyntax_ = transferSyntax;
+    }
+
+    virtual bool VisitDatasetTag(const DicomTag& tag,
+                                 const ValueRepresentation& vr,
+                                 const std::string& value,
+                                 bool isLittleEndian,
+                                 uint64_t fileOffset) ORTHANC_OVERRIDE
+    {
+      return false;  // Never reached, see "untilTag" below
+    }
+
+    bool IsValid() const
+    {
+      return (hasTransferSyntax_ &&
+              !sopClassUid_.empty() &&
+              !sopInstanceUid_.empty());
+    }
+
+    const std::string& GetSopClassUid() const
+    {
+      return sopClassUid_;
+    }
+
+    const std::string& GetSopInstanceUid() const
+    {
+      return sopInstanceUid_;
+    }
+
+    DicomTransferSyntax GetTransferSyntax() const
+    {
+      return transferSyntax_;
+    }
+  };
+
+
+  bool DicomStreamReader::LookupMetaHeader(std::string& sopClassUid,
+                                           std::string& sopInstanceUid,
+                                           DicomTransferSyntax& transferSyntax,
+                                           uint64_t& datasetOffset,
+                                           const void* buffer,
+                                           size_t size)
+  {
+    // The preamble (128 bytes), the "DICM" prefix (4 bytes), and the
+    // "File Meta Information Group Length" element (12 bytes)
+    static const size_t PREAMBLE_SIZE = 144;
+
+    if (buffer == NULL ||
+        size < PREAMBLE_SIZE)
+    {
+      return false;
+    }
+
+    MetaHeaderVisitor visitor;
+
+    {
+      boost::iostreams::array_source source(reinterpret_cast<const char*>(buffer), size);
+      boost::iostreams::stream<boost::iostreams::array_source> stream(source);
+
+      DicomStreamReader reader(stream);
+
+      try
+      {
+        // Stop as soon as the first tag of the dataset is reached
+        reader.Consume(visitor, DicomTag(0x0000, 0x0000));
+      }
+      catch (OrthancException&)
+      {
+        // Invalid DICOM file, or unsupported transfer syntax
+        return false;
+      }
+    }
+
+    if (!visitor.IsValid())
+    {
+      return false;
+    }
+
+    // The consistency of the group length with the content of the
+    // meta-header has been checked by "HandleMetaHeader()"
+    const uint64_t offset = (PREAMBLE_SIZE +
+                             ReadUnsignedInteger32(reinterpret_cast<const char*>(buffer) + 140, true));
+
+    if (offset > size)
+    {
+      return false;
+    }
+    else
+    {
+      sopClassUid = visitor.GetSopClassUid();
+      sopInstanceUid = visitor.GetSopInstanceUid();
+      transferSyntax = visitor.GetTransferSyntax();
+      datasetOffset = offset;
+      return true;
+    }
+  }
 }
 
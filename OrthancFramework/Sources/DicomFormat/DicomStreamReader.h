@@ -65,6 +65,7 @@ namespace Orthanc
     
   private:
     class PixelDataVisitor;
+    class MetaHeaderVisitor;
     
     enum State
     {
@@ -134,5 +135,19 @@ namespace Orthanc
     static bool LookupPixelDataOffset(uint64_t& offset,
                                       const void* buffer,
                                       size_t size);
+
+    /**
+     * Parse the DICOM meta-header of a file, and locate the beginning
+     * of its dataset, without parsing the dataset itself. Returns
+     * "false" if the file has no valid meta-header, or if the latter
+     * lacks the media storage SOP class/instance UIDs (new in Orthanc
+     * 1.11.3).
+     **/
+    static bool LookupMetaHeader(std::string& sopClassUid,
+                                 std::string& sopInstanceUid,
+                                 DicomTransferSyntax& transferSyntax,
+                                 uint64_t& datasetOffset,
+                                 const void* buffer,
+                                 size_t size);
   };
 }
@@ -36,6 +36,8 @@
 #include <dcmtk/dcmnet/diutil.h>  // For dcmConnectionTimeout()
 #include <dcmtk/dcmdata/dcdeftag.h>
 
+#include <algorithm>
+
 namespace Orthanc
 {
   static void FillSopSequence(DcmDataset& dataset,
@@ -281,7 +283,8 @@ namespace Orthanc
                       << " (manufacturer: " << EnumerationToString(parameters.GetRemoteModality().GetManufacturer())
                       << ", " << (parameters.HasTimeout() ?
                                   "timeout: " + boost::lexical_cast<std::string>(parameters.GetTimeout()) + "s" :
-                                  "no timeout") << ")";
+                                  "no timeout")
+                      << ", maximum PDU length: " << parameters.GetMaximumPduLength() << ")";
 
     CheckConnecting(parameters, ASC_initializeNetwork(NET_REQUESTOR, 0, /*opt_acse_timeout*/ acseTimeout, &net_));
     CheckConnecting(parameters, ASC_createAssociationParameters(&params_, parameters.GetMaximumPduLength()));
@@ -581,6 +584,59 @@ namespace Orthanc
                              "\": " + info);
     }
   }
+
+
+  OFCondition DicomAssociation::WritePDVs(T_ASC_Association& association,
+                                          T_ASC_PresentationContextID presID,
+                                          DUL_DATAPDV type,
+                                          const void* buffer,
+                                          size_t size)
+  {
+    size_t maxLength = size;
+
+    if (association.sendPDVLength != 0)
+    {
+      // Round down to an even length, so that the PDVs are never
+      // split in the middle of a 16-bit word
+      maxLength = static_cast<size_t>(association.sendPDVLength) & ~static_cast<size_t>(1);
+
+      if (maxLength == 0)
+      {
+        throw OrthancException(ErrorCode_NetworkProtocol, "Invalid maximum PDV length: " +
+                               boost::lexical_cast<std::string>(association.sendPDVLength));
+      }
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer);
+    size_t position = 0;
+
+    do
+    {
+      const size_t length = std::min(size - position, maxLength);
+
+      DUL_PDV pdv;
+      pdv.fragmentLength = static_cast<unsigned long>(length);
+      pdv.presentationContextID = presID;
+      pdv.pdvType = type;
+      pdv.lastPDV = (position + length == size ? OFTrue : OFFalse);
+      pdv.data = const_cast<uint8_t*>(data + position);  // DCMTK copies the data into the PDU
+
+      DUL_PDVLIST list;
+      list.count = 1;
+      list.pdv = &pdv;
+
+      OFCondition cond = DUL_WritePDVs(&association.DULassociation, &list);
+      if (cond.bad())
+      {
+        return cond;
+      }
+
+      position += length;
+    }
+    while (position < size);
+
+    return EC_Normal;
+  }
     
 
   void DicomAssociation::ReportStorageCommitment(
@@ -125,6 +125,18 @@ namespace Orthanc
                                const DicomAssociationParameters& parameters,
                                const std::string& command);
 
+    /**
+     * Send a buffer as a sequence of PDVs, without encoding it with
+     * DCMTK. The size of the PDVs is bounded by the maximum PDU
+     * length that was negotiated with the remote host (new in Orthanc
+     * 1.11.3).
+     **/
+    static OFCondition WritePDVs(T_ASC_Association& association,
+                                 T_ASC_PresentationContextID presID,
+                                 DUL_DATAPDV type,
+                                 const void* buffer,
+                                 size_t size);
+
     static void ReportStorageCommitment(
       const DicomAssociationParameters& parameters,
       const std::string& transactionUid,
@@ -34,6 +34,7 @@
 #include <dcmtk/dcmnet/diutil.h>  // For ASC_DEFAULTMAXPDU
 
 #include <boost/thread/mutex.hpp>
+#include <stdlib.h>  // For setenv()
 
 // By default, the default timeout for client DICOM connections is set to 10 seconds
 static boost::mutex  defaultConfigurationMutex_;
@@ -43,6 +44,9 @@ static std::string   defaultOwnCertificatePath_;
 static std::string   defaultTrustedCertificatesPath_;
 static unsigned int  defaultMaximumPduLength_ = ASC_DEFAULTMAXPDU;
 static bool          defaultRemoteCertificateRequired_ = true;
+static unsigned int  tcpBufferLength_ = 0;  // "0" means the default of DCMTK
+
+static const unsigned int MINIMUM_TCP_BUFFER_LENGTH = 4096;
 
 
 namespace Orthanc
@@ -122,6 +126,11 @@ namespace Orthanc
       timeout_ = remote.GetTimeout();
       assert(timeout_ != 0);
     }
+
+    if (remote.HasMaximumPduLength())
+    {
+      maximumPduLength_ = remote.GetMaximumPduLength();
+    }
   }
 
   void DicomAssociationParameters::SetRemoteApplicationEntityTitle(const std::string &aet)
@@ -498,4 +507,56 @@ namespace Orthanc
     boost::mutex::scoped_lock lock(defaultConfigurationMutex_);
     return defaultRemoteCertificateRequired_;
   }
+
+
+  void DicomAssociationParameters::SetTcpBufferLength(unsigned int length)
+  {
+    static const char* const TCP_BUFFER_LENGTH = "TCP_BUFFER_LENGTH";
+
+    if (length != 0 &&
+        length < MINIMUM_TCP_BUFFER_LENGTH)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange, "The size of the TCP buffers must be greater than " +
+                             boost::lexical_cast<std::string>(MINIMUM_TCP_BUFFER_LENGTH));
+    }
+
+    boost::mutex::scoped_lock lock(defaultConfigurationMutex_);
+
+    if (length == 0)
+    {
+      if (tcpBufferLength_ != 0)
+      {
+        // Revert to the default value of DCMTK
+#if defined(_WIN32)
+        _putenv_s(TCP_BUFFER_LENGTH, "");
+#else
+        unsetenv(TCP_BUFFER_LENGTH);
+#endif
+      }
+    }
+    else
+    {
+      const std::string value = boost::lexical_cast<std::string>(length);
+
+#if defined(_WIN32)
+      if (_putenv_s(TCP_BUFFER_LENGTH, value.c_str()) != 0)
+#else
+      if (setenv(TCP_BUFFER_LENGTH, value.c_str(), 1 /* overwrite */) != 0)
+#endif
+      {
+        throw OrthancException(ErrorCode_InternalError, "Cannot set the size of the TCP buffers");
+      }
+
+      CLOG(INFO, DICOM) << "Size of the TCP send/receive buffers of the DICOM connections: " << length << " bytes";
+    }
+
+    tcpBufferLength_ = length;
+  }
+
+
+  unsigned int DicomAssociationParameters::GetTcpBufferLength()
+  {
+    boost::mutex::scoped_lock lock(defaultConfigurationMutex_);
+    return tcpBufferLength_;
+  }
 }
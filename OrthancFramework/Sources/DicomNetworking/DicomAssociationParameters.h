@@ -127,5 +127,18 @@ namespace Orthanc
     static void SetDefaultRemoteCertificateRequired(bool required);
 
     static bool GetDefaultRemoteCertificateRequired();
+
+    /**
+     * Set the size of the SO_SNDBUF and SO_RCVBUF buffers of all the
+     * DICOM sockets, both for Orthanc SCU and Orthanc SCP (new in
+     * Orthanc 1.11.3). DCMTK applies the same size to both buffers,
+     * right after the creation of each socket, which is why this
+     * setting is global to the process. It must be called before
+     * opening any DICOM connection. Setting it to "0" keeps the
+     * default of DCMTK (32KB).
+     **/
+    static void SetTcpBufferLength(unsigned int length);
+
+    static unsigned int GetTcpBufferLength();
   };
 }
@@ -31,6 +31,7 @@
 #include "../Toolbox.h"
 #include "DicomAssociationParameters.h"
 #include "Internals/CommandDispatcher.h"
+#include "Internals/IdleAssociationsMonitor.h"
 
 #include <boost/thread.hpp>
 
@@ -50,6 +51,7 @@ namespace Orthanc
     boost::thread  thread_;
     T_ASC_Network *network_;
     std::unique_ptr<RunnableWorkersPool>  workers_;
+    std::unique_ptr<Internals::IdleAssociationsMonitor>  monitor_;
 
 #if ORTHANC_ENABLE_SSL == 1
     std::unique_ptr<DcmTLSTransportLayer> tls_;
@@ -74,7 +76,7 @@ namespace Orthanc
       {
         if (dispatcher.get() != NULL)
         {
-          server->pimpl_->workers_->Add(dispatcher.release());
+          server->pimpl_->monitor_->Dispatch(dispatcher.release());
         }
       }
       catch (OrthancException& e)
@@ -430,6 +432,8 @@ namespace Orthanc
     CLOG(INFO, DICOM) << "The embedded DICOM server will use " << threadsCount_ << " threads";
 
     pimpl_->workers_.reset(new RunnableWorkersPool(threadsCount_));
+    pimpl_->monitor_.reset(new Internals::IdleAssociationsMonitor(*pimpl_->workers_));
+    pimpl_->monitor_->Start();
     pimpl_->thread_ = boost::thread(ServerThread, this, maximumPduLength_, useDicomTls_);
   }
 
@@ -445,7 +449,14 @@ namespace Orthanc
         pimpl_->thread_.join();
       }
 
+      /**
+       * The monitor must stop resuming the parked associations before
+       * the workers are destroyed, and it must be destroyed after the
+       * workers, as the latter can still park associations.
+       **/
+      pimpl_->monitor_->Stop();
       pimpl_->workers_.reset(NULL);
+      pimpl_->monitor_.reset(NULL);
 
 #if ORTHANC_ENABLE_SSL == 1
       pimpl_->tls_.reset(NULL);  // Transport layer must be destroyed before the association itself
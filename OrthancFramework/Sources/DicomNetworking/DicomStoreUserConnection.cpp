@@ -24,6 +24,7 @@
 #include "../PrecompiledHeaders.h"
 #include "DicomStoreUserConnection.h"
 
+#include "../DicomFormat/DicomStreamReader.h"
 #include "../DicomParsing/FromDcmtkBridge.h"
 #include "../DicomParsing/ParsedDicomFile.h"
 #include "../Logging.h"
@@ -51,6 +52,114 @@ namespace Orthanc
   }
 
 
+  static void CheckStoreResponse(const T_DIMSE_C_StoreRSP& response,
+                                 uint8_t presID,
+                                 const DicomAssociationParameters& parameters)
+  {
+    {
+      OFString str;
+      CLOG(TRACE, DICOM) << "Received Store Response:" << std::endl
+                         << DIMSE_dumpMessage(str, response, DIMSE_INCOMING, NULL, presID);
+    }
+    
+    /**
+     * New in Orthanc 1.6.0: Deal with failures during C-STORE.
+     * http://dicom.nema.org/medical/dicom/current/output/chtml/part04/sect_B.2.3.html#table_B.2-1
+     **/
+    
+    if (response.DimseStatus != 0x0000 &&  // Success
+        response.DimseStatus != 0xB000 &&  // Warning - Coercion of Data Elements
+        response.DimseStatus != 0xB007 &&  // Warning - Data Set does not match SOP Class
+        response.DimseStatus != 0xB006)    // Warning - Elements Discarded
+    {
+      char buf[16];
+      sprintf(buf, "%04X", response.DimseStatus);
+      throw OrthancException(ErrorCode_NetworkProtocol,
+                             "C-STORE SCU to AET \"" +
+                             parameters.GetRemoteModality().GetApplicationEntityTitle() +
+                             "\" has failed with DIMSE status 0x" + buf);
+    }
+  }
+
+
+  static void WriteLittleEndian16(std::string& target,
+                                  uint16_t value)
+  {
+    target.push_back(static_cast<char>(value & 0xff));
+    target.push_back(static_cast<char>(value >> 8));
+  }
+
+
+  static void WriteLittleEndian32(std::string& target,
+                                  uint32_t value)
+  {
+    WriteLittleEndian16(target, static_cast<uint16_t>(value & 0xffff));
+    WriteLittleEndian16(target, static_cast<uint16_t>(value >> 16));
+  }
+
+
+  static void AddCommandElement(std::string& target,
+                                uint16_t element,
+                                const std::string& value,
+                                char padding)
+  {
+    const bool odd = (value.size() % 2 == 1);
+
+    WriteLittleEndian16(target, 0x0000);
+    WriteLittleEndian16(target, element);
+    WriteLittleEndian32(target, static_cast<uint32_t>(value.size() + (odd ? 1 : 0)));
+    target.append(value);
+
+    if (odd)
+    {
+      target.push_back(padding);
+    }
+  }
+
+
+  static void AddCommandElement(std::string& target,
+                                uint16_t element,
+                                uint16_t value)
+  {
+    WriteLittleEndian16(target, 0x0000);
+    WriteLittleEndian16(target, element);
+    WriteLittleEndian32(target, 2);
+    WriteLittleEndian16(target, value);
+  }
+
+
+  void DicomStoreUserConnection::EncodeStoreCommand(std::string& target,
+                                                    const std::string& sopClassUid,
+                                                    const std::string& sopInstanceUid,
+                                                    uint16_t messageId,
+                                                    bool hasMoveOriginator,
+                                                    const std::string& moveOriginatorAET,
+                                                    uint16_t moveOriginatorID)
+  {
+    std::string elements;
+    AddCommandElement(elements, 0x0002, sopClassUid, '\0');
+    AddCommandElement(elements, 0x0100, 0x0001);  // C-STORE-RQ
+    AddCommandElement(elements, 0x0110, messageId);
+    AddCommandElement(elements, 0x0700, 0x0000);  // Medium priority
+    AddCommandElement(elements, 0x0800, 0x0000);  // A dataset is present
+    AddCommandElement(elements, 0x1000, sopInstanceUid, '\0');
+
+    if (hasMoveOriginator)
+    {
+      AddCommandElement(elements, 0x1030, moveOriginatorAET, ' ');
+      AddCommandElement(elements, 0x1031, moveOriginatorID);
+    }
+
+    target.clear();
+    target.reserve(12 + elements.size());
+    WriteLittleEndian16(target, 0x0000);
+    WriteLittleEndian16(target, 0x0000);  // Command Group Length
+    WriteLittleEndian32(target, 4);
+    WriteLittleEndian32(target, static_cast<uint32_t>(elements.size()));
+    target.append(elements);
+  }
+
+
   bool DicomStoreUserConnection::ProposeStorageClass(const std::string& sopClassUid,
                                                      const std::set<DicomTransferSyntax>& sourceSyntaxes,
                                                      bool hasPreferred,
@@ -426,29 +535,104 @@ namespace Orthanc
       delete statusDetail;
     }
 
+    CheckStoreResponse(response, presID, GetParameters());
+  }
+
+
+  bool DicomStoreUserConnection::StorePassThrough(std::string& sopClassUid,
+                                                  std::string& sopInstanceUid,
+                                                  const void* buffer,
+                                                  size_t size,
+                                                  bool hasPreferred,
+                                                  DicomTransferSyntax preferred,
+                                                  bool hasMoveOriginator,
+                                                  const std::string& moveOriginatorAET,
+                                                  uint16_t moveOriginatorID)
+  {
+    DicomTransferSyntax transferSyntax;
+    uint64_t datasetOffset;
+
+    if (!DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, transferSyntax,
+                                             datasetOffset, buffer, size) ||
+        transferSyntax == DicomTransferSyntax_DeflatedLittleEndianExplicit)
+    {
+      return false;
+    }
+
+    uint8_t presID;
+    if (!NegotiatePresentationContext(presID, sopClassUid, transferSyntax, hasPreferred, preferred))
+    {
+      return false;  // Transcoding is needed
+    }
+
+    T_ASC_Association& association = association_->GetDcmtkAssociation();
+
+    T_DIMSE_C_StoreRQ request;
+    memset(&request, 0, sizeof(request));
+    request.MessageID = association.nextMsgID++;
+    strncpy(request.AffectedSOPClassUID, sopClassUid.c_str(), DIC_UI_LEN);
+    request.Priority = DIMSE_PRIORITY_MEDIUM;
+    request.DataSetType = DIMSE_DATASET_PRESENT;
+    strncpy(request.AffectedSOPInstanceUID, sopInstanceUid.c_str(), DIC_UI_LEN);
+
+    if (hasMoveOriginator)
+    {    
+      strncpy(request.MoveOriginatorApplicationEntityTitle, 
+              moveOriginatorAET.c_str(), DIC_AE_LEN);
+      request.opts = O_STORE_MOVEORIGINATORAETITLE;
+
+      request.MoveOriginatorID = moveOriginatorID;  // The type DIC_US is an alias for uint16_t
+      request.opts |= O_STORE_MOVEORIGINATORID;
+    }
+
     {
       OFString str;
-      CLOG(TRACE, DICOM) << "Received Store Response:" << std::endl
-                         << DIMSE_dumpMessage(str, response, DIMSE_INCOMING, NULL, presID);
+      CLOG(TRACE, DICOM) << "Sending Store Request:" << std::endl
+                         << DIMSE_dumpMessage(str, request, DIMSE_OUTGOING);
     }
-    
+
     /**
-     * New in Orthanc 1.6.0: Deal with failures during C-STORE.
-     * http://dicom.nema.org/medical/dicom/current/output/chtml/part04/sect_B.2.3.html#table_B.2-1
+     * The command set is sent first, followed by the bytes of the
+     * dataset, as stored after the DICOM meta-header. As the transfer
+     * syntax has been accepted, these bytes can be sent "as is".
      **/
-    
-    if (response.DimseStatus != 0x0000 &&  // Success
-        response.DimseStatus != 0xB000 &&  // Warning - Coercion of Data Elements
-        response.DimseStatus != 0xB007 &&  // Warning - Data Set does not match SOP Class
-        response.DimseStatus != 0xB006)    // Warning - Elements Discarded
+    std::string command;
+    EncodeStoreCommand(command, request.AffectedSOPClassUID, request.AffectedSOPInstanceUID, request.MessageID,
+                       hasMoveOriginator, request.MoveOriginatorApplicationEntityTitle, request.MoveOriginatorID);
+    DicomAssociation::CheckCondition(
+      DicomAssociation::WritePDVs(association, presID, DUL_COMMANDPDV, command.c_str(), command.size()),
+      GetParameters(), "C-STORE");
+
+    const uint8_t* dataset = reinterpret_cast<const uint8_t*>(buffer) + datasetOffset;
+    DicomAssociation::CheckCondition(
+      DicomAssociation::WritePDVs(association, presID, DUL_DATASETPDV, dataset,
+                                  size - static_cast<size_t>(datasetOffset)),
+      GetParameters(), "C-STORE");
+
+    T_DIMSE_Message response;
+    T_ASC_PresentationContextID responsePresID = 0;
+    DcmDataset* statusDetail = NULL;
+    DicomAssociation::CheckCondition(
+      DIMSE_receiveCommand(&association,
+                           (GetParameters().HasTimeout() ? DIMSE_NONBLOCKING : DIMSE_BLOCKING),
+                           GetParameters().GetTimeout(), &responsePresID, &response, &statusDetail),
+      GetParameters(), "C-STORE");
+
+    if (statusDetail != NULL) 
+    {
+      delete statusDetail;
+    }
+
+    if (response.CommandField != DIMSE_C_STORE_RSP ||
+        response.msg.CStoreRSP.MessageIDBeingRespondedTo != request.MessageID)
     {
-      char buf[16];
-      sprintf(buf, "%04X", response.DimseStatus);
       throw OrthancException(ErrorCode_NetworkProtocol,
-                             "C-STORE SCU to AET \"" +
-                             GetParameters().GetRemoteModality().GetApplicationEntityTitle() +
-                             "\" has failed with DIMSE status 0x" + buf);
+                             "Unexpected answer to a C-STORE request from AET \"" +
+                             GetParameters().GetRemoteModality().GetApplicationEntityTitle() + "\"");
     }
+
+    CheckStoreResponse(response.msg.CStoreRSP, presID, GetParameters());
+    return true;
   }
 
 
@@ -460,6 +644,13 @@ namespace Orthanc
                                        const std::string& moveOriginatorAET,
                                        uint16_t moveOriginatorID)
   {
+    if (StorePassThrough(sopClassUid, sopInstanceUid, buffer, size, proposeUncompressedSyntaxes_,
+                         DicomTransferSyntax_LittleEndianExplicit, hasMoveOriginator,
+                         moveOriginatorAET, moveOriginatorID))
+    {
+      return;
+    }
+
     std::unique_ptr<DcmFileFormat> dicom(
       FromDcmtkBridge::LoadFromMemoryBuffer(buffer, size));
 
@@ -508,6 +699,12 @@ namespace Orthanc
                                            const std::string& moveOriginatorAET,
                                            uint16_t moveOriginatorID)
   {
+    if (StorePassThrough(sopClassUid, sopInstanceUid, buffer, size, true, preferredTransferSyntax,
+                         hasMoveOriginator, moveOriginatorAET, moveOriginatorID))
+    {
+      return;  // No need for transcoding
+    }
+
     std::unique_ptr<DcmFileFormat> dicom(FromDcmtkBridge::LoadFromMemoryBuffer(buffer, size));
     if (dicom.get() == NULL ||
         dicom->getDataset() == NULL)
@@ -102,6 +102,19 @@ namespace Orthanc
                            bool hasPreferred,
                            DicomTransferSyntax preferred);
 
+    // Send the dataset of a DICOM file without parsing it with DCMTK,
+    // if the remote modality accepts its transfer syntax. Returns
+    // "false" if the caller must fallback to DCMTK.
+    bool StorePassThrough(std::string& sopClassUid,
+                          std::string& sopInstanceUid,
+                          const void* buffer,
+                          size_t size,
+                          bool hasPreferred,
+                          DicomTransferSyntax preferred,
+                          bool hasMoveOriginator,
+                          const std::string& moveOriginatorAET,
+                          uint16_t moveOriginatorID);
+
   public:
     explicit DicomStoreUserConnection(const DicomAssociationParameters& params);
     
@@ -160,5 +173,21 @@ namespace Orthanc
                    bool hasMoveOriginator,
                    const std::string& moveOriginatorAET,
                    uint16_t moveOriginatorID);
+
+    /**
+     * Encode the command set of a C-STORE request with medium
+     * priority, as sent before the dataset by the pass-through mode.
+     * The command set is always encoded using the "Implicit VR Little
+     * Endian" transfer syntax, and its elements are sorted by
+     * increasing tag.
+     * http://dicom.nema.org/medical/dicom/current/output/chtml/part07/sect_9.3.html#sect_9.3.1.1
+     **/
+    static void EncodeStoreCommand(std::string& target,
+                                   const std::string& sopClassUid,
+                                   const std::string& sopInstanceUid,
+                                   uint16_t messageId,
+                                   bool hasMoveOriginator,
+                                   const std::string& moveOriginatorAET,
+                                   uint16_t moveOriginatorID);
   };
 }
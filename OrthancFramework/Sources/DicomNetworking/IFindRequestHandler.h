@@ -24,6 +24,7 @@
 #pragma once
 
 #include "DicomFindAnswers.h"
+#include "../OrthancException.h"
 
 #include <list>
 
@@ -32,6 +33,31 @@ namespace Orthanc
   class IFindRequestHandler : public boost::noncopyable
   {
   public:
+    /**
+     * Receives the answers of a streaming C-FIND handler (new in
+     * Orthanc 1.11.3). Each answer is sent to the C-FIND SCU as soon
+     * as it is added. "Add()" blocks while too many answers are
+     * waiting to be sent (flow control), and returns "false" once the
+     * C-FIND SCU has cancelled the request, in which case the handler
+     * must stop its lookup.
+     **/
+    class IAnswersStream : public boost::noncopyable
+    {
+    public:
+      virtual ~IAnswersStream()
+      {
+      }
+
+      virtual bool Add(const DicomMap& map) = 0;
+
+      virtual bool Add(const ParsedDicomFile& dicom) = 0;
+
+      virtual bool IsCancelled() = 0;
+
+      // Set to "false" if the answers were cropped because of a limit
+      virtual void SetComplete(bool isComplete) = 0;
+    };
+
     virtual ~IFindRequestHandler()
     {
     }
@@ -43,5 +69,26 @@ namespace Orthanc
                         const std::string& remoteAet,
                         const std::string& calledAet,
                         ModalityManufacturer manufacturer) = 0;
+
+    /**
+     * If this method returns "true", the C-FIND SCP calls
+     * "HandleStream()" instead of "Handle()", from a separate thread
+     * (new in Orthanc 1.11.3).
+     **/
+    virtual bool IsStreaming() const
+    {
+      return false;
+    }
+
+    virtual void HandleStream(IAnswersStream& answers,
+                              const DicomMap& input,
+                              const std::list<DicomTag>& sequencesToReturn,
+                              const std::string& remoteIp,
+                              const std::string& remoteAet,
+                              const std::string& calledAet,
+                              ModalityManufacturer manufacturer)
+    {
+      throw OrthancException(ErrorCode_NotImplemented);
+    }
   };
 }
@@ -48,6 +48,16 @@ namespace Orthanc
     virtual unsigned int GetSubOperationCount() const = 0;
 
     virtual Status DoNext() = 0;
+
+    /**
+     * Called by the C-MOVE SCP if the SCU has sent a C-CANCEL: No
+     * other sub-operation will be requested by "DoNext()", and the
+     * sub-operations that are running in the background (if any)
+     * should be stopped (new in Orthanc 1.11.3).
+     **/
+    virtual void Cancel()
+    {
+    }
   };
 
 
@@ -24,6 +24,7 @@
 #pragma once
 
 #include "../DicomFormat/DicomMap.h"
+#include "../OrthancException.h"
 
 #include <vector>
 #include <string>
@@ -44,5 +45,25 @@ namespace Orthanc
                             const std::string& remoteIp,
                             const std::string& remoteAet,
                             const std::string& calledAet) = 0;
+
+    /**
+     * If this method returns "true", the C-STORE SCP does not parse
+     * the incoming dataset with DCMTK: The bytes received from the
+     * network are copied as such after a DICOM meta-header, and the
+     * resulting DICOM file is given to "HandleBuffer()" instead of
+     * "Handle()" (new in Orthanc 1.11.3).
+     **/
+    virtual bool IsBitPreserving() const
+    {
+      return false;
+    }
+
+    virtual uint16_t HandleBuffer(const std::string& dicom,
+                                  const std::string& remoteIp,
+                                  const std::string& remoteAet,
+                                  const std::string& calledAet)
+    {
+      throw OrthancException(ErrorCode_NotImplemented);
+    }
   };
 }
@@ -694,7 +694,8 @@ namespace Orthanc
       filter_(filter)
     {
       associationTimeout_ = server.GetAssociationTimeout();
-      elapsedTimeSinceLastCommand_ = 0;
+      lastCommandTime_ = boost::posix_time::microsec_clock::universal_time();
+      idle_ = false;
     }
 
 
@@ -726,7 +727,7 @@ namespace Orthanc
       T_DIMSE_Message msg;
 
       OFCondition cond = DIMSE_receiveCommand(assoc_, DIMSE_NONBLOCKING, 1, &presID, &msg, &statusDetail);
-      elapsedTimeSinceLastCommand_++;
+      idle_ = false;
     
       // if the command which was received has extra status
       // detail information, dump this information
@@ -746,12 +747,15 @@ namespace Orthanc
       else if (cond == DIMSE_NODATAAVAILABLE)
       {
         // Timeout due to DIMSE_NONBLOCKING
-        if (associationTimeout_ != 0 && 
-            elapsedTimeSinceLastCommand_ >= associationTimeout_)
+        if (IsAssociationTimeoutReached())
         {
           // This timeout is actually a association timeout
           finished = true;
         }
+        else
+        {
+          idle_ = true;
+        }
       }
       else if (cond == EC_Normal)
       {
@@ -762,7 +766,7 @@ namespace Orthanc
         }
         
         // Reset the association timeout counter
-        elapsedTimeSinceLastCommand_ = 0;
+        lastCommandTime_ = boost::posix_time::microsec_clock::universal_time();
 
         // Convert the type of request to Orthanc's internal type
         bool supported = false;
@@ -814,6 +818,18 @@ namespace Orthanc
             supported = true;
             break;
 
+          case DIMSE_C_CANCEL_RQ:
+            /**
+             * The C-CANCEL requests that are received while a C-FIND,
+             * C-MOVE or C-GET is running are handled by the SCPs. A
+             * C-CANCEL that arrives after the final response of the
+             * operation it targets is not an error: It must simply be
+             * ignored (new in Orthanc 1.11.3).
+             **/
+            CLOG(INFO, DICOM) << "Ignoring C-CANCEL for message " << msg.msg.CCancelRQ.MessageIDBeingRespondedTo
+                              << " that has already completed";
+            break;
+
           default:
             // we cannot handle this kind of message
             cond = DIMSE_BADCOMMANDTYPE;
@@ -957,6 +973,21 @@ namespace Orthanc
     }
 
 
+    bool CommandDispatcher::IsAssociationTimeoutReached() const
+    {
+      if (associationTimeout_ == 0)
+      {
+        return false;  // No timeout
+      }
+      else
+      {
+        const boost::posix_time::time_duration elapsed =
+          boost::posix_time::microsec_clock::universal_time() - lastCommandTime_;
+        return elapsed.total_seconds() >= static_cast<long>(associationTimeout_);
+      }
+    }
+
+
     OFCondition EchoScp(T_ASC_Association * assoc, T_DIMSE_Message * msg, T_ASC_PresentationContextID presID)
     {
       OFString temp_str;
@@ -28,6 +28,8 @@
 
 #include <dcmtk/dcmnet/dimse.h>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 namespace Orthanc
 {
   namespace Internals
@@ -38,7 +40,8 @@ namespace Orthanc
     {
     private:
       uint32_t associationTimeout_;
-      uint32_t elapsedTimeSinceLastCommand_;
+      boost::posix_time::ptime lastCommandTime_;
+      bool idle_;
       const DicomServer& server_;
       T_ASC_Association* assoc_;
       std::string remoteIp_;
@@ -64,6 +67,19 @@ namespace Orthanc
       virtual ~CommandDispatcher();
 
       virtual bool Step();
+
+      T_ASC_Association* GetAssociation() const
+      {
+        return assoc_;
+      }
+
+      // Whether the last call to "Step()" has received no command
+      bool IsIdle() const
+      {
+        return idle_;
+      }
+
+      bool IsAssociationTimeoutReached() const;
     };
 
     CommandDispatcher* AcceptAssociation(const DicomServer& server, 
@@ -74,6 +74,7 @@
 #include "../../PrecompiledHeaders.h"
 #include "FindScp.h"
 
+#include "../../Compatibility.h"  // For std::unique_ptr<>
 #include "../../DicomFormat/DicomArray.h"
 #include "../../DicomParsing/FromDcmtkBridge.h"
 #include "../../DicomParsing/ToDcmtkBridge.h"
@@ -83,6 +84,9 @@
 #include <dcmtk/dcmdata/dcfilefo.h>
 #include <dcmtk/dcmdata/dcdeftag.h>
 
+#include <boost/thread.hpp>
+#include <queue>
+
 
 
 /**
@@ -128,6 +132,181 @@ namespace Orthanc
 {
   namespace
   {  
+    /**
+     * Bounded queue between the thread running a streaming C-FIND
+     * handler (the producer), and the DCMTK callback that sends the
+     * C-FIND responses (the consumer). The answers are encoded by the
+     * producer, exactly as if they were stored in "DicomFindAnswers".
+     **/
+    class StreamedAnswers : public IFindRequestHandler::IAnswersStream
+    {
+    private:
+      boost::mutex               mutex_;
+      boost::condition_variable  changed_;
+      std::queue<DcmDataset*>    queue_;
+      size_t                     maxQueueSize_;
+      bool                       done_;
+      bool                       success_;
+      bool                       cancelled_;
+      bool                       complete_;
+
+      bool Push(DicomFindAnswers& answer)
+      {
+        std::unique_ptr<DcmDataset> dataset(answer.ExtractDcmDataset(0));
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        while (!cancelled_ &&
+               queue_.size() >= maxQueueSize_)
+        {
+          changed_.wait(lock);
+        }
+
+        if (cancelled_)
+        {
+          return false;
+        }
+        else
+        {
+          queue_.push(dataset.release());
+          changed_.notify_all();
+          return true;
+        }
+      }
+
+    public:
+      explicit StreamedAnswers(size_t maxQueueSize) :
+        maxQueueSize_(maxQueueSize),
+        done_(false),
+        success_(false),
+        cancelled_(false),
+        complete_(true)
+      {
+        if (maxQueueSize == 0)
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange);
+        }
+      }
+
+      virtual ~StreamedAnswers()
+      {
+        while (!queue_.empty())
+        {
+          delete queue_.front();
+          queue_.pop();
+        }
+      }
+
+      virtual bool Add(const DicomMap& map) ORTHANC_OVERRIDE
+      {
+        if (IsCancelled())
+        {
+          return false;
+        }
+        else
+        {
+          DicomFindAnswers answer(false /* not a worklist */);
+          answer.Add(map);
+          return Push(answer);
+        }
+      }
+
+      virtual bool Add(const ParsedDicomFile& dicom) ORTHANC_OVERRIDE
+      {
+        if (IsCancelled())
+        {
+          return false;
+        }
+        else
+        {
+          DicomFindAnswers answer(false /* not a worklist */);
+          answer.Add(dicom);
+          return Push(answer);
+        }
+      }
+
+      virtual bool IsCancelled() ORTHANC_OVERRIDE
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        return cancelled_;
+      }
+
+      virtual void SetComplete(bool isComplete) ORTHANC_OVERRIDE
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        complete_ = isComplete;
+      }
+
+      // Called by the producer once the handler has returned
+      void Close(bool success)
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        done_ = true;
+        success_ = success;
+        changed_.notify_all();
+      }
+
+      void Cancel()
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        cancelled_ = true;
+        changed_.notify_all();
+      }
+
+      /**
+       * Wait for at most "timeoutMs" milliseconds for the next
+       * answer. Returns "false" on timeout. Otherwise, "answer" is set
+       * to NULL once the handler has returned and all its answers have
+       * been sent, in which case "IsSuccess()" and "IsComplete()" give
+       * the final status.
+       **/
+      bool Pop(DcmDataset*& answer,
+               unsigned int timeoutMs)
+      {
+        const boost::system_time deadline = (boost::get_system_time() +
+                                             boost::posix_time::milliseconds(timeoutMs));
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        while (queue_.empty() &&
+               !done_)
+        {
+          if (!changed_.timed_wait(lock, deadline) &&
+              queue_.empty() &&
+              !done_)
+          {
+            return false;
+          }
+        }
+
+        if (queue_.empty())
+        {
+          answer = NULL;
+        }
+        else
+        {
+          answer = queue_.front();
+          queue_.pop();
+          changed_.notify_all();
+        }
+
+        return true;
+      }
+
+      bool IsSuccess()
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        return success_;
+      }
+
+      bool IsComplete()
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        return complete_;
+      }
+    };
+
+
     struct FindScpData
     {
       IFindRequestHandler* findHandler_;
@@ -137,6 +316,15 @@ namespace Orthanc
       const std::string* remoteIp_;
       const std::string* remoteAet_;
       const std::string* calledAet_;
+      T_ASC_Association* assoc_;
+      T_ASC_PresentationContextID presId_;
+
+      // For streaming C-FIND handlers (new in Orthanc 1.11.3)
+      std::unique_ptr<StreamedAnswers>  stream_;
+      std::unique_ptr<boost::thread>    streamThread_;
+      DicomMap                          streamQuery_;
+      std::list<DicomTag>               streamSequencesToReturn_;
+      ModalityManufacturer              streamManufacturer_;
 
       FindScpData() :
         findHandler_(NULL),
@@ -145,12 +333,88 @@ namespace Orthanc
         lastRequest_(NULL),
         remoteIp_(NULL),
         remoteAet_(NULL),
-        calledAet_(NULL)
+        calledAet_(NULL),
+        assoc_(NULL),
+        presId_(0),
+        streamManufacturer_(ModalityManufacturer_Generic)
+      {
+      }
+
+      ~FindScpData()
       {
+        if (streamThread_.get() != NULL)
+        {
+          // Unblock the handler if the association was closed before
+          // all the answers were sent
+          assert(stream_.get() != NULL);
+          stream_->Cancel();
+
+          if (streamThread_->joinable())
+          {
+            streamThread_->join();
+          }
+        }
       }
     };
 
 
+    static const size_t MAX_PENDING_STREAMED_ANSWERS = 32;
+
+    /**
+     * While waiting for the next streamed answer, DCMTK cannot detect
+     * a C-CANCEL by itself, as this is only done between two
+     * responses: Poll the association at this interval.
+     **/
+    static const unsigned int CANCEL_POLLING_INTERVAL_MS = 100;
+
+
+    static bool WaitStreamedAnswer(DcmDataset*& answer,
+                                   FindScpData& data,
+                                   DIC_US messageId)
+    {
+      assert(data.stream_.get() != NULL);
+
+      while (!data.stream_->Pop(answer, CANCEL_POLLING_INTERVAL_MS))
+      {
+        if (data.assoc_ != NULL &&
+            DIMSE_checkForCancelRQ(data.assoc_, data.presId_, messageId).good())
+        {
+          return false;  // Cancelled by the SCU
+        }
+      }
+
+      return true;
+    }
+
+
+    static void StreamingHandlerThread(FindScpData* data)
+    {
+      assert(data != NULL &&
+             data->findHandler_ != NULL &&
+             data->stream_.get() != NULL);
+
+      bool success = false;
+
+      try
+      {
+        data->findHandler_->HandleStream(*data->stream_, data->streamQuery_, data->streamSequencesToReturn_,
+                                         *data->remoteIp_, *data->remoteAet_,
+                                         *data->calledAet_, data->streamManufacturer_);
+        success = true;
+      }
+      catch (OrthancException& e)
+      {
+        CLOG(ERROR, DICOM) << "C-FIND request handler has failed: " << e.What();
+      }
+      catch (...)
+      {
+        CLOG(ERROR, DICOM) << "C-FIND request handler has failed because of a native exception";
+      }
+
+      data->stream_->Close(success);
+    }
+
+
 
     static void FixWorklistQuery(ParsedDicomFile& query)
     {
@@ -280,9 +544,22 @@ namespace Orthanc
               DicomMap filtered;
               FixFindQuery(filtered, input);
 
-              data.findHandler_->Handle(data.answers_, filtered, sequencesToReturn,
-                                        *data.remoteIp_, *data.remoteAet_,
-                                        *data.calledAet_, modality.GetManufacturer());
+              if (data.findHandler_->IsStreaming())
+              {
+                // The answers are sent as soon as the handler produces them
+                data.streamQuery_.Assign(filtered);
+                data.streamSequencesToReturn_ = sequencesToReturn;
+                data.streamManufacturer_ = modality.GetManufacturer();
+                data.stream_.reset(new StreamedAnswers(MAX_PENDING_STREAMED_ANSWERS));
+                data.streamThread_.reset(new boost::thread(StreamingHandlerThread, &data));
+              }
+              else
+              {
+                data.findHandler_->Handle(data.answers_, filtered, sequencesToReturn,
+                                          *data.remoteIp_, *data.remoteAet_,
+                                          *data.calledAet_, modality.GetManufacturer());
+              }
+
               ok = true;
             }
             else
@@ -314,6 +591,61 @@ namespace Orthanc
         return;
       }
 
+      if (cancelled)
+      {
+        // DCMTK has received a C-CANCEL after the previous response
+        CLOG(INFO, DICOM) << "C-FIND request cancelled by the SCU after " << (responseCount - 1) << " responses";
+
+        if (data.stream_.get() != NULL)
+        {
+          data.stream_->Cancel();  // Stops the lookup in the handler
+        }
+
+        response->DimseStatus = STATUS_FIND_Cancel_MatchingTerminatedDueToCancelRequest;
+        *responseIdentifiers = NULL;
+        return;
+      }
+
+      if (data.stream_.get() != NULL)
+      {
+        if (!WaitStreamedAnswer(*responseIdentifiers, data, request->MessageID))
+        {
+          CLOG(INFO, DICOM) << "C-FIND request cancelled by the SCU while waiting for the answer "
+                            << responseCount;
+          data.stream_->Cancel();
+          response->DimseStatus = STATUS_FIND_Cancel_MatchingTerminatedDueToCancelRequest;
+          *responseIdentifiers = NULL;
+          return;
+        }
+
+        if (*responseIdentifiers != NULL)
+        {
+          // There are pending results that are still to be sent
+          response->DimseStatus = STATUS_Pending;
+
+          std::stringstream s;  // DcmObject::PrintHelper cannot be used with VS2008
+          (*responseIdentifiers)->print(s);
+          CLOG(TRACE, DICOM) << "Sending streamed C-FIND Response " << responseCount << ":" << std::endl << s.str();
+        }
+        else if (!data.stream_->IsSuccess())
+        {
+          response->DimseStatus = STATUS_FIND_Failed_UnableToProcess;
+        }
+        else if (data.stream_->IsComplete())
+        {
+          // Success: All the results have been sent
+          response->DimseStatus = STATUS_Success;
+        }
+        else
+        {
+          // Success, but the results were too numerous and had to be cropped
+          CLOG(WARNING, DICOM) <<  "Too many results for an incoming C-FIND query";
+          response->DimseStatus = STATUS_FIND_Cancel_MatchingTerminatedDueToCancelRequest;
+        }
+
+        return;
+      }
+
       if (responseCount <= static_cast<int>(data.answers_.GetSize()))
       {
         // There are pending results that are still to be sent
@@ -364,6 +696,8 @@ namespace Orthanc
     data.remoteIp_ = &remoteIp;
     data.remoteAet_ = &remoteAet;
     data.calledAet_ = &calledAet;
+    data.assoc_ = assoc;
+    data.presId_ = presID;
 
     OFCondition cond = DIMSE_findProvider(assoc, presID, &msg->msg.CFindRQ, 
                                           FindScpCallback, &data,
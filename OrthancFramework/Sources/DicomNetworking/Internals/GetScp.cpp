@@ -249,6 +249,18 @@ namespace Orthanc
         response->DimseStatus = STATUS_GET_Failed_UnableToProcess;
         return;
       }
+
+      if (cancelled)
+      {
+        // DCMTK has received a C-CANCEL after the previous C-STORE sub-operation
+        CLOG(INFO, DICOM) << "C-GET request cancelled by the SCU after "
+                          << data.handler_->GetCompletedCount() << "/"
+                          << data.handler_->GetSubOperationCount() << " completed sub-operations";
+        FillResponse(*response, responseIdentifiers, *data.handler_);
+        response->DimseStatus = STATUS_GET_Cancel_SubOperationsTerminatedDueToCancelIndication;
+        data.canceled_ = true;
+        return;
+      }
       
       if (data.handler_->GetSubOperationCount() ==
           data.handler_->GetCompletedCount() +
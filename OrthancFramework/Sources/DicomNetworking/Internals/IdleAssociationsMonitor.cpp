@@ -0,0 +1,234 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../../PrecompiledHeaders.h"
+#include "IdleAssociationsMonitor.h"
+
+#include "../../Compatibility.h"
+#include "../../Logging.h"
+#include "../../OrthancException.h"
+#include "../../SystemToolbox.h"
+
+#include <cassert>
+
+
+namespace Orthanc
+{
+  namespace Internals
+  {
+    static const unsigned int POLLING_INTERVAL_MS = 10;
+
+
+    class IdleAssociationsMonitor::Runnable : public IRunnableBySteps
+    {
+    private:
+      IdleAssociationsMonitor&            monitor_;
+      std::unique_ptr<CommandDispatcher>  dispatcher_;
+
+    public:
+      Runnable(IdleAssociationsMonitor& monitor,
+               CommandDispatcher* dispatcher) :
+        monitor_(monitor),
+        dispatcher_(dispatcher)
+      {
+        if (dispatcher == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+      }
+
+      virtual bool Step() ORTHANC_OVERRIDE
+      {
+        if (!dispatcher_->Step())
+        {
+          return false;  // The association is over
+        }
+        else if (dispatcher_->IsIdle())
+        {
+          // No command was received during the last second: Release the worker
+          monitor_.Park(dispatcher_.release());
+          return false;
+        }
+        else
+        {
+          return true;
+        }
+      }
+    };
+
+
+    void IdleAssociationsMonitor::ResumeReady()
+    {
+      std::vector<CommandDispatcher*> candidates;
+      std::vector<T_ASC_Association*> associations;
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        candidates.reserve(parked_.size());
+        associations.reserve(parked_.size());
+
+        for (std::list<CommandDispatcher*>::const_iterator
+               it = parked_.begin(); it != parked_.end(); ++it)
+        {
+          candidates.push_back(*it);
+          associations.push_back((*it)->GetAssociation());
+        }
+      }
+
+      if (candidates.empty())
+      {
+        return;
+      }
+
+      /**
+       * Non-blocking check of the network connections. DCMTK sets to
+       * NULL the associations that have no data available, and takes
+       * care of the data that is buffered by the TLS layer.
+       **/
+      ASC_selectReadableAssociation(&associations[0], static_cast<int>(associations.size()), 0);
+
+      std::vector<CommandDispatcher*> ready;
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+          if (associations[i] != NULL ||
+              candidates[i]->IsAssociationTimeoutReached())
+          {
+            parked_.remove(candidates[i]);
+            ready.push_back(candidates[i]);
+          }
+        }
+      }
+
+      for (size_t i = 0; i < ready.size(); i++)
+      {
+        Dispatch(ready[i]);
+      }
+    }
+
+
+    void IdleAssociationsMonitor::MonitorThread(IdleAssociationsMonitor* that)
+    {
+      while (that->continue_)
+      {
+        try
+        {
+          that->ResumeReady();
+        }
+        catch (OrthancException& e)
+        {
+          CLOG(ERROR, DICOM) << "Exception while monitoring the idle DICOM associations: " << e.What();
+        }
+
+        SystemToolbox::USleep(POLLING_INTERVAL_MS * 1000);
+      }
+    }
+
+
+    IdleAssociationsMonitor::IdleAssociationsMonitor(RunnableWorkersPool& workers) :
+      workers_(workers),
+      continue_(false)
+    {
+    }
+
+
+    IdleAssociationsMonitor::~IdleAssociationsMonitor()
+    {
+      Stop();
+
+      // Abort the associations that are still parked
+      for (std::list<CommandDispatcher*>::iterator it = parked_.begin(); it != parked_.end(); ++it)
+      {
+        assert(*it != NULL);
+        delete *it;
+      }
+    }
+
+
+    void IdleAssociationsMonitor::Start()
+    {
+      if (continue_)
+      {
+        throw OrthancException(ErrorCode_BadSequenceOfCalls);
+      }
+      else
+      {
+        continue_ = true;
+        thread_ = boost::thread(MonitorThread, this);
+      }
+    }
+
+
+    void IdleAssociationsMonitor::Stop()
+    {
+      if (continue_)
+      {
+        continue_ = false;
+
+        if (thread_.joinable())
+        {
+          thread_.join();
+        }
+      }
+    }
+
+
+    void IdleAssociationsMonitor::Dispatch(CommandDispatcher* dispatcher)
+    {
+      std::unique_ptr<Runnable> runnable(new Runnable(*this, dispatcher));
+      workers_.Add(runnable.release());
+    }
+
+
+    void IdleAssociationsMonitor::Park(CommandDispatcher* dispatcher)
+    {
+      std::unique_ptr<CommandDispatcher> protection(dispatcher);
+
+      if (dispatcher == NULL)
+      {
+        throw OrthancException(ErrorCode_NullPointer);
+      }
+
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (continue_)
+      {
+        parked_.push_back(protection.release());
+      }
+      else
+      {
+        // The DICOM server is stopping: The association is aborted
+      }
+    }
+
+
+    size_t IdleAssociationsMonitor::GetParkedCount()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      return parked_.size();
+    }
+  }
+}
@@ -0,0 +1,78 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "CommandDispatcher.h"
+#include "../../MultiThreading/RunnableWorkersPool.h"
+
+#include <boost/thread.hpp>
+#include <list>
+
+namespace Orthanc
+{
+  namespace Internals
+  {
+    /**
+     * This class parks the associations that have not received any
+     * DIMSE command for a while, so that they do not occupy one of the
+     * threads of the DICOM server. A single thread monitors the network
+     * connections of the parked associations, and hands them back to
+     * the workers as soon as some data is available, or as soon as
+     * their association timeout is reached (new in Orthanc 1.11.3).
+     **/
+    class IdleAssociationsMonitor : public boost::noncopyable
+    {
+    private:
+      class Runnable;
+
+      RunnableWorkersPool&           workers_;
+      boost::mutex                   mutex_;
+      std::list<CommandDispatcher*>  parked_;
+      bool                           continue_;
+      boost::thread                  thread_;
+
+      static void MonitorThread(IdleAssociationsMonitor* that);
+
+      void ResumeReady();
+
+    public:
+      explicit IdleAssociationsMonitor(RunnableWorkersPool& workers);
+
+      ~IdleAssociationsMonitor();
+
+      void Start();
+
+      // After this call, the monitor does not resume parked associations anymore
+      void Stop();
+
+      // Hand an association over to the workers (takes ownership)
+      void Dispatch(CommandDispatcher* dispatcher);
+
+      // Park an idle association (takes ownership)
+      void Park(CommandDispatcher* dispatcher);
+
+      size_t GetParkedCount();
+    };
+  }
+}
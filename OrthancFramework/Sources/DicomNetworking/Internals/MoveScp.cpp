@@ -218,6 +218,36 @@ namespace Orthanc
         response->DimseStatus = STATUS_MOVE_Failed_UnableToProcess;
         return;
       }
+
+      if (cancelled &&
+          data.subOperationCount_ != 0)
+      {
+        // DCMTK has received a C-CANCEL after the previous sub-operation
+        unsigned int completed = (responseCount > 1 ? static_cast<unsigned int>(responseCount - 1) : 0);
+        if (completed > data.subOperationCount_)
+        {
+          completed = data.subOperationCount_;
+        }
+
+        CLOG(INFO, DICOM) << "C-MOVE request cancelled by the SCU after "
+                          << completed << "/" << data.subOperationCount_ << " sub-operations";
+
+        try
+        {
+          data.iterator_->Cancel();
+        }
+        catch (OrthancException& e)
+        {
+          CLOG(ERROR, DICOM) << "IMoveRequestHandler Failed to cancel: " << e.What();
+        }
+
+        response->DimseStatus = STATUS_MOVE_Cancel_SubOperationsTerminatedDueToCancelIndication;
+        response->NumberOfRemainingSubOperations = data.subOperationCount_ - completed;
+        response->NumberOfCompletedSubOperations = completed;
+        response->NumberOfFailedSubOperations = data.failureCount_;
+        response->NumberOfWarningSubOperations = data.warningCount_;
+        return;
+      }
   
       if (data.subOperationCount_ == 0)
       {
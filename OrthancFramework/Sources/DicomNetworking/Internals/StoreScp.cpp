@@ -77,6 +77,7 @@
 #  error The macro DCMTK_VERSION_NUMBER must be defined
 #endif
 
+#include "../../DicomFormat/DicomStreamReader.h"
 #include "../../DicomParsing/FromDcmtkBridge.h"
 #include "../../DicomParsing/ToDcmtkBridge.h"
 #include "../../OrthancException.h"
@@ -87,6 +88,12 @@
 #include <dcmtk/dcmdata/dcostrmb.h>
 #include <dcmtk/dcmdata/dcdeftag.h>
 #include <dcmtk/dcmnet/diutil.h>
+#include <dcmtk/dcmdata/dcostrma.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <limits>
 
 
 namespace Orthanc
@@ -203,6 +210,336 @@ namespace Orthanc
         }
       }
     }
+
+    /**
+     * DCMTK producer that appends the bytes received from the network
+     * to a memory buffer, for the bit-preserving mode.
+     **/
+    class StringProducer : public DcmProducer
+    {
+    private:
+      std::string&  target_;
+
+    public:
+      explicit StringProducer(std::string& target) :
+        target_(target)
+      {
+      }
+
+      virtual OFBool good() const ORTHANC_OVERRIDE
+      {
+        return OFTrue;
+      }
+
+      virtual OFCondition status() const ORTHANC_OVERRIDE
+      {
+        return EC_Normal;
+      }
+
+      virtual OFBool isFlushed() const ORTHANC_OVERRIDE
+      {
+        return OFTrue;
+      }
+
+      virtual offile_off_t avail() const ORTHANC_OVERRIDE
+      {
+        return std::numeric_limits<offile_off_t>::max();
+      }
+
+      virtual offile_off_t write(const void *buf,
+                                 offile_off_t buflen) ORTHANC_OVERRIDE
+      {
+        if (buflen > 0)
+        {
+          target_.append(reinterpret_cast<const char*>(buf), static_cast<size_t>(buflen));
+        }
+
+        return buflen;
+      }
+
+      virtual void flush() ORTHANC_OVERRIDE
+      {
+      }
+    };
+
+
+    class StringOutputStream : public DcmOutputStream
+    {
+    private:
+      StringProducer  producer_;
+
+    public:
+      explicit StringOutputStream(std::string& target) :
+        DcmOutputStream(&producer_),  // Same construction as "DcmOutputFileStream"
+        producer_(target)
+      {
+      }
+    };
+
+
+    class SopUidsVisitor : public DicomStreamReader::IVisitor
+    {
+    private:
+      std::string  sopClassUid_;
+      std::string  sopInstanceUid_;
+
+      static std::string StripPadding(const std::string& value)
+      {
+        size_t size = value.size();
+        while (size > 0 &&
+               (value[size - 1] == '\0' || value[size - 1] == ' '))
+        {
+          size--;
+        }
+
+        return value.substr(0, size);
+      }
+
+    public:
+      virtual void VisitMetaHeaderTag(const DicomTag& tag,
+                                      const ValueRepresentation& vr,
+                                      const std::string& value) ORTHANC_OVERRIDE
+      {
+      }
+
+      virtual void VisitTransferSyntax(DicomTransferSyntax transferSyntax) ORTHANC_OVERRIDE
+      {
+      }
+
+      virtual bool VisitDatasetTag(const DicomTag& tag,
+                                   const ValueRepresentation& vr,
+                                   const std::string& value,
+                                   bool isLittleEndian,
+                                   uint64_t fileOffset) ORTHANC_OVERRIDE
+      {
+        if (tag == DICOM_TAG_SOP_CLASS_UID)
+        {
+          sopClassUid_ = StripPadding(value);
+        }
+        else if (tag == DICOM_TAG_SOP_INSTANCE_UID)
+        {
+          sopInstanceUid_ = StripPadding(value);
+        }
+
+        return true;
+      }
+
+      const std::string& GetSopClassUid() const
+      {
+        return sopClassUid_;
+      }
+
+      const std::string& GetSopInstanceUid() const
+      {
+        return sopInstanceUid_;
+      }
+    };
+
+
+    static void WriteLittleEndian16(std::string& target,
+                                    uint16_t value)
+    {
+      target.push_back(static_cast<char>(value & 0xff));
+      target.push_back(static_cast<char>((value >> 8) & 0xff));
+    }
+
+
+    static void WriteLittleEndian32(std::string& target,
+                                    uint32_t value)
+    {
+      WriteLittleEndian16(target, static_cast<uint16_t>(value & 0xffff));
+      WriteLittleEndian16(target, static_cast<uint16_t>((value >> 16) & 0xffff));
+    }
+
+
+    static void AddMetaHeaderElement(std::string& target,
+                                     uint16_t element,
+                                     const char* vr,
+                                     const std::string& value,
+                                     char padding)
+    {
+      // The meta-header is always encoded as explicit VR little endian
+      const uint32_t length = static_cast<uint32_t>(value.size() + value.size() % 2);
+
+      WriteLittleEndian16(target, 0x0002);
+      WriteLittleEndian16(target, element);
+      target.append(vr, 2);
+
+      if (strcmp(vr, "OB") == 0)
+      {
+        WriteLittleEndian16(target, 0);
+        WriteLittleEndian32(target, length);
+      }
+      else
+      {
+        WriteLittleEndian16(target, static_cast<uint16_t>(length));
+      }
+
+      target.append(value);
+
+      if (value.size() % 2 == 1)
+      {
+        target.push_back(padding);
+      }
+    }
+  }
+
+
+  void Internals::WriteStoreMetaHeader(std::string& target,
+                                       const std::string& sopClassUid,
+                                       const std::string& sopInstanceUid,
+                                       const std::string& transferSyntaxUid,
+                                       const std::string& sourceAet)
+  {
+    std::string elements;
+    AddMetaHeaderElement(elements, 0x0001, "OB", std::string("\0\1", 2), '\0');
+    AddMetaHeaderElement(elements, 0x0002, "UI", sopClassUid, '\0');
+    AddMetaHeaderElement(elements, 0x0003, "UI", sopInstanceUid, '\0');
+    AddMetaHeaderElement(elements, 0x0010, "UI", transferSyntaxUid, '\0');
+    AddMetaHeaderElement(elements, 0x0012, "UI", OFFIS_IMPLEMENTATION_CLASS_UID, '\0');
+    AddMetaHeaderElement(elements, 0x0013, "SH", OFFIS_DTK_IMPLEMENTATION_VERSION_NAME, ' ');
+
+    if (!sourceAet.empty())
+    {
+      AddMetaHeaderElement(elements, 0x0016, "AE", sourceAet, ' ');
+    }
+
+    target.assign(128, '\0');
+    target.append("DICM");
+
+    // File Meta Information Group Length (0002,0000)
+    WriteLittleEndian16(target, 0x0002);
+    WriteLittleEndian16(target, 0x0000);
+    target.append("UL");
+    WriteLittleEndian16(target, 4);
+    WriteLittleEndian32(target, static_cast<uint32_t>(elements.size()));
+
+    target.append(elements);
+  }
+
+
+  uint16_t Internals::CheckAndHandleStoreBuffer(IStoreRequestHandler& handler,
+                                                const std::string& dicom,
+                                                const std::string& affectedSopClassUid,
+                                                const std::string& affectedSopInstanceUid,
+                                                const std::string& remoteIp,
+                                                const std::string& remoteAet,
+                                                const std::string& calledAet)
+  {
+    // Check that the SOP class/instance UIDs of the dataset
+    // correspond to those of the request, as in "storeScpCallback()"
+    SopUidsVisitor visitor;
+
+    try
+    {
+      boost::iostreams::array_source source(dicom.c_str(), dicom.size());
+      boost::iostreams::stream<boost::iostreams::array_source> stream(source);
+
+      DicomStreamReader reader(stream);
+      reader.Consume(visitor, DicomTag(0x0008, 0x0019));
+    }
+    catch (...)
+    {
+      return STATUS_STORE_Error_CannotUnderstand;
+    }
+
+    if (visitor.GetSopClassUid().empty() ||
+        visitor.GetSopInstanceUid().empty())
+    {
+      return STATUS_STORE_Error_CannotUnderstand;
+    }
+    else if (visitor.GetSopClassUid() != affectedSopClassUid ||
+             visitor.GetSopInstanceUid() != affectedSopInstanceUid)
+    {
+      return STATUS_STORE_Error_DataSetDoesNotMatchSOPClass;
+    }
+    else
+    {
+      // No exception must escape to DCMTK, as the C-STORE response
+      // must be sent in any case
+      try
+      {
+        return handler.HandleBuffer(dicom, remoteIp, remoteAet, calledAet);
+      }
+      catch (OrthancException& e)
+      {
+        CLOG(ERROR, DICOM) << "Exception while storing DICOM: " << e.What();
+        return STATUS_STORE_Refused_OutOfResources;
+      }
+      catch (std::exception& e)
+      {
+        CLOG(ERROR, DICOM) << "std::exception while storing DICOM: " << e.what();
+        return STATUS_STORE_Refused_OutOfResources;
+      }
+      catch (...)
+      {
+        CLOG(ERROR, DICOM) << "Native exception while storing DICOM";
+        return STATUS_STORE_Refused_OutOfResources;
+      }
+    }
+  }
+
+
+  namespace
+  {
+    /**
+     * Bit-preserving version of "DIMSE_storeProvider()": The dataset
+     * is received as a raw buffer, instead of being parsed by DCMTK
+     * then serialized back to memory by the handler.
+     **/
+    static OFCondition BitPreservingStoreProvider(T_ASC_Association* assoc,
+                                                  T_ASC_PresentationContextID presID,
+                                                  T_DIMSE_C_StoreRQ& req,
+                                                  const std::string& transferSyntaxUid,
+                                                  IStoreRequestHandler& handler,
+                                                  const std::string& remoteIp,
+                                                  const char* remoteAet,
+                                                  const char* calledAet,
+                                                  int timeout)
+    {
+      std::string dicom;
+      Internals::WriteStoreMetaHeader(dicom, req.AffectedSOPClassUID, req.AffectedSOPInstanceUID,
+                                      transferSyntaxUid, remoteAet);
+
+      T_ASC_PresentationContextID presIdData = presID;
+
+      {
+        StringOutputStream stream(dicom);
+        OFCondition cond = DIMSE_receiveDataSetInFile(assoc, (timeout ? DIMSE_NONBLOCKING : DIMSE_BLOCKING),
+                                                      timeout, &presIdData, &stream, NULL, NULL);
+        if (cond.bad())
+        {
+          return cond;
+        }
+      }
+
+      T_DIMSE_C_StoreRSP response;
+      memset(&response, 0, sizeof(response));
+      response.MessageIDBeingRespondedTo = req.MessageID;
+      response.DataSetType = DIMSE_DATASET_NULL;
+      OFStandard::strlcpy(response.AffectedSOPClassUID, req.AffectedSOPClassUID, sizeof(response.AffectedSOPClassUID));
+      OFStandard::strlcpy(response.AffectedSOPInstanceUID, req.AffectedSOPInstanceUID, sizeof(response.AffectedSOPInstanceUID));
+      response.opts = (O_STORE_AFFECTEDSOPCLASSUID | O_STORE_AFFECTEDSOPINSTANCEUID);
+
+      if (req.opts & O_STORE_RQ_BLANK_PADDING)
+      {
+        response.opts |= O_STORE_RSP_BLANK_PADDING;
+      }
+
+      if (presIdData != presID)
+      {
+        // The dataset was not sent over the presentation context of the command
+        response.DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+      }
+      else
+      {
+        response.DimseStatus = Internals::CheckAndHandleStoreBuffer(handler, dicom, req.AffectedSOPClassUID,
+                                                                    req.AffectedSOPInstanceUID,
+                                                                    remoteIp, remoteAet, calledAet);
+      }
+
+      return DIMSE_sendStoreResponse(assoc, presID, &req, &response, NULL);
+    }
   }
 
 /*
@@ -249,6 +586,29 @@ namespace Orthanc
       data.calledAET = "";
     }
 
+    if (handler.IsBitPreserving() &&
+        assoc != NULL &&
+        assoc->params != NULL)
+    {
+      T_ASC_PresentationContext pc;
+      DicomTransferSyntax syntax;
+
+      if (ASC_findAcceptedPresentationContext(assoc->params, presID, &pc).good() &&
+          LookupTransferSyntax(syntax, pc.acceptedTransferSyntax) &&
+          syntax != DicomTransferSyntax_DeflatedLittleEndianExplicit)  // DicomStreamReader cannot parse deflated datasets
+      {
+        cond = BitPreservingStoreProvider(assoc, presID, *req, pc.acceptedTransferSyntax, handler,
+                                          remoteIp, data.remoteAET, data.calledAET, timeout);
+
+        if (cond.bad())
+        {
+          CLOG(ERROR, DICOM) << "Store SCP Failed: " << cond.text();
+        }
+
+        return cond;
+      }
+    }
+
     DcmFileFormat dcmff;
 
     // store SourceApplicationEntityTitle in metaheader
@@ -37,5 +37,30 @@ namespace Orthanc
                          IStoreRequestHandler& handler,
                          const std::string& remoteIp,
                          int timeout);
+
+    /**
+     * Writes the preamble and the meta-header of a DICOM file, with
+     * the same content as "DcmFileFormat" would write. This is used
+     * by the bit-preserving C-STORE SCP.
+     **/
+    void WriteStoreMetaHeader(std::string& target,
+                              const std::string& sopClassUid,
+                              const std::string& sopInstanceUid,
+                              const std::string& transferSyntaxUid,
+                              const std::string& sourceAet);
+
+    /**
+     * Gives a DICOM file received by the bit-preserving C-STORE SCP
+     * to "IStoreRequestHandler::HandleBuffer()", after checking its
+     * SOP class/instance UIDs against those of the request. Returns
+     * the DIMSE status of the C-STORE response, and never throws.
+     **/
+    uint16_t CheckAndHandleStoreBuffer(IStoreRequestHandler& handler,
+                                       const std::string& dicom,
+                                       const std::string& affectedSopClassUid,
+                                       const std::string& affectedSopInstanceUid,
+                                       const std::string& remoteIp,
+                                       const std::string& remoteAet,
+                                       const std::string& calledAet);
   }
 }
@@ -24,6 +24,7 @@
 #include "../PrecompiledHeaders.h"
 #include "RemoteModalityParameters.h"
 
+#include "DicomAssociationParameters.h"
 #include "../Logging.h"
 #include "../OrthancException.h"
 #include "../SerializationToolbox.h"
@@ -49,6 +50,7 @@ static const char* KEY_PORT = "Port";
 static const char* KEY_USE_DICOM_TLS = "UseDicomTls";
 static const char* KEY_LOCAL_AET = "LocalAet";
 static const char* KEY_TIMEOUT = "Timeout";
+static const char* KEY_MAXIMUM_PDU_LENGTH = "MaximumPduLength";  // New in Orthanc 1.11.3
 
 
 namespace Orthanc
@@ -71,6 +73,7 @@ namespace Orthanc
     useDicomTls_ = false;
     localAet_.clear();
     timeout_ = 0;
+    maximumPduLength_ = 0;
   }
 
 
@@ -308,6 +311,11 @@ namespace Orthanc
     {
       timeout_ = SerializationToolbox::ReadUnsignedInteger(serialized, KEY_TIMEOUT);
     }
+
+    if (serialized.isMember(KEY_MAXIMUM_PDU_LENGTH))
+    {
+      SetMaximumPduLength(SerializationToolbox::ReadUnsignedInteger(serialized, KEY_MAXIMUM_PDU_LENGTH));
+    }
   }
 
 
@@ -400,7 +408,8 @@ namespace Orthanc
             !allowNEventReport_ ||
             !allowTranscoding_ ||
             useDicomTls_ ||
-            HasLocalAet());
+            HasLocalAet() ||
+            HasMaximumPduLength());
   }
 
   
@@ -427,6 +436,7 @@ namespace Orthanc
       target[KEY_USE_DICOM_TLS] = useDicomTls_;
       target[KEY_LOCAL_AET] = localAet_;
       target[KEY_TIMEOUT] = timeout_;
+      target[KEY_MAXIMUM_PDU_LENGTH] = maximumPduLength_;
     }
     else
     {
@@ -521,4 +531,24 @@ namespace Orthanc
   {
     return timeout_ != 0;
   }
+
+  void RemoteModalityParameters::SetMaximumPduLength(unsigned int pdu)
+  {
+    if (pdu != 0)
+    {
+      DicomAssociationParameters::CheckMaximumPduLength(pdu);
+    }
+
+    maximumPduLength_ = pdu;
+  }
+
+  unsigned int RemoteModalityParameters::GetMaximumPduLength() const
+  {
+    return maximumPduLength_;
+  }
+
+  bool RemoteModalityParameters::HasMaximumPduLength() const
+  {
+    return maximumPduLength_ != 0;
+  }
 }
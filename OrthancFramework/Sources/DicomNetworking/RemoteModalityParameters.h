@@ -50,6 +50,7 @@ namespace Orthanc
     bool                  useDicomTls_;
     std::string           localAet_;
     uint32_t              timeout_;
+    unsigned int          maximumPduLength_;
     
     void Clear();
 
@@ -117,5 +118,12 @@ namespace Orthanc
     uint32_t GetTimeout() const;
 
     bool HasTimeout() const;    
+
+    // Setting it to "0" will use "DicomAssociationParameters::GetDefaultMaximumPduLength()"
+    void SetMaximumPduLength(unsigned int pdu);
+
+    unsigned int GetMaximumPduLength() const;
+
+    bool HasMaximumPduLength() const;
   };
 }
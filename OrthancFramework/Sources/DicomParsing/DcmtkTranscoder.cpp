@@ -39,17 +39,368 @@
 #include "../OrthancException.h"
 
 #include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcofsetl.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcpixseq.h>
+#include <dcmtk/dcmdata/dcpxitem.h>
+#include <dcmtk/dcmdata/dcxfer.h>
 #include <dcmtk/dcmjpeg/djrploss.h>  // for DJ_RPLossy
 #include <dcmtk/dcmjpeg/djrplol.h>   // for DJ_RPLossless
 #include <dcmtk/dcmjpls/djrparam.h>  // for DJLSRepresentationParameter
 
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
 
 namespace Orthanc
 {
+  namespace
+  {
+    /**
+     * Encodes each frame of an uncompressed multi-frame image as a
+     * separate single-frame dataset, which allows to distribute the
+     * frames over several threads. Each DCMTK codec encodes the
+     * frames independently of each other, so the resulting fragments
+     * are the same as if the full image had been encoded at once.
+     **/
+    class FrameEncoder : public boost::noncopyable
+    {
+    private:
+      boost::mutex                             mutex_;
+      const DcmDataset&                        header_;   // Dataset without the pixel data
+      const Uint8*                             pixels_;
+      size_t                                   frameSize_;
+      bool                                     isWords_;
+      E_TransferSyntax                         xfer_;
+      const DcmRepresentationParameter&        parameters_;
+      unsigned int                             nextFrame_;
+      bool                                     success_;
+      bool                                     hasOffsetTable_;
+      std::vector< std::vector<std::string> >  fragments_;
+      std::unique_ptr<DcmDataset>              firstFrame_;
+
+      bool GetNextFrame(unsigned int& frame)
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (success_ &&
+            nextFrame_ < fragments_.size())
+        {
+          frame = nextFrame_;
+          nextFrame_++;
+          return true;
+        }
+        else
+        {
+          return false;
+        }
+      }
+
+      void SetFailure()
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        success_ = false;
+      }
+
+      bool EncodeFrame(unsigned int frame)
+      {
+        std::unique_ptr<DcmDataset> dataset(dynamic_cast<DcmDataset*>(header_.clone()));
+        if (dataset.get() == NULL)
+        {
+          return false;
+        }
+
+        const Uint8* pixels = pixels_ + static_cast<size_t>(frame) * frameSize_;
+
+        OFCondition c;
+        if (isWords_)
+        {
+          c = dataset->putAndInsertUint16Array(DCM_PixelData, reinterpret_cast<const Uint16*>(pixels),
+                                               static_cast<unsigned long>(frameSize_ / 2));
+        }
+        else
+        {
+          c = dataset->putAndInsertUint8Array(DCM_PixelData, pixels, static_cast<unsigned long>(frameSize_));
+        }
+
+        if (!c.good() ||
+            !dataset->putAndInsertString(DCM_NumberOfFrames, "1").good() ||
+            !dataset->chooseRepresentation(xfer_, &parameters_).good())
+        {
+          return false;
+        }
+
+        DcmElement* element = NULL;
+        if (!dataset->findAndGetElement(DCM_PixelData, element).good() ||
+            element == NULL)
+        {
+          return false;
+        }
+
+        DcmPixelData& pixelData = dynamic_cast<DcmPixelData&>(*element);
+
+        DcmPixelSequence* sequence = NULL;
+        if (!pixelData.getEncapsulatedRepresentation(xfer_, &parameters_, sequence).good() ||
+            sequence == NULL ||
+            sequence->card() < 2)
+        {
+          return false;
+        }
+
+        // The first item of the pixel sequence is the Basic Offset Table
+        std::vector<std::string>& target = fragments_[frame];
+        target.resize(sequence->card() - 1);
+
+        for (unsigned long i = 1; i < sequence->card(); i++)
+        {
+          DcmPixelItem* item = NULL;
+          Uint8* content = NULL;
+          if (!sequence->getItem(item, i).good() ||
+              item == NULL ||
+              !item->getUint8Array(content).good())
+          {
+            return false;
+          }
+
+          if (item->getLength() > 0)
+          {
+            target[i - 1].assign(reinterpret_cast<const char*>(content), item->getLength());
+          }
+        }
+
+        if (frame == 0)
+        {
+          DcmPixelItem* offsetTable = NULL;
+          if (!sequence->getItem(offsetTable, 0).good() ||
+              offsetTable == NULL)
+          {
+            return false;
+          }
+
+          hasOffsetTable_ = (offsetTable->getLength() > 0);
+
+          // Keep the first frame, to retrieve the attributes that were
+          // updated by the codec (e.g. "DerivationDescription")
+          dataset->findAndDeleteElement(DCM_PixelData);
+          firstFrame_.reset(dataset.release());
+        }
+
+        return true;
+      }
+
+    public:
+      FrameEncoder(const DcmDataset& header,
+                   const Uint8* pixels,
+                   size_t frameSize,
+                   bool isWords,
+                   unsigned int framesCount,
+                   E_TransferSyntax xfer,
+                   const DcmRepresentationParameter& parameters) :
+        header_(header),
+        pixels_(pixels),
+        frameSize_(frameSize),
+        isWords_(isWords),
+        xfer_(xfer),
+        parameters_(parameters),
+        nextFrame_(0),
+        success_(true),
+        hasOffsetTable_(false),
+        fragments_(framesCount)
+      {
+      }
+
+      void Worker()
+      {
+        unsigned int frame;
+        while (GetNextFrame(frame))
+        {
+          bool ok;
+
+          try
+          {
+            ok = EncodeFrame(frame);
+          }
+          catch (...)
+          {
+            ok = false;
+          }
+
+          if (!ok)
+          {
+            SetFailure();
+          }
+        }
+      }
+
+
+      // Replace the pixel data of the source image by the encoded frames
+      bool Commit(DcmDataset& target,
+                  DcmPixelData& pixelData) const
+      {
+        if (!success_ ||
+            firstFrame_.get() == NULL)
+        {
+          return false;
+        }
+
+        std::unique_ptr<DcmPixelSequence> sequence(new DcmPixelSequence(DcmTag(DCM_PixelData, EVR_OB)));
+
+        DcmPixelItem* offsetTable = new DcmPixelItem(DcmTag(DCM_Item, EVR_OB));
+        if (!sequence->insert(offsetTable).good())
+        {
+          delete offsetTable;
+          return false;
+        }
+
+        DcmOffsetList offsetList;
+
+        for (size_t i = 0; i < fragments_.size(); i++)
+        {
+          Uint32 frameLength = 0;
+
+          for (size_t j = 0; j < fragments_[i].size(); j++)
+          {
+            const std::string& fragment = fragments_[i][j];
+
+            std::unique_ptr<DcmPixelItem> item(new DcmPixelItem(DcmTag(DCM_Item, EVR_OB)));
+            if (!item->putUint8Array(fragment.empty() ? NULL : reinterpret_cast<const Uint8*>(fragment.c_str()),
+                                     static_cast<unsigned long>(fragment.size())).good())
+            {
+              return false;
+            }
+
+            frameLength += item->getLength() + 8;  // Include the header of the item
+            
+            if (!sequence->insert(item.release()).good())
+            {
+              return false;
+            }
+          }
+
+          offsetList.push_back(frameLength);
+        }
+
+        if (hasOffsetTable_ &&
+            !offsetTable->createOffsetTable(offsetList).good())
+        {
+          return false;
+        }
+
+        pixelData.putOriginalRepresentation(xfer_, &parameters_, sequence.release());
+
+        // Copy the attributes that were modified by the codec
+        for (unsigned long i = 0; i < firstFrame_->card(); i++)
+        {
+          DcmElement* element = firstFrame_->getElement(i);
+          if (element != NULL &&
+              element->getTag() != DCM_NumberOfFrames)
+          {
+            std::unique_ptr<DcmElement> cloned(dynamic_cast<DcmElement*>(element->clone()));
+            if (cloned.get() == NULL ||
+                !target.insert(cloned.release(), OFTrue /* replace old */).good())
+            {
+              return false;
+            }
+          }
+        }
+
+        target.updateOriginalXfer();
+        return true;
+      }
+    };
+
+
+    /**
+     * Shared by the calling thread and the runnables that are
+     * submitted to the pool of workers of the transcoder. The helpers
+     * that are started once the calling thread has encoded the last
+     * frame don't access the encoder, which can be destroyed as soon
+     * as "Close()" returns.
+     **/
+    class FrameEncoderHelpers : public boost::noncopyable
+    {
+    private:
+      boost::mutex               mutex_;
+      boost::condition_variable  finished_;
+      FrameEncoder*              encoder_;
+      unsigned int               running_;
+
+    public:
+      explicit FrameEncoderHelpers(FrameEncoder& encoder) :
+        encoder_(&encoder),
+        running_(0)
+      {
+      }
+
+      void Run()
+      {
+        FrameEncoder* encoder = NULL;
+
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          if (encoder_ == NULL)
+          {
+            return;  // The frames have all been encoded
+          }
+
+          encoder = encoder_;
+          running_++;
+        }
+
+        try
+        {
+          encoder->Worker();
+        }
+        catch (...)
+        {
+          // Errors while encoding the frames are reported by "Commit()"
+        }
+
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          assert(running_ > 0);
+          running_--;
+          finished_.notify_all();
+        }
+      }
+
+      void Close()
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        encoder_ = NULL;
+
+        while (running_ > 0)
+        {
+          finished_.wait(lock);
+        }
+      }
+    };
+
+
+    class FrameEncoderRunnable : public IRunnableBySteps
+    {
+    private:
+      boost::shared_ptr<FrameEncoderHelpers>  helpers_;
+
+    public:
+      explicit FrameEncoderRunnable(const boost::shared_ptr<FrameEncoderHelpers>& helpers) :
+        helpers_(helpers)
+      {
+      }
+
+      virtual bool Step() ORTHANC_OVERRIDE
+      {
+        helpers_->Run();
+        return false;  // Done
+      }
+    };
+  }
+
+
   DcmtkTranscoder::DcmtkTranscoder() :
-    lossyQuality_(90)
+    lossyQuality_(90),
+    threadsCount_(0)
   {
   }
 
@@ -84,6 +435,179 @@ namespace Orthanc
   }
 
 
+  void DcmtkTranscoder::SetThreadsCount(unsigned int count)
+  {
+    LOG(INFO) << "Number of threads to encode the frames in DCMTK transcoding: " << count;
+
+    threadsCount_ = count;
+
+    if (count == 0)
+    {
+      availableThreads_.reset(NULL);
+      workers_.reset(NULL);
+    }
+    else
+    {
+      availableThreads_.reset(new Semaphore(count));
+      workers_.reset(new RunnableWorkersPool(count));
+    }
+  }
+
+
+  unsigned int DcmtkTranscoder::GetThreadsCount() const
+  {
+    return threadsCount_;
+  }
+
+
+  bool DcmtkTranscoder::TranscodeFramesInParallel(DcmFileFormat& dicom,
+                                                  DicomTransferSyntax syntax,
+                                                  const DcmRepresentationParameter& parameters)
+  {
+    /**
+     * Returns "false" if the image is not eligible to parallel
+     * encoding, in which case the caller must fallback to the
+     * encoding of the full image by DCMTK.
+     **/
+
+    if (availableThreads_.get() == NULL ||
+        dicom.getDataset() == NULL)
+    {
+      return false;
+    }
+
+    DcmDataset& dataset = *dicom.getDataset();
+
+    Sint32 framesCount;
+    Uint16 rows, columns, samplesPerPixel, bitsAllocated;
+    if (!dataset.findAndGetSint32(DCM_NumberOfFrames, framesCount).good() ||
+        framesCount <= 1 ||
+        !dataset.findAndGetUint16(DCM_Rows, rows).good() ||
+        !dataset.findAndGetUint16(DCM_Columns, columns).good() ||
+        !dataset.findAndGetUint16(DCM_SamplesPerPixel, samplesPerPixel).good() ||
+        !dataset.findAndGetUint16(DCM_BitsAllocated, bitsAllocated).good() ||
+        (bitsAllocated != 8 && bitsAllocated != 16))
+    {
+      return false;
+    }
+
+    E_TransferSyntax xfer;
+    if (!FromDcmtkBridge::LookupDcmtkTransferSyntax(xfer, syntax))
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    // Acquire the helper threads before decoding the source image
+    unsigned int helpers = 0;
+    while (helpers + 1 < static_cast<unsigned int>(framesCount) &&
+           availableThreads_->TryAcquire())
+    {
+      helpers++;
+    }
+
+    if (helpers == 0)
+    {
+      // All the threads are busy with other transcodings
+      return false;
+    }
+
+    bool success = false;
+
+    try
+    {
+      // The frames must be available as raw pixels
+      if (DcmXfer(dataset.getCurrentXfer()).isEncapsulated() &&
+          !FromDcmtkBridge::Transcode(dicom, DicomTransferSyntax_LittleEndianExplicit, NULL))
+      {
+        availableThreads_->Release(helpers);
+        return false;
+      }
+
+      const size_t frameSize = (static_cast<size_t>(rows) * static_cast<size_t>(columns) *
+                                static_cast<size_t>(samplesPerPixel) * static_cast<size_t>(bitsAllocated / 8));
+
+      DcmElement* element = NULL;
+      const Uint8* pixels = NULL;
+      if (dataset.findAndGetElement(DCM_PixelData, element).good() &&
+          element != NULL &&
+          element->getLength() >= frameSize * static_cast<size_t>(framesCount))
+      {
+        if (bitsAllocated == 16)
+        {
+          Uint16* words = NULL;
+          if (element->getUint16Array(words).good())
+          {
+            pixels = reinterpret_cast<const Uint8*>(words);
+          }
+        }
+        else
+        {
+          Uint8* bytes = NULL;
+          if (element->getUint8Array(bytes).good())
+          {
+            pixels = bytes;
+          }
+        }
+      }
+
+      if (pixels != NULL)
+      {
+        std::unique_ptr<DcmDataset> header(dynamic_cast<DcmDataset*>(dataset.clone()));
+        header->findAndDeleteElement(DCM_PixelData);
+
+        FrameEncoder encoder(*header, pixels, frameSize, (bitsAllocated == 16),
+                             static_cast<unsigned int>(framesCount), xfer, parameters);
+
+        {
+          /**
+           * As the helper threads were reserved through the
+           * semaphore, the runnables never wait behind the ones of
+           * another transcoding.
+           **/
+          boost::shared_ptr<FrameEncoderHelpers> encoderHelpers(new FrameEncoderHelpers(encoder));
+
+          try
+          {
+            for (unsigned int i = 0; i < helpers; i++)
+            {
+              workers_->Add(new FrameEncoderRunnable(encoderHelpers));
+            }
+
+            encoder.Worker();  // The calling thread also takes part to the encoding
+          }
+          catch (...)
+          {
+            // The encoder must outlive the helpers
+            encoderHelpers->Close();
+            throw;
+          }
+
+          encoderHelpers->Close();
+        }
+
+        success = (encoder.Commit(dataset, dynamic_cast<DcmPixelData&>(*element)) &&
+                   dicom.canWriteXfer(xfer) &&
+                   dicom.validateMetaInfo(xfer, EWM_updateMeta).good());
+
+        if (success)
+        {
+          dicom.removeInvalidGroups();
+          LOG(INFO) << "Encoded " << framesCount << " frames to transfer syntax "
+                    << GetTransferSyntaxUid(syntax) << " using " << (helpers + 1) << " threads";
+        }
+      }
+    }
+    catch (...)
+    {
+      availableThreads_->Release(helpers);
+      throw;
+    }
+
+    availableThreads_->Release(helpers);
+    return success;
+  }
+
+
   bool DcmtkTranscoder::InplaceTranscode(DicomTransferSyntax& selectedSyntax /* out */,
                                          DcmFileFormat& dicom,
                                          const std::set<DicomTransferSyntax>& allowedSyntaxes,
@@ -208,7 +732,8 @@ namespace Orthanc
        * WARNING: This call results in a segmentation fault if using
        * the DCMTK package 3.6.2 from Ubuntu 18.04.
        **/              
-      if (FromDcmtkBridge::Transcode(dicom, DicomTransferSyntax_JPEGLSLossless, &parameters))
+      if (TranscodeFramesInParallel(dicom, DicomTransferSyntax_JPEGLSLossless, parameters) ||
+          FromDcmtkBridge::Transcode(dicom, DicomTransferSyntax_JPEGLSLossless, &parameters))
       {
         selectedSyntax = DicomTransferSyntax_JPEGLSLossless;
         return true;
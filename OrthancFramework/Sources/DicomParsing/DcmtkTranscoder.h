@@ -32,14 +32,25 @@
 #endif
 
 #include "IDicomTranscoder.h"
+#include "../MultiThreading/RunnableWorkersPool.h"
+#include "../MultiThreading/Semaphore.h"
+
+class DcmRepresentationParameter;
 
 namespace Orthanc
 {
   class ORTHANC_PUBLIC DcmtkTranscoder : public IDicomTranscoder
   {
   private:
-    unsigned int  lossyQuality_;
-    
+    unsigned int                          lossyQuality_;
+    unsigned int                          threadsCount_;
+    std::unique_ptr<Semaphore>            availableThreads_;  // Shared by all the transcodings
+    std::unique_ptr<RunnableWorkersPool>  workers_;
+
+    bool TranscodeFramesInParallel(DcmFileFormat& dicom,
+                                   DicomTransferSyntax syntax,
+                                   const DcmRepresentationParameter& parameters);
+
     bool InplaceTranscode(DicomTransferSyntax& selectedSyntax /* out */,
                           DcmFileFormat& dicom,
                           const std::set<DicomTransferSyntax>& allowedSyntaxes,
@@ -51,6 +62,20 @@ namespace Orthanc
     void SetLossyQuality(unsigned int quality);
 
     unsigned int GetLossyQuality() const;
+
+    /**
+     * Set the number of threads of the pool that is used, in addition
+     * to the calling threads, to encode the frames of multi-frame
+     * images in parallel. This pool of threads is shared by all the
+     * concurrent calls to "Transcode()". The decoding of the source
+     * image is still done by the calling thread. The value "0"
+     * disables parallel encoding. This method is not thread-safe, and
+     * must be called before the first transcoding (new in Orthanc
+     * 1.11.3).
+     **/
+    void SetThreadsCount(unsigned int count);
+
+    unsigned int GetThreadsCount() const;
     
     static bool IsSupported(DicomTransferSyntax syntax);
 
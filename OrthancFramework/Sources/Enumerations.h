@@ -745,6 +745,7 @@ namespace Orthanc
     FileContentType_Dicom = 1,
     FileContentType_DicomAsJson = 2,          // For Orthanc <= 1.9.0
     FileContentType_DicomUntilPixelData = 3,  // New in Orthanc 1.9.1
+    FileContentType_DicomFrameOffsetTable = 4,  // New in Orthanc 1.11.3
 
     // Make sure that the value "65535" can be stored into this enumeration
     FileContentType_StartUser = 1024,
@@ -111,6 +111,9 @@ namespace Orthanc
       case FileContentType_DicomUntilPixelData:
         return "DICOM until pixel data";
 
+      case FileContentType_DicomFrameOffsetTable:
+        return "DICOM frame offset table";
+
       default:
         return "User-defined";
     }
@@ -133,7 +133,7 @@ namespace Orthanc
         range.resize(end - start);
         assert(!range.empty());
 
-        memcpy(&range[0], &found->second[start], range.size());
+        memcpy(&range[0], &(*found->second)[start], range.size());
         
         return StringMemoryBuffer::CreateFromSwap(range);
       }
@@ -39,6 +39,7 @@
 
 
 static const std::string METRICS_CREATE = "orthanc_storage_create_duration_ms";
+static const std::string METRICS_COMPRESS = "orthanc_storage_compress_duration_ms";
 static const std::string METRICS_READ = "orthanc_storage_read_duration_ms";
 static const std::string METRICS_REMOVE = "orthanc_storage_remove_duration_ms";
 
@@ -112,10 +113,13 @@ namespace Orthanc
 
       case CompressionType_ZlibWithSize:
       {
-        ZlibCompressor zlib;
-
         std::string compressed;
-        zlib.Compress(compressed, data, size);
+
+        {
+          MetricsTimer timer(*this, METRICS_COMPRESS);
+          ZlibCompressor zlib;
+          zlib.Compress(compressed, data, size);
+        }
 
         std::string compressedMD5;
       
@@ -264,6 +268,39 @@ namespace Orthanc
   }
 
 
+  void StorageAccessor::ReadRange(std::string& target,
+                                  const std::string& fileUuid,
+                                  FileContentType contentType,
+                                  uint64_t start /* inclusive */,
+                                  uint64_t end /* exclusive */)
+  {
+    if (start > end)
+    {
+      throw OrthancException(ErrorCode_BadRange);
+    }
+
+    std::string full;
+    if (cache_ != NULL &&
+        cache_->Fetch(full, fileUuid, contentType))
+    {
+      // The full file is already in the cache, no need to access the storage area
+      if (end > full.size())
+      {
+        throw OrthancException(ErrorCode_BadRange);
+      }
+
+      target.assign(full, static_cast<size_t>(start), static_cast<size_t>(end - start));
+    }
+    else
+    {
+      MetricsTimer timer(*this, METRICS_READ);
+      std::unique_ptr<IMemoryBuffer> buffer(area_.ReadRange(fileUuid, contentType, start, end));
+      assert(buffer->GetSize() == end - start);
+      buffer->MoveToString(target);
+    }
+  }
+
+
 #if ORTHANC_ENABLE_CIVETWEB == 1 || ORTHANC_ENABLE_MONGOOSE == 1
   void StorageAccessor::SetupSender(BufferHttpSender& sender,
                                     const FileInfo& info,
@@ -107,6 +107,13 @@ namespace Orthanc
                         FileContentType fullFileContentType,
                         uint64_t end /* exclusive */);
 
+    // New in Orthanc 1.11.3. The file must not be compressed.
+    void ReadRange(std::string& target,
+                   const std::string& fileUuid,
+                   FileContentType contentType,
+                   uint64_t start /* inclusive */,
+                   uint64_t end /* exclusive */);
+
     void Remove(const std::string& fileUuid,
                 FileContentType type);
 
@@ -0,0 +1,1024 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "TieredStorageArea.h"
+
+#include "../IDynamicObject.h"
+#include "../Logging.h"
+#include "../OrthancException.h"
+#include "../StringMemoryBuffer.h"
+#include "../SystemToolbox.h"
+#include "../Toolbox.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cassert>
+#include <string.h>
+
+
+static const char* const METRICS_HITS = "orthanc_storage_tier_hits_count";
+static const char* const METRICS_MISSES = "orthanc_storage_tier_misses_count";
+static const char* const METRICS_HIT_RATIO = "orthanc_storage_tier_hit_ratio";
+static const char* const METRICS_SIZE = "orthanc_storage_tier_size_mb";
+static const char* const METRICS_COUNT = "orthanc_storage_tier_count";
+static const char* const METRICS_PENDING = "orthanc_storage_tier_pending_writes_mb";
+
+
+namespace Orthanc
+{
+  class TieredStorageArea::Entry : public boost::noncopyable
+  {
+  private:
+    FileContentType  type_;
+    uint64_t         size_;
+    uint64_t         hits_;
+    uint64_t         tick_;
+    bool             dirty_;
+    bool             ready_;
+    bool             recovered_;
+
+  public:
+    Entry(FileContentType type,
+          uint64_t size,
+          bool dirty) :
+      type_(type),
+      size_(size),
+      hits_(0),
+      tick_(0),
+      dirty_(dirty),
+      ready_(false),
+      recovered_(false)
+    {
+    }
+
+    FileContentType GetType() const
+    {
+      return type_;
+    }
+
+    uint64_t GetSize() const
+    {
+      return size_;
+    }
+
+    uint64_t GetHits() const
+    {
+      return hits_;
+    }
+
+    uint64_t GetTick() const
+    {
+      return tick_;
+    }
+
+    void Touch(uint64_t tick)
+    {
+      hits_++;
+      tick_ = tick;
+    }
+
+    bool IsDirty() const
+    {
+      return dirty_;
+    }
+
+    void SetClean()
+    {
+      dirty_ = false;
+    }
+
+    // A file is not ready while it is being written to the local tier
+    bool IsReady() const
+    {
+      return ready_;
+    }
+
+    void SetReady()
+    {
+      ready_ = true;
+    }
+
+    bool IsEvictable() const
+    {
+      return ready_ && !dirty_;
+    }
+
+    // Whether the file was left in the local tier by a previous execution
+    bool IsRecovered() const
+    {
+      return recovered_;
+    }
+
+    void SetRecovered()
+    {
+      recovered_ = true;
+    }
+  };
+
+
+  static IMemoryBuffer* ExtractRange(const IMemoryBuffer& buffer,
+                                     uint64_t start,
+                                     uint64_t end)
+  {
+    if (start > end ||
+        end > buffer.GetSize())
+    {
+      throw OrthancException(ErrorCode_BadRange);
+    }
+    else if (start == end)
+    {
+      return new StringMemoryBuffer;
+    }
+    else
+    {
+      std::string range;
+      range.resize(end - start);
+      memcpy(&range[0], reinterpret_cast<const uint8_t*>(buffer.GetData()) + start, range.size());
+      return StringMemoryBuffer::CreateFromSwap(range);
+    }
+  }
+
+
+  TieredStorageArea::Priority TieredStorageArea::GetPriority(const Entry& entry) const
+  {
+    // The entry with the lowest priority is the first to be evicted
+    switch (evictionPolicy_)
+    {
+      case EvictionPolicy_LeastRecentlyUsed:
+        return Priority(entry.GetTick(), 0);
+
+      case EvictionPolicy_LeastFrequentlyUsed:
+        // Ties between files with the same number of hits are broken by recency
+        return Priority(entry.GetHits(), entry.GetTick());
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  void TieredStorageArea::MakeEvictable(const std::string& uuid,
+                                        Entry& entry)
+  {
+    assert(entry.IsEvictable());
+    entry.Touch(tick_++);
+    evictionQueue_[GetPriority(entry)] = uuid;
+  }
+
+
+  void TieredStorageArea::Touch(const std::string& uuid,
+                                Entry& entry)
+  {
+    if (entry.IsEvictable())
+    {
+      evictionQueue_.erase(GetPriority(entry));
+      MakeEvictable(uuid, entry);
+    }
+    else
+    {
+      entry.Touch(tick_++);
+    }
+  }
+
+
+  void TieredStorageArea::EraseEntry(Entries::iterator entry)
+  {
+    assert(entry != entries_.end() &&
+           entry->second != NULL);
+
+    if (entry->second->IsEvictable())
+    {
+      evictionQueue_.erase(GetPriority(*entry->second));
+    }
+
+    assert(currentSize_ >= entry->second->GetSize());
+    currentSize_ -= entry->second->GetSize();
+
+    if (entry->second->IsDirty())
+    {
+      assert(dirtySize_ >= entry->second->GetSize());
+      dirtySize_ -= entry->second->GetSize();
+    }
+
+    delete entry->second;
+    entries_.erase(entry);
+  }
+
+
+  void TieredStorageArea::EnforceMaximumSize(Victims& victims)
+  {
+    // The files that are not flushed yet to the remote storage area
+    // cannot be evicted, which may temporarily exceed the maximum size
+    while (currentSize_ > maximumSize_ &&
+           !evictionQueue_.empty())
+    {
+      Entries::iterator found = entries_.find(evictionQueue_.begin()->second);
+      assert(found != entries_.end());
+
+      victims.push_back(std::make_pair(found->first, found->second->GetType()));
+      EraseEntry(found);
+    }
+  }
+
+
+  void TieredStorageArea::RemoveVictims(const Victims& victims)
+  {
+    for (Victims::const_iterator it = victims.begin(); it != victims.end(); ++it)
+    {
+      try
+      {
+        local_->Remove(it->first, it->second);
+      }
+      catch (OrthancException& e)
+      {
+        LOG(WARNING) << "Cannot evict file \"" << it->first << "\" from the local storage tier: " << e.What();
+      }
+    }
+  }
+
+
+  void TieredStorageArea::PublishMetrics()
+  {
+    // The mutex must be locked
+    if (metricsRegistry_ != NULL)
+    {
+      static const float MEGA_BYTES = 1024 * 1024;
+
+      metricsRegistry_->SetValue(METRICS_HITS, static_cast<float>(hits_));
+      metricsRegistry_->SetValue(METRICS_MISSES, static_cast<float>(misses_));
+      metricsRegistry_->SetValue(METRICS_HIT_RATIO, (hits_ + misses_ == 0 ? 0.0f :
+                                                     static_cast<float>(hits_) / static_cast<float>(hits_ + misses_)));
+      metricsRegistry_->SetValue(METRICS_SIZE, static_cast<float>(currentSize_) / MEGA_BYTES);
+      metricsRegistry_->SetValue(METRICS_COUNT, static_cast<float>(entries_.size()));
+      metricsRegistry_->SetValue(METRICS_PENDING, static_cast<float>(dirtySize_) / MEGA_BYTES);
+    }
+  }
+
+
+  bool TieredStorageArea::LookupLocal(const std::string& uuid)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Entries::iterator found = entries_.find(uuid);
+
+    bool isHit = (found != entries_.end() &&
+                  found->second->IsReady());
+
+    if (isHit)
+    {
+      Touch(uuid, *found->second);
+      hits_++;
+    }
+    else
+    {
+      misses_++;
+    }
+
+    PublishMetrics();
+    return isHit;
+  }
+
+
+  bool TieredStorageArea::AddToLocal(const std::string& uuid,
+                                     const void* content,
+                                     size_t size,
+                                     FileContentType type,
+                                     bool dirty)
+  {
+    Victims victims;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (entries_.find(uuid) != entries_.end())
+      {
+        // Concurrent read-through of the same file
+        return false;
+      }
+
+      entries_[uuid] = new Entry(type, size, dirty);
+      currentSize_ += size;
+
+      if (dirty)
+      {
+        dirtySize_ += size;
+      }
+
+      EnforceMaximumSize(victims);
+    }
+
+    RemoveVictims(victims);
+    victims.clear();
+
+    // The file is written to the local tier without holding the mutex
+    bool success;
+
+    try
+    {
+      if (dirty)
+      {
+        WriteContentType(uuid, type);
+      }
+
+      local_->Create(uuid, content, size, type);
+      success = true;
+    }
+    catch (OrthancException& e)
+    {
+      LOG(WARNING) << "Cannot write file \"" << uuid << "\" to the local storage tier: " << e.What();
+      success = false;
+    }
+
+    bool isRemoved = false;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Entries::iterator found = entries_.find(uuid);
+
+      if (found == entries_.end())
+      {
+        // The file was removed while it was written
+        isRemoved = true;
+      }
+      else if (success)
+      {
+        found->second->SetReady();
+
+        if (found->second->IsEvictable())
+        {
+          MakeEvictable(uuid, *found->second);
+        }
+
+        EnforceMaximumSize(victims);
+      }
+      else
+      {
+        EraseEntry(found);
+      }
+
+      PublishMetrics();
+    }
+
+    if (isRemoved ||
+        !success)
+    {
+      try
+      {
+        local_->Remove(uuid, type);
+      }
+      catch (OrthancException&)
+      {
+      }
+
+      if (dirty)
+      {
+        RemoveContentType(uuid);
+      }
+    }
+
+    RemoveVictims(victims);
+
+    return (success || isRemoved);
+  }
+
+
+  IMemoryBuffer* TieredStorageArea::ReadThrough(const std::string& uuid,
+                                                FileContentType type)
+  {
+    std::unique_ptr<IMemoryBuffer> buffer(remote_->Read(uuid, type));
+
+    if (buffer->GetSize() <= maximumSize_)
+    {
+      AddToLocal(uuid, buffer->GetData(), buffer->GetSize(), type, false /* clean */);
+    }
+
+    return buffer.release();
+  }
+
+
+  bool TieredStorageArea::IsInRemote(const std::string& uuid,
+                                     FileContentType type)
+  {
+    try
+    {
+      if (remote_->HasReadRange())
+      {
+        std::unique_ptr<IMemoryBuffer> buffer(remote_->ReadRange(uuid, type, 0, 0));
+      }
+      else
+      {
+        std::unique_ptr<IMemoryBuffer> buffer(remote_->Read(uuid, type));
+      }
+
+      return true;
+    }
+    catch (OrthancException&)
+    {
+      return false;
+    }
+  }
+
+
+  std::string TieredStorageArea::GetContentTypePath(const std::string& uuid) const
+  {
+    assert(!contentTypesDirectory_.empty());
+    return (boost::filesystem::path(contentTypesDirectory_) / uuid).string();
+  }
+
+
+  void TieredStorageArea::WriteContentType(const std::string& uuid,
+                                           FileContentType type)
+  {
+    if (!contentTypesDirectory_.empty())
+    {
+      // Synchronously written before the file itself, so that a file
+      // that is not flushed yet never lacks its content type
+      SystemToolbox::WriteFile(boost::lexical_cast<std::string>(static_cast<int>(type)),
+                               GetContentTypePath(uuid), true /* fsync */);
+    }
+  }
+
+
+  void TieredStorageArea::RemoveContentType(const std::string& uuid)
+  {
+    if (!contentTypesDirectory_.empty())
+    {
+      try
+      {
+        SystemToolbox::RemoveFile(GetContentTypePath(uuid));
+      }
+      catch (OrthancException& e)
+      {
+        LOG(WARNING) << "Cannot remove the content type of file \"" << uuid << "\" from the local storage tier: " << e.What();
+      }
+    }
+  }
+
+
+  void TieredStorageArea::ReadContentTypes(std::map<std::string, FileContentType>& target,
+                                           std::set<std::string>& corrupted) const
+  {
+    namespace fs = boost::filesystem;
+
+    target.clear();
+    corrupted.clear();
+
+    if (contentTypesDirectory_.empty() ||
+        !fs::is_directory(contentTypesDirectory_))
+    {
+      return;
+    }
+
+    for (fs::directory_iterator it(contentTypesDirectory_), end; it != end; ++it)
+    {
+      const std::string uuid = it->path().filename().string();
+
+      if (Toolbox::IsUuid(uuid) &&
+          SystemToolbox::IsRegularFile(it->path().string()))
+      {
+        std::string content;
+        SystemToolbox::ReadFile(content, it->path().string());
+
+        try
+        {
+          target[uuid] = static_cast<FileContentType>(boost::lexical_cast<int>(content));
+        }
+        catch (boost::bad_lexical_cast&)
+        {
+          // Typically, a crash while writing the content type
+          corrupted.insert(uuid);
+        }
+      }
+    }
+  }
+
+
+  void TieredStorageArea::UploadRecoveredFile(const std::string& uuid,
+                                              FileContentType type,
+                                              const IMemoryBuffer& content)
+  {
+    try
+    {
+      remote_->Create(uuid, content.GetData(), content.GetSize(), type);
+    }
+    catch (OrthancException&)
+    {
+      /**
+       * The file might have been uploaded before the previous
+       * execution stopped, in which case some storage areas (such as
+       * "FilesystemStorage") refuse to overwrite it. As the
+       * identifiers are UUIDs, an existing file has the same content.
+       **/
+      if (!IsInRemote(uuid, type))
+      {
+        throw;
+      }
+    }
+  }
+
+
+  bool TieredStorageArea::FlushFile(const std::string& uuid)
+  {
+    // Prevents "Remove()" to run while the file is being uploaded
+    boost::mutex::scoped_lock flushLock(flushMutex_);
+
+    FileContentType type;
+    bool recovered = false;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Entries::const_iterator found = entries_.find(uuid);
+      if (found == entries_.end() ||
+          !found->second->IsDirty())
+      {
+        return true;  // Removed in the meantime, or already flushed
+      }
+      else if (!found->second->IsReady())
+      {
+        return false;
+      }
+      else
+      {
+        type = found->second->GetType();
+        recovered = found->second->IsRecovered();
+      }
+    }
+
+    try
+    {
+      std::unique_ptr<IMemoryBuffer> content(local_->Read(uuid, type));
+
+      if (recovered)
+      {
+        UploadRecoveredFile(uuid, type, *content);
+      }
+      else
+      {
+        remote_->Create(uuid, content->GetData(), content->GetSize(), type);
+      }
+    }
+    catch (OrthancException& e)
+    {
+      LOG(ERROR) << "Cannot upload file \"" << uuid << "\" from the local storage tier "
+                 << "to the remote storage area: " << e.What();
+      return false;
+    }
+
+    RemoveContentType(uuid);
+
+    Victims victims;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Entries::iterator found = entries_.find(uuid);
+      if (found != entries_.end() &&
+          found->second->IsDirty())
+      {
+        assert(dirtySize_ >= found->second->GetSize());
+        dirtySize_ -= found->second->GetSize();
+        found->second->SetClean();
+        MakeEvictable(uuid, *found->second);
+        EnforceMaximumSize(victims);
+      }
+
+      PublishMetrics();
+    }
+
+    RemoveVictims(victims);
+    return true;
+  }
+
+
+  void TieredStorageArea::FlushThread(TieredStorageArea* that)
+  {
+    static const int32_t TIMEOUT = 100;  // In milliseconds
+
+    while (!that->flushDone_)
+    {
+      std::unique_ptr<IDynamicObject> obj(that->flushQueue_.Dequeue(TIMEOUT));
+
+      if (obj.get() != NULL)
+      {
+        const std::string& uuid = dynamic_cast<SingleValueObject<std::string>&>(*obj).GetValue();
+
+        if (!that->FlushFile(uuid))
+        {
+          // Retry later, without hammering the remote storage area
+          that->flushQueue_.Enqueue(obj.release());
+          boost::this_thread::sleep(boost::posix_time::seconds(1));
+        }
+      }
+    }
+  }
+
+
+  TieredStorageArea::TieredStorageArea(IStorageArea* remote,
+                                       IStorageArea* local,
+                                       uint64_t maximumSize,
+                                       EvictionPolicy evictionPolicy,
+                                       WritePolicy writePolicy) :
+    remote_(remote),
+    local_(local),
+    maximumSize_(maximumSize),
+    evictionPolicy_(evictionPolicy),
+    writePolicy_(writePolicy),
+    currentSize_(0),
+    dirtySize_(0),
+    tick_(0),
+    hits_(0),
+    misses_(0),
+    metricsRegistry_(NULL),
+    flushDone_(false)
+  {
+    if (remote_.get() == NULL ||
+        local_.get() == NULL)
+    {
+      throw OrthancException(ErrorCode_NullPointer);
+    }
+
+    if (evictionPolicy != EvictionPolicy_LeastRecentlyUsed &&
+        evictionPolicy != EvictionPolicy_LeastFrequentlyUsed)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    switch (writePolicy)
+    {
+      case WritePolicy_WriteThrough:
+        break;
+
+      case WritePolicy_WriteBack:
+        flushThread_ = boost::thread(FlushThread, this);
+        break;
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  TieredStorageArea::~TieredStorageArea()
+  {
+    flushDone_ = true;
+
+    if (flushThread_.joinable())
+    {
+      flushThread_.join();
+    }
+
+    FlushPendingWrites();
+
+    for (Entries::iterator it = entries_.begin(); it != entries_.end(); ++it)
+    {
+      assert(it->second != NULL);
+
+      if (writePolicy_ == WritePolicy_WriteBack &&
+          it->second->IsEvictable())
+      {
+        /**
+         * In write-back mode, the local tier is not cleared at
+         * startup, as it might contain files that could not be
+         * uploaded. Only leave such files behind.
+         **/
+        try
+        {
+          local_->Remove(it->first, it->second->GetType());
+        }
+        catch (OrthancException&)
+        {
+        }
+      }
+
+      delete it->second;
+    }
+  }
+
+
+  void TieredStorageArea::SetMetricsRegistry(MetricsRegistry* registry)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    metricsRegistry_ = registry;
+    PublishMetrics();
+  }
+
+
+  void TieredStorageArea::GetStatistics(uint64_t& hits,
+                                        uint64_t& misses,
+                                        uint64_t& currentSize,
+                                        uint64_t& dirtySize,
+                                        size_t& countFiles)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    hits = hits_;
+    misses = misses_;
+    currentSize = currentSize_;
+    dirtySize = dirtySize_;
+    countFiles = entries_.size();
+  }
+
+
+  void TieredStorageArea::FlushPendingWrites()
+  {
+    std::list<std::string> pending;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      for (Entries::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+      {
+        if (it->second->IsDirty())
+        {
+          pending.push_back(it->first);
+        }
+      }
+    }
+
+    for (std::list<std::string>::const_iterator it = pending.begin(); it != pending.end(); ++it)
+    {
+      if (!FlushFile(*it))
+      {
+        LOG(ERROR) << "File \"" << *it << "\" is only available in the local storage tier";
+      }
+    }
+  }
+
+
+  void TieredStorageArea::SetContentTypesDirectory(const std::string& directory)
+  {
+    if (directory.empty())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    SystemToolbox::MakeDirectory(directory);
+    contentTypesDirectory_ = directory;
+  }
+
+
+  void TieredStorageArea::RecoverLocalFiles(const std::set<std::string>& uuids,
+                                            bool pendingWrites)
+  {
+    std::map<std::string, FileContentType> types;
+    std::set<std::string> corrupted;
+    ReadContentTypes(types, corrupted);
+
+    size_t countPending = 0;
+
+    for (std::set<std::string>::const_iterator it = uuids.begin(); it != uuids.end(); ++it)
+    {
+      std::map<std::string, FileContentType>::const_iterator type = types.find(*it);
+
+      if (!pendingWrites ||
+          (!contentTypesDirectory_.empty() &&
+           type == types.end() &&
+           corrupted.find(*it) == corrupted.end()))
+      {
+        /**
+         * Copy of a file of the remote area, left by the
+         * write-through mode, or left by the write-back mode after
+         * it was flushed or read through (the content type of a file
+         * is only removed once it is uploaded).
+         **/
+        local_->Remove(*it, FileContentType_Unknown);
+      }
+      else if (type == types.end())
+      {
+        // Uploading the file with a wrong content type could make it unreachable
+        throw OrthancException(contentTypesDirectory_.empty() ? ErrorCode_BadSequenceOfCalls : ErrorCode_CorruptedFile,
+                               "The content type of file \"" + *it + "\" in the local storage tier is unknown, "
+                               "it cannot be uploaded to the storage area");
+      }
+      else if (writePolicy_ == WritePolicy_WriteThrough)
+      {
+        {
+          std::unique_ptr<IMemoryBuffer> content(local_->Read(*it, type->second));
+          UploadRecoveredFile(*it, type->second, *content);
+        }
+
+        local_->Remove(*it, type->second);
+        RemoveContentType(*it);
+        countPending++;
+      }
+      else
+      {
+        // The file is read to get its size, and to make sure it is readable
+        std::unique_ptr<IMemoryBuffer> content(local_->Read(*it, type->second));
+
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+
+          if (entries_.find(*it) != entries_.end())
+          {
+            throw OrthancException(ErrorCode_BadSequenceOfCalls,
+                                   "The local storage tier must be recovered before it is used");
+          }
+
+          std::unique_ptr<Entry> entry(new Entry(type->second, content->GetSize(), true /* dirty */));
+          entry->SetReady();
+          entry->SetRecovered();
+
+          entries_[*it] = entry.release();
+          currentSize_ += content->GetSize();
+          dirtySize_ += content->GetSize();
+
+          PublishMetrics();
+        }
+
+        flushQueue_.Enqueue(new SingleValueObject<std::string>(*it));
+        countPending++;
+      }
+    }
+
+    // Remove the content types whose file was never written to the
+    // local tier (crash in the meantime), or is not pending anymore
+    for (std::map<std::string, FileContentType>::const_iterator it = types.begin(); it != types.end(); ++it)
+    {
+      if (!pendingWrites ||
+          uuids.find(it->first) == uuids.end())
+      {
+        RemoveContentType(it->first);
+      }
+    }
+
+    for (std::set<std::string>::const_iterator it = corrupted.begin(); it != corrupted.end(); ++it)
+    {
+      if (uuids.find(*it) == uuids.end())
+      {
+        RemoveContentType(*it);
+      }
+    }
+
+    if (countPending > 0)
+    {
+      LOG(WARNING) << "Recovered " << countPending << " file(s) of the local storage tier "
+                   << "that were possibly not uploaded to the storage area by a previous execution";
+    }
+  }
+
+
+  void TieredStorageArea::Create(const std::string& uuid,
+                                 const void* content,
+                                 size_t size,
+                                 FileContentType type)
+  {
+    if (writePolicy_ == WritePolicy_WriteBack &&
+        size <= maximumSize_ &&
+        AddToLocal(uuid, content, size, type, true /* dirty */))
+    {
+      flushQueue_.Enqueue(new SingleValueObject<std::string>(uuid));
+    }
+    else
+    {
+      // Write-through (also used as a fallback if the local tier is
+      // too small for this file, or if it cannot be written)
+      remote_->Create(uuid, content, size, type);
+
+      if (size <= maximumSize_)
+      {
+        AddToLocal(uuid, content, size, type, false /* clean */);
+      }
+    }
+  }
+
+
+  IMemoryBuffer* TieredStorageArea::Read(const std::string& uuid,
+                                         FileContentType type)
+  {
+    if (LookupLocal(uuid))
+    {
+      try
+      {
+        return local_->Read(uuid, type);
+      }
+      catch (OrthancException&)
+      {
+        // The file was evicted concurrently: Fallback to the remote area
+      }
+    }
+
+    return ReadThrough(uuid, type);
+  }
+
+
+  IMemoryBuffer* TieredStorageArea::ReadRange(const std::string& uuid,
+                                              FileContentType type,
+                                              uint64_t start /* inclusive */,
+                                              uint64_t end /* exclusive */)
+  {
+    if (LookupLocal(uuid))
+    {
+      try
+      {
+        if (local_->HasReadRange())
+        {
+          return local_->ReadRange(uuid, type, start, end);
+        }
+        else
+        {
+          std::unique_ptr<IMemoryBuffer> buffer(local_->Read(uuid, type));
+          return ExtractRange(*buffer, start, end);
+        }
+      }
+      catch (OrthancException& e)
+      {
+        if (e.GetErrorCode() == ErrorCode_BadRange)
+        {
+          throw;
+        }
+        
+        // The file was evicted concurrently: Fallback to the remote area
+      }
+    }
+
+    if (remote_->HasReadRange())
+    {
+      /**
+       * Don't download the full file from the remote area only to
+       * serve a range (e.g. one frame of a multi-frame image): The
+       * file will be brought into the local tier by the next full
+       * read.
+       **/
+      return remote_->ReadRange(uuid, type, start, end);
+    }
+    else
+    {
+      std::unique_ptr<IMemoryBuffer> buffer(ReadThrough(uuid, type));
+      return ExtractRange(*buffer, start, end);
+    }
+  }
+
+
+  bool TieredStorageArea::HasReadRange() const
+  {
+    // Ranges are emulated if neither of the storage areas supports them
+    return true;
+  }
+
+
+  void TieredStorageArea::Remove(const std::string& uuid,
+                                 FileContentType type)
+  {
+    std::unique_ptr<boost::mutex::scoped_lock> flushLock;
+
+    if (writePolicy_ == WritePolicy_WriteBack)
+    {
+      flushLock.reset(new boost::mutex::scoped_lock(flushMutex_));
+    }
+
+    bool isLocal = false;
+    bool isDirty = false;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Entries::iterator found = entries_.find(uuid);
+      if (found != entries_.end())
+      {
+        // If the file is not ready, "AddToLocal()" will remove it
+        isLocal = found->second->IsReady();
+        isDirty = found->second->IsDirty();
+        EraseEntry(found);
+        PublishMetrics();
+      }
+    }
+
+    if (isLocal)
+    {
+      local_->Remove(uuid, type);
+    }
+
+    if (isDirty)
+    {
+      // Files that are not flushed yet don't exist in the remote area
+      RemoveContentType(uuid);
+    }
+    else
+    {
+      remote_->Remove(uuid, type);
+    }
+  }
+}
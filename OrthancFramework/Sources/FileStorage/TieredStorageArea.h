@@ -0,0 +1,250 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../OrthancFramework.h"
+
+#if !defined(ORTHANC_SANDBOXED)
+#  error The macro ORTHANC_SANDBOXED must be defined
+#endif
+
+#if ORTHANC_SANDBOXED == 1
+#  error The class TieredStorageArea cannot be used in sandboxed environments
+#endif
+
+#include "IStorageArea.h"
+#include "../Compatibility.h"  // For ORTHANC_OVERRIDE and std::unique_ptr
+#include "../MetricsRegistry.h"
+#include "../MultiThreading/SharedMessageQueue.h"
+
+#include <boost/thread.hpp>
+#include <list>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+namespace Orthanc
+{
+  /**
+   * Decorator that keeps a size-bounded copy of the most useful
+   * attachments of a slow storage area (e.g. a network filesystem
+   * or an object store provided by a plugin) inside a fast local
+   * storage area (typically a "FilesystemStorage" on a SSD). The
+   * local tier is a cache: Its content is not persistent across
+   * restarts, except for the files that have not been flushed yet to
+   * the remote storage area in write-back mode. The content type of
+   * such files is stored in a separate directory, so that they can
+   * be uploaded with their original content type after a crash.
+   **/
+  class ORTHANC_PUBLIC TieredStorageArea : public IStorageArea
+  {
+  public:
+    enum EvictionPolicy
+    {
+      EvictionPolicy_LeastRecentlyUsed,
+      EvictionPolicy_LeastFrequentlyUsed
+    };
+
+    enum WritePolicy
+    {
+      // "Create()" returns once the file is stored in the remote area
+      WritePolicy_WriteThrough,
+
+      // "Create()" returns once the file is stored in the local tier,
+      // and the file is uploaded to the remote area by a background
+      // thread. This is faster, but files that are not flushed yet
+      // are lost if the local disk fails.
+      WritePolicy_WriteBack
+    };
+
+  private:
+    class Entry;
+
+    typedef std::map<std::string, Entry*>                 Entries;
+    typedef std::pair<uint64_t, uint64_t>                 Priority;
+    typedef std::map<Priority, std::string>               EvictionQueue;
+    typedef std::list< std::pair<std::string, FileContentType> >  Victims;
+
+    std::unique_ptr<IStorageArea>  remote_;
+    std::unique_ptr<IStorageArea>  local_;
+    uint64_t                       maximumSize_;
+    EvictionPolicy                 evictionPolicy_;
+    WritePolicy                    writePolicy_;
+
+    boost::mutex      mutex_;
+    Entries           entries_;
+    EvictionQueue     evictionQueue_;  // Only contains the clean files
+    uint64_t          currentSize_;
+    uint64_t          dirtySize_;
+    uint64_t          tick_;
+    uint64_t          hits_;
+    uint64_t          misses_;
+    MetricsRegistry*  metricsRegistry_;
+
+    boost::mutex        flushMutex_;
+    SharedMessageQueue  flushQueue_;
+    bool                flushDone_;
+    boost::thread       flushThread_;
+
+    std::string         contentTypesDirectory_;  // Empty if the content types are not stored
+
+    Priority GetPriority(const Entry& entry) const;
+
+    void MakeEvictable(const std::string& uuid,
+                       Entry& entry);
+
+    void Touch(const std::string& uuid,
+               Entry& entry);
+
+    void EraseEntry(Entries::iterator entry);
+
+    void EnforceMaximumSize(Victims& victims);
+
+    void RemoveVictims(const Victims& victims);
+
+    void PublishMetrics();
+
+    bool LookupLocal(const std::string& uuid);
+
+    bool AddToLocal(const std::string& uuid,
+                    const void* content,
+                    size_t size,
+                    FileContentType type,
+                    bool dirty);
+
+    IMemoryBuffer* ReadThrough(const std::string& uuid,
+                               FileContentType type);
+
+    bool IsInRemote(const std::string& uuid,
+                    FileContentType type);
+
+    std::string GetContentTypePath(const std::string& uuid) const;
+
+    void WriteContentType(const std::string& uuid,
+                          FileContentType type);
+
+    void RemoveContentType(const std::string& uuid);
+
+    void ReadContentTypes(std::map<std::string, FileContentType>& target,
+                          std::set<std::string>& corrupted) const;
+
+    void UploadRecoveredFile(const std::string& uuid,
+                             FileContentType type,
+                             const IMemoryBuffer& content);
+
+    bool FlushFile(const std::string& uuid);
+
+    static void FlushThread(TieredStorageArea* that);
+
+  public:
+    /**
+     * The "remote" and "local" storage areas are owned by the newly
+     * created object. The files that are already present in the
+     * "local" storage area (i.e. left by a previous execution) must
+     * be given to "RecoverLocalFiles()" before serving requests. In
+     * write-back mode, the destructor removes the local copies of the
+     * files that were successfully uploaded.
+     **/
+    TieredStorageArea(IStorageArea* remote,
+                      IStorageArea* local,
+                      uint64_t maximumSize,
+                      EvictionPolicy evictionPolicy,
+                      WritePolicy writePolicy);
+
+    virtual ~TieredStorageArea();
+
+    // The registry must outlive this object, or be reset to NULL
+    void SetMetricsRegistry(MetricsRegistry* registry);
+
+    uint64_t GetMaximumSize() const
+    {
+      return maximumSize_;
+    }
+
+    EvictionPolicy GetEvictionPolicy() const
+    {
+      return evictionPolicy_;
+    }
+
+    WritePolicy GetWritePolicy() const
+    {
+      return writePolicy_;
+    }
+
+    void GetStatistics(uint64_t& hits,
+                       uint64_t& misses,
+                       uint64_t& currentSize,
+                       uint64_t& dirtySize,
+                       size_t& countFiles);
+
+    // Synchronously upload the files that are pending in write-back mode
+    void FlushPendingWrites();
+
+    /**
+     * Sets the directory where the content type of the files that
+     * are not flushed yet is stored (one small file per attachment).
+     * Must be called before "RecoverLocalFiles()" and before the
+     * first write. Without such a directory, the files left in the
+     * local tier by the write-back mode cannot be recovered.
+     **/
+    void SetContentTypesDirectory(const std::string& directory);
+
+    /**
+     * To be called once at startup, with the list of the files that
+     * are stored in the "local" storage area by a previous execution.
+     * If "pendingWrites" is "false", these files are known to be
+     * copies of files of the remote area (i.e. the local tier was
+     * last used in write-through mode), and they are removed.
+     * Otherwise (i.e. the local tier was last used in write-back
+     * mode), the files whose content type was stored might have
+     * never been uploaded: In write-back mode, they are scheduled for
+     * upload, and in write-through mode, they are synchronously
+     * uploaded then removed, an exception being thrown if some upload
+     * fails. The other files are copies of the remote area, and are
+     * removed. An exception is thrown if the content types are not
+     * stored (cf. "SetContentTypesDirectory()"), as uploading a file
+     * with a wrong content type could make it unreachable.
+     **/
+    void RecoverLocalFiles(const std::set<std::string>& uuids,
+                           bool pendingWrites);
+
+    virtual void Create(const std::string& uuid,
+                        const void* content, 
+                        size_t size,
+                        FileContentType type) ORTHANC_OVERRIDE;
+
+    virtual IMemoryBuffer* Read(const std::string& uuid,
+                                FileContentType type) ORTHANC_OVERRIDE;
+
+    virtual IMemoryBuffer* ReadRange(const std::string& uuid,
+                                     FileContentType type,
+                                     uint64_t start /* inclusive */,
+                                     uint64_t end /* exclusive */) ORTHANC_OVERRIDE;
+
+    virtual bool HasReadRange() const ORTHANC_OVERRIDE;
+
+    virtual void Remove(const std::string& uuid,
+                        FileContentType type) ORTHANC_OVERRIDE;
+  };
+}
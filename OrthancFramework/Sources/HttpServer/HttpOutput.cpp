@@ -54,7 +54,8 @@ namespace Orthanc
     hasContentLength_(false),
     contentLength_(0),
     contentPosition_(0),
-    keepAlive_(isKeepAlive)
+    keepAlive_(isKeepAlive),
+    sentBodySize_(0)
   {
   }
 
@@ -73,6 +74,19 @@ namespace Orthanc
   }
 
 
+  void HttpOutput::StateMachine::SendToStream(bool isHeader,
+                                              const void* buffer,
+                                              size_t length)
+  {
+    stream_.Send(isHeader, buffer, length);
+
+    if (!isHeader)
+    {
+      sentBodySize_ += length;
+    }
+  }
+
+
   void HttpOutput::StateMachine::SetHttpStatus(HttpStatus status)
   {
     if (state_ != State_WritingHeader)
@@ -210,7 +224,7 @@ namespace Orthanc
       uint64_t contentLength = (hasContentLength_ ? contentLength_ : length);
       s += "Content-Length: " + boost::lexical_cast<std::string>(contentLength) + "\r\n\r\n";
 
-      stream_.Send(true, s.c_str(), s.size());
+      SendToStream(true, s.c_str(), s.size());
       state_ = State_WritingBody;
     }
 
@@ -223,7 +237,7 @@ namespace Orthanc
 
     if (length > 0)
     {
-      stream_.Send(false, buffer, length);
+      SendToStream(false, buffer, length);
       contentPosition_ += length;
     }
 
@@ -446,44 +460,76 @@ namespace Orthanc
       return;
     }
 
-    std::string compressed, encoding;
+    std::string compressed;
+    Compress(compressed, buffer, length, compression);
+
+    AnswerPrecompressed(compressed.empty() ? NULL : compressed.c_str(), compressed.size(), compression);
+  }
 
+
+  static const char* GetContentEncoding(HttpCompression compression)
+  {
+    switch (compression)
+    {
+      case HttpCompression_Deflate:
+        return "deflate";
+
+      case HttpCompression_Gzip:
+        return "gzip";
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  void HttpOutput::Compress(std::string& target,
+                            const void* buffer,
+                            size_t length,
+                            HttpCompression compression)
+  {
     switch (compression)
     {
       case HttpCompression_Deflate:
       {
-        encoding = "deflate";
         ZlibCompressor compressor;
         // Do not prefix the buffer with its uncompressed size, to be compatible with "deflate"
         compressor.SetPrefixWithUncompressedSize(false);  
-        compressor.Compress(compressed, buffer, length);
+        compressor.Compress(target, buffer, length);
         break;
       }
 
       case HttpCompression_Gzip:
       {
-        encoding = "gzip";
         GzipCompressor compressor;
-        compressor.Compress(compressed, buffer, length);
+        compressor.Compress(target, buffer, length);
         break;
       }
 
       default:
-        throw OrthancException(ErrorCode_InternalError);
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
     }
+  }
+
+
+  void HttpOutput::AnswerPrecompressed(const void* buffer,
+                                       size_t length,
+                                       HttpCompression compression)
+  {
+    const char* encoding = GetContentEncoding(compression);
 
-    LOG(TRACE) << "Compressing a HTTP answer using " << encoding;
+    LOG(TRACE) << "Sending a HTTP answer compressed using " << encoding;
 
     // The body is empty, do not use HTTP compression
-    if (compressed.size() == 0)
+    if (length == 0)
     {
       AnswerEmpty();
     }
     else
     {
       stateMachine_.AddHeader("Content-Encoding", encoding);
-      stateMachine_.SetContentLength(compressed.size());
-      stateMachine_.SendBody(compressed.c_str(), compressed.size());
+      stateMachine_.SetContentLength(length);
+      stateMachine_.SendBody(buffer, length);
     }
 
     stateMachine_.CloseBody();
@@ -628,7 +674,7 @@ namespace Orthanc
 
     header += ("Content-Type: " + contentType + "\r\n\r\n");
 
-    stream_.Send(true, header.c_str(), header.size());
+    SendToStream(true, header.c_str(), header.size());
   }
 
 
@@ -718,14 +764,14 @@ namespace Orthanc
 
     std::string header;
     PrepareMultipartItemHeader(header, length, headers, multipartBoundary_, multipartContentType_);
-    stream_.Send(false, header.c_str(), header.size());
+    SendToStream(false, header.c_str(), header.size());
 
     if (length > 0)
     {
-      stream_.Send(false, item, length);
+      SendToStream(false, item, length);
     }
 
-    stream_.Send(false, "\r\n", 2);    
+    SendToStream(false, "\r\n", 2);    
   }
 
 
@@ -741,7 +787,7 @@ namespace Orthanc
     try
     {
       std::string header = "--" + multipartBoundary_ + "--\r\n";
-      stream_.Send(false, header.c_str(), header.size());
+      SendToStream(false, header.c_str(), header.size());
     }
     catch (OrthancException&)
     {
@@ -762,7 +808,7 @@ namespace Orthanc
     {
       if (size > 0)
       {
-        stream_.Send(false, data, size);
+        SendToStream(false, data, size);
       }
     }
   }
@@ -62,12 +62,17 @@ namespace Orthanc
       uint64_t contentPosition_;
       bool keepAlive_;
       std::list<std::string> headers_;
+      uint64_t sentBodySize_;
 
       std::string multipartBoundary_;
       std::string multipartContentType_;
 
       void StartStreamInternal(const std::string& contentType);
 
+      void SendToStream(bool isHeader,
+                        const void* buffer,
+                        size_t length);
+
     public:
       StateMachine(IHttpOutputStream& stream,
                    bool isKeepAlive);
@@ -108,6 +113,16 @@ namespace Orthanc
         return state_;
       }
 
+      HttpStatus GetHttpStatus() const
+      {
+        return status_;
+      }
+
+      uint64_t GetSentBodySize() const
+      {
+        return sentBodySize_;
+      }
+
       void CheckHeadersCompatibilityWithMultipart() const;
 
       void StartStream(const std::string& contentType);
@@ -122,8 +137,6 @@ namespace Orthanc
     bool         isDeflateAllowed_;
     bool         isGzipAllowed_;
 
-    HttpCompression GetPreferredCompression(size_t bodySize) const;
-
   public:
     HttpOutput(IHttpOutputStream& stream,
                bool isKeepAlive);
@@ -136,6 +149,27 @@ namespace Orthanc
 
     bool IsGzipAllowed() const;
 
+    HttpCompression GetPreferredCompression(size_t bodySize) const;
+
+    // HTTP status of the answer, and number of bytes of its body that
+    // were sent so far, for the metrics (new in Orthanc 1.11.3)
+    HttpStatus GetHttpStatus() const
+    {
+      return stateMachine_.GetHttpStatus();
+    }
+
+    uint64_t GetSentBodySize() const
+    {
+      return stateMachine_.GetSentBodySize();
+    }
+
+    // Compress a body using the "Content-Encoding" associated with
+    // "compression" (new in Orthanc 1.11.3)
+    static void Compress(std::string& target,
+                         const void* buffer,
+                         size_t length,
+                         HttpCompression compression);
+
     void SendStatus(HttpStatus status,
 		    const char* message,
 		    size_t messageSize);
@@ -164,6 +198,16 @@ namespace Orthanc
 
     void AnswerEmpty();
 
+    /**
+     * Answer with a body that was already compressed by "Compress()",
+     * which is typically retrieved from a cache (new in Orthanc
+     * 1.11.3). The "compression" must be the one that is returned by
+     * "GetPreferredCompression()".
+     **/
+    void AnswerPrecompressed(const void* buffer,
+                             size_t length,
+                             HttpCompression compression);
+
     void SendMethodNotAllowed(const std::string& allowed);
 
     void Redirect(const std::string& path);
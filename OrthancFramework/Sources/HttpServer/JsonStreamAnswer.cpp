@@ -0,0 +1,191 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "JsonStreamAnswer.h"
+
+#include "../OrthancException.h"
+#include "../Toolbox.h"
+
+
+namespace Orthanc
+{
+  static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;  // 64KB
+
+
+  static void WriteCompactJson(std::string& target,
+                               const Json::Value& source)
+  {
+    Toolbox::WriteFastJson(target, source);
+
+    // Remove the trailing newline that is added by "Json::FastWriter"
+    while (!target.empty() &&
+           target[target.size() - 1] == '\n')
+    {
+      target.resize(target.size() - 1);
+    }
+  }
+
+
+  void JsonStreamAnswer::AppendItem(const std::string& key,
+                                    const Json::Value& item)
+  {
+    if (hasItems_)
+    {
+      chunk_ += ",";
+    }
+
+    std::string s;
+
+    if (isObject_)
+    {
+      WriteCompactJson(s, key);
+      chunk_ += s + ":";
+    }
+
+    WriteCompactJson(s, item);
+    chunk_ += s;
+
+    hasItems_ = true;
+  }
+
+
+  JsonStreamAnswer::JsonStreamAnswer(IItemsSource& source,
+                                     bool isObject) :
+    source_(source),
+    isObject_(isObject),
+    chunkSize_(DEFAULT_CHUNK_SIZE),
+    state_(State_Start),
+    hasItems_(false)
+  {
+  }
+
+
+  void JsonStreamAnswer::SetChunkSize(size_t chunkSize)
+  {
+    chunkSize_ = chunkSize;
+  }
+
+
+  void JsonStreamAnswer::Flatten(Json::Value& target)
+  {
+    if (state_ != State_Start)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    target = (isObject_ ? Json::objectValue : Json::arrayValue);
+
+    std::string key;
+    Json::Value item;
+    while (source_.ReadNextItem(key, item))
+    {
+      if (isObject_)
+      {
+        target[key].swap(item);
+      }
+      else
+      {
+        target.append(Json::nullValue).swap(item);
+      }
+    }
+
+    state_ = State_Done;
+  }
+
+
+  HttpCompression JsonStreamAnswer::SetupHttpCompression(bool gzipAllowed,
+                                                         bool deflateAllowed)
+  {
+    return HttpCompression_None;
+  }
+
+
+  std::string JsonStreamAnswer::GetContentType()
+  {
+    return MIME_JSON_UTF8;
+  }
+
+
+  uint64_t JsonStreamAnswer::GetContentLength()
+  {
+    // The length is unknown until all the items have been produced
+    throw OrthancException(ErrorCode_BadSequenceOfCalls,
+                           "A JSON stream must be sent without buffering");
+  }
+
+
+  bool JsonStreamAnswer::ReadNextChunk()
+  {
+    chunk_.clear();
+
+    switch (state_)
+    {
+      case State_Start:
+        chunk_ = (isObject_ ? "{" : "[");
+        state_ = State_Items;
+        break;
+
+      case State_Items:
+        break;
+
+      case State_Done:
+        return false;
+
+      default:
+        throw OrthancException(ErrorCode_InternalError);
+    }
+
+    std::string key;
+    Json::Value item;
+
+    do
+    {
+      if (source_.ReadNextItem(key, item))
+      {
+        AppendItem(key, item);
+      }
+      else
+      {
+        chunk_ += (isObject_ ? "}\n" : "]\n");
+        state_ = State_Done;
+      }
+    }
+    while (state_ == State_Items &&
+           chunk_.size() < chunkSize_);
+
+    return true;
+  }
+
+
+  const char* JsonStreamAnswer::GetChunkContent()
+  {
+    return chunk_.c_str();
+  }
+
+
+  size_t JsonStreamAnswer::GetChunkSize()
+  {
+    return chunk_.size();
+  }
+}
@@ -0,0 +1,121 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "IHttpStreamAnswer.h"
+#include "../Compatibility.h"  // For ORTHANC_OVERRIDE
+
+#include <json/value.h>
+
+namespace Orthanc
+{
+  /**
+   * Streams a JSON array (or a JSON object) whose items are produced
+   * one by one by a source, so that the full answer never has to be
+   * stored in memory. The items are written using the compact JSON
+   * syntax, and are grouped into chunks of approximately
+   * "chunkSize" bytes. As the length of the answer is not known in
+   * advance, this class must be sent using
+   * "HttpOutput::AnswerWithoutBuffering()".
+   **/
+  class ORTHANC_PUBLIC JsonStreamAnswer : public IHttpStreamAnswer
+  {
+  public:
+    class IItemsSource : public boost::noncopyable
+    {
+    public:
+      virtual ~IItemsSource()
+      {
+      }
+
+      /**
+       * Returns "false" once all the items have been read. The "key"
+       * is only used if streaming a JSON object.
+       **/
+      virtual bool ReadNextItem(std::string& key,
+                                Json::Value& item) = 0;
+    };
+
+  private:
+    enum State
+    {
+      State_Start,
+      State_Items,
+      State_Done
+    };
+
+    IItemsSource&  source_;
+    bool           isObject_;
+    size_t         chunkSize_;
+    State          state_;
+    bool           hasItems_;
+    std::string    chunk_;
+
+    void AppendItem(const std::string& key,
+                    const Json::Value& item);
+
+  public:
+    JsonStreamAnswer(IItemsSource& source,
+                     bool isObject);
+
+    bool IsObject() const
+    {
+      return isObject_;
+    }
+
+    // Approximate size of the chunks, for test purpose. If set to
+    // "0", each item is sent in a separate chunk.
+    void SetChunkSize(size_t chunkSize);
+
+    /**
+     * Read all the items at once into a JSON value, instead of
+     * streaming them. This is used if the answer must be converted
+     * (e.g. to XML), or if it is small enough to be buffered.
+     **/
+    void Flatten(Json::Value& target);
+
+
+    /**
+     * Implementation of the IHttpStreamAnswer interface.
+     **/
+
+    virtual HttpCompression SetupHttpCompression(bool gzipAllowed,
+                                                 bool deflateAllowed) ORTHANC_OVERRIDE;
+
+    virtual bool HasContentFilename(std::string& filename) ORTHANC_OVERRIDE
+    {
+      return false;
+    }
+
+    virtual std::string GetContentType() ORTHANC_OVERRIDE;
+
+    virtual uint64_t GetContentLength() ORTHANC_OVERRIDE;
+
+    virtual bool ReadNextChunk() ORTHANC_OVERRIDE;
+
+    virtual const char* GetChunkContent() ORTHANC_OVERRIDE;
+
+    virtual size_t GetChunkSize() ORTHANC_OVERRIDE;
+  };
+}
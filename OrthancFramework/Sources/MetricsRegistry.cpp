@@ -28,6 +28,10 @@
 #include "Compatibility.h"
 #include "OrthancException.h"
 
+#include <iomanip>
+#include <locale>
+#include <sstream>
+
 namespace Orthanc
 {
   static const boost::posix_time::ptime GetNow()
@@ -167,6 +171,291 @@ namespace Orthanc
   };
 
 
+  static std::string FormatValue(double value)
+  {
+    std::ostringstream s;
+    s.imbue(std::locale::classic());
+    s << std::setprecision(15) << value;
+    return s.str();
+  }
+
+
+  static std::string FormatLabels(const MetricsRegistry::Labels& labels)
+  {
+    // https://prometheus.io/docs/instrumenting/exposition_formats/#comments-help-text-and-type-information
+    std::string s;
+
+    for (MetricsRegistry::Labels::const_iterator it = labels.begin(); it != labels.end(); ++it)
+    {
+      if (!s.empty())
+      {
+        s += ",";
+      }
+
+      s += it->first + "=\"";
+
+      for (size_t i = 0; i < it->second.size(); i++)
+      {
+        switch (it->second[i])
+        {
+          case '\\':
+            s += "\\\\";
+            break;
+
+          case '"':
+            s += "\\\"";
+            break;
+
+          case '\n':
+            s += "\\n";
+            break;
+
+          default:
+            s += it->second[i];
+        }
+      }
+
+      s += "\"";
+    }
+
+    return s;
+  }
+
+
+  class MetricsRegistry::Family : public boost::noncopyable
+  {
+  private:
+    struct Series
+    {
+      double                 value_;         // Sum of the observations for histograms
+      uint64_t               count_;
+      std::vector<uint64_t>  bucketsCount_;  // Not cumulative
+
+      Series() :
+        value_(0),
+        count_(0)
+      {
+      }
+    };
+
+    // The key of the time series is made of their formatted labels
+    typedef std::map<std::string, Series>  AllSeries;
+
+    FamilyType           type_;
+    std::vector<double>  buckets_;
+    AllSeries            series_;
+
+    Series& GetSeries(const Labels& labels)
+    {
+      const std::string key = FormatLabels(labels);
+
+      AllSeries::iterator found = series_.find(key);
+      if (found == series_.end())
+      {
+        Series& series = series_[key];
+        series.bucketsCount_.resize(buckets_.size(), 0);
+        return series;
+      }
+      else
+      {
+        return found->second;
+      }
+    }
+
+    const Series* LookupSeries(const Labels& labels) const
+    {
+      AllSeries::const_iterator found = series_.find(FormatLabels(labels));
+      if (found == series_.end())
+      {
+        return NULL;
+      }
+      else
+      {
+        return &found->second;
+      }
+    }
+
+    static void AddLine(ChunkedBuffer& buffer,
+                        const std::string& name,
+                        const std::string& labels,
+                        const std::string& value)
+    {
+      if (labels.empty())
+      {
+        buffer.AddChunk(name + " " + value + "\n");
+      }
+      else
+      {
+        buffer.AddChunk(name + "{" + labels + "} " + value + "\n");
+      }
+    }
+
+  public:
+    explicit Family(FamilyType type) :
+      type_(type)
+    {
+      if (type_ == FamilyType_Histogram)
+      {
+        GetDefaultHistogramBuckets(buckets_);
+      }
+    }
+
+    FamilyType GetType() const
+    {
+      return type_;
+    }
+
+    void SetBuckets(const std::vector<double>& buckets)
+    {
+      assert(type_ == FamilyType_Histogram);
+
+      for (size_t i = 1; i < buckets.size(); i++)
+      {
+        if (buckets[i - 1] >= buckets[i])
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange,
+                                 "The buckets of a histogram must be sorted in increasing order");
+        }
+      }
+
+      if (buckets != buckets_)
+      {
+        buckets_ = buckets;
+        series_.clear();
+      }
+    }
+
+    void Add(const Labels& labels,
+             double delta)
+    {
+      assert(type_ != FamilyType_Histogram);
+
+      if (type_ == FamilyType_Counter &&
+          delta < 0)
+      {
+        throw OrthancException(ErrorCode_ParameterOutOfRange,
+                               "A Prometheus counter cannot decrease");
+      }
+
+      Series& series = GetSeries(labels);
+      series.value_ += delta;
+    }
+
+    void Observe(const Labels& labels,
+                 double value)
+    {
+      assert(type_ == FamilyType_Histogram);
+
+      Series& series = GetSeries(labels);
+      series.value_ += value;
+      series.count_++;
+
+      for (size_t i = 0; i < buckets_.size(); i++)
+      {
+        if (value <= buckets_[i])
+        {
+          series.bucketsCount_[i]++;
+          break;
+        }
+      }
+    }
+
+    bool LookupValue(double& value,
+                     const Labels& labels) const
+    {
+      const Series* series = LookupSeries(labels);
+      if (series == NULL)
+      {
+        return false;
+      }
+      else
+      {
+        value = series->value_;
+        return true;
+      }
+    }
+
+    bool LookupHistogram(std::vector<uint64_t>& bucketsCount,
+                         uint64_t& count,
+                         double& sum,
+                         const Labels& labels) const
+    {
+      const Series* series = LookupSeries(labels);
+      if (series == NULL)
+      {
+        return false;
+      }
+      else
+      {
+        bucketsCount.resize(buckets_.size());
+
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < buckets_.size(); i++)
+        {
+          cumulative += series->bucketsCount_[i];
+          bucketsCount[i] = cumulative;
+        }
+
+        count = series->count_;
+        sum = series->value_;
+        return true;
+      }
+    }
+
+    void Export(ChunkedBuffer& buffer,
+                const std::string& name) const
+    {
+      if (series_.empty())
+      {
+        return;
+      }
+
+      switch (type_)
+      {
+        case FamilyType_Counter:
+          buffer.AddChunk("# TYPE " + name + " counter\n");
+          break;
+
+        case FamilyType_Gauge:
+          buffer.AddChunk("# TYPE " + name + " gauge\n");
+          break;
+
+        case FamilyType_Histogram:
+          buffer.AddChunk("# TYPE " + name + " histogram\n");
+          break;
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
+
+      for (AllSeries::const_iterator it = series_.begin(); it != series_.end(); ++it)
+      {
+        if (type_ == FamilyType_Histogram)
+        {
+          const std::string prefix = (it->first.empty() ? "" : it->first + ",");
+
+          uint64_t cumulative = 0;
+          for (size_t i = 0; i < buckets_.size(); i++)
+          {
+            cumulative += it->second.bucketsCount_[i];
+            AddLine(buffer, name + "_bucket", prefix + "le=\"" + FormatValue(buckets_[i]) + "\"",
+                    boost::lexical_cast<std::string>(cumulative));
+          }
+
+          AddLine(buffer, name + "_bucket", prefix + "le=\"+Inf\"",
+                  boost::lexical_cast<std::string>(it->second.count_));
+          AddLine(buffer, name + "_sum", it->first, FormatValue(it->second.value_));
+          AddLine(buffer, name + "_count", it->first, boost::lexical_cast<std::string>(it->second.count_));
+        }
+        else
+        {
+          AddLine(buffer, name, it->first, FormatValue(it->second.value_));
+        }
+      }
+    }
+  };
+
+
   MetricsRegistry::~MetricsRegistry()
   {
     for (Content::iterator it = content_.begin(); it != content_.end(); ++it)
@@ -174,6 +463,12 @@ namespace Orthanc
       assert(it->second != NULL);
       delete it->second;
     }
+
+    for (Families::iterator it = families_.begin(); it != families_.end(); ++it)
+    {
+      assert(it->second != NULL);
+      delete it->second;
+    }
   }
 
   bool MetricsRegistry::IsEnabled() const
@@ -277,6 +572,124 @@ namespace Orthanc
   }
 
 
+  MetricsRegistry::Family& MetricsRegistry::GetFamily(const std::string& name,
+                                                      FamilyType type)
+  {
+    // The mutex must be locked by the caller
+    Families::iterator found = families_.find(name);
+
+    if (found == families_.end())
+    {
+      Family* family = new Family(type);
+      families_[name] = family;
+      return *family;
+    }
+    else
+    {
+      assert(found->second != NULL);
+
+      if (found->second->GetType() != type)
+      {
+        throw OrthancException(ErrorCode_BadParameterType,
+                               "Another type of metrics is already registered with name: " + name);
+      }
+
+      return *found->second;
+    }
+  }
+
+
+  void MetricsRegistry::IncrementCounter(const std::string& name,
+                                         const Labels& labels,
+                                         double delta)
+  {
+    if (enabled_)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      GetFamily(name, FamilyType_Counter).Add(labels, delta);
+    }
+  }
+
+
+  void MetricsRegistry::AddToGauge(const std::string& name,
+                                   const Labels& labels,
+                                   double delta)
+  {
+    if (enabled_)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      GetFamily(name, FamilyType_Gauge).Add(labels, delta);
+    }
+  }
+
+
+  void MetricsRegistry::RegisterHistogram(const std::string& name,
+                                          const std::vector<double>& buckets)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    GetFamily(name, FamilyType_Histogram).SetBuckets(buckets);
+  }
+
+
+  void MetricsRegistry::ObserveHistogram(const std::string& name,
+                                         const Labels& labels,
+                                         double value)
+  {
+    if (enabled_)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      GetFamily(name, FamilyType_Histogram).Observe(labels, value);
+    }
+  }
+
+
+  void MetricsRegistry::GetDefaultHistogramBuckets(std::vector<double>& target)
+  {
+    static const double BUCKETS[] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+    target.assign(BUCKETS, BUCKETS + sizeof(BUCKETS) / sizeof(double));
+  }
+
+
+  bool MetricsRegistry::LookupLabeledValue(double& value,
+                                           const std::string& name,
+                                           const Labels& labels)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Families::const_iterator found = families_.find(name);
+    if (found == families_.end() ||
+        found->second->GetType() == FamilyType_Histogram)
+    {
+      return false;
+    }
+    else
+    {
+      return found->second->LookupValue(value, labels);
+    }
+  }
+
+
+  bool MetricsRegistry::LookupHistogram(std::vector<uint64_t>& bucketsCount,
+                                        uint64_t& count,
+                                        double& sum,
+                                        const std::string& name,
+                                        const Labels& labels)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Families::const_iterator found = families_.find(name);
+    if (found == families_.end() ||
+        found->second->GetType() != FamilyType_Histogram)
+    {
+      return false;
+    }
+    else
+    {
+      return found->second->LookupHistogram(bucketsCount, count, sum, labels);
+    }
+  }
+
+
   void MetricsRegistry::ExportPrometheusText(std::string& s)
   {
     // https://www.boost.org/doc/libs/1_69_0/doc/html/date_time/examples.html#date_time.examples.seconds_since_epoch
@@ -310,6 +723,12 @@ namespace Orthanc
       }
     }
 
+    for (Families::const_iterator it = families_.begin(); it != families_.end(); ++it)
+    {
+      assert(it->second != NULL);
+      it->second->Export(buffer, it->first);
+    }
+
     buffer.Flatten(s);
   }
 
@@ -36,6 +36,9 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <map>
+#include <vector>
+
 namespace Orthanc
 {
   enum MetricsType
@@ -49,19 +52,36 @@ namespace Orthanc
   
   class ORTHANC_PUBLIC MetricsRegistry : public boost::noncopyable
   {
+  public:
+    // Name and value of the Prometheus labels of one time series
+    typedef std::map<std::string, std::string>  Labels;
+
   private:
+    enum FamilyType
+    {
+      FamilyType_Counter,
+      FamilyType_Gauge,
+      FamilyType_Histogram
+    };
+
     class Item;
+    class Family;
 
-    typedef std::map<std::string, Item*>   Content;
+    typedef std::map<std::string, Item*>    Content;
+    typedef std::map<std::string, Family*>  Families;
 
     bool          enabled_;
     boost::mutex  mutex_;
     Content       content_;
+    Families      families_;
 
     void SetValueInternal(const std::string& name,
                           float value,
                           MetricsType type);
 
+    Family& GetFamily(const std::string& name,
+                      FamilyType type);
+
   public:
     MetricsRegistry();
 
@@ -83,6 +103,45 @@ namespace Orthanc
 
     MetricsType GetMetricsType(const std::string& name);
 
+    /**
+     * The following methods deal with Prometheus counters, gauges and
+     * histograms whose time series are identified by labels (new in
+     * Orthanc 1.11.3). Contrarily to "SetValue()", these metrics are
+     * cumulative, and are not associated with a timestamp.
+     **/
+    void IncrementCounter(const std::string& name,
+                          const Labels& labels,
+                          double delta);
+
+    void AddToGauge(const std::string& name,
+                    const Labels& labels,
+                    double delta);
+
+    // The "buckets" are the upper bounds of the bins, without "+Inf"
+    void RegisterHistogram(const std::string& name,
+                           const std::vector<double>& buckets);
+
+    // Histograms that are not registered use the default buckets
+    void ObserveHistogram(const std::string& name,
+                          const Labels& labels,
+                          double value);
+
+    // The default buckets of the Prometheus client libraries, that
+    // are suitable for durations expressed in seconds
+    static void GetDefaultHistogramBuckets(std::vector<double>& target);
+
+    // Returns "false" if the counter or the gauge has no such time series
+    bool LookupLabeledValue(double& value,
+                            const std::string& name,
+                            const Labels& labels);
+
+    // Returns "false" if the histogram has no such time series
+    bool LookupHistogram(std::vector<uint64_t>& bucketsCount /* cumulative, without "+Inf" */,
+                         uint64_t& count,
+                         double& sum,
+                         const std::string& name,
+                         const Labels& labels);
+
     // https://prometheus.io/docs/instrumenting/exposition_formats/#text-based-format
     void ExportPrometheusText(std::string& s);
 
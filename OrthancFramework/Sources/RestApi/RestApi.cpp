@@ -26,6 +26,7 @@
 
 #include "../HttpServer/StringHttpOutput.h"
 #include "../Logging.h"
+#include "../MetricsRegistry.h"
 #include "../OrthancException.h"
 
 #include <boost/algorithm/string/replace.hpp>
@@ -38,6 +39,221 @@ namespace Orthanc
   namespace
   {
     // Anonymous namespace to avoid clashes between compilation modules
+
+    /**
+     * Records the metrics of one call to a route of the REST API. The
+     * route is identified by the path that was used to register its
+     * handler (e.g. "/instances/{id}/file"), which keeps the number
+     * of time series bounded.
+     **/
+    class RouteMetrics : public boost::noncopyable
+    {
+    private:
+      MetricsRegistry&          registry_;
+      HttpOutput*               output_;
+      MetricsRegistry::Labels   labels_;
+      boost::posix_time::ptime  start_;
+      bool                      hasErrorStatus_;
+      HttpStatus                errorStatus_;
+
+    public:
+      RouteMetrics(MetricsRegistry& registry,
+                   HttpMethod method,
+                   const std::string& route) :
+        registry_(registry),
+        output_(NULL),
+        start_(boost::posix_time::microsec_clock::universal_time()),
+        hasErrorStatus_(false),
+        errorStatus_(HttpStatus_500_InternalServerError)
+      {
+        labels_["method"] = EnumerationToString(method);
+        labels_["route"] = route;
+
+        registry_.AddToGauge("orthanc_rest_api_requests_in_flight", labels_, 1);
+        registry_.IncrementCounter("orthanc_rest_api_request_bytes_total", labels_, 0);
+      }
+
+      ~RouteMetrics()
+      {
+        try
+        {
+          const boost::posix_time::time_duration duration =
+            boost::posix_time::microsec_clock::universal_time() - start_;
+
+          registry_.AddToGauge("orthanc_rest_api_requests_in_flight", labels_, -1);
+          registry_.ObserveHistogram("orthanc_rest_api_request_duration_seconds", labels_,
+                                     static_cast<double>(duration.total_microseconds()) / 1000000.0);
+          registry_.IncrementCounter("orthanc_rest_api_response_bytes_total", labels_,
+                                     output_ == NULL ? 0 : static_cast<double>(output_->GetSentBodySize()));
+
+          HttpStatus status;
+          if (hasErrorStatus_)
+          {
+            status = errorStatus_;
+          }
+          else if (output_ != NULL)
+          {
+            status = output_->GetHttpStatus();
+          }
+          else
+          {
+            // The body of a chunked request could not be read
+            status = HttpStatus_400_BadRequest;
+          }
+
+          MetricsRegistry::Labels labels = labels_;
+          labels["status"] = boost::lexical_cast<std::string>(status);
+          registry_.IncrementCounter("orthanc_rest_api_requests_total", labels, 1);
+        }
+        catch (OrthancException& e)
+        {
+          LOG(ERROR) << "Cannot update the metrics of the REST API: " << e.What();
+        }
+      }
+
+      void AddRequestBytes(size_t size)
+      {
+        registry_.IncrementCounter("orthanc_rest_api_request_bytes_total", labels_, static_cast<double>(size));
+      }
+
+      void SetOutput(HttpOutput& output)
+      {
+        output_ = &output;
+      }
+
+      // The HTTP status of errors is only sent once the exception
+      // has reached the HTTP server
+      void SetErrorStatus(HttpStatus status)
+      {
+        hasErrorStatus_ = true;
+        errorStatus_ = status;
+      }
+    };
+
+
+    /**
+     * Wraps the reader of a chunked request to a route of the REST
+     * API (e.g. the streamed uploads to "/instances"), so that the
+     * request is recorded in the metrics as the buffered requests,
+     * from the reception of its first chunk to the end of "Execute()".
+     **/
+    class MeteredChunkedRequestReader : public IHttpHandler::IChunkedRequestReader
+    {
+    private:
+      std::unique_ptr<IHttpHandler::IChunkedRequestReader>  reader_;
+      std::unique_ptr<RouteMetrics>                         metrics_;
+
+      void SetErrorStatus(HttpStatus status)
+      {
+        if (metrics_.get() != NULL)
+        {
+          metrics_->SetErrorStatus(status);
+        }
+      }
+
+    public:
+      MeteredChunkedRequestReader(IHttpHandler::IChunkedRequestReader* reader /* takes ownership */,
+                                  MetricsRegistry& registry,
+                                  HttpMethod method,
+                                  const std::string& route) :
+        reader_(reader),
+        metrics_(new RouteMetrics(registry, method, route))
+      {
+        if (reader == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+      }
+
+      virtual void AddBodyChunk(const void* data,
+                                size_t size) ORTHANC_OVERRIDE
+      {
+        if (metrics_.get() != NULL)
+        {
+          metrics_->AddRequestBytes(size);
+        }
+
+        try
+        {
+          reader_->AddBodyChunk(data, size);
+        }
+        catch (OrthancException& e)
+        {
+          SetErrorStatus(e.GetHttpStatus());
+          throw;
+        }
+        catch (...)
+        {
+          SetErrorStatus(HttpStatus_500_InternalServerError);
+          throw;
+        }
+      }
+
+      virtual void Execute(HttpOutput& output) ORTHANC_OVERRIDE
+      {
+        if (metrics_.get() != NULL)
+        {
+          metrics_->SetOutput(output);
+        }
+
+        try
+        {
+          reader_->Execute(output);
+        }
+        catch (OrthancException& e)
+        {
+          SetErrorStatus(e.GetHttpStatus());
+          metrics_.reset(NULL);
+          throw;
+        }
+        catch (...)
+        {
+          SetErrorStatus(HttpStatus_500_InternalServerError);
+          metrics_.reset(NULL);
+          throw;
+        }
+
+        metrics_.reset(NULL);  // Record the request now
+      }
+    };
+
+
+    class RouteLookupVisitor : public RestApiHierarchy::IVisitor
+    {
+    private:
+      HttpMethod   method_;
+      std::string  route_;
+
+    public:
+      explicit RouteLookupVisitor(HttpMethod method) :
+        method_(method)
+      {
+      }
+
+      const std::string& GetRoute() const
+      {
+        return route_;
+      }
+
+      virtual bool Visit(const RestApiHierarchy::Resource& resource,
+                         const UriComponents& uri,
+                         bool hasTrailing,
+                         const HttpToolbox::Arguments& components,
+                         const UriComponents& trailing) ORTHANC_OVERRIDE
+      {
+        if (resource.HasHandler(method_))
+        {
+          route_ = resource.GetUriTemplate();
+          return true;
+        }
+        else
+        {
+          return false;
+        }
+      }
+    };
+
+
     class HttpHandlerVisitor : public RestApiHierarchy::IVisitor
     {
     private:
@@ -51,6 +267,8 @@ namespace Orthanc
       const HttpToolbox::Arguments& getArguments_;
       const void* bodyData_;
       size_t bodySize_;
+      MetricsRegistry* metrics_;
+      std::unique_ptr<RouteMetrics> routeMetrics_;
 
     public:
       HttpHandlerVisitor(RestApi& api,
@@ -62,7 +280,8 @@ namespace Orthanc
                          const HttpToolbox::Arguments& headers,
                          const HttpToolbox::Arguments& getArguments,
                          const void* bodyData,
-                         size_t bodySize) :
+                         size_t bodySize,
+                         MetricsRegistry* metrics) :
         api_(api),
         output_(output),
         origin_(origin),
@@ -72,10 +291,19 @@ namespace Orthanc
         headers_(headers),
         getArguments_(getArguments),
         bodyData_(bodyData),
-        bodySize_(bodySize)
+        bodySize_(bodySize),
+        metrics_(metrics)
       {
       }
 
+      void SetErrorStatus(HttpStatus status)
+      {
+        if (routeMetrics_.get() != NULL)
+        {
+          routeMetrics_->SetErrorStatus(status);
+        }
+      }
+
       virtual bool Visit(const RestApiHierarchy::Resource& resource,
                          const UriComponents& uri,
                          bool hasTrailing,
@@ -84,6 +312,14 @@ namespace Orthanc
       {
         if (resource.HasHandler(method_))
         {
+          if (metrics_ != NULL &&
+              metrics_->IsEnabled())
+          {
+            routeMetrics_.reset(new RouteMetrics(*metrics_, method_, resource.GetUriTemplate()));
+            routeMetrics_->SetOutput(output_.GetLowLevelOutput());
+            routeMetrics_->AddRequestBytes(bodySize_);
+          }
+
           switch (method_)
           {
             case HttpMethod_Get:
@@ -767,6 +1003,30 @@ namespace Orthanc
 
 
 
+  RestApi::RestApi() :
+    metrics_(NULL)
+  {
+  }
+
+
+  void RestApi::SetMetricsRegistry(MetricsRegistry* registry)
+  {
+    metrics_ = registry;
+  }
+
+
+  bool RestApi::CreateRouteChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
+                                                RequestOrigin origin,
+                                                const char* remoteIp,
+                                                const char* username,
+                                                HttpMethod method,
+                                                const UriComponents& uri,
+                                                const HttpToolbox::Arguments& headers)
+  {
+    return false;
+  }
+
+
   bool RestApi::CreateChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
                                            RequestOrigin origin,
                                            const char* remoteIp,
@@ -775,7 +1035,30 @@ namespace Orthanc
                                            const UriComponents& uri,
                                            const HttpToolbox::Arguments& headers)
   {
-    return false;
+    std::unique_ptr<IChunkedRequestReader> reader;
+    if (!CreateRouteChunkedRequestReader(reader, origin, remoteIp, username, method, uri, headers))
+    {
+      return false;
+    }
+
+    if (reader.get() == NULL)
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    RouteLookupVisitor visitor(method);
+    if (metrics_ != NULL &&
+        metrics_->IsEnabled() &&
+        root_.LookupResource(uri, visitor))
+    {
+      target.reset(new MeteredChunkedRequestReader(reader.release(), *metrics_, method, visitor.GetRoute()));
+    }
+    else
+    {
+      target.reset(reader.release());
+    }
+
+    return true;
   }
 
 
@@ -821,12 +1104,25 @@ namespace Orthanc
     HttpToolbox::CompileGetArguments(compiled, getArguments);
 
     HttpHandlerVisitor visitor(*this, wrappedOutput, origin, remoteIp, username, 
-                               method, headers, compiled, bodyData, bodySize);
+                               method, headers, compiled, bodyData, bodySize, metrics_);
 
-    if (root_.LookupResource(uri, visitor))
+    try
     {
-      wrappedOutput.Finalize();
-      return true;
+      if (root_.LookupResource(uri, visitor))
+      {
+        wrappedOutput.Finalize();
+        return true;
+      }
+    }
+    catch (OrthancException& e)
+    {
+      visitor.SetErrorStatus(e.GetHttpStatus());
+      throw;
+    }
+    catch (...)
+    {
+      visitor.SetErrorStatus(HttpStatus_500_InternalServerError);
+      throw;
     }
 
     std::set<HttpMethod> methods;
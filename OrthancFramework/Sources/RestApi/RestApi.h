@@ -31,12 +31,39 @@
 
 namespace Orthanc
 {
+  class MetricsRegistry;
+
   class RestApi : public IHttpHandler
   {
   private:
-    RestApiHierarchy root_;
+    RestApiHierarchy  root_;
+    MetricsRegistry*  metrics_;
+
+  protected:
+    /**
+     * To be overridden by the REST APIs that process the body of some
+     * of their POST or PUT routes as a stream (new in Orthanc
+     * 1.11.3). The readers that are created by this method are
+     * recorded in the metrics of their route.
+     **/
+    virtual bool CreateRouteChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
+                                                 RequestOrigin origin,
+                                                 const char* remoteIp,
+                                                 const char* username,
+                                                 HttpMethod method,
+                                                 const UriComponents& uri,
+                                                 const HttpToolbox::Arguments& headers);
 
   public:
+    RestApi();
+
+    /**
+     * Record the latency, the status codes, the request/response
+     * bytes and the number of active requests of each route of the
+     * REST API into the given registry (new in Orthanc 1.11.3).
+     **/
+    void SetMetricsRegistry(MetricsRegistry* registry);
+
     static void AutoListChildren(RestApiGetCall& call);
 
     virtual bool CreateChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
@@ -62,6 +62,11 @@ namespace Orthanc
       return getArguments_.find(name) != getArguments_.end();
     }
 
+    const HttpToolbox::Arguments& GetArguments() const
+    {
+      return getArguments_;
+    }
+
     bool GetBooleanArgument(const std::string& name,
                             bool defaultValue) const;
     
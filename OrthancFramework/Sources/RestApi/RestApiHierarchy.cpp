@@ -179,7 +179,8 @@ namespace Orthanc
 
 
   template <typename Handler>
-  void RestApiHierarchy::RegisterInternal(const RestApiPath& path,
+  void RestApiHierarchy::RegisterInternal(const std::string& uri,
+                                          const RestApiPath& path,
                                           Handler handler,
                                           size_t level)
   {
@@ -188,10 +189,12 @@ namespace Orthanc
       if (path.IsUniversalTrailing())
       {
         handlersWithTrailing_.Register(handler);
+        handlersWithTrailing_.SetUriTemplate(uri);
       }
       else
       {
         handlers_.Register(handler);
+        handlers_.SetUriTemplate(uri);
       }
     }
     else
@@ -206,7 +209,7 @@ namespace Orthanc
         child = &AddChild(children_, path.GetLevelName(level));
       }
 
-      child->RegisterInternal(path, handler, level + 1);
+      child->RegisterInternal(uri, path, handler, level + 1);
     }
   }
 
@@ -349,28 +352,28 @@ namespace Orthanc
                                   RestApiGetCall::Handler handler)
   {
     RestApiPath path(uri);
-    RegisterInternal(path, handler, 0);
+    RegisterInternal(uri, path, handler, 0);
   }
 
   void RestApiHierarchy::Register(const std::string& uri,
                                   RestApiPutCall::Handler handler)
   {
     RestApiPath path(uri);
-    RegisterInternal(path, handler, 0);
+    RegisterInternal(uri, path, handler, 0);
   }
 
   void RestApiHierarchy::Register(const std::string& uri,
                                   RestApiPostCall::Handler handler)
   {
     RestApiPath path(uri);
-    RegisterInternal(path, handler, 0);
+    RegisterInternal(uri, path, handler, 0);
   }
 
   void RestApiHierarchy::Register(const std::string& uri,
                                   RestApiDeleteCall::Handler handler)
   {
     RestApiPath path(uri);
-    RegisterInternal(path, handler, 0);
+    RegisterInternal(uri, path, handler, 0);
   }
 
   void RestApiHierarchy::CreateSiteMap(Json::Value& target) const
@@ -42,12 +42,25 @@ namespace Orthanc
       RestApiPostCall::Handler    postHandler_;
       RestApiPutCall::Handler     putHandler_;
       RestApiDeleteCall::Handler  deleteHandler_;
+      std::string                 uriTemplate_;
 
     public:
       Resource();
 
       bool HasHandler(HttpMethod method) const;
 
+      // Path that was used to register the handlers (e.g.
+      // "/instances/{id}/file"), for the metrics (new in Orthanc 1.11.3)
+      void SetUriTemplate(const std::string& uriTemplate)
+      {
+        uriTemplate_ = uriTemplate;
+      }
+
+      const std::string& GetUriTemplate() const
+      {
+        return uriTemplate_;
+      }
+
       void Register(RestApiGetCall::Handler handler);
 
       void Register(RestApiPutCall::Handler handler);
@@ -99,7 +112,8 @@ namespace Orthanc
     static void DeleteChildren(Children& children);
 
     template <typename Handler>
-    void RegisterInternal(const RestApiPath& path,
+    void RegisterInternal(const std::string& uri,
+                          const RestApiPath& path,
                           Handler handler,
                           size_t level);
 
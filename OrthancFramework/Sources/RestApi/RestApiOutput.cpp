@@ -114,6 +114,23 @@ namespace Orthanc
     alreadySent_ = true;
   }
 
+  void RestApiOutput::AnswerJson(JsonStreamAnswer& stream,
+                                 bool streaming)
+  {
+    if (streaming &&
+        !convertJsonToXml_)
+    {
+      AnswerWithoutBuffering(stream);
+    }
+    else
+    {
+      Json::Value value;
+      stream.Flatten(value);
+      AnswerJson(value);
+    }
+  }
+
+
   void RestApiOutput::AnswerBuffer(const std::string& buffer,
                                    MimeType contentType)
   {
@@ -121,6 +138,25 @@ namespace Orthanc
                  buffer.size(), contentType);
   }
 
+  void RestApiOutput::AnswerPrecompressedBuffer(const std::string& compressed,
+                                                HttpCompression compression,
+                                                const std::string& contentType)
+  {
+    CheckStatus();
+
+    if (convertJsonToXml_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls,
+                             "Cannot convert a precompressed JSON answer to XML");
+    }
+    else
+    {
+      output_.SetContentType(contentType);
+      output_.AnswerPrecompressed(compressed.empty() ? NULL : compressed.c_str(), compressed.size(), compression);
+      alreadySent_ = true;
+    }
+  }
+
   void RestApiOutput::AnswerBuffer(const void* buffer,
                                    size_t length,
                                    MimeType contentType)
@@ -156,6 +192,13 @@ namespace Orthanc
     alreadySent_ = true;
   }
 
+  void RestApiOutput::AnswerNotModified()
+  {
+    CheckStatus();
+    output_.SendStatus(HttpStatus_304_NotModified);
+    alreadySent_ = true;
+  }
+
   void RestApiOutput::SignalErrorInternal(HttpStatus status,
 					  const char* message,
 					  size_t messageSize)
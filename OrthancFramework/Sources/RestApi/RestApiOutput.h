@@ -25,6 +25,7 @@
 
 #include "../HttpServer/HttpOutput.h"
 #include "../HttpServer/HttpFileSender.h"
+#include "../HttpServer/JsonStreamAnswer.h"
 
 #include <json/value.h>
 
@@ -71,6 +72,14 @@ namespace Orthanc
 
     void AnswerJson(const Json::Value& value);
 
+    /**
+     * Answer with a JSON array or object whose items are produced on
+     * the fly. If "streaming" is "false", or if the answer must be
+     * converted to XML, all the items are read before answering.
+     **/
+    void AnswerJson(JsonStreamAnswer& stream,
+                    bool streaming);
+
     void AnswerBuffer(const std::string& buffer,
                       MimeType contentType);
 
@@ -78,6 +87,15 @@ namespace Orthanc
                       size_t length,
                       MimeType contentType);
 
+    /**
+     * Answer with a body that was compressed by
+     * "HttpOutput::Compress()" (new in Orthanc 1.11.3). The JSON
+     * answers cannot be converted to XML in this case.
+     **/
+    void AnswerPrecompressedBuffer(const std::string& compressed,
+                                   HttpCompression compression,
+                                   const std::string& contentType);
+
     void SetContentFilename(const char* filename);
 
     void SignalError(HttpStatus status);
@@ -87,6 +105,9 @@ namespace Orthanc
 
     void Redirect(const std::string& path);
 
+    // Answer "304 Not Modified" to a conditional GET (new in Orthanc 1.11.3)
+    void AnswerNotModified();
+
     void SetCookie(const std::string& name,
                    const std::string& value,
                    unsigned int maxAge = 0);
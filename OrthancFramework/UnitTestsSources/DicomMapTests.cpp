@@ -35,6 +35,7 @@
 #include "../Sources/Compatibility.h"
 #include "../Sources/OrthancException.h"
 #include "../Sources/DicomFormat/DicomMap.h"
+#include "../Sources/DicomFormat/DicomFrameOffsetTable.h"
 #include "../Sources/DicomFormat/DicomStreamReader.h"
 #include "../Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../Sources/DicomParsing/ToDcmtkBridge.h"
@@ -1380,3 +1381,286 @@ TEST(DicomStreamReader, DISABLED_Tutu3)
 }
 
 #endif
+
+
+static void AppendLittleEndian16(std::string& target,
+                                 uint16_t value)
+{
+  target.push_back(static_cast<char>(value & 0xff));
+  target.push_back(static_cast<char>(value >> 8));
+}
+
+
+static void AppendLittleEndian32(std::string& target,
+                                 uint32_t value)
+{
+  AppendLittleEndian16(target, static_cast<uint16_t>(value & 0xffff));
+  AppendLittleEndian16(target, static_cast<uint16_t>(value >> 16));
+}
+
+
+static void AppendShortExplicitElement(std::string& target,
+                                       uint16_t group,
+                                       uint16_t element,
+                                       const char* vr,
+                                       const std::string& value)
+{
+  AppendLittleEndian16(target, group);
+  AppendLittleEndian16(target, element);
+  target.append(vr, 2);
+  AppendLittleEndian16(target, static_cast<uint16_t>(value.size()));
+  target.append(value);
+}
+
+
+static void AppendItem(std::string& target,
+                       const std::string& content)
+{
+  AppendLittleEndian16(target, 0xfffe);
+  AppendLittleEndian16(target, 0xe000);
+  AppendLittleEndian32(target, static_cast<uint32_t>(content.size()));
+  target.append(content);
+}
+
+
+static std::string CreateEncapsulatedDicom(const std::string& transferSyntax,
+                                           const std::string& numberOfFrames,
+                                           const std::vector<uint32_t>& basicOffsetTable,
+                                           const std::vector<std::string>& fragments)
+{
+  std::string metaHeader;
+  AppendShortExplicitElement(metaHeader, 0x0002, 0x0010, "UI", transferSyntax);
+
+  std::string dicom(128, '\0');
+  dicom.append("DICM");
+  AppendShortExplicitElement(dicom, 0x0002, 0x0000, "UL", "");
+  dicom.resize(dicom.size() - 2);
+  AppendLittleEndian16(dicom, 4);
+  AppendLittleEndian32(dicom, static_cast<uint32_t>(metaHeader.size()));
+  dicom.append(metaHeader);
+
+  AppendShortExplicitElement(dicom, 0x0028, 0x0008, "IS", numberOfFrames);
+
+  AppendLittleEndian16(dicom, 0x7fe0);
+  AppendLittleEndian16(dicom, 0x0010);
+  dicom.append("OB");
+  AppendLittleEndian16(dicom, 0);
+  AppendLittleEndian32(dicom, 0xffffffffu);
+
+  std::string table;
+  for (size_t i = 0; i < basicOffsetTable.size(); i++)
+  {
+    AppendLittleEndian32(table, basicOffsetTable[i]);
+  }
+
+  AppendItem(dicom, table);
+
+  for (size_t i = 0; i < fragments.size(); i++)
+  {
+    AppendItem(dicom, fragments[i]);
+  }
+
+  AppendLittleEndian16(dicom, 0xfffe);
+  AppendLittleEndian16(dicom, 0xe0dd);
+  AppendLittleEndian32(dicom, 0);
+
+  return dicom;
+}
+
+
+TEST(DicomFrameOffsetTable, OneFragmentPerFrame)
+{
+  std::vector<uint32_t> bot;
+  std::vector<std::string> fragments;
+  fragments.push_back("hello");
+  fragments.push_back("");
+  fragments.push_back("world!");
+
+  const std::string dicom = CreateEncapsulatedDicom("1.2.840.10008.1.2.4.50", "3 ", bot, fragments);
+
+  DicomFrameOffsetTable table;
+  ASSERT_TRUE(table.Parse(dicom));
+  ASSERT_EQ(dicom.size(), table.GetFileSize());
+  ASSERT_EQ(DicomTransferSyntax_JPEGProcess1, table.GetTransferSyntax());
+  ASSERT_EQ(3u, table.GetFramesCount());
+  ASSERT_EQ(5u, table.GetFrameSize(0));
+  ASSERT_EQ(0u, table.GetFrameSize(1));
+  ASSERT_EQ(6u, table.GetFrameSize(2));
+  ASSERT_THROW(table.GetFrameSize(3), OrthancException);
+
+  std::string frame;
+  table.ExtractFrame(frame, 0, dicom.c_str(), dicom.size(), 0);
+  ASSERT_EQ("hello", frame);
+  table.ExtractFrame(frame, 1, dicom.c_str(), dicom.size(), 0);
+  ASSERT_TRUE(frame.empty());
+
+  uint64_t start, end;
+  table.GetFrameRange(start, end, 2);
+  ASSERT_EQ(6u, end - start);
+  ASSERT_EQ("world!", dicom.substr(start, end - start));
+
+  const std::string range = dicom.substr(start, end - start);
+  table.ExtractFrame(frame, 2, range.c_str(), range.size(), start);
+  ASSERT_EQ("world!", frame);
+  ASSERT_THROW(table.ExtractFrame(frame, 0, range.c_str(), range.size(), start), OrthancException);
+}
+
+
+TEST(DicomFrameOffsetTable, BasicOffsetTable)
+{
+  std::vector<std::string> fragments;
+  fragments.push_back("ab");
+  fragments.push_back("cd");
+  fragments.push_back("efgh");
+  fragments.push_back("ij");
+
+  std::vector<uint32_t> bot;
+  bot.push_back(0);
+  bot.push_back(2 * 8 + 2 + 2);  // The second frame starts at the third fragment
+
+  const std::string dicom = CreateEncapsulatedDicom("1.2.840.10008.1.2.4.90", "2", bot, fragments);
+
+  DicomFrameOffsetTable table;
+  ASSERT_TRUE(table.Parse(dicom));
+  ASSERT_EQ(DicomTransferSyntax_JPEG2000LosslessOnly, table.GetTransferSyntax());
+  ASSERT_EQ(2u, table.GetFramesCount());
+  ASSERT_EQ(4u, table.GetFrameSize(0));
+  ASSERT_EQ(6u, table.GetFrameSize(1));
+
+  uint64_t start, end;
+  table.GetFrameRange(start, end, 1);
+  ASSERT_EQ(8u + 4u + 2u, end - start);  // Includes the header of the fourth item
+
+  const std::string range = dicom.substr(start, end - start);
+
+  std::string frame;
+  table.ExtractFrame(frame, 1, range.c_str(), range.size(), start);
+  ASSERT_EQ("efghij", frame);
+  table.ExtractFrame(frame, 0, dicom.c_str(), dicom.size(), 0);
+  ASSERT_EQ("abcd", frame);
+
+  ASSERT_TRUE(table.GetSourceUuid().empty());
+  table.SetSourceUuid("8c1cf4f1-b3c1-4cd4-9d34-4a3d0d3b8fc1");
+
+  std::string serialized;
+  table.Serialize(serialized);
+
+  DicomFrameOffsetTable copy;
+  copy.Unserialize(serialized);
+  ASSERT_EQ(dicom.size(), copy.GetFileSize());
+  ASSERT_EQ("8c1cf4f1-b3c1-4cd4-9d34-4a3d0d3b8fc1", copy.GetSourceUuid());
+  ASSERT_EQ(DicomTransferSyntax_JPEG2000LosslessOnly, copy.GetTransferSyntax());
+  ASSERT_EQ(2u, copy.GetFramesCount());
+  copy.ExtractFrame(frame, 1, range.c_str(), range.size(), start);
+  ASSERT_EQ("efghij", frame);
+
+  ASSERT_THROW(copy.Unserialize(serialized.substr(0, serialized.size() - 1)), OrthancException);
+  ASSERT_THROW(copy.Unserialize("nope"), OrthancException);
+  ASSERT_EQ(0u, copy.GetFramesCount());
+  ASSERT_TRUE(copy.GetSourceUuid().empty());
+
+  ASSERT_TRUE(table.Parse(dicom));
+  ASSERT_TRUE(table.GetSourceUuid().empty());
+
+  // Offset table that doesn't point to the start of a fragment
+  bot[1] = 3;
+  ASSERT_FALSE(table.Parse(CreateEncapsulatedDicom("1.2.840.10008.1.2.4.90", "2", bot, fragments)));
+
+  // More fragments than frames, but no offset table
+  bot.clear();
+  ASSERT_FALSE(table.Parse(CreateEncapsulatedDicom("1.2.840.10008.1.2.4.90", "2", bot, fragments)));
+  ASSERT_EQ(0u, table.GetFramesCount());
+
+  // Single frame spread over several fragments
+  const std::string single = CreateEncapsulatedDicom("1.2.840.10008.1.2.4.90", "", bot, fragments);
+  ASSERT_TRUE(table.Parse(single));
+  ASSERT_EQ(1u, table.GetFramesCount());
+  table.ExtractFrame(frame, 0, single.c_str(), single.size(), 0);
+  ASSERT_EQ("abcdefghij", frame);
+}
+
+
+TEST(DicomFrameOffsetTable, NotEncapsulated)
+{
+  std::vector<uint32_t> bot;
+  std::vector<std::string> fragments;
+  fragments.push_back("hello");
+
+  DicomFrameOffsetTable table;
+  ASSERT_FALSE(table.Parse(CreateEncapsulatedDicom("1.2.840.10008.1.2.1", "1", bot, fragments)));
+  ASSERT_FALSE(table.Parse("nope"));
+  ASSERT_TRUE(table.Parse(CreateEncapsulatedDicom("1.2.840.10008.1.2.5", "1", bot, fragments)));  // RLE
+}
+
+
+static std::string CreateDicomWithMetaHeader(const std::string& metaHeader,
+                                             const std::string& dataset)
+{
+  std::string dicom(128, '\0');
+  dicom.append("DICM");
+  AppendShortExplicitElement(dicom, 0x0002, 0x0000, "UL", "");
+  dicom.resize(dicom.size() - 2);
+  AppendLittleEndian16(dicom, 4);
+  AppendLittleEndian32(dicom, static_cast<uint32_t>(metaHeader.size()));
+  dicom.append(metaHeader);
+  dicom.append(dataset);
+  return dicom;
+}
+
+
+TEST(DicomStreamReader, LookupMetaHeader)
+{
+  std::string dataset;
+  AppendShortExplicitElement(dataset, 0x0008, 0x0016, "UI", std::string("1.2.840.10008.5.1.4.1.1.7") + '\0');
+  AppendShortExplicitElement(dataset, 0x0008, 0x0018, "UI", "1.2.3.40");
+
+  std::string metaHeader;
+  AppendShortExplicitElement(metaHeader, 0x0002, 0x0002, "UI", std::string("1.2.840.10008.5.1.4.1.1.7") + '\0');
+  AppendShortExplicitElement(metaHeader, 0x0002, 0x0003, "UI", "1.2.3.40");
+  AppendShortExplicitElement(metaHeader, 0x0002, 0x0010, "UI", std::string("1.2.840.10008.1.2.1") + '\0');
+
+  std::string sopClassUid, sopInstanceUid;
+  DicomTransferSyntax transferSyntax;
+  uint64_t offset;
+
+  {
+    std::string dicom = CreateDicomWithMetaHeader(metaHeader, dataset);
+    ASSERT_TRUE(DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, transferSyntax,
+                                                    offset, dicom.c_str(), dicom.size()));
+    ASSERT_EQ("1.2.840.10008.5.1.4.1.1.7", sopClassUid);
+    ASSERT_EQ("1.2.3.40", sopInstanceUid);
+    ASSERT_EQ(DicomTransferSyntax_LittleEndianExplicit, transferSyntax);
+    ASSERT_EQ(144u + metaHeader.size(), offset);
+    ASSERT_EQ(dataset, dicom.substr(static_cast<size_t>(offset)));
+  }
+
+  {
+    // The dataset is not needed
+    std::string dicom = CreateDicomWithMetaHeader(metaHeader, "");
+    ASSERT_TRUE(DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, transferSyntax,
+                                                    offset, dicom.c_str(), dicom.size()));
+    ASSERT_EQ(dicom.size(), offset);
+  }
+
+  {
+    // No SOP instance UID in the meta-header
+    std::string incomplete;
+    AppendShortExplicitElement(incomplete, 0x0002, 0x0002, "UI", std::string("1.2.840.10008.5.1.4.1.1.7") + '\0');
+    AppendShortExplicitElement(incomplete, 0x0002, 0x0010, "UI", std::string("1.2.840.10008.1.2.1") + '\0');
+
+    std::string dicom = CreateDicomWithMetaHeader(incomplete, dataset);
+    ASSERT_FALSE(DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, transferSyntax,
+                                                     offset, dicom.c_str(), dicom.size()));
+  }
+
+  {
+    // Truncated meta-header
+    std::string dicom = CreateDicomWithMetaHeader(metaHeader, dataset);
+    ASSERT_FALSE(DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, transferSyntax,
+                                                     offset, dicom.c_str(), 150));
+  }
+
+  std::string s = "nope";
+  ASSERT_FALSE(DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, transferSyntax,
+                                                   offset, s.c_str(), s.size()));
+}
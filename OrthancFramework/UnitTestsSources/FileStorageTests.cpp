@@ -29,14 +29,17 @@
 #include <gtest/gtest.h>
 
 #include "../Sources/FileStorage/FilesystemStorage.h"
+#include "../Sources/FileStorage/MemoryStorageArea.h"
 #include "../Sources/FileStorage/StorageAccessor.h"
 #include "../Sources/FileStorage/StorageCache.h"
+#include "../Sources/FileStorage/TieredStorageArea.h"
 #include "../Sources/HttpServer/BufferHttpSender.h"
 #include "../Sources/HttpServer/FilesystemHttpSender.h"
 #include "../Sources/Logging.h"
 #include "../Sources/OrthancException.h"
 #include "../Sources/Toolbox.h"
 
+#include <boost/filesystem.hpp>
 #include <ctype.h>
 
 
@@ -192,3 +195,391 @@ TEST(StorageAccessor, Mix)
   ASSERT_THROW(accessor.Read(r, uncompressedInfo.GetUuid(), FileContentType_Unknown), OrthancException);
   */
 }
+
+
+static std::string ReadFromStorage(IStorageArea& area,
+                                   const std::string& uuid)
+{
+  std::string s;
+  std::unique_ptr<IMemoryBuffer> buffer(area.Read(uuid, FileContentType_Unknown));
+  buffer->MoveToString(s);
+  return s;
+}
+
+
+static std::string ReadRangeFromStorage(IStorageArea& area,
+                                        const std::string& uuid,
+                                        uint64_t start,
+                                        uint64_t end)
+{
+  std::string s;
+  std::unique_ptr<IMemoryBuffer> buffer(area.ReadRange(uuid, FileContentType_Unknown, start, end));
+  buffer->MoveToString(s);
+  return s;
+}
+
+
+TEST(TieredStorageArea, WriteThrough)
+{
+  MemoryStorageArea* remote = new MemoryStorageArea;
+  TieredStorageArea tier(remote, new MemoryStorageArea, 10,
+                         TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                         TieredStorageArea::WritePolicy_WriteThrough);
+
+  MetricsRegistry metrics;
+  tier.SetMetricsRegistry(&metrics);
+
+  const std::string a = Toolbox::GenerateUuid();
+  const std::string b = Toolbox::GenerateUuid();
+  const std::string c = Toolbox::GenerateUuid();
+  const std::string d = Toolbox::GenerateUuid();
+
+  tier.Create(a, "hello", 5, FileContentType_Unknown);
+  tier.Create(b, "world", 5, FileContentType_Unknown);
+  ASSERT_EQ("hello", ReadFromStorage(*remote, a));
+  ASSERT_EQ("world", ReadFromStorage(*remote, b));
+
+  uint64_t hits, misses, size, dirty;
+  size_t count;
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(0u, hits);
+  ASSERT_EQ(0u, misses);
+  ASSERT_EQ(10u, size);
+  ASSERT_EQ(0u, dirty);
+  ASSERT_EQ(2u, count);
+
+  ASSERT_EQ("hello", ReadFromStorage(tier, a));  // Hit, "b" becomes the oldest file
+  tier.Create(c, "abcde", 5, FileContentType_Unknown);  // Evicts "b"
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(1u, hits);
+  ASSERT_EQ(0u, misses);
+  ASSERT_EQ(10u, size);
+  ASSERT_EQ(2u, count);
+
+  ASSERT_EQ("world", ReadFromStorage(tier, b));  // Miss, read-through evicts "a"
+  ASSERT_EQ("bc", ReadRangeFromStorage(tier, c, 1, 3));  // Hit
+  ASSERT_EQ("el", ReadRangeFromStorage(tier, a, 1, 3));  // Miss, served by the remote area
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(2u, misses);
+  ASSERT_EQ(10u, size);
+  ASSERT_EQ(2u, count);
+
+  // Files that are larger than the local tier are never cached
+  tier.Create(d, "0123456789abcdef", 16, FileContentType_Unknown);
+  ASSERT_EQ("0123456789abcdef", ReadFromStorage(tier, d));
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(3u, misses);
+  ASSERT_EQ(10u, size);
+  ASSERT_EQ(2u, count);
+
+  tier.Remove(c, FileContentType_Unknown);
+  ASSERT_THROW(ReadFromStorage(*remote, c), OrthancException);
+  ASSERT_THROW(ReadFromStorage(tier, c), OrthancException);
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(5u, size);
+  ASSERT_EQ(1u, count);
+
+  ASSERT_EQ(MetricsType_Default, metrics.GetMetricsType("orthanc_storage_tier_hit_ratio"));
+  tier.SetMetricsRegistry(NULL);
+}
+
+
+TEST(TieredStorageArea, LeastFrequentlyUsed)
+{
+  TieredStorageArea tier(new MemoryStorageArea, new MemoryStorageArea, 10,
+                         TieredStorageArea::EvictionPolicy_LeastFrequentlyUsed,
+                         TieredStorageArea::WritePolicy_WriteThrough);
+
+  const std::string a = Toolbox::GenerateUuid();
+  const std::string b = Toolbox::GenerateUuid();
+  const std::string c = Toolbox::GenerateUuid();
+
+  tier.Create(a, "hello", 5, FileContentType_Unknown);
+  tier.Create(b, "world", 5, FileContentType_Unknown);
+  ASSERT_EQ("hello", ReadFromStorage(tier, a));
+  ASSERT_EQ("hello", ReadFromStorage(tier, a));
+  ASSERT_EQ("world", ReadFromStorage(tier, b));  // "b" is more recent, but less frequent
+  tier.Create(c, "abcde", 5, FileContentType_Unknown);  // Evicts "b"
+
+  uint64_t hits, misses, size, dirty;
+  size_t count;
+  ASSERT_EQ("hello", ReadFromStorage(tier, a));
+  ASSERT_EQ("world", ReadFromStorage(tier, b));
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(4u, hits);
+  ASSERT_EQ(1u, misses);
+}
+
+
+TEST(TieredStorageArea, WriteBack)
+{
+  MemoryStorageArea* remote = new MemoryStorageArea;
+  TieredStorageArea tier(remote, new MemoryStorageArea, 100,
+                         TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                         TieredStorageArea::WritePolicy_WriteBack);
+
+  const std::string a = Toolbox::GenerateUuid();
+  const std::string b = Toolbox::GenerateUuid();
+
+  tier.Create(a, "hello", 5, FileContentType_Unknown);
+  tier.Create(b, "world", 5, FileContentType_Unknown);
+  ASSERT_EQ("hello", ReadFromStorage(tier, a));
+  ASSERT_EQ("orl", ReadRangeFromStorage(tier, b, 1, 4));
+
+  tier.FlushPendingWrites();
+
+  uint64_t hits, misses, size, dirty;
+  size_t count;
+  tier.GetStatistics(hits, misses, size, dirty, count);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(0u, misses);
+  ASSERT_EQ(10u, size);
+  ASSERT_EQ(0u, dirty);
+  ASSERT_EQ(2u, count);
+
+  ASSERT_EQ("hello", ReadFromStorage(*remote, a));
+  ASSERT_EQ("world", ReadFromStorage(*remote, b));
+
+  tier.Remove(a, FileContentType_Unknown);
+  ASSERT_THROW(ReadFromStorage(*remote, a), OrthancException);
+  ASSERT_THROW(ReadFromStorage(tier, a), OrthancException);
+}
+
+
+namespace
+{
+  class UnavailableStorageArea : public IStorageArea
+  {
+  public:
+    virtual void Create(const std::string& uuid,
+                        const void* content,
+                        size_t size,
+                        FileContentType type) ORTHANC_OVERRIDE
+    {
+      throw OrthancException(ErrorCode_NetworkProtocol);
+    }
+
+    virtual IMemoryBuffer* Read(const std::string& uuid,
+                                FileContentType type) ORTHANC_OVERRIDE
+    {
+      throw OrthancException(ErrorCode_NetworkProtocol);
+    }
+
+    virtual IMemoryBuffer* ReadRange(const std::string& uuid,
+                                     FileContentType type,
+                                     uint64_t start /* inclusive */,
+                                     uint64_t end /* exclusive */) ORTHANC_OVERRIDE
+    {
+      throw OrthancException(ErrorCode_NetworkProtocol);
+    }
+
+    virtual bool HasReadRange() const ORTHANC_OVERRIDE
+    {
+      return true;
+    }
+
+    virtual void Remove(const std::string& uuid,
+                        FileContentType type) ORTHANC_OVERRIDE
+    {
+      throw OrthancException(ErrorCode_NetworkProtocol);
+    }
+  };
+}
+
+
+namespace
+{
+  // Remote storage area that records the content type of the files
+  class TypedStorageArea : public MemoryStorageArea
+  {
+  private:
+    std::map<std::string, FileContentType>  types_;
+
+  public:
+    virtual void Create(const std::string& uuid,
+                        const void* content,
+                        size_t size,
+                        FileContentType type) ORTHANC_OVERRIDE
+    {
+      MemoryStorageArea::Create(uuid, content, size, type);
+      types_[uuid] = type;
+    }
+
+    FileContentType GetType(const std::string& uuid) const
+    {
+      std::map<std::string, FileContentType>::const_iterator found = types_.find(uuid);
+      if (found == types_.end())
+      {
+        throw OrthancException(ErrorCode_InexistentItem);
+      }
+      else
+      {
+        return found->second;
+      }
+    }
+  };
+}
+
+
+static void CrashInWriteBackMode(const std::string& path,
+                                 const std::string& types,
+                                 const std::string& uuid,
+                                 const std::string& content,
+                                 FileContentType type)
+{
+  // The remote area is unavailable, so the file and its content type are left in the local tier
+  TieredStorageArea tier(new UnavailableStorageArea, new FilesystemStorage(path), 100,
+                         TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                         TieredStorageArea::WritePolicy_WriteBack);
+  tier.SetContentTypesDirectory(types);
+  tier.Create(uuid, content.c_str(), content.size(), type);
+}
+
+
+TEST(TieredStorageArea, RecoveryAfterCrash)
+{
+  const std::string path = "UnitTestsStorageTier";
+  const std::string types = "UnitTestsStorageTierTypes";
+
+  const std::string a = Toolbox::GenerateUuid();
+  const std::string b = Toolbox::GenerateUuid();
+  const std::string c = Toolbox::GenerateUuid();
+  const std::string d = Toolbox::GenerateUuid();
+
+  {
+    FilesystemStorage local(path);
+    local.Clear();
+    boost::filesystem::remove_all(types);
+  }
+
+  // Files left in the local tier by a crash in write-back mode
+  CrashInWriteBackMode(path, types, a, "hello", FileContentType_Dicom);
+  CrashInWriteBackMode(path, types, b, "world", FileContentType_DicomAsJson);
+
+  {
+    // Copy of a file of the remote area, that was read through before the crash
+    FilesystemStorage local(path);
+    local.Create(d, "copy!", 5, FileContentType_Unknown);
+  }
+
+  std::set<std::string> leftovers;
+
+  {
+    FilesystemStorage* local = new FilesystemStorage(path);
+    local->ListAllFiles(leftovers);
+    ASSERT_EQ(3u, leftovers.size());
+
+    TypedStorageArea* remote = new TypedStorageArea;
+    remote->Create(b, "world", 5, FileContentType_DicomAsJson);  // "b" was uploaded before the crash
+
+    TieredStorageArea tier(remote, local, 100,
+                           TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                           TieredStorageArea::WritePolicy_WriteBack);
+    tier.SetContentTypesDirectory(types);
+    tier.RecoverLocalFiles(leftovers, true /* pending writes */);
+
+    uint64_t hits, misses, size, dirty;
+    size_t count;
+    tier.GetStatistics(hits, misses, size, dirty, count);
+    ASSERT_EQ(10u, size);
+    ASSERT_EQ(2u, count);  // "d" has no content type, so it is a mere copy that is removed
+
+    ASSERT_EQ("hello", ReadFromStorage(tier, a));  // Served by the local tier
+    ASSERT_EQ("world", ReadFromStorage(tier, b));
+
+    tier.FlushPendingWrites();
+    tier.GetStatistics(hits, misses, size, dirty, count);
+    ASSERT_EQ(0u, dirty);
+    ASSERT_EQ(2u, count);
+    ASSERT_EQ(2u, hits);
+    ASSERT_EQ(0u, misses);
+
+    ASSERT_EQ("hello", ReadFromStorage(*remote, a));
+    ASSERT_EQ("world", ReadFromStorage(*remote, b));
+
+    // The files are uploaded with their original content type
+    ASSERT_EQ(FileContentType_Dicom, remote->GetType(a));
+    ASSERT_EQ(FileContentType_DicomAsJson, remote->GetType(b));
+    ASSERT_TRUE(boost::filesystem::is_empty(types));
+  }
+
+  {
+    // The uploaded files are removed from the local tier on shutdown
+    FilesystemStorage local(path);
+    local.ListAllFiles(leftovers);
+    ASSERT_TRUE(leftovers.empty());
+  }
+
+  // New crash, then restart in write-through mode while the remote area is down
+  CrashInWriteBackMode(path, types, c, "abcde", FileContentType_Dicom);
+
+  {
+    FilesystemStorage local(path);
+    local.ListAllFiles(leftovers);
+    ASSERT_EQ(1u, leftovers.size());
+  }
+
+  {
+    TieredStorageArea tier(new UnavailableStorageArea, new FilesystemStorage(path), 100,
+                           TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                           TieredStorageArea::WritePolicy_WriteThrough);
+    tier.SetContentTypesDirectory(types);
+    ASSERT_THROW(tier.RecoverLocalFiles(leftovers, true /* pending writes */), OrthancException);
+  }
+
+  {
+    // Without the content types, the file cannot be uploaded
+    TieredStorageArea tier(new MemoryStorageArea, new FilesystemStorage(path), 100,
+                           TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                           TieredStorageArea::WritePolicy_WriteThrough);
+    ASSERT_THROW(tier.RecoverLocalFiles(leftovers, true /* pending writes */), OrthancException);
+  }
+
+  {
+    // The file must not have been lost
+    FilesystemStorage local(path);
+    local.ListAllFiles(leftovers);
+    ASSERT_EQ(1u, leftovers.size());
+  }
+
+  {
+    TypedStorageArea* remote = new TypedStorageArea;
+    TieredStorageArea tier(remote, new FilesystemStorage(path), 100,
+                           TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                           TieredStorageArea::WritePolicy_WriteThrough);
+    tier.SetContentTypesDirectory(types);
+    tier.RecoverLocalFiles(leftovers, true /* pending writes */);
+    ASSERT_EQ("abcde", ReadFromStorage(*remote, c));
+    ASSERT_EQ(FileContentType_Dicom, remote->GetType(c));
+    ASSERT_TRUE(boost::filesystem::is_empty(types));
+  }
+
+  {
+    // In write-through mode, the uploaded files are removed from the local tier
+    FilesystemStorage local(path);
+    local.ListAllFiles(leftovers);
+    ASSERT_TRUE(leftovers.empty());
+
+    // Leftovers of the write-through mode are mere copies of the remote area
+    local.Create(a, "hello", 5, FileContentType_Unknown);
+    local.ListAllFiles(leftovers);
+    ASSERT_EQ(1u, leftovers.size());
+  }
+
+  {
+    TieredStorageArea tier(new UnavailableStorageArea, new FilesystemStorage(path), 100,
+                           TieredStorageArea::EvictionPolicy_LeastRecentlyUsed,
+                           TieredStorageArea::WritePolicy_WriteThrough);
+    tier.RecoverLocalFiles(leftovers, false /* no pending writes */);
+  }
+
+  {
+    FilesystemStorage local(path);
+    local.ListAllFiles(leftovers);
+    ASSERT_TRUE(leftovers.empty());
+  }
+
+  boost::filesystem::remove_all(types);
+}
@@ -1421,6 +1421,123 @@ TEST(MetricsRegistry, Basic)
 #endif
 
 
+#if ORTHANC_SANDBOXED != 1
+TEST(MetricsRegistry, Labeled)
+{
+  MetricsRegistry::Labels a, b;
+  a["route"] = "/a";
+  b["route"] = "/b";
+  b["method"] = "GET";
+
+  {
+    MetricsRegistry m;
+    m.SetEnabled(false);
+    m.IncrementCounter("counter", a, 1);
+    m.AddToGauge("gauge", a, 1);
+    m.ObserveHistogram("histogram", a, 1);
+
+    double v;
+    ASSERT_FALSE(m.LookupLabeledValue(v, "counter", a));
+    ASSERT_FALSE(m.LookupLabeledValue(v, "gauge", a));
+
+    std::string s;
+    m.ExportPrometheusText(s);
+    ASSERT_TRUE(s.empty());
+  }
+
+  {
+    MetricsRegistry m;
+    m.IncrementCounter("counter", a, 1);
+    m.IncrementCounter("counter", a, 2.5);
+    m.IncrementCounter("counter", b, 1);
+    ASSERT_THROW(m.IncrementCounter("counter", a, -1), OrthancException);
+    ASSERT_THROW(m.AddToGauge("counter", a, 1), OrthancException);
+
+    m.AddToGauge("gauge", a, 1);
+    m.AddToGauge("gauge", a, 1);
+    m.AddToGauge("gauge", a, -1);
+
+    double v;
+    ASSERT_TRUE(m.LookupLabeledValue(v, "counter", a));  ASSERT_DOUBLE_EQ(3.5, v);
+    ASSERT_TRUE(m.LookupLabeledValue(v, "counter", b));  ASSERT_DOUBLE_EQ(1, v);
+    ASSERT_TRUE(m.LookupLabeledValue(v, "gauge", a));    ASSERT_DOUBLE_EQ(1, v);
+    ASSERT_FALSE(m.LookupLabeledValue(v, "gauge", b));
+    ASSERT_FALSE(m.LookupLabeledValue(v, "nope", a));
+
+    std::string s;
+    m.ExportPrometheusText(s);
+    ASSERT_EQ("# TYPE counter counter\n"
+              "counter{method=\"GET\",route=\"/b\"} 1\n"
+              "counter{route=\"/a\"} 3.5\n"
+              "# TYPE gauge gauge\n"
+              "gauge{route=\"/a\"} 1\n", s);
+  }
+
+  {
+    MetricsRegistry m;
+
+    std::vector<double> buckets;
+    buckets.push_back(1);
+    buckets.push_back(0.5);
+    ASSERT_THROW(m.RegisterHistogram("histogram", buckets), OrthancException);
+
+    buckets[1] = 10;
+    m.RegisterHistogram("histogram", buckets);
+    m.ObserveHistogram("histogram", a, 0.5);
+    m.ObserveHistogram("histogram", a, 1);
+    m.ObserveHistogram("histogram", a, 5);
+    m.ObserveHistogram("histogram", a, 20);
+
+    std::vector<uint64_t> counts;
+    uint64_t count;
+    double sum;
+    ASSERT_FALSE(m.LookupHistogram(counts, count, sum, "histogram", b));
+    ASSERT_TRUE(m.LookupHistogram(counts, count, sum, "histogram", a));
+    ASSERT_EQ(2u, counts.size());
+    ASSERT_EQ(2u, counts[0]);
+    ASSERT_EQ(3u, counts[1]);
+    ASSERT_EQ(4u, count);
+    ASSERT_DOUBLE_EQ(26.5, sum);
+
+    MetricsRegistry::Labels c;
+    c["route"] = "a\"b\\c\nd";
+    m.ObserveHistogram("histogram", c, 0.1);
+
+    std::string s;
+    m.ExportPrometheusText(s);
+    ASSERT_EQ("# TYPE histogram histogram\n"
+              "histogram_bucket{route=\"/a\",le=\"1\"} 2\n"
+              "histogram_bucket{route=\"/a\",le=\"10\"} 3\n"
+              "histogram_bucket{route=\"/a\",le=\"+Inf\"} 4\n"
+              "histogram_sum{route=\"/a\"} 26.5\n"
+              "histogram_count{route=\"/a\"} 4\n"
+              "histogram_bucket{route=\"a\\\"b\\\\c\\nd\",le=\"1\"} 1\n"
+              "histogram_bucket{route=\"a\\\"b\\\\c\\nd\",le=\"10\"} 1\n"
+              "histogram_bucket{route=\"a\\\"b\\\\c\\nd\",le=\"+Inf\"} 1\n"
+              "histogram_sum{route=\"a\\\"b\\\\c\\nd\"} 0.1\n"
+              "histogram_count{route=\"a\\\"b\\\\c\\nd\"} 1\n", s);
+  }
+
+  {
+    MetricsRegistry m;
+    m.ObserveHistogram("histogram", MetricsRegistry::Labels(), 0.003);
+
+    std::vector<double> defaultBuckets;
+    MetricsRegistry::GetDefaultHistogramBuckets(defaultBuckets);
+
+    std::vector<uint64_t> counts;
+    uint64_t count;
+    double sum;
+    ASSERT_TRUE(m.LookupHistogram(counts, count, sum, "histogram", MetricsRegistry::Labels()));
+    ASSERT_EQ(defaultBuckets.size(), counts.size());
+    ASSERT_EQ(1u, counts[0]);
+    ASSERT_EQ(1u, counts.back());
+    ASSERT_EQ(1u, count);
+  }
+}
+#endif
+
+
 #if ORTHANC_SANDBOXED != 1
 TEST(Toolbox, ReadFileRange)
 {
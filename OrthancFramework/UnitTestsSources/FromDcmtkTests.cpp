@@ -3224,6 +3224,121 @@ TEST(DicomMap, DicomWebWithInteger64)
 #include "../Sources/DicomNetworking/DicomStoreUserConnection.h"
 #include "../Sources/DicomParsing/DcmtkTranscoder.h"
 
+#include <dcmtk/dcmdata/dcistrmb.h>
+
+static void DecodeCommandSet(DcmDataset& target,
+                             const std::string& command)
+{
+  // The command sets are always encoded using "Implicit VR Little Endian"
+  DcmInputBufferStream is;
+  is.setBuffer(command.c_str(), command.size());
+  is.setEos();
+
+  target.transferInit();
+  ASSERT_TRUE(target.read(is, EXS_LittleEndianImplicit).good());
+  target.loadAllDataIntoMemory();
+  target.transferEnd();
+}
+
+
+static uint16_t GetCommandUint16(DcmDataset& command,
+                                 uint16_t element)
+{
+  Uint16 value;
+  if (command.findAndGetUint16(DcmTagKey(0x0000, element), value).good())
+  {
+    return value;
+  }
+  else
+  {
+    throw OrthancException(ErrorCode_InexistentTag);
+  }
+}
+
+
+static uint32_t GetCommandLength(DcmDataset& command,
+                                 uint16_t element)
+{
+  DcmElement* e = NULL;
+  if (command.findAndGetElement(DcmTagKey(0x0000, element), e).good() &&
+      e != NULL)
+  {
+    return e->getLength();
+  }
+  else
+  {
+    throw OrthancException(ErrorCode_InexistentTag);
+  }
+}
+
+
+TEST(DicomStoreUserConnection, EncodeStoreCommand)
+{
+  // Both UIDs have an odd length, and must be padded with a null byte
+  const std::string sopClassUid = "1.2.840.10008.5.1.4.1.1.7";
+  const std::string sopInstanceUid = "1.2.3.4.5";
+
+  {
+    std::string command;
+    DicomStoreUserConnection::EncodeStoreCommand(command, sopClassUid, sopInstanceUid, 42,
+                                                 false, "", 0);
+    ASSERT_EQ(0u, command.size() % 2);
+
+    DcmDataset dataset;
+    DecodeCommandSet(dataset, command);
+
+    Uint32 groupLength;
+    ASSERT_TRUE(dataset.findAndGetUint32(DcmTagKey(0x0000, 0x0000), groupLength).good());
+    ASSERT_EQ(command.size() - 12u, groupLength);
+
+    OFString s;
+    ASSERT_TRUE(dataset.findAndGetOFString(DcmTagKey(0x0000, 0x0002), s).good());
+    ASSERT_EQ(sopClassUid, std::string(s.c_str()));
+    ASSERT_EQ(sopClassUid.size() + 1u, GetCommandLength(dataset, 0x0002));
+    ASSERT_EQ('\0', command[command.find(sopClassUid) + sopClassUid.size()]);
+
+    ASSERT_TRUE(dataset.findAndGetOFString(DcmTagKey(0x0000, 0x1000), s).good());
+    ASSERT_EQ(sopInstanceUid, std::string(s.c_str()));
+    ASSERT_EQ(sopInstanceUid.size() + 1u, GetCommandLength(dataset, 0x1000));
+    ASSERT_EQ('\0', command[command.find(sopInstanceUid) + sopInstanceUid.size()]);
+
+    ASSERT_EQ(0x0001, GetCommandUint16(dataset, 0x0100));  // C-STORE-RQ
+    ASSERT_EQ(42, GetCommandUint16(dataset, 0x0110));      // Message ID
+    ASSERT_EQ(0x0000, GetCommandUint16(dataset, 0x0700));  // Medium priority
+    ASSERT_NE(0x0101, GetCommandUint16(dataset, 0x0800));  // A dataset is present
+
+    ASSERT_FALSE(dataset.tagExists(DcmTagKey(0x0000, 0x1030)));
+    ASSERT_FALSE(dataset.tagExists(DcmTagKey(0x0000, 0x1031)));
+  }
+
+  {
+    // The AET has an odd length, and must be padded with a space
+    std::string command;
+    DicomStoreUserConnection::EncodeStoreCommand(command, sopClassUid, sopInstanceUid, 43,
+                                                 true, "ORTHANC", 0x1234);
+    ASSERT_EQ(0u, command.size() % 2);
+
+    DcmDataset dataset;
+    DecodeCommandSet(dataset, command);
+
+    Uint32 groupLength;
+    ASSERT_TRUE(dataset.findAndGetUint32(DcmTagKey(0x0000, 0x0000), groupLength).good());
+    ASSERT_EQ(command.size() - 12u, groupLength);
+
+    OFString s;
+    ASSERT_TRUE(dataset.findAndGetOFString(DcmTagKey(0x0000, 0x1030), s).good());
+    ASSERT_EQ("ORTHANC", std::string(s.c_str()));
+    ASSERT_EQ(8u, GetCommandLength(dataset, 0x1030));
+    ASSERT_EQ(' ', command[command.find("ORTHANC") + 7]);
+
+    ASSERT_EQ(0x1234, GetCommandUint16(dataset, 0x1031));
+    ASSERT_EQ(43, GetCommandUint16(dataset, 0x0110));
+
+    // The Move Originator fields are the last elements of the command set
+    ASSERT_EQ(command.size() - 10u, command.rfind(std::string("\x00\x00\x31\x10", 4)));
+  }
+}
+
 TEST(Toto, DISABLED_Transcode3)
 {
   DicomAssociationParameters p;
@@ -3328,4 +3443,285 @@ TEST(Toto, DISABLED_Transcode4)
   }
 }
 
+
+#if ORTHANC_ENABLE_DCMTK_JPEG_LOSSLESS == 1
+static void TranscodeMultiFrame(std::string& target,
+                                const std::string& source,
+                                unsigned int threadsCount)
+{
+  DcmtkTranscoder transcoder;
+  transcoder.SetThreadsCount(threadsCount);
+
+  std::set<DicomTransferSyntax> s;
+  s.insert(DicomTransferSyntax_JPEGLSLossless);
+
+  IDicomTranscoder::DicomImage a, b;
+  a.AcquireParsed(FromDcmtkBridge::LoadFromMemoryBuffer(source.c_str(), source.size()));
+  ASSERT_TRUE(transcoder.Transcode(b, a, s, false));
+
+  DicomTransferSyntax syntax;
+  ASSERT_TRUE(FromDcmtkBridge::LookupOrthancTransferSyntax(syntax, b.GetParsed()));
+  ASSERT_EQ(DicomTransferSyntax_JPEGLSLossless, syntax);
+
+  target.assign(reinterpret_cast<const char*>(b.GetBufferData()), b.GetBufferSize());
+}
+
+
+TEST(DcmtkTranscoder, ParallelFrames)
+{
+  static const unsigned int FRAMES = 7;
+  static const unsigned int WIDTH = 31;
+  static const unsigned int HEIGHT = 17;
+
+  std::string source;
+
+  {
+    DcmDataset dataset;
+    ASSERT_TRUE(dataset.putAndInsertString(DCM_SOPClassUID, "1.2.840.10008.5.1.4.1.1.7.2").good());
+    ASSERT_TRUE(dataset.putAndInsertString(DCM_SOPInstanceUID, "1.2.3.4").good());
+    ASSERT_TRUE(dataset.putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2").good());
+    ASSERT_TRUE(dataset.putAndInsertString(DCM_NumberOfFrames, boost::lexical_cast<std::string>(FRAMES).c_str()).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_Rows, HEIGHT).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_Columns, WIDTH).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_SamplesPerPixel, 1).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_BitsAllocated, 16).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_BitsStored, 12).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_HighBit, 11).good());
+    ASSERT_TRUE(dataset.putAndInsertUint16(DCM_PixelRepresentation, 0).good());
+
+    std::vector<Uint16> pixels(FRAMES * WIDTH * HEIGHT);
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+      pixels[i] = static_cast<Uint16>((i * 37 + i / WIDTH) % 4096);
+    }
+
+    ASSERT_TRUE(dataset.putAndInsertUint16Array(DCM_PixelData, &pixels[0], pixels.size()).good());
+    ASSERT_TRUE(FromDcmtkBridge::SaveToMemoryBuffer(source, dataset));
+  }
+
+  std::string sequential, parallel;
+  TranscodeMultiFrame(sequential, source, 0);
+  TranscodeMultiFrame(parallel, source, 3);
+
+  // The parallel encoding must not change the output
+  ASSERT_EQ(sequential.size(), parallel.size());
+  ASSERT_TRUE(sequential == parallel);
+
+  ParsedDicomFile parsed(parallel);
+  ASSERT_EQ(FRAMES, parsed.GetFramesCount());
+
+  for (unsigned int i = 0; i < FRAMES; i++)
+  {
+    std::unique_ptr<ImageAccessor> a(parsed.DecodeFrame(i));
+    ASSERT_EQ(WIDTH, a->GetWidth());
+    ASSERT_EQ(HEIGHT, a->GetHeight());
+    ASSERT_EQ(PixelFormat_Grayscale16, a->GetFormat());
+
+    const uint16_t* p = reinterpret_cast<const uint16_t*>(a->GetConstRow(3));
+    size_t j = i * WIDTH * HEIGHT + 3 * WIDTH;
+    ASSERT_EQ((j * 37 + j / WIDTH) % 4096, p[0]);
+  }
+}
+#endif
+
+#endif
+
+
+
+#if ORTHANC_ENABLE_DCMTK_NETWORKING == 1
+
+#include "../Sources/DicomFormat/DicomStreamReader.h"
+#include "../Sources/DicomNetworking/Internals/StoreScp.h"
+
+#include <stdexcept>
+
+static void AppendExplicitElement(std::string& target,
+                                  uint16_t group,
+                                  uint16_t element,
+                                  const char* vr,
+                                  const std::string& value)
+{
+  // Explicit VR little endian, with a 16-bit length and null padding
+  const uint16_t length = static_cast<uint16_t>(value.size() + value.size() % 2);
+  const uint16_t header[] = { group, element };
+
+  for (size_t i = 0; i < 2; i++)
+  {
+    target.push_back(static_cast<char>(header[i] & 0xff));
+    target.push_back(static_cast<char>(header[i] >> 8));
+  }
+
+  target.append(vr, 2);
+  target.push_back(static_cast<char>(length & 0xff));
+  target.push_back(static_cast<char>(length >> 8));
+  target.append(value);
+
+  if (value.size() % 2 == 1)
+  {
+    target.push_back('\0');
+  }
+}
+
+
+static std::string CreateBitPreservingDicom(const std::string& sopClassUid,
+                                            const std::string& sopInstanceUid,
+                                            const std::string& sourceAet)
+{
+  std::string dicom;
+  Internals::WriteStoreMetaHeader(dicom, sopClassUid, sopInstanceUid, "1.2.840.10008.1.2.1", sourceAet);
+  AppendExplicitElement(dicom, 0x0008, 0x0016, "UI", sopClassUid);
+  AppendExplicitElement(dicom, 0x0008, 0x0018, "UI", sopInstanceUid);
+  AppendExplicitElement(dicom, 0x0010, 0x0010, "PN", "HELLO");
+  return dicom;
+}
+
+
+TEST(StoreScp, WriteMetaHeader)
+{
+  // All these values have an odd length, and must be padded
+  const std::string sopClassUid = "1.2.840.10008.5.1.4.1.1.7";
+  const std::string sopInstanceUid = "1.2.3.4.5";
+  const std::string sourceAet = "ORTHANC";
+
+  std::string header;
+  Internals::WriteStoreMetaHeader(header, sopClassUid, sopInstanceUid, "1.2.840.10008.1.2.1", sourceAet);
+  ASSERT_EQ(0u, header.size() % 2);
+  ASSERT_EQ(std::string(128, '\0') + "DICM", header.substr(0, 132));
+  ASSERT_EQ('\0', header[header.find(sopClassUid) + sopClassUid.size()]);
+  ASSERT_EQ('\0', header[header.find(sopInstanceUid) + sopInstanceUid.size()]);
+  ASSERT_EQ(' ', header[header.find(sourceAet) + sourceAet.size()]);
+
+  const std::string dicom = CreateBitPreservingDicom(sopClassUid, sopInstanceUid, sourceAet);
+
+  {
+    std::string c, i;
+    DicomTransferSyntax syntax;
+    uint64_t datasetOffset;
+    ASSERT_TRUE(DicomStreamReader::LookupMetaHeader(c, i, syntax, datasetOffset, dicom.c_str(), dicom.size()));
+    ASSERT_EQ(sopClassUid, c);
+    ASSERT_EQ(sopInstanceUid, i);
+    ASSERT_EQ(DicomTransferSyntax_LittleEndianExplicit, syntax);
+    ASSERT_EQ(header.size(), datasetOffset);
+  }
+
+  {
+    std::unique_ptr<DcmFileFormat> f(FromDcmtkBridge::LoadFromMemoryBuffer(dicom.c_str(), dicom.size()));
+    ASSERT_TRUE(f.get() != NULL);
+
+    DcmMetaInfo& meta = *f->getMetaInfo();
+
+    Uint32 groupLength;
+    ASSERT_TRUE(meta.findAndGetUint32(DCM_FileMetaInformationGroupLength, groupLength).good());
+    ASSERT_EQ(header.size() - 144u, groupLength);  // 144 = preamble + "DICM" + (0002,0000)
+
+    OFString s;
+    ASSERT_TRUE(meta.findAndGetOFString(DCM_MediaStorageSOPClassUID, s).good());
+    ASSERT_EQ(sopClassUid, std::string(s.c_str()));
+    ASSERT_TRUE(meta.findAndGetOFString(DCM_MediaStorageSOPInstanceUID, s).good());
+    ASSERT_EQ(sopInstanceUid, std::string(s.c_str()));
+    ASSERT_TRUE(meta.findAndGetOFString(DCM_TransferSyntaxUID, s).good());
+    ASSERT_EQ("1.2.840.10008.1.2.1", std::string(s.c_str()));
+    ASSERT_TRUE(meta.findAndGetOFString(DCM_SourceApplicationEntityTitle, s).good());
+    ASSERT_EQ(sourceAet, std::string(s.c_str()));
+
+    ASSERT_TRUE(f->getDataset()->findAndGetOFString(DCM_PatientName, s).good());
+    ASSERT_EQ("HELLO", std::string(s.c_str()));
+  }
+
+  {
+    // No source AET
+    std::string dicom2 = CreateBitPreservingDicom(sopClassUid, sopInstanceUid, "");
+    std::unique_ptr<DcmFileFormat> f(FromDcmtkBridge::LoadFromMemoryBuffer(dicom2.c_str(), dicom2.size()));
+    ASSERT_TRUE(f.get() != NULL);
+    ASSERT_FALSE(f->getMetaInfo()->tagExists(DCM_SourceApplicationEntityTitle));
+  }
+}
+
+
+namespace
+{
+  class BufferStoreHandler : public IStoreRequestHandler
+  {
+  private:
+    unsigned int  count_;
+    bool          failure_;
+
+  public:
+    explicit BufferStoreHandler(bool failure) :
+      count_(0),
+      failure_(failure)
+    {
+    }
+
+    unsigned int GetCount() const
+    {
+      return count_;
+    }
+
+    virtual uint16_t Handle(DcmDataset& dicom,
+                            const std::string& remoteIp,
+                            const std::string& remoteAet,
+                            const std::string& calledAet) ORTHANC_OVERRIDE
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    virtual bool IsBitPreserving() const ORTHANC_OVERRIDE
+    {
+      return true;
+    }
+
+    virtual uint16_t HandleBuffer(const std::string& dicom,
+                                  const std::string& remoteIp,
+                                  const std::string& remoteAet,
+                                  const std::string& calledAet) ORTHANC_OVERRIDE
+    {
+      count_++;
+
+      if (failure_)
+      {
+        throw std::runtime_error("Simulated failure");
+      }
+      else
+      {
+        return 0x0000;
+      }
+    }
+  };
+}
+
+
+TEST(StoreScp, CheckAndHandleBuffer)
+{
+  const std::string sopClassUid = "1.2.840.10008.5.1.4.1.1.7";
+  const std::string sopInstanceUid = "1.2.3.4.5";
+  const std::string dicom = CreateBitPreservingDicom(sopClassUid, sopInstanceUid, "ORTHANC");
+
+  {
+    BufferStoreHandler handler(false);
+    ASSERT_EQ(0x0000, Internals::CheckAndHandleStoreBuffer(handler, dicom, sopClassUid, sopInstanceUid,
+                                                           "127.0.0.1", "ORTHANC", "CALLED"));
+    ASSERT_EQ(1u, handler.GetCount());
+
+    // Mismatch between the SOP class/instance UIDs of the request and of the dataset
+    ASSERT_EQ(0xA900, Internals::CheckAndHandleStoreBuffer(handler, dicom, "1.2.840.10008.5.1.4.1.1.2", sopInstanceUid,
+                                                           "127.0.0.1", "ORTHANC", "CALLED"));
+    ASSERT_EQ(0xA900, Internals::CheckAndHandleStoreBuffer(handler, dicom, sopClassUid, "1.2.3.4.6",
+                                                           "127.0.0.1", "ORTHANC", "CALLED"));
+
+    // Not a DICOM file
+    ASSERT_EQ(0xC000, Internals::CheckAndHandleStoreBuffer(handler, "nope", sopClassUid, sopInstanceUid,
+                                                           "127.0.0.1", "ORTHANC", "CALLED"));
+    ASSERT_EQ(1u, handler.GetCount());
+  }
+
+  {
+    // Exceptions that are not Orthanc exceptions must not escape
+    BufferStoreHandler handler(true);
+    ASSERT_EQ(0xA700, Internals::CheckAndHandleStoreBuffer(handler, dicom, sopClassUid, sopInstanceUid,
+                                                           "127.0.0.1", "ORTHANC", "CALLED"));
+    ASSERT_EQ(1u, handler.GetCount());
+  }
+}
+
 #endif
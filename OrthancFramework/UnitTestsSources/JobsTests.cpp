@@ -1438,6 +1438,35 @@ TEST(JobsSerialization, RemoteModalityParameters)
     ASSERT_EQ(42u, modality.GetTimeout());
   }
 
+  s = Json::nullValue;
+
+  {
+    RemoteModalityParameters modality;
+    ASSERT_FALSE(modality.HasMaximumPduLength());
+    ASSERT_EQ(0u, modality.GetMaximumPduLength());
+    ASSERT_THROW(modality.SetMaximumPduLength(4095), OrthancException);
+    ASSERT_THROW(modality.SetMaximumPduLength(131073), OrthancException);
+    modality.SetMaximumPduLength(131072);
+    ASSERT_TRUE(modality.IsAdvancedFormatNeeded());
+    modality.Serialize(s, false);
+    ASSERT_EQ(Json::objectValue, s.type());
+  }
+
+  {
+    RemoteModalityParameters modality(s);
+    ASSERT_TRUE(modality.HasMaximumPduLength());
+    ASSERT_EQ(131072u, modality.GetMaximumPduLength());
+
+    DicomAssociationParameters a("ORTHANC", modality);
+    ASSERT_EQ(131072u, a.GetMaximumPduLength());
+
+    modality.SetMaximumPduLength(0);
+    ASSERT_FALSE(modality.HasMaximumPduLength());
+
+    DicomAssociationParameters b("ORTHANC", modality);
+    ASSERT_EQ(DicomAssociationParameters::GetDefaultMaximumPduLength(), b.GetMaximumPduLength());
+  }
+
   {
     Json::Value t;
     t["AllowStorageCommitment"] = false;
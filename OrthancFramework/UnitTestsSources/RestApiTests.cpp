@@ -43,6 +43,8 @@
 #include <algorithm>
 
 #if ORTHANC_SANDBOXED != 1
+#  include "../Sources/HttpServer/StringHttpOutput.h"
+#  include "../Sources/MetricsRegistry.h"
 #  include "../Sources/RestApi/RestApi.h"
 #endif
 
@@ -383,6 +385,254 @@ TEST(RestApi, RestApiHierarchy)
 
 
 
+#if ORTHANC_SANDBOXED != 1
+static void AnswerMetricsHello(RestApiGetCall& call)
+{
+  call.GetOutput().AnswerBuffer("hello", MimeType_PlainText);
+}
+
+static void FailMetricsHello(RestApiPostCall& call)
+{
+  throw OrthancException(ErrorCode_UnknownResource);
+}
+
+TEST(RestApi, Metrics)
+{
+  MetricsRegistry metrics;
+
+  RestApi api;
+  api.SetMetricsRegistry(&metrics);
+  api.Register("/hello/{name}", AnswerMetricsHello);
+  api.Register("/hello/{name}", FailMetricsHello);
+
+  UriComponents uri;
+  Toolbox::SplitUriComponents(uri, "/hello/world");
+
+  HttpToolbox::Arguments headers;
+  HttpToolbox::GetArguments getArguments;
+
+  {
+    StringHttpOutput stream;
+    HttpOutput output(stream, false /* no keep-alive */);
+    ASSERT_TRUE(api.Handle(output, RequestOrigin_RestApi, "127.0.0.1", "", HttpMethod_Get,
+                           uri, headers, getArguments, NULL, 0));
+  }
+
+  {
+    StringHttpOutput stream;
+    HttpOutput output(stream, false /* no keep-alive */);
+    ASSERT_THROW(api.Handle(output, RequestOrigin_RestApi, "127.0.0.1", "", HttpMethod_Post,
+                            uri, headers, getArguments, "abc", 3), OrthancException);
+  }
+
+  {
+    // Not a route of this REST API
+    UriComponents other;
+    Toolbox::SplitUriComponents(other, "/nope");
+
+    StringHttpOutput stream;
+    HttpOutput output(stream, false /* no keep-alive */);
+    ASSERT_FALSE(api.Handle(output, RequestOrigin_RestApi, "127.0.0.1", "", HttpMethod_Get,
+                            other, headers, getArguments, NULL, 0));
+  }
+
+  MetricsRegistry::Labels get;
+  get["method"] = "GET";
+  get["route"] = "/hello/{name}";
+
+  MetricsRegistry::Labels post;
+  post["method"] = "POST";
+  post["route"] = "/hello/{name}";
+
+  double value;
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_in_flight", get));
+  ASSERT_DOUBLE_EQ(0, value);
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_request_bytes_total", get));
+  ASSERT_DOUBLE_EQ(0, value);
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_response_bytes_total", get));
+  ASSERT_DOUBLE_EQ(5, value);
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_request_bytes_total", post));
+  ASSERT_DOUBLE_EQ(3, value);
+
+  MetricsRegistry::Labels labels = get;
+  labels["status"] = "200";
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_total", labels));
+  ASSERT_DOUBLE_EQ(1, value);
+
+  labels = post;
+  labels["status"] = "404";
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_total", labels));
+  ASSERT_DOUBLE_EQ(1, value);
+
+  std::vector<uint64_t> buckets;
+  uint64_t count;
+  double sum;
+  ASSERT_TRUE(metrics.LookupHistogram(buckets, count, sum, "orthanc_rest_api_request_duration_seconds", get));
+  ASSERT_EQ(1u, count);
+  ASSERT_TRUE(metrics.LookupHistogram(buckets, count, sum, "orthanc_rest_api_request_duration_seconds", post));
+  ASSERT_EQ(1u, count);
+}
+
+
+
+namespace
+{
+  class ChunkedUploadApi : public RestApi
+  {
+  private:
+    class Reader : public IChunkedRequestReader
+    {
+    private:
+      std::string  body_;
+
+    public:
+      virtual void AddBodyChunk(const void* data,
+                                size_t size) ORTHANC_OVERRIDE
+      {
+        body_.append(reinterpret_cast<const char*>(data), size);
+      }
+
+      virtual void Execute(HttpOutput& output) ORTHANC_OVERRIDE
+      {
+        if (body_ == "fail")
+        {
+          throw OrthancException(ErrorCode_BadFileFormat);
+        }
+        else
+        {
+          output.Answer(body_.c_str(), body_.size());
+        }
+      }
+    };
+
+  protected:
+    virtual bool CreateRouteChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
+                                                 RequestOrigin origin,
+                                                 const char* remoteIp,
+                                                 const char* username,
+                                                 HttpMethod method,
+                                                 const UriComponents& uri,
+                                                 const HttpToolbox::Arguments& headers) ORTHANC_OVERRIDE
+    {
+      target.reset(new Reader);
+      return true;
+    }
+  };
+}
+
+TEST(RestApi, MetricsChunked)
+{
+  MetricsRegistry metrics;
+
+  ChunkedUploadApi api;
+  api.SetMetricsRegistry(&metrics);
+  api.Register("/hello/{name}", FailMetricsHello);
+
+  UriComponents uri;
+  Toolbox::SplitUriComponents(uri, "/hello/world");
+
+  HttpToolbox::Arguments headers;
+
+  {
+    std::unique_ptr<IHttpHandler::IChunkedRequestReader> reader;
+    ASSERT_TRUE(api.CreateChunkedRequestReader(reader, RequestOrigin_RestApi, "127.0.0.1", "",
+                                               HttpMethod_Post, uri, headers));
+    reader->AddBodyChunk("hel", 3);
+    reader->AddBodyChunk("lo", 2);
+
+    StringHttpOutput stream;
+    HttpOutput output(stream, false /* no keep-alive */);
+    reader->Execute(output);
+  }
+
+  {
+    std::unique_ptr<IHttpHandler::IChunkedRequestReader> reader;
+    ASSERT_TRUE(api.CreateChunkedRequestReader(reader, RequestOrigin_RestApi, "127.0.0.1", "",
+                                               HttpMethod_Post, uri, headers));
+    reader->AddBodyChunk("fail", 4);
+
+    StringHttpOutput stream;
+    HttpOutput output(stream, false /* no keep-alive */);
+    ASSERT_THROW(reader->Execute(output), OrthancException);
+  }
+
+  {
+    // The body could not be read
+    std::unique_ptr<IHttpHandler::IChunkedRequestReader> reader;
+    ASSERT_TRUE(api.CreateChunkedRequestReader(reader, RequestOrigin_RestApi, "127.0.0.1", "",
+                                               HttpMethod_Post, uri, headers));
+  }
+
+  MetricsRegistry::Labels post;
+  post["method"] = "POST";
+  post["route"] = "/hello/{name}";
+
+  double value;
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_in_flight", post));
+  ASSERT_DOUBLE_EQ(0, value);
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_request_bytes_total", post));
+  ASSERT_DOUBLE_EQ(9, value);
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_response_bytes_total", post));
+  ASSERT_DOUBLE_EQ(5, value);
+
+  MetricsRegistry::Labels labels = post;
+  labels["status"] = "200";
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_total", labels));
+  ASSERT_DOUBLE_EQ(1, value);
+
+  labels["status"] = "400";
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_total", labels));
+  ASSERT_DOUBLE_EQ(2, value);
+
+  std::vector<uint64_t> buckets;
+  uint64_t count;
+  double sum;
+  ASSERT_TRUE(metrics.LookupHistogram(buckets, count, sum, "orthanc_rest_api_request_duration_seconds", post));
+  ASSERT_EQ(3u, count);
+}
+
+static void AnswerNotModified(RestApiGetCall& call)
+{
+  call.GetOutput().AnswerNotModified();
+}
+
+TEST(RestApi, NotModified)
+{
+  MetricsRegistry metrics;
+
+  RestApi api;
+  api.SetMetricsRegistry(&metrics);
+  api.Register("/cached", AnswerNotModified);
+
+  UriComponents uri;
+  Toolbox::SplitUriComponents(uri, "/cached");
+
+  HttpToolbox::Arguments headers;
+  HttpToolbox::GetArguments getArguments;
+
+  StringHttpOutput stream;
+
+  {
+    HttpOutput output(stream, false /* no keep-alive */);
+    ASSERT_TRUE(api.Handle(output, RequestOrigin_RestApi, "127.0.0.1", "", HttpMethod_Get,
+                           uri, headers, getArguments, NULL, 0));
+  }
+
+  ASSERT_EQ(HttpStatus_304_NotModified, stream.GetStatus());
+
+  MetricsRegistry::Labels labels;
+  labels["method"] = "GET";
+  labels["route"] = "/cached";
+  labels["status"] = "304";
+
+  double value;
+  ASSERT_TRUE(metrics.LookupLabeledValue(value, "orthanc_rest_api_requests_total", labels));
+  ASSERT_DOUBLE_EQ(1, value);
+}
+#endif
+
+
+
 
 namespace
 {
@@ -31,10 +31,14 @@
 #include "../Sources/Toolbox.h"
 #include "../Sources/OrthancException.h"
 #include "../Sources/HttpServer/BufferHttpSender.h"
+#include "../Sources/HttpServer/HttpOutput.h"
 #include "../Sources/HttpServer/HttpStreamTranscoder.h"
+#include "../Sources/HttpServer/JsonStreamAnswer.h"
 #include "../Sources/Compression/ZlibCompressor.h"
 #include "../Sources/Compression/GzipCompressor.h"
 
+#include <boost/lexical_cast.hpp>
+
 #if ORTHANC_SANDBOXED != 1
 #  include "../Sources/HttpServer/FilesystemHttpSender.h"
 #  include "../Sources/SystemToolbox.h"
@@ -175,6 +179,34 @@ TEST(Zlib, Empty)
 }
 
 
+#if ORTHANC_SANDBOXED != 1
+TEST(HttpOutput, Compress)
+{
+  const std::string s = "Hello world, hello world, hello world";
+
+  std::string compressed;
+  HttpOutput::Compress(compressed, s.c_str(), s.size(), HttpCompression_Gzip);
+
+  std::string uncompressed;
+  GzipCompressor gzip;
+  IBufferCompressor::Uncompress(uncompressed, gzip, compressed);
+  ASSERT_EQ(s, uncompressed);
+
+  HttpOutput::Compress(compressed, s.c_str(), s.size(), HttpCompression_Deflate);
+  ASSERT_FALSE(compressed.empty());
+
+  // "deflate" is raw zlib data, without the uncompressed size as prefix
+  ZlibCompressor zlib;
+  zlib.SetPrefixWithUncompressedSize(false);
+  std::string compressed2;
+  IBufferCompressor::Compress(compressed2, zlib, s);
+  ASSERT_EQ(compressed2, compressed);
+
+  ASSERT_THROW(HttpOutput::Compress(compressed, s.c_str(), s.size(), HttpCompression_None), OrthancException);
+}
+#endif
+
+
 #if ORTHANC_SANDBOXED != 1
 static bool ReadAllStream(std::string& result,
                           IHttpStreamAnswer& stream,
@@ -334,3 +366,116 @@ TEST(HttpStreamTranscoder, Basic)
   }
 }
 #endif
+
+
+#if ORTHANC_SANDBOXED != 1
+namespace
+{
+  class IntegersSource : public JsonStreamAnswer::IItemsSource
+  {
+  private:
+    unsigned int  count_;
+    unsigned int  current_;
+
+  public:
+    explicit IntegersSource(unsigned int count) :
+      count_(count),
+      current_(0)
+    {
+    }
+
+    virtual bool ReadNextItem(std::string& key,
+                              Json::Value& item) ORTHANC_OVERRIDE
+    {
+      if (current_ == count_)
+      {
+        return false;
+      }
+      else
+      {
+        key = "item-" + boost::lexical_cast<std::string>(current_);
+        item = Json::objectValue;
+        item["value"] = static_cast<int>(current_);
+        current_++;
+        return true;
+      }
+    }
+  };
+}
+
+
+static void ReadJsonStream(Json::Value& target,
+                           JsonStreamAnswer& stream)
+{
+  ASSERT_EQ(HttpCompression_None, stream.SetupHttpCompression(true, true));
+  ASSERT_THROW(stream.GetContentLength(), OrthancException);
+  ASSERT_EQ(std::string(MIME_JSON_UTF8), stream.GetContentType());
+
+  std::string s;
+  while (stream.ReadNextChunk())
+  {
+    ASSERT_LT(0u, stream.GetChunkSize());
+    s.append(stream.GetChunkContent(), stream.GetChunkSize());
+  }
+
+  ASSERT_FALSE(stream.ReadNextChunk());
+  ASSERT_TRUE(Toolbox::ReadJson(target, s));
+}
+
+
+TEST(JsonStreamAnswer, Basic)
+{
+  for (unsigned int count = 0; count < 5; count++)
+  {
+    for (size_t cs = 0; cs < 40; cs += 13)
+    {
+      Json::Value a, b;
+
+      {
+        IntegersSource source(count);
+        JsonStreamAnswer stream(source, false);
+        stream.SetChunkSize(cs);
+        ReadJsonStream(a, stream);
+      }
+
+      {
+        IntegersSource source(count);
+        JsonStreamAnswer stream(source, false);
+        stream.Flatten(b);
+        ASSERT_THROW(stream.Flatten(b), OrthancException);
+      }
+
+      ASSERT_EQ(Json::arrayValue, a.type());
+      ASSERT_EQ(count, a.size());
+      ASSERT_EQ(a, b);
+
+      for (unsigned int i = 0; i < count; i++)
+      {
+        ASSERT_EQ(i, a[i]["value"].asUInt());
+      }
+
+      {
+        IntegersSource source(count);
+        JsonStreamAnswer stream(source, true);
+        stream.SetChunkSize(cs);
+        ReadJsonStream(a, stream);
+      }
+
+      {
+        IntegersSource source(count);
+        JsonStreamAnswer stream(source, true);
+        stream.Flatten(b);
+      }
+
+      ASSERT_EQ(Json::objectValue, a.type());
+      ASSERT_EQ(count, a.size());
+      ASSERT_EQ(a, b);
+
+      for (unsigned int i = 0; i < count; i++)
+      {
+        ASSERT_EQ(i, a["item-" + boost::lexical_cast<std::string>(i)]["value"].asUInt());
+      }
+    }
+  }
+}
+#endif
@@ -0,0 +1,108 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../../OrthancFramework/Sources/Logging.h"
+#include "../../OrthancFramework/Sources/Toolbox.h"
+
+#include "../Sources/OrthancInitialization.h"
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+
+/**
+ * The benchmarks write their results as JSON by default, which allows
+ * to track the regressions across commits, e.g.:
+ *
+ *   $ ./Benchmarks --benchmark_out=results.json --benchmark_repetitions=5
+ *
+ * Give "--benchmark_format=console" to get a human-readable output. The
+ * standard options of Google Benchmark are available (cf. "--help"),
+ * such as "--benchmark_filter=ServerIndex" to select the benchmarks.
+ * The benchmarks should be built in "Release" mode, as the "Debug"
+ * builds check the invariants of the caches after each operation.
+ **/
+
+using namespace Orthanc;
+
+
+int main(int argc, char **argv)
+{
+  Logging::Initialize();
+  Toolbox::InitializeGlobalLocale(NULL);
+  Toolbox::DetectEndianness();
+  OrthancInitialize();
+
+  std::vector<char*> arguments(argv, argv + argc);
+
+  bool hasFormat = false;
+  bool hasOutFormat = false;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string s(argv[i]);
+    if (s.compare(0, 19, "--benchmark_format=") == 0)
+    {
+      hasFormat = true;
+    }
+    else if (s.compare(0, 23, "--benchmark_out_format=") == 0)
+    {
+      hasOutFormat = true;
+    }
+  }
+
+  static char JSON_FORMAT[] = "--benchmark_format=json";
+  static char JSON_OUT_FORMAT[] = "--benchmark_out_format=json";
+
+  if (!hasFormat)
+  {
+    arguments.push_back(JSON_FORMAT);
+  }
+
+  if (!hasOutFormat)
+  {
+    arguments.push_back(JSON_OUT_FORMAT);
+  }
+
+  // Store the version of Orthanc in the "context" section of the JSON
+  benchmark::AddCustomContext("orthanc_version", ORTHANC_VERSION);
+
+  int count = static_cast<int>(arguments.size());
+  benchmark::Initialize(&count, &arguments[0]);
+
+  int result;
+  if (benchmark::ReportUnrecognizedArguments(count, &arguments[0]))
+  {
+    result = -1;
+  }
+  else
+  {
+    benchmark::RunSpecifiedBenchmarks();
+    result = 0;
+  }
+
+  OrthancFinalize();
+  Logging::Finalize();
+
+  return result;
+}
@@ -0,0 +1,160 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../../OrthancFramework/Sources/Compatibility.h"  // For std::unique_ptr<>
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomAssociationParameters.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomServer.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomStoreUserConnection.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/IStoreRequestHandlerFactory.h"
+#include "../../OrthancFramework/Sources/DicomParsing/ParsedDicomFile.h"
+#include "../../OrthancFramework/Sources/Images/Image.h"
+#include "../../OrthancFramework/Sources/Images/ImageProcessing.h"
+
+#include <benchmark/benchmark.h>
+#include <dcmtk/dcmnet/dimse.h>
+
+
+/**
+ * Throughput of C-STORE between Orthanc SCU and Orthanc SCP over the
+ * loopback interface, depending on the maximum PDU length and on the
+ * size of the TCP buffers. The received datasets are discarded, so
+ * that only the cost of the DICOM network stack is measured. The
+ * effect of the TCP buffers is much larger on real links, whose
+ * bandwidth-delay product is higher than that of the loopback.
+ **/
+
+using namespace Orthanc;
+
+
+namespace
+{
+  static const uint16_t  BENCHMARK_PORT = 14242;
+  static const char*     BENCHMARK_AET = "BENCHMARK";
+
+  class NullStoreRequestHandler : public IStoreRequestHandler
+  {
+  public:
+    virtual uint16_t Handle(DcmDataset& dicom,
+                            const std::string& remoteIp,
+                            const std::string& remoteAet,
+                            const std::string& calledAet) ORTHANC_OVERRIDE
+    {
+      return STATUS_Success;
+    }
+  };
+
+
+  class NullServerFactory :
+    public IStoreRequestHandlerFactory,
+    public DicomServer::IRemoteModalities
+  {
+  public:
+    virtual IStoreRequestHandler* ConstructStoreRequestHandler() ORTHANC_OVERRIDE
+    {
+      return new NullStoreRequestHandler;
+    }
+
+    virtual bool IsSameAETitle(const std::string& aet1,
+                               const std::string& aet2) ORTHANC_OVERRIDE
+    {
+      return aet1 == aet2;
+    }
+
+    virtual bool LookupAETitle(RemoteModalityParameters& modality,
+                               const std::string& aet) ORTHANC_OVERRIDE
+    {
+      return false;
+    }
+  };
+
+
+  // 32MB of uncompressed pixel data, as in a large CT or MG image
+  void CreateLargeDicom(std::string& target)
+  {
+    DicomMap tags;
+    tags.SetValue(DICOM_TAG_PATIENT_ID, "BENCHMARK", false);
+    tags.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "1.2.826.0.1.3680043.10.1.1", false);
+    tags.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "1.2.826.0.1.3680043.10.2.1", false);
+    tags.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "1.2.826.0.1.3680043.10.3.1", false);
+    tags.SetValue(DICOM_TAG_SOP_CLASS_UID, "1.2.840.10008.5.1.4.1.1.2", false);  // CT image
+
+    ParsedDicomFile dicom(tags, GetDefaultDicomEncoding(), false /* be strict */);
+
+    Image image(PixelFormat_Grayscale16, 4096, 4096, false);
+    ImageProcessing::Set(image, 42);
+    dicom.EmbedImage(image);
+
+    dicom.SaveToMemoryBuffer(target);
+  }
+}
+
+
+static void DicomNetwork_Store(benchmark::State& state)
+{
+  const unsigned int pduLength = static_cast<unsigned int>(state.range(0));
+  const unsigned int tcpBufferLength = static_cast<unsigned int>(state.range(1));
+
+  std::string dicom;
+  CreateLargeDicom(dicom);
+
+  // Must be set before the sockets of the server and of the client are created
+  DicomAssociationParameters::SetTcpBufferLength(tcpBufferLength);
+
+  NullServerFactory factory;
+
+  DicomServer server;
+  server.SetApplicationEntityTitle(BENCHMARK_AET);
+  server.SetPortNumber(BENCHMARK_PORT);
+  server.SetMaximumPduLength(pduLength);
+  server.SetRemoteModalities(factory);
+  server.SetStoreRequestHandlerFactory(factory);
+  server.Start();
+
+  {
+    DicomAssociationParameters parameters;
+    parameters.SetRemoteApplicationEntityTitle(BENCHMARK_AET);
+    parameters.SetRemoteHost("127.0.0.1");
+    parameters.SetRemotePort(BENCHMARK_PORT);
+    parameters.SetMaximumPduLength(pduLength);
+
+    DicomStoreUserConnection scu(parameters);
+
+    for (auto _ : state)
+    {
+      std::string sopClassUid, sopInstanceUid;
+      scu.Store(sopClassUid, sopInstanceUid, dicom.c_str(), dicom.size(), false, "", 0);
+    }
+  }
+
+  server.Stop();
+
+  DicomAssociationParameters::SetTcpBufferLength(0);
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * dicom.size());
+}
+
+BENCHMARK(DicomNetwork_Store)
+  ->Args({16384, 0})              // Default configuration of Orthanc
+  ->Args({131072, 0})             // Maximum PDU length supported by DCMTK
+  ->Args({131072, 4194304})       // Large PDU and 4MB TCP buffers
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
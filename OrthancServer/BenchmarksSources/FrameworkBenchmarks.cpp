@@ -0,0 +1,499 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../../OrthancFramework/Sources/Cache/LeastRecentlyUsedIndex.h"
+#include "../../OrthancFramework/Sources/Cache/MemoryObjectCache.h"
+#include "../../OrthancFramework/Sources/Compatibility.h"  // For std::unique_ptr<>
+#include "../../OrthancFramework/Sources/Compression/ZipWriter.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomMap.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomStreamReader.h"
+#include "../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
+#include "../../OrthancFramework/Sources/DicomParsing/ParsedDicomFile.h"
+#include "../../OrthancFramework/Sources/Images/Image.h"
+#include "../../OrthancFramework/Sources/Images/ImageProcessing.h"
+#include "../../OrthancFramework/Sources/OrthancException.h"
+
+#include <benchmark/benchmark.h>
+#include <boost/lexical_cast.hpp>
+#include <sstream>
+#include <string.h>
+
+
+/**
+ * All the inputs of the benchmarks below are synthetic and generated
+ * from fixed seeds, so that the measures are comparable across runs
+ * and across commits.
+ **/
+
+using namespace Orthanc;
+
+
+namespace
+{
+  // Linear congruential generator (constants from "Numerical Recipes")
+  class RandomGenerator : public boost::noncopyable
+  {
+  private:
+    uint32_t  state_;
+
+  public:
+    explicit RandomGenerator(uint32_t seed) :
+      state_(seed)
+    {
+    }
+
+    uint32_t Next()
+    {
+      state_ = state_ * 1664525u + 1013904223u;
+      return state_;
+    }
+  };
+
+
+  void FillRandom(ImageAccessor& image,
+                  uint32_t seed)
+  {
+    RandomGenerator generator(seed);
+
+    const unsigned int rowSize = image.GetBytesPerPixel() * image.GetWidth();
+
+    for (unsigned int y = 0; y < image.GetHeight(); y++)
+    {
+      uint8_t* p = reinterpret_cast<uint8_t*>(image.GetRow(y));
+      for (unsigned int x = 0; x < rowSize; x++)
+      {
+        p[x] = static_cast<uint8_t>(generator.Next() >> 24);
+      }
+    }
+  }
+
+
+  void CreateSyntheticTags(DicomMap& target,
+                           unsigned int index)
+  {
+    const std::string suffix = boost::lexical_cast<std::string>(index);
+
+    target.Clear();
+    target.SetValue(DICOM_TAG_PATIENT_ID, "PATIENT-" + suffix, false);
+    target.SetValue(DICOM_TAG_PATIENT_NAME, "BENCHMARK^PATIENT" + suffix, false);
+    target.SetValue(DICOM_TAG_PATIENT_BIRTH_DATE, "19700101", false);
+    target.SetValue(DICOM_TAG_PATIENT_SEX, (index % 2 == 0 ? "F" : "M"), false);
+    target.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "1.2.826.0.1.3680043.10.1." + suffix, false);
+    target.SetValue(DICOM_TAG_STUDY_DATE, "20220101", false);
+    target.SetValue(DICOM_TAG_STUDY_TIME, "120000", false);
+    target.SetValue(DICOM_TAG_STUDY_DESCRIPTION, "Benchmark study", false);
+    target.SetValue(DICOM_TAG_ACCESSION_NUMBER, "ACC-" + suffix, false);
+    target.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "1.2.826.0.1.3680043.10.2." + suffix, false);
+    target.SetValue(DICOM_TAG_MODALITY, "CT", false);
+    target.SetValue(DICOM_TAG_SERIES_NUMBER, "1", false);
+    target.SetValue(DICOM_TAG_SERIES_DESCRIPTION, "Benchmark series", false);
+    target.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "1.2.826.0.1.3680043.10.3." + suffix, false);
+    target.SetValue(DICOM_TAG_SOP_CLASS_UID, "1.2.840.10008.5.1.4.1.1.2", false);  // CT image
+    target.SetValue(DICOM_TAG_INSTANCE_NUMBER, suffix, false);
+    target.SetValue(DICOM_TAG_IMAGE_POSITION_PATIENT, "0\\0\\" + suffix, false);
+    target.SetValue(DICOM_TAG_IMAGE_ORIENTATION_PATIENT, "1\\0\\0\\0\\1\\0", false);
+  }
+
+
+  ParsedDicomFile* CreateSyntheticDicom(unsigned int width,
+                                        unsigned int height)
+  {
+    DicomMap tags;
+    CreateSyntheticTags(tags, 0);
+
+    std::unique_ptr<ParsedDicomFile> dicom(
+      new ParsedDicomFile(tags, GetDefaultDicomEncoding(), false /* be strict */));
+
+    Image image(PixelFormat_Grayscale16, width, height, false);
+    FillRandom(image, 42);
+    dicom->EmbedImage(image);
+
+    return dicom.release();
+  }
+
+
+  class CacheableString : public ICacheable
+  {
+  private:
+    std::string  value_;
+
+  public:
+    explicit CacheableString(const std::string& value) :
+      value_(value)
+    {
+    }
+
+    virtual size_t GetMemoryUsage() const ORTHANC_OVERRIDE
+    {
+      return value_.size();
+    }
+  };
+
+
+  class NullVisitor : public DicomStreamReader::IVisitor
+  {
+  private:
+    size_t  countTags_;
+
+  public:
+    NullVisitor() :
+      countTags_(0)
+    {
+    }
+
+    size_t GetCountTags() const
+    {
+      return countTags_;
+    }
+
+    virtual void VisitMetaHeaderTag(const DicomTag& tag,
+                                    const ValueRepresentation& vr,
+                                    const std::string& value) ORTHANC_OVERRIDE
+    {
+    }
+
+    virtual void VisitTransferSyntax(DicomTransferSyntax transferSyntax) ORTHANC_OVERRIDE
+    {
+    }
+
+    virtual bool VisitDatasetTag(const DicomTag& tag,
+                                 const ValueRepresentation& vr,
+                                 const std::string& value,
+                                 bool isLittleEndian,
+                                 uint64_t fileOffset) ORTHANC_OVERRIDE
+    {
+      countTags_++;
+      return (tag != DICOM_TAG_PIXEL_DATA);
+    }
+  };
+}
+
+
+
+static void DicomMap_Construction(benchmark::State& state)
+{
+  for (auto _ : state)
+  {
+    DicomMap tags;
+    CreateSyntheticTags(tags, 42);
+    benchmark::DoNotOptimize(tags.GetSize());
+  }
+}
+
+BENCHMARK(DicomMap_Construction);
+
+
+static void DicomMap_ExtractMainDicomTags(benchmark::State& state)
+{
+  DicomMap tags;
+  CreateSyntheticTags(tags, 42);
+
+  for (auto _ : state)
+  {
+    DicomMap study;
+    tags.ExtractStudyInformation(study);
+    benchmark::DoNotOptimize(study.GetSize());
+  }
+}
+
+BENCHMARK(DicomMap_ExtractMainDicomTags);
+
+
+static void FromDcmtkBridge_ExtractDicomSummary(benchmark::State& state)
+{
+  std::unique_ptr<ParsedDicomFile> dicom(CreateSyntheticDicom(512, 512));
+  DcmDataset& dataset = *dicom->GetDcmtkObject().getDataset();
+
+  const std::set<DicomTag> ignoreTagLength;
+
+  for (auto _ : state)
+  {
+    DicomMap summary;
+    FromDcmtkBridge::ExtractDicomSummary(summary, dataset, ORTHANC_MAXIMUM_TAG_LENGTH, ignoreTagLength);
+    benchmark::DoNotOptimize(summary.GetSize());
+  }
+}
+
+BENCHMARK(FromDcmtkBridge_ExtractDicomSummary);
+
+
+static void DicomStreamReader_Consume(benchmark::State& state)
+{
+  std::string buffer;
+
+  {
+    std::unique_ptr<ParsedDicomFile> dicom(CreateSyntheticDicom(512, 512));
+    dicom->SaveToMemoryBuffer(buffer);
+  }
+
+  for (auto _ : state)
+  {
+    std::istringstream stream(buffer);
+    DicomStreamReader reader(stream);
+
+    NullVisitor visitor;
+    reader.Consume(visitor);
+    benchmark::DoNotOptimize(visitor.GetCountTags());
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * buffer.size());
+}
+
+BENCHMARK(DicomStreamReader_Consume);
+
+
+static void ImageProcessing_Convert(benchmark::State& state)
+{
+  const unsigned int size = static_cast<unsigned int>(state.range(0));
+
+  Image source(PixelFormat_Grayscale16, size, size, false);
+  FillRandom(source, 42);
+
+  Image target(PixelFormat_Grayscale8, size, size, false);
+
+  for (auto _ : state)
+  {
+    ImageProcessing::Convert(target, source);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * size * size);
+}
+
+BENCHMARK(ImageProcessing_Convert)->Arg(512)->Arg(2048);
+
+
+static void ImageProcessing_ShiftScale(benchmark::State& state)
+{
+  const unsigned int size = static_cast<unsigned int>(state.range(0));
+
+  // This is the windowing of the rendering of floating-point images
+  Image source(PixelFormat_Float32, size, size, false);
+
+  {
+    Image tmp(PixelFormat_Grayscale16, size, size, false);
+    FillRandom(tmp, 42);
+    ImageProcessing::Convert(source, tmp);
+  }
+
+  Image target(PixelFormat_Grayscale8, size, size, false);
+
+  for (auto _ : state)
+  {
+    ImageProcessing::ShiftScale(target, source, -1024.0f, 255.0f / 65536.0f, false);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * size * size);
+}
+
+BENCHMARK(ImageProcessing_ShiftScale)->Arg(512)->Arg(2048);
+
+
+static void ImageProcessing_GetMinMaxIntegerValue(benchmark::State& state)
+{
+  const unsigned int size = static_cast<unsigned int>(state.range(0));
+
+  Image image(PixelFormat_Grayscale16, size, size, false);
+  FillRandom(image, 42);
+
+  for (auto _ : state)
+  {
+    int64_t minValue, maxValue;
+    ImageProcessing::GetMinMaxIntegerValue(minValue, maxValue, image);
+    benchmark::DoNotOptimize(minValue);
+    benchmark::DoNotOptimize(maxValue);
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * size * size);
+}
+
+BENCHMARK(ImageProcessing_GetMinMaxIntegerValue)->Arg(512)->Arg(2048);
+
+
+static void ImageProcessing_SmoothGaussian5x5(benchmark::State& state)
+{
+  const unsigned int size = static_cast<unsigned int>(state.range(0));
+
+  Image source(PixelFormat_Grayscale8, size, size, false);
+  FillRandom(source, 42);
+
+  Image image(PixelFormat_Grayscale8, size, size, false);
+
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    ImageProcessing::Copy(image, source);
+    state.ResumeTiming();
+
+    ImageProcessing::SmoothGaussian5x5(image, false);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * size * size);
+}
+
+BENCHMARK(ImageProcessing_SmoothGaussian5x5)->Arg(512);
+
+
+static void ImageProcessing_Resize(benchmark::State& state)
+{
+  const unsigned int size = static_cast<unsigned int>(state.range(0));
+
+  Image source(PixelFormat_RGB24, size, size, false);
+  FillRandom(source, 42);
+
+  Image target(PixelFormat_RGB24, 256, 256, false);
+
+  for (auto _ : state)
+  {
+    ImageProcessing::Resize(target, source);
+    benchmark::ClobberMemory();
+  }
+}
+
+BENCHMARK(ImageProcessing_Resize)->Arg(512)->Arg(2048);
+
+
+static void ZipWriter_Memory(benchmark::State& state)
+{
+  const size_t countFiles = static_cast<size_t>(state.range(0));
+
+  std::string content;
+
+  {
+    // 64KB per file, half random (incompressible) and half constant
+    Image image(PixelFormat_Grayscale8, 256, 128, false);
+    FillRandom(image, 42);
+    memset(image.GetRow(64), 0, 64 * image.GetPitch());
+    content.assign(reinterpret_cast<const char*>(image.GetConstBuffer()), image.GetPitch() * image.GetHeight());
+  }
+
+  for (auto _ : state)
+  {
+    std::string archive;
+
+    {
+      ZipWriter writer;
+      writer.SetMemoryOutput(archive, false /* no ZIP64 */);
+      writer.SetCompressionLevel(6);
+      writer.Open();
+
+      for (size_t i = 0; i < countFiles; i++)
+      {
+        writer.OpenFile(("file-" + boost::lexical_cast<std::string>(i)).c_str());
+        writer.Write(content);
+      }
+
+      writer.Close();
+    }
+
+    benchmark::DoNotOptimize(archive.size());
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * countFiles * content.size());
+}
+
+BENCHMARK(ZipWriter_Memory)->Arg(16)->Arg(256);
+
+
+static void MemoryObjectCache_AcquireAndAccess(benchmark::State& state)
+{
+  const size_t countKeys = static_cast<size_t>(state.range(0));
+
+  std::vector<std::string> keys;
+  keys.reserve(countKeys);
+  for (size_t i = 0; i < countKeys; i++)
+  {
+    keys.push_back("key-" + boost::lexical_cast<std::string>(i));
+  }
+
+  MemoryObjectCache cache;
+  cache.SetMaximumSize(countKeys / 2 * 1024);  // Half of the items fit in the cache
+
+  RandomGenerator generator(42);
+  const std::string value(1024, 'x');
+
+  for (auto _ : state)
+  {
+    const std::string& key = keys[generator.Next() % countKeys];
+
+    bool found;
+
+    {
+      MemoryObjectCache::Accessor accessor(cache, key, false /* shared */);
+      found = accessor.IsValid();
+    }
+
+    if (!found)
+    {
+      cache.Acquire(key, new CacheableString(value));
+    }
+  }
+}
+
+BENCHMARK(MemoryObjectCache_AcquireAndAccess)->Arg(1000)->Arg(100000);
+
+
+static void LeastRecentlyUsedIndex_MakeMostRecent(benchmark::State& state)
+{
+  const unsigned int countKeys = static_cast<unsigned int>(state.range(0));
+
+  LeastRecentlyUsedIndex<unsigned int> index;
+  for (unsigned int i = 0; i < countKeys; i++)
+  {
+    index.Add(i);
+  }
+
+  RandomGenerator generator(42);
+
+  for (auto _ : state)
+  {
+    index.MakeMostRecent(generator.Next() % countKeys);
+  }
+}
+
+BENCHMARK(LeastRecentlyUsedIndex_MakeMostRecent)->Arg(1000)->Arg(100000);
+
+
+static void LeastRecentlyUsedIndex_Recycle(benchmark::State& state)
+{
+  const unsigned int countKeys = static_cast<unsigned int>(state.range(0));
+
+  LeastRecentlyUsedIndex<unsigned int> index;
+  for (unsigned int i = 0; i < countKeys; i++)
+  {
+    index.Add(i);
+  }
+
+  unsigned int next = countKeys;
+
+  for (auto _ : state)
+  {
+    // Simulates a full cache: Evict the oldest item, then insert a new one
+    index.RemoveOldest();
+    index.Add(next++);
+  }
+}
+
+BENCHMARK(LeastRecentlyUsedIndex_Recycle)->Arg(1000)->Arg(100000);
@@ -0,0 +1,236 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../../OrthancFramework/Sources/Compatibility.h"  // For std::unique_ptr<>
+#include "../../OrthancFramework/Sources/FileStorage/MemoryStorageArea.h"
+
+#include "../Sources/Database/SQLiteDatabaseWrapper.h"
+#include "../Sources/Search/DatabaseLookup.h"
+#include "../Sources/ServerContext.h"
+#include "../Sources/ServerIndex.h"
+
+#include <benchmark/benchmark.h>
+#include <boost/lexical_cast.hpp>
+#include <stdio.h>
+
+
+using namespace Orthanc;
+
+
+namespace
+{
+  /**
+   * Hierarchy of the synthetic database: Each series contains 50
+   * instances, each study contains 4 series, and each patient has 2
+   * studies. All the identifiers derive from the index of the
+   * instance, which makes the content of the database reproducible.
+   **/
+  static const unsigned int INSTANCES_PER_SERIES = 50;
+  static const unsigned int SERIES_PER_STUDY = 4;
+  static const unsigned int STUDIES_PER_PATIENT = 2;
+
+  static const char* const MODALITIES[] = { "CT", "MR", "PT", "US" };
+
+
+  class SyntheticDatabase : public boost::noncopyable
+  {
+  private:
+    MemoryStorageArea               storage_;
+    SQLiteDatabaseWrapper           db_;   // The SQLite DB is in memory
+    std::unique_ptr<ServerContext>  context_;
+    unsigned int                    countInstances_;
+
+  public:
+    SyntheticDatabase() :
+      countInstances_(0)
+    {
+      db_.Open();
+      context_.reset(new ServerContext(db_, storage_, true /* running unit tests */, 10));
+      context_->SetupJobsEngine(true, false);
+    }
+
+    ~SyntheticDatabase()
+    {
+      context_->Stop();
+      context_.reset(NULL);
+      db_.Close();
+    }
+
+    ServerIndex& GetIndex()
+    {
+      return context_->GetIndex();
+    }
+
+    unsigned int GetCountInstances() const
+    {
+      return countInstances_;
+    }
+
+    static void GetSummary(DicomMap& target,
+                           unsigned int instance)
+    {
+      const unsigned int series = instance / INSTANCES_PER_SERIES;
+      const unsigned int study = series / SERIES_PER_STUDY;
+      const unsigned int patient = study / STUDIES_PER_PATIENT;
+
+      const std::string patientId = boost::lexical_cast<std::string>(patient);
+      const std::string studyId = boost::lexical_cast<std::string>(study);
+      const std::string seriesId = boost::lexical_cast<std::string>(series);
+      const std::string instanceId = boost::lexical_cast<std::string>(instance);
+
+      target.Clear();
+      target.SetValue(DICOM_TAG_PATIENT_ID, "PATIENT-" + patientId, false);
+      target.SetValue(DICOM_TAG_PATIENT_NAME, "BENCHMARK^PATIENT" + patientId, false);
+      target.SetValue(DICOM_TAG_PATIENT_BIRTH_DATE, "19700101", false);
+      target.SetValue(DICOM_TAG_PATIENT_SEX, (patient % 2 == 0 ? "F" : "M"), false);
+      target.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "1.2.826.0.1.3680043.10.1." + studyId, false);
+      target.SetValue(DICOM_TAG_STUDY_DATE, "2022" + std::string(study % 2 == 0 ? "01" : "06") + "15", false);
+      target.SetValue(DICOM_TAG_STUDY_DESCRIPTION, "Benchmark study", false);
+      target.SetValue(DICOM_TAG_ACCESSION_NUMBER, "ACC-" + studyId, false);
+      target.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "1.2.826.0.1.3680043.10.2." + seriesId, false);
+      target.SetValue(DICOM_TAG_MODALITY, MODALITIES[series % SERIES_PER_STUDY], false);
+      target.SetValue(DICOM_TAG_SERIES_NUMBER, boost::lexical_cast<std::string>(series % SERIES_PER_STUDY + 1), false);
+      target.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "1.2.826.0.1.3680043.10.3." + instanceId, false);
+      target.SetValue(DICOM_TAG_SOP_CLASS_UID, "1.2.840.10008.5.1.4.1.1.2", false);  // CT image
+      target.SetValue(DICOM_TAG_INSTANCE_NUMBER, boost::lexical_cast<std::string>(instance % INSTANCES_PER_SERIES + 1), false);
+    }
+
+    void AddInstance()
+    {
+      DicomMap summary;
+      GetSummary(summary, countInstances_);
+
+      char uuid[64];
+      sprintf(uuid, "00000000-0000-0000-0000-%012u", countInstances_);
+
+      ServerIndex::Attachments attachments;
+      attachments.push_back(FileInfo(uuid, FileContentType_Dicom, 512 * 1024, "md5"));
+
+      std::map<MetadataType, std::string> instanceMetadata;
+      ServerIndex::MetadataMap metadata;
+
+      if (GetIndex().Store(instanceMetadata, summary, attachments, metadata,
+                           DicomInstanceOrigin::FromPlugins(), false /* don't overwrite */,
+                           true, DicomTransferSyntax_LittleEndianExplicit,
+                           false /* no pixel data offset */, 0, false /* not a reconstruct */) != StoreStatus_Success)
+      {
+        throw OrthancException(ErrorCode_InternalError);
+      }
+
+      countInstances_++;
+    }
+
+    void Populate(unsigned int countInstances)
+    {
+      while (countInstances_ < countInstances)
+      {
+        AddInstance();
+      }
+    }
+  };
+}
+
+
+
+static void ServerIndex_Store(benchmark::State& state)
+{
+  SyntheticDatabase database;
+  database.Populate(static_cast<unsigned int>(state.range(0)));
+
+  for (auto _ : state)
+  {
+    database.AddInstance();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(ServerIndex_Store)->Arg(0)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+
+static void ServerIndex_LookupStudyByIdentifier(benchmark::State& state)
+{
+  SyntheticDatabase database;
+  database.Populate(static_cast<unsigned int>(state.range(0)));
+
+  DicomMap summary;
+  SyntheticDatabase::GetSummary(summary, database.GetCountInstances() / 2);
+
+  DatabaseLookup lookup;
+  lookup.AddRestConstraint(DICOM_TAG_STUDY_INSTANCE_UID,
+                           summary.GetStringValue(DICOM_TAG_STUDY_INSTANCE_UID, "", false),
+                           true /* case sensitive */, true /* mandatory */);
+
+  for (auto _ : state)
+  {
+    std::vector<std::string> resources;
+    database.GetIndex().ApplyLookupResources(resources, NULL, lookup, ResourceType_Study, 0 /* no limit */);
+
+    if (resources.size() != 1)
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+  }
+}
+
+BENCHMARK(ServerIndex_LookupStudyByIdentifier)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+
+static void ServerIndex_LookupStudiesByWildcard(benchmark::State& state)
+{
+  SyntheticDatabase database;
+  database.Populate(static_cast<unsigned int>(state.range(0)));
+
+  // Matches about 1 patient out of 10
+  DatabaseLookup lookup;
+  lookup.AddRestConstraint(DICOM_TAG_PATIENT_NAME, "BENCHMARK^PATIENT1*", false /* case insensitive */, true);
+  lookup.AddRestConstraint(DICOM_TAG_STUDY_DATE, "20220101-20220131", false, true);
+
+  for (auto _ : state)
+  {
+    std::vector<std::string> resources;
+    database.GetIndex().ApplyLookupResources(resources, NULL, lookup, ResourceType_Study, 0 /* no limit */);
+    benchmark::DoNotOptimize(resources.size());
+  }
+}
+
+BENCHMARK(ServerIndex_LookupStudiesByWildcard)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+
+static void ServerIndex_LookupSeriesWithInstances(benchmark::State& state)
+{
+  SyntheticDatabase database;
+  database.Populate(static_cast<unsigned int>(state.range(0)));
+
+  DatabaseLookup lookup;
+  lookup.AddRestConstraint(DICOM_TAG_MODALITY, "MR", true, true);
+
+  for (auto _ : state)
+  {
+    std::vector<std::string> resources, instances;
+    database.GetIndex().ApplyLookupResources(resources, &instances, lookup, ResourceType_Series, 100);
+    benchmark::DoNotOptimize(instances.size());
+  }
+}
+
+BENCHMARK(ServerIndex_LookupSeriesWithInstances)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
@@ -31,7 +31,9 @@
 #include "../../../OrthancFramework/Sources/Logging.h"
 #include "../../../OrthancFramework/Sources/OrthancException.h"
 #include "../../Sources/Database/Compatibility/ICreateInstance.h"
+#include "../../Sources/Database/Compatibility/IExpandResources.h"
 #include "../../Sources/Database/Compatibility/IGetChildrenMetadata.h"
+#include "../../Sources/Database/Compatibility/IKeysetPagination.h"
 #include "../../Sources/Database/Compatibility/ILookupResourceAndParent.h"
 #include "../../Sources/Database/Compatibility/ILookupResources.h"
 #include "../../Sources/Database/Compatibility/ISetResourcesContent.h"
@@ -45,7 +47,9 @@ namespace Orthanc
   class OrthancPluginDatabase::Transaction :
     public IDatabaseWrapper::ITransaction,
     public Compatibility::ICreateInstance,
+    public Compatibility::IExpandResources,
     public Compatibility::IGetChildrenMetadata,
+    public Compatibility::IKeysetPagination,
     public Compatibility::ILookupResources,
     public Compatibility::ILookupResourceAndParent,
     public Compatibility::ISetResourcesContent
@@ -1274,6 +1278,39 @@ namespace Orthanc
     }
 
 
+    virtual void ExpandResources(ResourcesBatch& target,
+                                 bool includeMainDicomTags,
+                                 bool includeMetadata,
+                                 bool includeChildren) ORTHANC_OVERRIDE
+    {
+      // No batched primitive in the legacy database SDK
+      IExpandResources::Apply(*this, target, includeMainDicomTags, includeMetadata, includeChildren);
+    }
+
+
+    virtual void GetAllPublicIds(std::list<std::string>& publicIds,
+                                 std::list<int64_t>& internalIds,
+                                 ResourceType resourceType,
+                                 int64_t since,
+                                 size_t limit) ORTHANC_OVERRIDE
+    {
+      // The database SDK cannot sort the resources by internal ID
+      IKeysetPagination::ListResources(*this, publicIds, internalIds, resourceType, since, limit);
+    }
+
+
+    virtual void ApplyLookupResources(std::list<std::string>& resourcesId,
+                                      std::list<std::string>* instancesId,
+                                      std::list<int64_t>& internalIds,
+                                      const std::vector<DatabaseConstraint>& lookup,
+                                      ResourceType queryLevel,
+                                      int64_t since,
+                                      size_t limit) ORTHANC_OVERRIDE
+    {
+      IKeysetPagination::LookupResources(*this, resourcesId, instancesId, internalIds, lookup, queryLevel, since, limit);
+    }
+
+
     virtual bool SelectPatientToRecycle(int64_t& internalId) ORTHANC_OVERRIDE
     {
       ResetAnswers();
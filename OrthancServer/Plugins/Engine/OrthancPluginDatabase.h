@@ -113,6 +113,11 @@ namespace Orthanc
       return false;  // No support for revisions in old API
     }
 
+    virtual bool HasKeysetPaginationSupport() const ORTHANC_OVERRIDE
+    {
+      return false;  // The database SDK cannot sort the resources by internal ID
+    }
+
     void AnswerReceived(const _OrthancPluginDatabaseAnswer& answer);
   };
 }
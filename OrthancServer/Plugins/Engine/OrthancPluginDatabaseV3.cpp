@@ -29,6 +29,8 @@
 
 #include "../../../OrthancFramework/Sources/Logging.h"
 #include "../../../OrthancFramework/Sources/OrthancException.h"
+#include "../../Sources/Database/Compatibility/IExpandResources.h"
+#include "../../Sources/Database/Compatibility/IKeysetPagination.h"
 #include "../../Sources/Database/ResourcesContent.h"
 #include "../../Sources/Database/VoidDatabaseListener.h"
 #include "PluginsEnumerations.h"
@@ -45,7 +47,10 @@
 
 namespace Orthanc
 {
-  class OrthancPluginDatabaseV3::Transaction : public IDatabaseWrapper::ITransaction
+  class OrthancPluginDatabaseV3::Transaction :
+    public IDatabaseWrapper::ITransaction,
+    public Compatibility::IExpandResources,
+    public Compatibility::IKeysetPagination
   {
   private:
     OrthancPluginDatabaseV3&           that_;
@@ -1033,6 +1038,42 @@ namespace Orthanc
         return false;
       }
     }
+
+
+    virtual void ExpandResources(ResourcesBatch& target,
+                                 bool includeMainDicomTags,
+                                 bool includeMetadata,
+                                 bool includeChildren) ORTHANC_OVERRIDE
+    {
+      /**
+       * The database SDK has no batched primitive yet, but all the
+       * queries are still issued inside the same transaction.
+       **/
+      IExpandResources::Apply(*this, target, includeMainDicomTags, includeMetadata, includeChildren);
+    }
+
+
+    virtual void GetAllPublicIds(std::list<std::string>& publicIds,
+                                 std::list<int64_t>& internalIds,
+                                 ResourceType resourceType,
+                                 int64_t since,
+                                 size_t limit) ORTHANC_OVERRIDE
+    {
+      // The database SDK cannot sort the resources by internal ID
+      IKeysetPagination::ListResources(*this, publicIds, internalIds, resourceType, since, limit);
+    }
+
+
+    virtual void ApplyLookupResources(std::list<std::string>& resourcesId,
+                                      std::list<std::string>* instancesId,
+                                      std::list<int64_t>& internalIds,
+                                      const std::vector<DatabaseConstraint>& lookup,
+                                      ResourceType queryLevel,
+                                      int64_t since,
+                                      size_t limit) ORTHANC_OVERRIDE
+    {
+      IKeysetPagination::LookupResources(*this, resourcesId, instancesId, internalIds, lookup, queryLevel, since, limit);
+    }
   };
 
   
@@ -3113,6 +3113,28 @@ namespace Orthanc
     CopyToMemoryBuffer(*p.target, dicom);
   }
 
+
+  void OrthancPlugins::GetRawFrameForInstance(const void* parameters)
+  {
+    const _OrthancPluginGetRawFrameForInstance& p = 
+      *reinterpret_cast<const _OrthancPluginGetRawFrameForInstance*>(parameters);
+
+    std::string frame;
+    MimeType mime;
+
+    {
+      PImpl::ServerContextLock lock(*pimpl_);
+
+      if (!lock.GetContext().ReadRawFrame(frame, mime, p.instanceId, p.frameIndex))
+      {
+        ServerContext::DicomCacheLocker locker(lock.GetContext(), p.instanceId);
+        locker.GetDicom().GetRawFrame(frame, mime, p.frameIndex);
+      }
+    }
+
+    CopyToMemoryBuffer(*p.target, frame);
+  }
+
   static void ThrowOnHttpError(HttpStatus httpStatus)
   {
     int intHttpStatus = static_cast<int>(httpStatus);
@@ -4544,6 +4566,10 @@ namespace Orthanc
         GetDicomForInstance(parameters);
         return true;
 
+      case _OrthancPluginService_GetRawFrameForInstance:
+        GetRawFrameForInstance(parameters);
+        return true;
+
       case _OrthancPluginService_RestApiGet:
         RestApiGet(parameters, false);
         return true;
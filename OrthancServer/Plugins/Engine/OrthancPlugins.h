@@ -143,6 +143,8 @@ namespace Orthanc
 
     void GetDicomForInstance(const void* parameters);
 
+    void GetRawFrameForInstance(const void* parameters);
+
     void RestApiGet(const void* parameters,
                     bool afterPlugins);
 
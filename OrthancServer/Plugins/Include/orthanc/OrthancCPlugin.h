@@ -504,6 +504,7 @@ extern "C"
     _OrthancPluginService_ReconstructMainDicomTags = 3014,
     _OrthancPluginService_RestApiGet2 = 3015,
     _OrthancPluginService_CallRestApi = 3016,              /* New in Orthanc 1.9.2 */
+    _OrthancPluginService_GetRawFrameForInstance = 3017,   /* New in Orthanc 1.11.3 */
 
     /* Access to DICOM instances */
     _OrthancPluginService_GetInstanceRemoteAet = 4000,
@@ -700,6 +701,7 @@ extern "C"
     OrthancPluginContentType_Dicom = 1,               /*!< DICOM */
     OrthancPluginContentType_DicomAsJson = 2,         /*!< JSON summary of a DICOM file */
     OrthancPluginContentType_DicomUntilPixelData = 3, /*!< DICOM Header till pixel data */
+    OrthancPluginContentType_DicomFrameOffsetTable = 4, /*!< Offsets of the frames in encapsulated pixel data (new in Orthanc 1.11.3) */
 
     _OrthancPluginContentType_INTERNAL = 0x7fffffff
   } OrthancPluginContentType;
@@ -9034,6 +9036,45 @@ extern "C"
   }
 
 
+
+  typedef struct
+  {
+    OrthancPluginMemoryBuffer*  target;
+    const char*                 instanceId;
+    uint32_t                    frameIndex;
+  } _OrthancPluginGetRawFrameForInstance;
+
+  /**
+   * @brief Retrieve the raw content of one frame of a stored DICOM instance.
+   * 
+   * Retrieve the raw content of one frame of a DICOM instance, using
+   * its Orthanc identifier. If the pixel data is encapsulated, this
+   * function only reads the bytes of the frame from the storage area
+   * if possible, which is much faster than calling
+   * OrthancPluginGetDicomForInstance() followed by
+   * OrthancPluginGetInstanceRawFrame().
+   * 
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param target The target memory buffer. It must be freed with OrthancPluginFreeMemoryBuffer().
+   * @param instanceId The Orthanc identifier of the DICOM instance of interest.
+   * @param frameIndex The index of the frame of interest.
+   * @return 0 if success, or the error code if failure.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginErrorCode  OrthancPluginGetRawFrameForInstance(
+    OrthancPluginContext*       context,
+    OrthancPluginMemoryBuffer*  target,
+    const char*                 instanceId,
+    uint32_t                    frameIndex)
+  {
+    _OrthancPluginGetRawFrameForInstance params;
+    params.target = target;
+    params.instanceId = instanceId;
+    params.frameIndex = frameIndex;
+    return context->InvokeService(context, _OrthancPluginService_GetRawFrameForInstance, &params);
+  }
+
+
 #ifdef  __cplusplus
 }
 #endif
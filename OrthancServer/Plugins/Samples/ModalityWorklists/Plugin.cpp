@@ -22,8 +22,8 @@
 
 #include "../../../../OrthancFramework/Sources/Compatibility.h"
 #include "../Common/OrthancPluginCppWrapper.h"
+#include "WorklistsIndex.h"
 
-#include <boost/filesystem.hpp>
 #include <json/value.h>
 #include <string.h>
 #include <iostream>
@@ -32,38 +32,16 @@
 static std::string folder_;
 static bool filterIssuerAet_ = false;
 static unsigned int limitAnswers_ = 0;
+static std::unique_ptr<WorklistsIndex> index_;
+
 
 /**
- * This is the main function for matching a DICOM worklist against a query.
+ * Creates the matcher of the C-Find query. The (possibly modified)
+ * query is also returned as JSON, in order to look for the candidate
+ * worklists in the index.
  **/
-static bool MatchWorklist(OrthancPluginWorklistAnswers*      answers,
-                           const OrthancPluginWorklistQuery*  query,
-                           const OrthancPlugins::FindMatcher& matcher,
-                           const std::string& path)
-{
-  OrthancPlugins::MemoryBuffer dicom;
-  dicom.ReadFile(path);
-
-  if (matcher.IsMatch(dicom))
-  {
-    // This DICOM file matches the worklist query, add it to the answers
-    OrthancPluginErrorCode code = OrthancPluginWorklistAddAnswer
-      (OrthancPlugins::GetGlobalContext(), answers, query, dicom.GetData(), dicom.GetSize());
-
-    if (code != OrthancPluginErrorCode_Success)
-    {
-      OrthancPlugins::LogError("Error while adding an answer to a worklist request");
-      ORTHANC_PLUGINS_THROW_PLUGIN_ERROR_CODE(code);
-    }
-
-    return true;
-  }
-
-  return false;
-}
-
-
-static OrthancPlugins::FindMatcher* CreateMatcher(const OrthancPluginWorklistQuery* query,
+static OrthancPlugins::FindMatcher* CreateMatcher(Json::Value& json,
+                                                  const OrthancPluginWorklistQuery* query,
                                                   const char*                       issuerAet)
 {
   // Extract the DICOM instance underlying the C-Find query
@@ -71,7 +49,6 @@ static OrthancPlugins::FindMatcher* CreateMatcher(const OrthancPluginWorklistQue
   dicom.GetDicomQuery(query);
 
   // Convert the DICOM as JSON, and dump it to the user in "--verbose" mode
-  Json::Value json;
   dicom.DicomToJson(json, OrthancPluginDicomToJsonFormat_Short,
                     static_cast<OrthancPluginDicomToJsonFlags>(0), 0);
 
@@ -144,62 +121,53 @@ OrthancPluginErrorCode Callback(OrthancPluginWorklistAnswers*     answers,
   try
   {
     // Construct an object to match the worklists in the database against the C-Find query
-    std::unique_ptr<OrthancPlugins::FindMatcher> matcher(CreateMatcher(query, issuerAet));
+    Json::Value json;
+    std::unique_ptr<OrthancPlugins::FindMatcher> matcher(CreateMatcher(json, query, issuerAet));
 
-    // Loop over the regular files in the database folder
-    namespace fs = boost::filesystem;
+    // Only the worklists that are compatible with the indexed
+    // attributes of the query are matched, without reading the disk
+    WorklistsIndex::Worklists candidates;
+    size_t countWorklists;
+    index_->LookupCandidates(candidates, countWorklists, json);
 
-    fs::path source(folder_);
-    fs::directory_iterator end;
-    unsigned int parsedFilesCount = 0;
     unsigned int matchedWorklistCount = 0;
 
-    try
+    for (WorklistsIndex::Worklists::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
     {
-      for (fs::directory_iterator it(source); it != end; ++it)
+      const std::string& dicom = (*it)->GetDicom();
+
+      if (matcher->IsMatch(dicom.c_str(), dicom.size()))
       {
-        fs::file_type type(it->status().type());
+        if (limitAnswers_ != 0 &&
+            matchedWorklistCount >= limitAnswers_)
+        {
+          // Too many answers are to be returned wrt. the
+          // "LimitAnswers" configuration parameter. Mark the
+          // C-FIND result as incomplete.
+          OrthancPluginWorklistMarkIncomplete(OrthancPlugins::GetGlobalContext(), answers);
+          return OrthancPluginErrorCode_Success;
+        }
+
+        // This DICOM file matches the worklist query, add it to the answers
+        OrthancPluginErrorCode code = OrthancPluginWorklistAddAnswer
+          (OrthancPlugins::GetGlobalContext(), answers, query, dicom.c_str(), dicom.size());
 
-        if (type == fs::regular_file ||
-            type == fs::reparse_file)   // cf. BitBucket issue #11
+        if (code != OrthancPluginErrorCode_Success)
         {
-          std::string extension = fs::extension(it->path());
-          std::transform(extension.begin(), extension.end(), extension.begin(), tolower);  // Convert to lowercase
-
-          if (extension == ".wl")
-          {
-            parsedFilesCount++;
-            // We found a worklist (i.e. a DICOM find with extension ".wl"), match it against the query
-            if (MatchWorklist(answers, query, *matcher, it->path().string()))
-            {
-              if (limitAnswers_ != 0 &&
-                  matchedWorklistCount >= limitAnswers_)
-              {
-                // Too many answers are to be returned wrt. the
-                // "LimitAnswers" configuration parameter. Mark the
-                // C-FIND result as incomplete.
-                OrthancPluginWorklistMarkIncomplete(OrthancPlugins::GetGlobalContext(), answers);
-                return OrthancPluginErrorCode_Success;
-              }
-              
-              OrthancPlugins::LogInfo("Worklist matched: " + it->path().string());
-              matchedWorklistCount++;
-            }
-          }
+          OrthancPlugins::LogError("Error while adding an answer to a worklist request");
+          ORTHANC_PLUGINS_THROW_PLUGIN_ERROR_CODE(code);
         }
-      }
 
-      std::ostringstream message;
-      message << "Worklist C-Find: parsed " << parsedFilesCount
-              << " files, found " << matchedWorklistCount << " match(es)";
-      OrthancPlugins::LogInfo(message.str());
-    }
-    catch (fs::filesystem_error&)
-    {
-      OrthancPlugins::LogError("Inexistent folder while scanning for worklists: " + source.string());
-      return OrthancPluginErrorCode_DirectoryExpected;
+        OrthancPlugins::LogInfo("Worklist matched: " + (*it)->GetPath());
+        matchedWorklistCount++;
+      }
     }
 
+    std::ostringstream message;
+    message << "Worklist C-Find: " << countWorklists << " worklists in the index, matched "
+            << candidates.size() << " candidate(s), found " << matchedWorklistCount << " match(es)";
+    OrthancPlugins::LogInfo(message.str());
+
     return OrthancPluginErrorCode_Success;
   }
   catch (OrthancPlugins::PluginException& e)
@@ -238,6 +206,10 @@ extern "C"
       if (worklists.LookupStringValue(folder_, "Database"))
       {
         OrthancPlugins::LogWarning("The database of worklists will be read from folder: " + folder_);
+
+        index_.reset(new WorklistsIndex(folder_));
+        index_->Start();
+
         OrthancPluginRegisterWorklistCallback(OrthancPlugins::GetGlobalContext(), Callback);
       }
       else
@@ -261,6 +233,7 @@ extern "C"
   ORTHANC_PLUGINS_API void OrthancPluginFinalize()
   {
     OrthancPlugins::LogWarning("Sample worklist plugin is finalizing");
+    index_.reset(NULL);
   }
 
 
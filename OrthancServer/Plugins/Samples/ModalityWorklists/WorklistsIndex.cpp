@@ -0,0 +1,544 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "WorklistsIndex.h"
+
+#include "../Common/OrthancPluginCppWrapper.h"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#if defined(__linux__)
+#  include <poll.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+
+static const char* const SCHEDULED_PROCEDURE_STEP_SEQUENCE = "0040,0100";
+static const char* const SCHEDULED_STATION_AETITLE = "0040,0001";
+static const char* const SCHEDULED_PROCEDURE_STEP_START_DATE = "0040,0002";
+static const char* const MODALITY = "0008,0060";
+
+
+// Remove the padding, and convert to uppercase, so that the index
+// never misses a worklist because of the case sensitivity of the matcher
+static std::string NormalizeValue(const std::string& value)
+{
+  size_t first = value.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos)
+  {
+    return "";
+  }
+
+  size_t last = value.find_last_not_of(" \t\r\n");
+
+  std::string result = value.substr(first, last - first + 1);
+  std::transform(result.begin(), result.end(), result.begin(), toupper);
+  return result;
+}
+
+
+static std::string GetNormalizedValue(const Json::Value& item,
+                                      const char* tag)
+{
+  if (item.type() == Json::objectValue &&
+      item.isMember(tag) &&
+      item[tag].type() == Json::stringValue)
+  {
+    return NormalizeValue(item[tag].asString());
+  }
+  else
+  {
+    return "";
+  }
+}
+
+
+static bool LookupExactConstraint(std::string& target,
+                                  const Json::Value& item,
+                                  const char* tag)
+{
+  target = GetNormalizedValue(item, tag);
+
+  // Wildcards and lists of values are not indexed
+  return (!target.empty() &&
+          target.find_first_of("*?\\") == std::string::npos);
+}
+
+
+static bool IsDate(const std::string& value)
+{
+  if (value.size() != 8)
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < value.size(); i++)
+  {
+    if (value[i] < '0' || value[i] > '9')
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static bool LookupDateConstraint(std::string& start,
+                                 std::string& end,
+                                 const Json::Value& item)
+{
+  const std::string value = GetNormalizedValue(item, SCHEDULED_PROCEDURE_STEP_START_DATE);
+
+  if (IsDate(value))
+  {
+    start = value;
+    end = value;
+    return true;
+  }
+
+  size_t separator = value.find('-');
+  if (separator == std::string::npos)
+  {
+    return false;
+  }
+
+  start = value.substr(0, separator);
+  end = value.substr(separator + 1);
+
+  return ((start.empty() || IsDate(start)) &&
+          (end.empty() || IsDate(end)) &&
+          !(start.empty() && end.empty()));
+}
+
+
+WorklistsIndex::Worklist::Worklist(const std::string& path,
+                                   std::time_t lastWriteTime,
+                                   uintmax_t fileSize) :
+  path_(path),
+  lastWriteTime_(lastWriteTime),
+  fileSize_(fileSize),
+  isValid_(false)
+{
+  Json::Value json;
+
+  try
+  {
+    OrthancPlugins::MemoryBuffer dicom;
+    dicom.ReadFile(path);
+    dicom.DicomToJson(json, OrthancPluginDicomToJsonFormat_Short,
+                      static_cast<OrthancPluginDicomToJsonFlags>(0), 0);
+    dicom.ToString(dicom_);
+  }
+  catch (OrthancPlugins::PluginException&)
+  {
+    OrthancPlugins::LogError("Cannot parse worklist: " + path);
+    return;
+  }
+
+  isValid_ = true;
+
+  if (json.isMember(SCHEDULED_PROCEDURE_STEP_SEQUENCE) &&
+      json[SCHEDULED_PROCEDURE_STEP_SEQUENCE].type() == Json::arrayValue &&
+      json[SCHEDULED_PROCEDURE_STEP_SEQUENCE].size() > 0)
+  {
+    const Json::Value& steps = json[SCHEDULED_PROCEDURE_STEP_SEQUENCE];
+
+    for (Json::Value::ArrayIndex i = 0; i < steps.size(); i++)
+    {
+      stationAets_.insert(GetNormalizedValue(steps[i], SCHEDULED_STATION_AETITLE));
+      modalities_.insert(GetNormalizedValue(steps[i], MODALITY));
+      dates_.insert(GetNormalizedValue(steps[i], SCHEDULED_PROCEDURE_STEP_START_DATE));
+    }
+  }
+  else
+  {
+    // No scheduled procedure step: The worklist is a candidate for any query
+    stationAets_.insert("");
+    modalities_.insert("");
+    dates_.insert("");
+  }
+}
+
+
+void WorklistsIndex::MonitorThread(WorklistsIndex* that)
+{
+#if defined(__linux__)
+  std::vector<char> buffer(16 * 1024);
+
+  while (that->monitoring_)
+  {
+    struct pollfd descriptor;
+    descriptor.fd = that->inotify_;
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+
+    if (poll(&descriptor, 1, 100 /* timeout in milliseconds */) > 0)
+    {
+      bool isWatchRemoved = false;
+      std::set<std::string> modifiedFiles;
+
+      for (;;)
+      {
+        ssize_t size = read(that->inotify_, &buffer[0], buffer.size());
+        if (size <= 0)
+        {
+          break;  // No more event (the descriptor is non-blocking)
+        }
+
+        for (ssize_t pos = 0; pos < size; )
+        {
+          const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(&buffer[pos]);
+          if (event->mask & IN_IGNORED)
+          {
+            isWatchRemoved = true;  // The folder was deleted or unmounted
+          }
+          else if (event->len > 0)
+          {
+            modifiedFiles.insert(event->name);
+          }
+
+          pos += sizeof(struct inotify_event) + event->len;
+        }
+      }
+
+      boost::mutex::scoped_lock lock(that->mutex_);
+      that->dirty_ = true;
+      that->modifiedFiles_.insert(modifiedFiles.begin(), modifiedFiles.end());
+
+      if (isWatchRemoved)
+      {
+        // Fallback to the listing of the folder before each query
+        close(that->inotify_);
+        that->inotify_ = -1;
+        return;
+      }
+    }
+  }
+#endif
+}
+
+
+void WorklistsIndex::LookupExact(Candidates& target,
+                                 const Index& index,
+                                 const std::string& value)
+{
+  // The worklists without a value are always candidates
+  std::pair<Index::const_iterator, Index::const_iterator> range = index.equal_range("");
+  for (Index::const_iterator it = range.first; it != range.second; ++it)
+  {
+    target.insert(it->second);
+  }
+
+  range = index.equal_range(value);
+  for (Index::const_iterator it = range.first; it != range.second; ++it)
+  {
+    target.insert(it->second);
+  }
+}
+
+
+void WorklistsIndex::LookupRange(Candidates& target,
+                                 const Index& index,
+                                 const std::string& start,
+                                 const std::string& end)
+{
+  LookupExact(target, index, "");
+
+  Index::const_iterator first = (start.empty() ? index.begin() : index.lower_bound(start));
+  Index::const_iterator last = (end.empty() ? index.end() : index.upper_bound(end));
+
+  for (Index::const_iterator it = first; it != last; ++it)
+  {
+    target.insert(it->second);
+  }
+}
+
+
+void WorklistsIndex::RebuildIndexes()
+{
+  byStationAet_.clear();
+  byModality_.clear();
+  byDate_.clear();
+
+  for (Content::const_iterator it = content_.begin(); it != content_.end(); ++it)
+  {
+    const Worklist& worklist = *it->second;
+
+    if (worklist.IsValid())
+    {
+      for (std::set<std::string>::const_iterator
+             value = worklist.GetStationAets().begin(); value != worklist.GetStationAets().end(); ++value)
+      {
+        byStationAet_.insert(std::make_pair(*value, it->second));
+      }
+
+      for (std::set<std::string>::const_iterator
+             value = worklist.GetModalities().begin(); value != worklist.GetModalities().end(); ++value)
+      {
+        byModality_.insert(std::make_pair(*value, it->second));
+      }
+
+      for (std::set<std::string>::const_iterator
+             value = worklist.GetDates().begin(); value != worklist.GetDates().end(); ++value)
+      {
+        byDate_.insert(std::make_pair(*value, it->second));
+      }
+    }
+  }
+}
+
+
+void WorklistsIndex::Refresh()
+{
+  namespace fs = boost::filesystem;
+
+  // Cleared before the scan, so that the changes during the scan
+  // will trigger another refresh
+  dirty_ = false;
+
+  // The modification time has a resolution of one second, and the
+  // size can be unchanged: The files that are reported by inotify
+  // are always read again
+  std::set<std::string> modifiedFiles;
+  modifiedFiles.swap(modifiedFiles_);
+
+  Content updated;
+  bool changed = false;
+
+  try
+  {
+    fs::directory_iterator end;
+    for (fs::directory_iterator it(folder_); it != end; ++it)
+    {
+      fs::file_type type(it->status().type());
+
+      if (type == fs::regular_file ||
+          type == fs::reparse_file)   // cf. BitBucket issue #11
+      {
+        std::string extension = fs::extension(it->path());
+        std::transform(extension.begin(), extension.end(), extension.begin(), tolower);  // Convert to lowercase
+
+        if (extension == ".wl")
+        {
+          const std::string path = it->path().string();
+
+          std::time_t lastWriteTime;
+          uintmax_t fileSize;
+
+          try
+          {
+            lastWriteTime = fs::last_write_time(it->path());
+            fileSize = fs::file_size(it->path());
+          }
+          catch (fs::filesystem_error&)
+          {
+            continue;  // The file was removed in the meantime
+          }
+
+          Content::const_iterator found = content_.find(path);
+          if (found != content_.end() &&
+              found->second->IsSameFile(lastWriteTime, fileSize) &&
+              modifiedFiles.find(it->path().filename().string()) == modifiedFiles.end())
+          {
+            updated[path] = found->second;
+          }
+          else
+          {
+            // New or modified worklist
+            updated[path].reset(new Worklist(path, lastWriteTime, fileSize));
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+  catch (fs::filesystem_error&)
+  {
+    dirty_ = true;
+    modifiedFiles_.insert(modifiedFiles.begin(), modifiedFiles.end());
+    OrthancPlugins::LogError("Inexistent folder while scanning for worklists: " + folder_);
+    ORTHANC_PLUGINS_THROW_EXCEPTION(DirectoryExpected);
+  }
+
+  if (updated.size() != content_.size())
+  {
+    changed = true;  // Some worklist was removed
+  }
+
+  content_.swap(updated);
+
+  if (changed)
+  {
+    RebuildIndexes();
+  }
+}
+
+
+WorklistsIndex::WorklistsIndex(const std::string& folder) :
+  folder_(folder),
+  dirty_(true),
+  inotify_(-1),
+  monitoring_(false)
+{
+}
+
+
+WorklistsIndex::~WorklistsIndex()
+{
+  Stop();
+}
+
+
+void WorklistsIndex::Start()
+{
+  Stop();
+
+#if defined(__linux__)
+  inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (inotify_ != -1 &&
+      inotify_add_watch(inotify_, folder_.c_str(), (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE |
+                                                    IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                                    IN_DELETE_SELF | IN_MOVE_SELF)) != -1)
+  {
+    OrthancPlugins::LogWarning("Monitoring the changes in the folder of worklists");
+    dirty_ = true;
+    monitoring_ = true;
+    monitor_ = boost::thread(MonitorThread, this);
+    return;
+  }
+
+  if (inotify_ != -1)
+  {
+    close(inotify_);
+    inotify_ = -1;
+  }
+#endif
+
+  OrthancPlugins::LogWarning("Cannot monitor the folder of worklists, it will be listed before each query");
+}
+
+
+void WorklistsIndex::Stop()
+{
+  if (monitoring_)
+  {
+    monitoring_ = false;
+
+    if (monitor_.joinable())
+    {
+      monitor_.join();
+    }
+  }
+
+#if defined(__linux__)
+  if (inotify_ != -1)
+  {
+    close(inotify_);
+    inotify_ = -1;
+  }
+#endif
+}
+
+
+void WorklistsIndex::LookupCandidates(Worklists& candidates,
+                                      size_t& countWorklists,
+                                      const Json::Value& query)
+{
+  candidates.clear();
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  if (dirty_ ||
+      inotify_ == -1)
+  {
+    Refresh();
+  }
+
+  countWorklists = content_.size();
+
+  std::list<Candidates> constraints;
+
+  if (query.isMember(SCHEDULED_PROCEDURE_STEP_SEQUENCE) &&
+      query[SCHEDULED_PROCEDURE_STEP_SEQUENCE].type() == Json::arrayValue &&
+      query[SCHEDULED_PROCEDURE_STEP_SEQUENCE].size() == 1)
+  {
+    const Json::Value& step = query[SCHEDULED_PROCEDURE_STEP_SEQUENCE][0];
+
+    std::string value, start, end;
+
+    if (LookupExactConstraint(value, step, SCHEDULED_STATION_AETITLE))
+    {
+      constraints.push_back(Candidates());
+      LookupExact(constraints.back(), byStationAet_, value);
+    }
+
+    if (LookupExactConstraint(value, step, MODALITY))
+    {
+      constraints.push_back(Candidates());
+      LookupExact(constraints.back(), byModality_, value);
+    }
+
+    if (LookupDateConstraint(start, end, step))
+    {
+      constraints.push_back(Candidates());
+      LookupRange(constraints.back(), byDate_, start, end);
+    }
+  }
+
+  if (constraints.empty())
+  {
+    // No indexed constraint, all the valid worklists are candidates
+    for (Content::const_iterator it = content_.begin(); it != content_.end(); ++it)
+    {
+      if (it->second->IsValid())
+      {
+        candidates.push_back(it->second);
+      }
+    }
+  }
+  else
+  {
+    Candidates result;
+    result.swap(constraints.front());
+    constraints.pop_front();
+
+    while (!constraints.empty() &&
+           !result.empty())
+    {
+      Candidates intersection;
+      std::set_intersection(result.begin(), result.end(),
+                            constraints.front().begin(), constraints.front().end(),
+                            std::inserter(intersection, intersection.begin()));
+      result.swap(intersection);
+      constraints.pop_front();
+    }
+
+    candidates.assign(result.begin(), result.end());
+  }
+}
@@ -0,0 +1,164 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <json/value.h>
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+
+
+/**
+ * In-memory index of the worklists that are stored as ".wl" files in
+ * a folder. Each file is read and parsed only once, and again if it
+ * is modified. The worklists are indexed by the ScheduledStationAETitle,
+ * the Modality and the ScheduledProcedureStepStartDate of their
+ * scheduled procedure steps, so that a C-FIND query is only matched
+ * against the worklists that are compatible with these attributes.
+ *
+ * On Linux, the folder is monitored with inotify, and it is only
+ * scanned again if some file has changed. On the other platforms,
+ * the folder is listed before each query, which is much cheaper
+ * than reading all the files.
+ **/
+class WorklistsIndex : public boost::noncopyable
+{
+public:
+  class Worklist : public boost::noncopyable
+  {
+  private:
+    std::string            path_;
+    std::time_t            lastWriteTime_;
+    uintmax_t              fileSize_;
+    bool                   isValid_;
+    std::string            dicom_;
+    std::set<std::string>  stationAets_;
+    std::set<std::string>  modalities_;
+    std::set<std::string>  dates_;
+
+  public:
+    Worklist(const std::string& path,
+             std::time_t lastWriteTime,
+             uintmax_t fileSize);
+
+    const std::string& GetPath() const
+    {
+      return path_;
+    }
+
+    bool IsSameFile(std::time_t lastWriteTime,
+                    uintmax_t fileSize) const
+    {
+      return (lastWriteTime_ == lastWriteTime &&
+              fileSize_ == fileSize);
+    }
+
+    // "false" if the file is not a valid DICOM file
+    bool IsValid() const
+    {
+      return isValid_;
+    }
+
+    const std::string& GetDicom() const
+    {
+      return dicom_;
+    }
+
+    // The empty string is used if some scheduled procedure step has no value
+    const std::set<std::string>& GetStationAets() const
+    {
+      return stationAets_;
+    }
+
+    const std::set<std::string>& GetModalities() const
+    {
+      return modalities_;
+    }
+
+    const std::set<std::string>& GetDates() const
+    {
+      return dates_;
+    }
+  };
+
+  typedef std::list< boost::shared_ptr<Worklist> >  Worklists;
+
+private:
+  typedef std::map<std::string, boost::shared_ptr<Worklist> >       Content;
+  typedef std::multimap<std::string, boost::shared_ptr<Worklist> >  Index;
+  typedef std::set< boost::shared_ptr<Worklist> >                   Candidates;
+
+  boost::mutex   mutex_;
+  std::string    folder_;
+  Content        content_;       // Indexed by the path of the files
+  Index          byStationAet_;
+  Index          byModality_;
+  Index          byDate_;
+  bool           dirty_;
+  std::set<std::string>  modifiedFiles_;  // Names reported by inotify since the last refresh
+  int            inotify_;       // "-1" if the folder is not monitored
+  bool           monitoring_;
+  boost::thread  monitor_;
+
+  static void MonitorThread(WorklistsIndex* that);
+
+  void Refresh();
+
+  void RebuildIndexes();
+
+  static void LookupExact(Candidates& target,
+                          const Index& index,
+                          const std::string& value);
+
+  static void LookupRange(Candidates& target,
+                          const Index& index,
+                          const std::string& start,
+                          const std::string& end);
+
+public:
+  explicit WorklistsIndex(const std::string& folder);
+
+  ~WorklistsIndex();
+
+  // Start monitoring the folder (if supported by the platform)
+  void Start();
+
+  void Stop();
+
+  /**
+   * Returns the worklists that could match the given C-FIND query,
+   * formatted as by "OrthancPluginDicomToJsonFormat_Short". The
+   * candidates must still be checked by a "FindMatcher".
+   **/
+  void LookupCandidates(Worklists& candidates,
+                        size_t& countWorklists,
+                        const Json::Value& query);
+};
@@ -0,0 +1,64 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../../PrecompiledHeadersServer.h"
+#include "IExpandResources.h"
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    void IExpandResources::Apply(IExpandResources& database,
+                                 ResourcesBatch& target,
+                                 bool includeMainDicomTags,
+                                 bool includeMetadata,
+                                 bool includeChildren)
+    {
+      // Fallback for the database back-ends that have no batched
+      // primitive: Loop over the resources, one query at a time
+
+      std::list<int64_t> resources;
+      target.GetResources(resources);
+
+      for (std::list<int64_t>::const_iterator
+             it = resources.begin(); it != resources.end(); ++it)
+      {
+        ResourcesBatch::Item& item = target.GetItem(*it);
+
+        if (includeMainDicomTags)
+        {
+          database.GetMainDicomTags(item.GetMainDicomTags(), *it);
+        }
+
+        if (includeMetadata)
+        {
+          database.GetAllMetadata(item.GetMetadata(), *it);
+        }
+
+        if (includeChildren)
+        {
+          database.GetChildrenPublicId(item.GetChildrenPublicIds(), *it);
+        }
+      }
+    }
+  }
+}
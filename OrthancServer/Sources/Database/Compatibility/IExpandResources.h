@@ -0,0 +1,50 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../ResourcesBatch.h"
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    class IExpandResources : public boost::noncopyable
+    {
+    public:
+      virtual void GetAllMetadata(std::map<MetadataType, std::string>& target,
+                                  int64_t id) = 0;
+
+      virtual void GetChildrenPublicId(std::list<std::string>& target,
+                                       int64_t id) = 0;
+
+      virtual void GetMainDicomTags(DicomMap& map,
+                                    int64_t id) = 0;
+
+      static void Apply(IExpandResources& database,
+                        ResourcesBatch& target,
+                        bool includeMainDicomTags,
+                        bool includeMetadata,
+                        bool includeChildren);
+    };
+  }
+}
@@ -0,0 +1,142 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../../PrecompiledHeadersServer.h"
+#include "IKeysetPagination.h"
+
+#include <cassert>
+#include <map>
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    namespace
+    {
+      struct Item
+      {
+        std::string  publicId_;
+        std::string  instanceId_;
+      };
+    }
+
+
+    static void SortAndTruncate(std::list<std::string>& publicIds,
+                                std::list<std::string>* instancesIds,
+                                std::list<int64_t>& internalIds,
+                                IKeysetPagination& database,
+                                const std::list<std::string>& resources,
+                                const std::list<std::string>* instances,
+                                int64_t since,
+                                size_t limit)
+    {
+      assert(instances == NULL ||
+             instances->size() == resources.size());
+
+      // The map sorts the resources by internal ID, and removes duplicates
+      std::map<int64_t, Item> sorted;
+
+      std::list<std::string>::const_iterator instance;
+      if (instances != NULL)
+      {
+        instance = instances->begin();
+      }
+
+      for (std::list<std::string>::const_iterator
+             it = resources.begin(); it != resources.end(); ++it)
+      {
+        int64_t id;
+        ResourceType type;
+        if (database.LookupResource(id, type, *it) &&
+            id > since)
+        {
+          Item& item = sorted[id];
+          item.publicId_ = *it;
+
+          if (instances != NULL)
+          {
+            item.instanceId_ = *instance;
+          }
+        }
+
+        if (instances != NULL)
+        {
+          ++instance;
+        }
+      }
+
+      publicIds.clear();
+      internalIds.clear();
+
+      if (instancesIds != NULL)
+      {
+        instancesIds->clear();
+      }
+
+      for (std::map<int64_t, Item>::const_iterator it = sorted.begin();
+           it != sorted.end() && (limit == 0 || publicIds.size() < limit); ++it)
+      {
+        publicIds.push_back(it->second.publicId_);
+        internalIds.push_back(it->first);
+
+        if (instancesIds != NULL)
+        {
+          instancesIds->push_back(it->second.instanceId_);
+        }
+      }
+    }
+
+
+    void IKeysetPagination::ListResources(IKeysetPagination& database,
+                                          std::list<std::string>& publicIds,
+                                          std::list<int64_t>& internalIds,
+                                          ResourceType resourceType,
+                                          int64_t since,
+                                          size_t limit)
+    {
+      std::list<std::string> resources;
+      database.GetAllPublicIds(resources, resourceType);
+
+      SortAndTruncate(publicIds, NULL, internalIds, database, resources, NULL, since, limit);
+    }
+
+
+    void IKeysetPagination::LookupResources(IKeysetPagination& database,
+                                            std::list<std::string>& resourcesId,
+                                            std::list<std::string>* instancesId,
+                                            std::list<int64_t>& internalIds,
+                                            const std::vector<DatabaseConstraint>& lookup,
+                                            ResourceType queryLevel,
+                                            int64_t since,
+                                            size_t limit)
+    {
+      // The limit cannot be given to the database, as the resources
+      // before the cursor must be discarded afterward
+      std::list<std::string> resources, instances;
+      database.ApplyLookupResources(resources, (instancesId == NULL ? NULL : &instances),
+                                    lookup, queryLevel, 0 /* no limit */);
+
+      SortAndTruncate(resourcesId, instancesId, internalIds, database, resources,
+                      (instancesId == NULL ? NULL : &instances), since, limit);
+    }
+  }
+}
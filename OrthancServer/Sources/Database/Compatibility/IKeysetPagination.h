@@ -0,0 +1,76 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../../Search/DatabaseConstraint.h"
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <vector>
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    /**
+     * Emulation of keyset pagination for the database back-ends that
+     * cannot sort the resources by internal ID. All the resources are
+     * listed before being sorted, so each page has a linear cost:
+     * Orthanc refuses the "cursor" argument of the REST API with such
+     * back-ends, and only uses this emulation to read all the
+     * resources in one single pass.
+     **/
+    class IKeysetPagination : public boost::noncopyable
+    {
+    public:
+      virtual void GetAllPublicIds(std::list<std::string>& target,
+                                   ResourceType resourceType) = 0;
+
+      virtual void ApplyLookupResources(std::list<std::string>& resourcesId,
+                                        std::list<std::string>* instancesId,
+                                        const std::vector<DatabaseConstraint>& lookup,
+                                        ResourceType queryLevel,
+                                        size_t limit) = 0;
+
+      virtual bool LookupResource(int64_t& id,
+                                  ResourceType& type,
+                                  const std::string& publicId) = 0;
+
+      static void ListResources(IKeysetPagination& database,
+                                std::list<std::string>& publicIds,
+                                std::list<int64_t>& internalIds,
+                                ResourceType resourceType,
+                                int64_t since,
+                                size_t limit);
+
+      static void LookupResources(IKeysetPagination& database,
+                                  std::list<std::string>& resourcesId,
+                                  std::list<std::string>* instancesId,
+                                  std::list<int64_t>& internalIds,
+                                  const std::vector<DatabaseConstraint>& lookup,
+                                  ResourceType queryLevel,
+                                  int64_t since,
+                                  size_t limit);
+    };
+  }
+}
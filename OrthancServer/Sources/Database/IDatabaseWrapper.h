@@ -36,6 +36,7 @@
 namespace Orthanc
 {
   class DatabaseConstraint;
+  class ResourcesBatch;
   class ResourcesContent;
 
   
@@ -235,6 +236,46 @@ namespace Orthanc
                                            ResourceType& type,
                                            std::string& parentPublicId,
                                            const std::string& publicId) = 0;
+
+
+      /**
+       * Primitive introduced in Orthanc 1.11.3: Retrieve the main
+       * DICOM tags, the metadata and/or the public IDs of the
+       * children of all the resources that are registered in
+       * "target", using a few set-based queries. The database
+       * plugins fall back to "Compatibility::IExpandResources", which
+       * issues the per-resource queries, as the database SDK has no
+       * batched primitive.
+       **/
+
+      virtual void ExpandResources(ResourcesBatch& target,
+                                   bool includeMainDicomTags,
+                                   bool includeMetadata,
+                                   bool includeChildren) = 0;
+
+
+      /**
+       * Primitives introduced in Orthanc 1.11.3 for keyset
+       * pagination: Only the resources whose internal ID is strictly
+       * greater than "since" are listed, sorted by increasing
+       * internal ID. The internal IDs of the listed resources are
+       * stored in "internalIds", the last one being the cursor to the
+       * next page. A "limit" of zero means no limit.
+       **/
+
+      virtual void GetAllPublicIds(std::list<std::string>& publicIds,
+                                   std::list<int64_t>& internalIds,
+                                   ResourceType resourceType,
+                                   int64_t since,
+                                   size_t limit) = 0;
+
+      virtual void ApplyLookupResources(std::list<std::string>& resourcesId,
+                                        std::list<std::string>* instancesId, // Can be NULL if not needed
+                                        std::list<int64_t>& internalIds,
+                                        const std::vector<DatabaseConstraint>& lookup,
+                                        ResourceType queryLevel,
+                                        int64_t since,
+                                        size_t limit) = 0;
     };
 
 
@@ -259,5 +300,13 @@ namespace Orthanc
                          IStorageArea& storageArea) = 0;
 
     virtual bool HasRevisionsSupport() const = 0;
+
+    /**
+     * Whether the back-end natively sorts and filters the resources
+     * by internal ID (new in Orthanc 1.11.3). If "false", the keyset
+     * primitives of the transactions are emulated with a linear
+     * cost, and must not be used to browse the database page by page.
+     **/
+    virtual bool HasKeysetPaginationSupport() const = 0;
   };
 }
@@ -0,0 +1,101 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeadersServer.h"
+#include "ResourcesBatch.h"
+
+#include "../../../OrthancFramework/Sources/OrthancException.h"
+
+#include <cassert>
+
+
+namespace Orthanc
+{
+  ResourcesBatch::Item& ResourcesBatch::GetItemInternal(int64_t resourceId) const
+  {
+    Items::const_iterator found = items_.find(resourceId);
+
+    if (found == items_.end())
+    {
+      throw OrthancException(ErrorCode_UnknownResource);
+    }
+    else
+    {
+      assert(found->second != NULL);
+      return *found->second;
+    }
+  }
+
+
+  ResourcesBatch::~ResourcesBatch()
+  {
+    for (Items::iterator it = items_.begin(); it != items_.end(); ++it)
+    {
+      assert(it->second != NULL);
+      delete it->second;
+    }
+  }
+
+
+  void ResourcesBatch::AddResource(int64_t resourceId)
+  {
+    if (items_.find(resourceId) == items_.end())
+    {
+      items_[resourceId] = new Item;
+    }
+  }
+
+
+  void ResourcesBatch::GetResources(std::list<int64_t>& target) const
+  {
+    target.clear();
+
+    for (Items::const_iterator it = items_.begin(); it != items_.end(); ++it)
+    {
+      target.push_back(it->first);
+    }
+  }
+
+
+  void ResourcesBatch::AddMainDicomTag(int64_t resourceId,
+                                       uint16_t group,
+                                       uint16_t element,
+                                       const std::string& value)
+  {
+    GetItemInternal(resourceId).GetMainDicomTags().SetValue(group, element, value, false /* not binary */);
+  }
+
+
+  void ResourcesBatch::AddMetadata(int64_t resourceId,
+                                   MetadataType metadata,
+                                   const std::string& value)
+  {
+    GetItemInternal(resourceId).GetMetadata()[metadata] = value;
+  }
+
+
+  void ResourcesBatch::AddChild(int64_t resourceId,
+                                const std::string& childPublicId)
+  {
+    GetItemInternal(resourceId).GetChildrenPublicIds().push_back(childPublicId);
+  }
+}
@@ -0,0 +1,133 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../../../OrthancFramework/Sources/DicomFormat/DicomMap.h"
+#include "../ServerEnumerations.h"
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+
+
+namespace Orthanc
+{
+  /**
+   * Content of a set of resources that is retrieved from the
+   * database in one go by "IDatabaseWrapper::ITransaction::ExpandResources()",
+   * instead of one query per resource and per type of information.
+   **/
+  class ResourcesBatch : public boost::noncopyable
+  {
+  public:
+    class Item : public boost::noncopyable
+    {
+    private:
+      DicomMap                             mainDicomTags_;
+      std::map<MetadataType, std::string>  metadata_;
+      std::list<std::string>               childrenPublicIds_;
+
+    public:
+      DicomMap& GetMainDicomTags()
+      {
+        return mainDicomTags_;
+      }
+
+      const DicomMap& GetMainDicomTags() const
+      {
+        return mainDicomTags_;
+      }
+
+      std::map<MetadataType, std::string>& GetMetadata()
+      {
+        return metadata_;
+      }
+
+      const std::map<MetadataType, std::string>& GetMetadata() const
+      {
+        return metadata_;
+      }
+
+      std::list<std::string>& GetChildrenPublicIds()
+      {
+        return childrenPublicIds_;
+      }
+
+      const std::list<std::string>& GetChildrenPublicIds() const
+      {
+        return childrenPublicIds_;
+      }
+    };
+
+  private:
+    typedef std::map<int64_t, Item*>  Items;
+
+    Items  items_;
+
+    Item& GetItemInternal(int64_t resourceId) const;
+
+  public:
+    ~ResourcesBatch();
+
+    void AddResource(int64_t resourceId);
+
+    bool IsEmpty() const
+    {
+      return items_.empty();
+    }
+
+    size_t GetSize() const
+    {
+      return items_.size();
+    }
+
+    bool HasResource(int64_t resourceId) const
+    {
+      return items_.find(resourceId) != items_.end();
+    }
+
+    void GetResources(std::list<int64_t>& target) const;
+
+    Item& GetItem(int64_t resourceId)
+    {
+      return GetItemInternal(resourceId);
+    }
+
+    const Item& GetItem(int64_t resourceId) const
+    {
+      return GetItemInternal(resourceId);
+    }
+
+    void AddMainDicomTag(int64_t resourceId,
+                         uint16_t group,
+                         uint16_t element,
+                         const std::string& value);
+
+    void AddMetadata(int64_t resourceId,
+                     MetadataType metadata,
+                     const std::string& value);
+
+    void AddChild(int64_t resourceId,
+                  const std::string& childPublicId);
+  };
+}
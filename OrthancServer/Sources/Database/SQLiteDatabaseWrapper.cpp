@@ -32,6 +32,7 @@
 #include "Compatibility/IGetChildrenMetadata.h"
 #include "Compatibility/ILookupResourceAndParent.h"
 #include "Compatibility/ISetResourcesContent.h"
+#include "ResourcesBatch.h"
 #include "VoidDatabaseListener.h"
 
 #include <OrthancServerResources.h>
@@ -224,6 +225,59 @@ namespace Orthanc
     }
 
 
+    // Same as "AnswerLookup()", but sorted by internal ID (for keyset pagination)
+    void AnswerLookupWithCursor(std::list<std::string>& resourcesId,
+                                std::list<std::string>* instancesId,
+                                std::list<int64_t>& internalIds,
+                                ResourceType level)
+    {
+      static const char* const TABLES[] = { "patients", "studies", "series", "instances" };
+
+      resourcesId.clear();
+      internalIds.clear();
+
+      if (instancesId != NULL)
+      {
+        instancesId->clear();
+      }
+
+      std::string sql;
+
+      if (instancesId == NULL ||
+          level == ResourceType_Instance)
+      {
+        sql = "SELECT publicId, publicId, internalId FROM Lookup ORDER BY internalId";
+      }
+      else
+      {
+        const std::string table = TABLES[level];
+
+        sql = "SELECT " + table + ".publicId, instances.publicId, " + table + ".internalId FROM Lookup AS " + table;
+
+        for (int child = level + 1; child <= ResourceType_Instance; child++)
+        {
+          sql += (std::string(" INNER JOIN Resources ") + TABLES[child] + " ON " +
+                  TABLES[child - 1] + ".internalId=" + TABLES[child] + ".parentId");
+        }
+
+        sql += " GROUP BY " + table + ".internalId ORDER BY " + table + ".internalId";
+      }
+
+      SQLite::Statement statement(db_, sql);
+
+      while (statement.Step())
+      {
+        resourcesId.push_back(statement.ColumnString(0));
+        internalIds.push_back(statement.ColumnInt64(2));
+
+        if (instancesId != NULL)
+        {
+          instancesId->push_back(statement.ColumnString(1));
+        }
+      }
+    }
+
+
     void ClearTable(const std::string& tableName)
     {
       db_.Execute("DELETE FROM " + tableName);    
@@ -379,6 +433,36 @@ namespace Orthanc
     }
 
 
+    virtual void ApplyLookupResources(std::list<std::string>& resourcesId,
+                                      std::list<std::string>* instancesId,
+                                      std::list<int64_t>& internalIds,
+                                      const std::vector<DatabaseConstraint>& lookup,
+                                      ResourceType queryLevel,
+                                      int64_t since,
+                                      size_t limit) ORTHANC_OVERRIDE
+    {
+      LookupFormatter formatter;
+
+      std::string sql;
+      LookupFormatter::ApplyWithCursor(sql, formatter, lookup, queryLevel, since, limit);
+
+      sql = "CREATE TEMPORARY TABLE Lookup AS " + sql;
+    
+      {
+        SQLite::Statement s(db_, SQLITE_FROM_HERE, "DROP TABLE IF EXISTS Lookup");
+        s.Run();
+      }
+
+      {
+        SQLite::Statement statement(db_, sql);
+        formatter.Bind(statement);
+        statement.Run();
+      }
+
+      AnswerLookupWithCursor(resourcesId, instancesId, internalIds, queryLevel);
+    }
+
+
     // From the "ICreateInstance" interface
     virtual void AttachChild(int64_t parent,
                              int64_t child) ORTHANC_OVERRIDE
@@ -533,6 +617,29 @@ namespace Orthanc
     }
 
 
+    virtual void GetAllPublicIds(std::list<std::string>& publicIds,
+                                 std::list<int64_t>& internalIds,
+                                 ResourceType resourceType,
+                                 int64_t since,
+                                 size_t limit) ORTHANC_OVERRIDE
+    {
+      SQLite::Statement s(db_, SQLITE_FROM_HERE,
+                          "SELECT publicId, internalId FROM Resources WHERE "
+                          "resourceType=? AND internalId>? ORDER BY internalId LIMIT ?");
+      s.BindInt(0, resourceType);
+      s.BindInt64(1, since);
+      s.BindInt64(2, (limit == 0 ? -1 /* no limit */ : static_cast<int64_t>(limit)));
+
+      publicIds.clear();
+      internalIds.clear();
+      while (s.Step())
+      {
+        publicIds.push_back(s.ColumnString(0));
+        internalIds.push_back(s.ColumnInt64(1));
+      }
+    }
+
+
     virtual void GetChanges(std::list<ServerIndexChange>& target /*out*/,
                             bool& done /*out*/,
                             int64_t since,
@@ -903,6 +1010,67 @@ namespace Orthanc
     }
 
 
+    virtual void ExpandResources(ResourcesBatch& target,
+                                 bool includeMainDicomTags,
+                                 bool includeMetadata,
+                                 bool includeChildren) ORTHANC_OVERRIDE
+    {
+      // Bound the size of the "IN" clauses of the dynamic statements
+      static const size_t MAX_RESOURCES_PER_QUERY = 1000;
+
+      std::list<int64_t> resources;
+      target.GetResources(resources);
+
+      std::list<int64_t>::const_iterator it = resources.begin();
+
+      while (it != resources.end())
+      {
+        // The list only contains integers, which prevents SQL injection
+        std::string ids;
+
+        for (size_t count = 0; count < MAX_RESOURCES_PER_QUERY && it != resources.end(); count++, ++it)
+        {
+          if (!ids.empty())
+          {
+            ids += ",";
+          }
+
+          ids += boost::lexical_cast<std::string>(*it);
+        }
+
+        if (includeMainDicomTags)
+        {
+          SQLite::Statement s(db_, "SELECT id, tagGroup, tagElement, value FROM MainDicomTags WHERE id IN (" + ids + ")");
+          while (s.Step())
+          {
+            target.AddMainDicomTag(s.ColumnInt64(0),
+                                   static_cast<uint16_t>(s.ColumnInt(1)),
+                                   static_cast<uint16_t>(s.ColumnInt(2)),
+                                   s.ColumnString(3));
+          }
+        }
+
+        if (includeMetadata)
+        {
+          SQLite::Statement s(db_, "SELECT id, type, value FROM Metadata WHERE id IN (" + ids + ")");
+          while (s.Step())
+          {
+            target.AddMetadata(s.ColumnInt64(0), static_cast<MetadataType>(s.ColumnInt(1)), s.ColumnString(2));
+          }
+        }
+
+        if (includeChildren)
+        {
+          SQLite::Statement s(db_, "SELECT parentId, publicId FROM Resources WHERE parentId IN (" + ids + ")");
+          while (s.Step())
+          {
+            target.AddChild(s.ColumnInt64(0), s.ColumnString(1));
+          }
+        }
+      }
+    }
+
+
     virtual bool LookupResource(int64_t& id,
                                 ResourceType& type,
                                 const std::string& publicId) ORTHANC_OVERRIDE
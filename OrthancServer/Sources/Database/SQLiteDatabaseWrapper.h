@@ -97,6 +97,11 @@ namespace Orthanc
       return false;  // TODO - REVISIONS
     }
 
+    virtual bool HasKeysetPaginationSupport() const ORTHANC_OVERRIDE
+    {
+      return true;
+    }
+
 
     /**
      * The "StartTransaction()" method is guaranteed to return a class
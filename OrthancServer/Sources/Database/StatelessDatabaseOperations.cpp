@@ -35,6 +35,7 @@
 #include "../Search/DatabaseLookup.h"
 #include "../ServerIndexChange.h"
 #include "../ServerToolbox.h"
+#include "ResourcesBatch.h"
 #include "ResourcesContent.h"
 
 #include <boost/lexical_cast.hpp>
@@ -299,6 +300,248 @@ namespace Orthanc
   }
 
 
+  static bool LookupStringMetadata(std::string& result,
+                                   const std::map<MetadataType, std::string>& metadata,
+                                   MetadataType type)
+  {
+    std::map<MetadataType, std::string>::const_iterator found = metadata.find(type);
+
+    if (found == metadata.end())
+    {
+      return false;
+    }
+    else
+    {
+      result = found->second;
+      return true;
+    }
+  }
+
+
+  static bool LookupIntegerMetadata(int64_t& result,
+                                    const std::map<MetadataType, std::string>& metadata,
+                                    MetadataType type)
+  {
+    std::string s;
+    if (!LookupStringMetadata(s, metadata, type))
+    {
+      return false;
+    }
+
+    try
+    {
+      result = boost::lexical_cast<int64_t>(s);
+      return true;
+    }
+    catch (boost::bad_lexical_cast&)
+    {
+      return false;
+    }
+  }
+
+
+  /**
+   * Fill the expanded resource, given the main DICOM tags, the
+   * metadata and the children that were previously retrieved by
+   * "IDatabaseWrapper::ITransaction::ExpandResources()"
+   **/
+  static void FillExpandedResource(ExpandedResource& target,
+                                   StatelessDatabaseOperations::ReadOnlyTransaction& transaction,
+                                   int64_t internalId,
+                                   ResourceType type,
+                                   const std::string& parent,
+                                   const std::string& publicId,
+                                   const ResourcesBatch::Item& content,
+                                   const std::set<DicomTag>& requestedTags,
+                                   ExpandResourceDbFlags expandFlags)
+  {
+    // Set information about the parent resource (if it exists)
+    if (type == ResourceType_Patient)
+    {
+      if (!parent.empty())
+      {
+        throw OrthancException(ErrorCode_DatabasePlugin);
+      }
+    }
+    else
+    {
+      if (parent.empty())
+      {
+        throw OrthancException(ErrorCode_DatabasePlugin);
+      }
+
+      target.parentId_ = parent;
+    }
+
+    target.type_ = type;
+    target.id_ = publicId;
+
+    if (expandFlags & ExpandResourceDbFlags_IncludeChildren)
+    {
+      // List the children resources
+      target.childrenIds_ = content.GetChildrenPublicIds();
+    }
+
+    if (expandFlags & ExpandResourceDbFlags_IncludeMetadata)
+    {
+      // Extract the metadata
+      target.metadata_ = content.GetMetadata();
+
+      switch (type)
+      {
+        case ResourceType_Patient:
+        case ResourceType_Study:
+          break;
+
+        case ResourceType_Series:
+        {
+          int64_t i;
+          if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Series_ExpectedNumberOfInstances))
+          {
+            target.expectedNumberOfInstances_ = static_cast<int>(i);
+            target.status_ = EnumerationToString(transaction.GetSeriesStatus(internalId, i));
+          }
+          else
+          {
+            target.expectedNumberOfInstances_ = -1;
+            target.status_ = EnumerationToString(SeriesStatus_Unknown);
+          }
+
+          break;
+        }
+
+        case ResourceType_Instance:
+        {
+          FileInfo attachment;
+          int64_t revision;  // ignored
+          if (!transaction.LookupAttachment(attachment, revision, internalId, FileContentType_Dicom))
+          {
+            throw OrthancException(ErrorCode_InternalError);
+          }
+
+          target.fileSize_ = static_cast<unsigned int>(attachment.GetUncompressedSize());
+          target.fileUuid_ = attachment.GetUuid();
+
+          int64_t i;
+          if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Instance_IndexInSeries))
+          {
+            target.indexInSeries_ = static_cast<int>(i);
+          }
+          else
+          {
+            target.indexInSeries_ = -1;
+          }
+
+          break;
+        }
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
+
+      // check the main dicom tags list has not changed since the resource was stored
+      target.mainDicomTagsSignature_ = DicomMap::GetDefaultMainDicomTagsSignature(type);
+      LookupStringMetadata(target.mainDicomTagsSignature_, target.metadata_, MetadataType_MainDicomTagsSignature);
+    }
+
+    if (expandFlags & ExpandResourceDbFlags_IncludeMainDicomTags)
+    {
+      // read all tags from DB
+      target.tags_.Assign(content.GetMainDicomTags());
+
+      // read all main sequences from DB
+      std::string serializedSequences;
+      if (LookupStringMetadata(serializedSequences, target.metadata_, MetadataType_MainDicomSequences))
+      {
+        Json::Value jsonMetadata;
+        Toolbox::ReadJson(jsonMetadata, serializedSequences);
+
+        assert(jsonMetadata["Version"].asInt() == 1);
+        target.tags_.FromDicomAsJson(jsonMetadata["Sequences"], true /* append */, true /* parseSequences */);
+      }
+
+      // check if we have access to all requestedTags or if we must get tags from parents
+      if (requestedTags.size() > 0)
+      {
+        std::set<DicomTag> savedMainDicomTags;
+
+        FromDcmtkBridge::ParseListOfTags(savedMainDicomTags, target.mainDicomTagsSignature_);
+
+        // read parent main dicom tags as long as we have not gathered all requested tags
+        ResourceType currentLevel = target.type_;
+        int64_t currentInternalId = internalId;
+        Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
+
+        while ((target.missingRequestedTags_.size() > 0)
+              && currentLevel != ResourceType_Patient)
+        {
+          currentLevel = GetParentResourceType(currentLevel);
+
+          int64_t currentParentId;
+          if (!transaction.LookupParent(currentParentId, currentInternalId))
+          {
+            break;
+          }
+
+          std::map<MetadataType, std::string> parentMetadata;
+          transaction.GetAllMetadata(parentMetadata, currentParentId);
+
+          std::string parentMainDicomTagsSignature = DicomMap::GetDefaultMainDicomTagsSignature(currentLevel);
+          LookupStringMetadata(parentMainDicomTagsSignature, parentMetadata, MetadataType_MainDicomTagsSignature);
+
+          std::set<DicomTag> parentSavedMainDicomTags;
+          FromDcmtkBridge::ParseListOfTags(parentSavedMainDicomTags, parentMainDicomTagsSignature);
+
+          size_t previousMissingCount = target.missingRequestedTags_.size();
+          Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
+          Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
+
+          // read the parent tags from DB only if it reduces the number of missing tags
+          if (target.missingRequestedTags_.size() < previousMissingCount)
+          { 
+            Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
+
+            DicomMap parentTags;
+            transaction.GetMainDicomTags(parentTags, currentParentId);
+
+            target.tags_.Merge(parentTags);
+          }
+
+          currentInternalId = currentParentId;
+        }
+      }
+    }
+
+    std::string tmp;
+
+    if (LookupStringMetadata(tmp, target.metadata_, MetadataType_AnonymizedFrom))
+    {
+      target.anonymizedFrom_ = tmp;
+    }
+
+    if (LookupStringMetadata(tmp, target.metadata_, MetadataType_ModifiedFrom))
+    {
+      target.modifiedFrom_ = tmp;
+    }
+
+    if (type == ResourceType_Patient ||
+        type == ResourceType_Study ||
+        type == ResourceType_Series)
+    {
+      target.isStable_ = !transaction.GetTransactionContext().IsUnstableResource(internalId);
+
+      if (LookupStringMetadata(tmp, target.metadata_, MetadataType_LastUpdate))
+      {
+        target.lastUpdate_ = tmp;
+      }
+    }
+    else
+    {
+      target.isStable_ = false;
+    }
+  }
+
+
   class StatelessDatabaseOperations::MainDicomTagsRegistry : public boost::noncopyable
   {
   private:
@@ -654,6 +897,7 @@ namespace Orthanc
     db_(db),
     mainDicomTagsRegistry_(new MainDicomTagsRegistry),
     hasFlushToDisk_(db.HasFlushToDisk()),
+    hasKeysetPagination_(db.HasKeysetPaginationSupport()),
     maxRetries_(0)
   {
   }
@@ -719,48 +963,6 @@ namespace Orthanc
     class Operations : public ReadOnlyOperationsT6<
       bool&, ExpandedResource&, const std::string&, ResourceType, const std::set<DicomTag>&, ExpandResourceDbFlags>
     {
-    private:
-  
-      static bool LookupStringMetadata(std::string& result,
-                                       const std::map<MetadataType, std::string>& metadata,
-                                       MetadataType type)
-      {
-        std::map<MetadataType, std::string>::const_iterator found = metadata.find(type);
-
-        if (found == metadata.end())
-        {
-          return false;
-        }
-        else
-        {
-          result = found->second;
-          return true;
-        }
-      }
-
-
-      static bool LookupIntegerMetadata(int64_t& result,
-                                        const std::map<MetadataType, std::string>& metadata,
-                                        MetadataType type)
-      {
-        std::string s;
-        if (!LookupStringMetadata(s, metadata, type))
-        {
-          return false;
-        }
-
-        try
-        {
-          result = boost::lexical_cast<int64_t>(s);
-          return true;
-        }
-        catch (boost::bad_lexical_cast&)
-        {
-          return false;
-        }
-      }
-
-
     public:
       virtual void ApplyTuple(ReadOnlyTransaction& transaction,
                               const Tuple& tuple) ORTHANC_OVERRIDE
@@ -776,205 +978,95 @@ namespace Orthanc
         }
         else
         {
-          ExpandedResource& target = tuple.get<1>();
-          ExpandResourceDbFlags expandFlags = tuple.get<5>();
-
-          // Set information about the parent resource (if it exists)
-          if (type == ResourceType_Patient)
-          {
-            if (!parent.empty())
-            {
-              throw OrthancException(ErrorCode_DatabasePlugin);
-            }
-          }
-          else
-          {
-            if (parent.empty())
-            {
-              throw OrthancException(ErrorCode_DatabasePlugin);
-            }
-
-            target.parentId_ = parent;
-          }
-
-          target.type_ = type;
-          target.id_ = tuple.get<2>();
+          const ExpandResourceDbFlags expandFlags = tuple.get<5>();
 
-          if (expandFlags & ExpandResourceDbFlags_IncludeChildren)
-          {
-            // List the children resources
-            transaction.GetChildrenPublicId(target.childrenIds_, internalId);
-          }
-
-          if (expandFlags & ExpandResourceDbFlags_IncludeMetadata)
-          {
-            // Extract the metadata
-            transaction.GetAllMetadata(target.metadata_, internalId);
-
-            switch (type)
-            {
-              case ResourceType_Patient:
-              case ResourceType_Study:
-                break;
-
-              case ResourceType_Series:
-              {
-                int64_t i;
-                if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Series_ExpectedNumberOfInstances))
-                {
-                  target.expectedNumberOfInstances_ = static_cast<int>(i);
-                  target.status_ = EnumerationToString(transaction.GetSeriesStatus(internalId, i));
-                }
-                else
-                {
-                  target.expectedNumberOfInstances_ = -1;
-                  target.status_ = EnumerationToString(SeriesStatus_Unknown);
-                }
-
-                break;
-              }
+          ResourcesBatch batch;
+          batch.AddResource(internalId);
+          transaction.ExpandResources(batch,
+                                      (expandFlags & ExpandResourceDbFlags_IncludeMainDicomTags) != 0,
+                                      (expandFlags & ExpandResourceDbFlags_IncludeMetadata) != 0,
+                                      (expandFlags & ExpandResourceDbFlags_IncludeChildren) != 0);
 
-              case ResourceType_Instance:
-              {
-                FileInfo attachment;
-                int64_t revision;  // ignored
-                if (!transaction.LookupAttachment(attachment, revision, internalId, FileContentType_Dicom))
-                {
-                  throw OrthancException(ErrorCode_InternalError);
-                }
-
-                target.fileSize_ = static_cast<unsigned int>(attachment.GetUncompressedSize());
-                target.fileUuid_ = attachment.GetUuid();
-
-                int64_t i;
-                if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Instance_IndexInSeries))
-                {
-                  target.indexInSeries_ = static_cast<int>(i);
-                }
-                else
-                {
-                  target.indexInSeries_ = -1;
-                }
-
-                break;
-              }
-
-              default:
-                throw OrthancException(ErrorCode_InternalError);
-            }
-
-            // check the main dicom tags list has not changed since the resource was stored
-            target.mainDicomTagsSignature_ = DicomMap::GetDefaultMainDicomTagsSignature(type);
-            LookupStringMetadata(target.mainDicomTagsSignature_, target.metadata_, MetadataType_MainDicomTagsSignature);
-          }
-
-          if (expandFlags & ExpandResourceDbFlags_IncludeMainDicomTags)
-          {
-            // read all tags from DB
-            transaction.GetMainDicomTags(target.tags_, internalId);
-
-            // read all main sequences from DB
-            std::string serializedSequences;
-            if (LookupStringMetadata(serializedSequences, target.metadata_, MetadataType_MainDicomSequences))
-            {
-              Json::Value jsonMetadata;
-              Toolbox::ReadJson(jsonMetadata, serializedSequences);
-
-              assert(jsonMetadata["Version"].asInt() == 1);
-              target.tags_.FromDicomAsJson(jsonMetadata["Sequences"], true /* append */, true /* parseSequences */);
-            }
-
-            // check if we have access to all requestedTags or if we must get tags from parents
-            const std::set<DicomTag>& requestedTags = tuple.get<4>();
-
-            if (requestedTags.size() > 0)
-            {
-              std::set<DicomTag> savedMainDicomTags;
-              
-              FromDcmtkBridge::ParseListOfTags(savedMainDicomTags, target.mainDicomTagsSignature_);
-
-              // read parent main dicom tags as long as we have not gathered all requested tags
-              ResourceType currentLevel = target.type_;
-              int64_t currentInternalId = internalId;
-              Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
-
-              while ((target.missingRequestedTags_.size() > 0)
-                    && currentLevel != ResourceType_Patient)
-              {
-                currentLevel = GetParentResourceType(currentLevel);
-
-                int64_t currentParentId;
-                if (!transaction.LookupParent(currentParentId, currentInternalId))
-                {
-                  break;
-                }
-
-                std::map<MetadataType, std::string> parentMetadata;
-                transaction.GetAllMetadata(parentMetadata, currentParentId);
+          FillExpandedResource(tuple.get<1>(), transaction, internalId, type, parent, tuple.get<2>(),
+                               batch.GetItem(internalId), tuple.get<4>(), expandFlags);
+          tuple.get<0>() = true;
+        }
+      }
+    };
 
-                std::string parentMainDicomTagsSignature = DicomMap::GetDefaultMainDicomTagsSignature(currentLevel);
-                LookupStringMetadata(parentMainDicomTagsSignature, parentMetadata, MetadataType_MainDicomTagsSignature);
+    bool found;
+    Operations operations;
+    operations.Apply(*this, found, target, publicId, level, requestedTags, expandFlags);
+    return found;
+  }
 
-                std::set<DicomTag> parentSavedMainDicomTags;
-                FromDcmtkBridge::ParseListOfTags(parentSavedMainDicomTags, parentMainDicomTagsSignature);
-                
-                size_t previousMissingCount = target.missingRequestedTags_.size();
-                Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
-                Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
 
-                // read the parent tags from DB only if it reduces the number of missing tags
-                if (target.missingRequestedTags_.size() < previousMissingCount)
-                { 
-                  Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
+  void StatelessDatabaseOperations::ExpandResources(ExpandedResources& target,
+                                                    const std::list<std::string>& publicIds,
+                                                    ResourceType level,
+                                                    const std::set<DicomTag>& requestedTags,
+                                                    ExpandResourceDbFlags expandFlags)
+  {
+    class Operations : public ReadOnlyOperationsT5<
+      ExpandedResources&, const std::list<std::string>&, ResourceType, const std::set<DicomTag>&, ExpandResourceDbFlags>
+    {
+    private:
+      struct Resource
+      {
+        std::string   publicId_;
+        int64_t       internalId_;
+        ResourceType  type_;
+        std::string   parent_;
+      };
 
-                  DicomMap parentTags;
-                  transaction.GetMainDicomTags(parentTags, currentParentId);
+    public:
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        ExpandedResources& target = tuple.get<0>();
+        const std::list<std::string>& publicIds = tuple.get<1>();
+        const ExpandResourceDbFlags expandFlags = tuple.get<4>();
 
-                  target.tags_.Merge(parentTags);
-                }
+        target.clear();
 
-                currentInternalId = currentParentId;
-              }
-            }
-          }
+        // Resolve the public IDs, skipping the resources that have been deleted in the meantime
+        std::list<Resource> resources;
+        ResourcesBatch batch;
 
-          std::string tmp;
-
-          if (LookupStringMetadata(tmp, target.metadata_, MetadataType_AnonymizedFrom))
-          {
-            target.anonymizedFrom_ = tmp;
-          }
+        for (std::list<std::string>::const_iterator it = publicIds.begin(); it != publicIds.end(); ++it)
+        {
+          Resource resource;
+          resource.publicId_ = *it;
 
-          if (LookupStringMetadata(tmp, target.metadata_, MetadataType_ModifiedFrom))
+          if (transaction.LookupResourceAndParent(resource.internalId_, resource.type_, resource.parent_, *it) &&
+              resource.type_ == tuple.get<2>() &&
+              !batch.HasResource(resource.internalId_))
           {
-            target.modifiedFrom_ = tmp;
+            batch.AddResource(resource.internalId_);
+            resources.push_back(resource);
           }
+        }
 
-          if (type == ResourceType_Patient ||
-              type == ResourceType_Study ||
-              type == ResourceType_Series)
-          {
-            target.isStable_ = !transaction.GetTransactionContext().IsUnstableResource(internalId);
-
-            if (LookupStringMetadata(tmp, target.metadata_, MetadataType_LastUpdate))
-            {
-              target.lastUpdate_ = tmp;
-            }
-          }
-          else
-          {
-            target.isStable_ = false;
-          }
+        if (!batch.IsEmpty())
+        {
+          transaction.ExpandResources(batch,
+                                      (expandFlags & ExpandResourceDbFlags_IncludeMainDicomTags) != 0,
+                                      (expandFlags & ExpandResourceDbFlags_IncludeMetadata) != 0,
+                                      (expandFlags & ExpandResourceDbFlags_IncludeChildren) != 0);
+        }
 
-          tuple.get<0>() = true;
+        for (std::list<Resource>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+        {
+          boost::shared_ptr<ExpandedResource> expanded(new ExpandedResource);
+          FillExpandedResource(*expanded, transaction, it->internalId_, it->type_, it->parent_, it->publicId_,
+                               batch.GetItem(it->internalId_), tuple.get<3>(), expandFlags);
+          target[it->publicId_] = expanded;
         }
       }
     };
 
-    bool found;
     Operations operations;
-    operations.Apply(*this, found, target, publicId, level, requestedTags, expandFlags);
-    return found;
+    operations.Apply(*this, target, publicIds, level, requestedTags, expandFlags);
   }
 
 
@@ -1090,6 +1182,109 @@ namespace Orthanc
   }
 
 
+  void StatelessDatabaseOperations::GetAllUuids(std::list<std::string>& target,
+                                                int64_t& cursor,
+                                                bool& done,
+                                                ResourceType resourceType,
+                                                size_t limit)
+  {
+    class Operations : public ReadOnlyOperationsT5<std::list<std::string>&, std::list<int64_t>&, ResourceType, int64_t, size_t>
+    {
+    public:
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        transaction.GetAllPublicIds(tuple.get<0>(), tuple.get<1>(), tuple.get<2>(), tuple.get<3>(), tuple.get<4>());
+      }
+    };
+
+    std::list<int64_t> internalIds;
+
+    // Ask for one more resource, in order to know whether this is the last page
+    Operations operations;
+    operations.Apply(*this, target, internalIds, resourceType, cursor, (limit == 0 ? 0 : limit + 1));
+
+    assert(target.size() == internalIds.size());
+
+    if (limit != 0 &&
+        target.size() > limit)
+    {
+      target.pop_back();
+      internalIds.pop_back();
+      done = false;
+    }
+    else
+    {
+      done = true;
+    }
+
+    if (!internalIds.empty())
+    {
+      cursor = internalIds.back();
+    }
+  }
+
+
+  void StatelessDatabaseOperations::LookupInstancesWithMetadata(std::list<std::string>& target,
+                                                                int64_t& cursor,
+                                                                bool& done,
+                                                                MetadataType type,
+                                                                size_t limit)
+  {
+    class Operations : public ReadOnlyOperationsT5<std::list<std::string>&, int64_t&, bool&, MetadataType, size_t>
+    {
+    public:
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        const size_t limit = tuple.get<4>();
+
+        tuple.get<0>().clear();
+
+        std::list<std::string> publicIds;
+        std::list<int64_t> internalIds;
+
+        // Ask for one more instance, in order to know whether this is the last page
+        transaction.GetAllPublicIds(publicIds, internalIds, ResourceType_Instance,
+                                    tuple.get<1>(), (limit == 0 ? 0 : limit + 1));
+
+        assert(publicIds.size() == internalIds.size());
+
+        if (limit != 0 &&
+            publicIds.size() > limit)
+        {
+          publicIds.pop_back();
+          internalIds.pop_back();
+          tuple.get<2>() = false;
+        }
+        else
+        {
+          tuple.get<2>() = true;
+        }
+
+        std::list<std::string>::const_iterator publicId = publicIds.begin();
+        for (std::list<int64_t>::const_iterator it = internalIds.begin(); it != internalIds.end(); ++it, ++publicId)
+        {
+          std::string value;
+          int64_t revision;
+          if (transaction.LookupMetadata(value, revision, *it, tuple.get<3>()))
+          {
+            tuple.get<0>().push_back(*publicId);
+          }
+        }
+
+        if (!internalIds.empty())
+        {
+          tuple.get<1>() = internalIds.back();
+        }
+      }
+    };
+
+    Operations operations;
+    operations.Apply(*this, target, cursor, done, type, limit);
+  }
+
+
   void StatelessDatabaseOperations::GetGlobalStatistics(/* out */ uint64_t& diskSize,
                                                         /* out */ uint64_t& uncompressedSize,
                                                         /* out */ uint64_t& countPatients, 
@@ -1964,6 +2159,63 @@ namespace Orthanc
   }
 
 
+  void StatelessDatabaseOperations::ApplyLookupResources(std::vector<std::string>& resourcesId,
+                                                         std::vector<std::string>* instancesId,
+                                                         std::vector<int64_t>& internalIds,
+                                                         const DatabaseLookup& lookup,
+                                                         ResourceType queryLevel,
+                                                         int64_t since,
+                                                         size_t limit)
+  {
+    class Operations : public ReadOnlyOperationsT5<bool, const std::vector<DatabaseConstraint>&, ResourceType, int64_t, size_t>
+    {
+    private:
+      std::list<std::string>  resourcesList_;
+      std::list<std::string>  instancesList_;
+      std::list<int64_t>      internalIdsList_;
+      
+    public:
+      const std::list<std::string>& GetResourcesList() const
+      {
+        return resourcesList_;
+      }
+
+      const std::list<std::string>& GetInstancesList() const
+      {
+        return instancesList_;
+      }
+
+      const std::list<int64_t>& GetInternalIdsList() const
+      {
+        return internalIdsList_;
+      }
+
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        transaction.ApplyLookupResources(resourcesList_, (tuple.get<0>() ? &instancesList_ : NULL), internalIdsList_,
+                                         tuple.get<1>(), tuple.get<2>(), tuple.get<3>(), tuple.get<4>());
+      }
+    };
+
+
+    std::vector<DatabaseConstraint> normalized;
+    NormalizeLookup(normalized, lookup, queryLevel);
+
+    Operations operations;
+    operations.Apply(*this, (instancesId != NULL), normalized, queryLevel, since, limit);
+    
+    CopyListToVector(resourcesId, operations.GetResourcesList());
+
+    internalIds.assign(operations.GetInternalIdsList().begin(), operations.GetInternalIdsList().end());
+
+    if (instancesId != NULL)
+    { 
+      CopyListToVector(*instancesId, operations.GetInstancesList());
+    }
+  }
+
+
   bool StatelessDatabaseOperations::DeleteResource(Json::Value& remainingAncestor,
                                                    const std::string& uuid,
                                                    ResourceType expectedType)
@@ -3511,4 +3763,172 @@ namespace Orthanc
     Apply(operations);
     return operations.GetStatus();
   }
+
+
+  bool StatelessDatabaseOperations::ReplaceDicomAttachment(const std::string& instancePublicId,
+                                                           const Attachments& attachments,
+                                                           DicomTransferSyntax transferSyntax,
+                                                           bool hasPixelDataOffset,
+                                                           uint64_t pixelDataOffset,
+                                                           int64_t oldRevision,
+                                                           const std::string& oldMD5,
+                                                           uint64_t maximumStorageSize,
+                                                           unsigned int maximumPatients)
+  {
+    class Operations : public IReadWriteOperations
+    {
+    private:
+      bool                success_;
+      const std::string&  instancePublicId_;
+      const Attachments&  attachments_;
+      DicomTransferSyntax transferSyntax_;
+      bool                hasPixelDataOffset_;
+      uint64_t            pixelDataOffset_;
+      int64_t             oldRevision_;
+      const std::string&  oldMD5_;
+      uint64_t            maximumStorageSize_;
+      unsigned int        maximumPatientCount_;
+
+      static void ReplaceMetadata(ReadWriteTransaction& transaction,
+                                  int64_t instance,
+                                  MetadataType metadata,
+                                  const std::string& value)
+      {
+        std::string oldValue;
+        int64_t revision;
+        
+        if (transaction.LookupMetadata(oldValue, revision, instance, metadata))
+        {
+          transaction.SetMetadata(instance, metadata, value, revision + 1);
+        }
+        else
+        {
+          transaction.SetMetadata(instance, metadata, value, 0);
+        }
+      }
+
+    public:
+      Operations(const std::string& instancePublicId,
+                 const Attachments& attachments,
+                 DicomTransferSyntax transferSyntax,
+                 bool hasPixelDataOffset,
+                 uint64_t pixelDataOffset,
+                 int64_t oldRevision,
+                 const std::string& oldMD5,
+                 uint64_t maximumStorageSize,
+                 unsigned int maximumPatientCount) :
+        success_(false),
+        instancePublicId_(instancePublicId),
+        attachments_(attachments),
+        transferSyntax_(transferSyntax),
+        hasPixelDataOffset_(hasPixelDataOffset),
+        pixelDataOffset_(pixelDataOffset),
+        oldRevision_(oldRevision),
+        oldMD5_(oldMD5),
+        maximumStorageSize_(maximumStorageSize),
+        maximumPatientCount_(maximumPatientCount)
+      {
+      }
+
+      bool IsSuccess() const
+      {
+        return success_;
+      }
+
+      virtual void Apply(ReadWriteTransaction& transaction) ORTHANC_OVERRIDE
+      {
+        ResourceType resourceType;
+        int64_t instanceId;
+        if (!transaction.LookupResource(instanceId, resourceType, instancePublicId_) ||
+            resourceType != ResourceType_Instance)
+        {
+          success_ = false;  // The instance was deleted in the meantime
+          return;
+        }
+
+        FileInfo oldDicom;
+        int64_t revision;
+        if (!transaction.LookupAttachment(oldDicom, revision, instanceId, FileContentType_Dicom) ||
+            revision != oldRevision_ ||
+            oldDicom.GetUncompressedMD5() != oldMD5_)
+        {
+          success_ = false;  // The DICOM file was modified in the meantime
+          return;
+        }
+
+        // Remove the DICOM file and all the attachments that are derived from it
+        static const FileContentType DERIVED[] = {
+          FileContentType_Dicom,
+          FileContentType_DicomAsJson,
+          FileContentType_DicomUntilPixelData,
+          FileContentType_DicomFrameOffsetTable
+        };
+
+        std::map<FileContentType, int64_t> newRevisions;
+
+        for (size_t i = 0; i < sizeof(DERIVED) / sizeof(FileContentType); i++)
+        {
+          FileInfo info;
+          if (transaction.LookupAttachment(info, revision, instanceId, DERIVED[i]))
+          {
+            transaction.DeleteAttachment(instanceId, DERIVED[i]);
+            newRevisions[DERIVED[i]] = revision + 1;
+          }
+          else
+          {
+            newRevisions[DERIVED[i]] = 0;
+          }
+        }
+
+        // Locate the patient of the instance
+        int64_t patientId = instanceId;
+        int64_t parent;
+        while (transaction.LookupParent(parent, patientId))
+        {
+          patientId = parent;
+        }
+
+        uint64_t compressedSize = 0;
+        for (Attachments::const_iterator it = attachments_.begin(); it != attachments_.end(); ++it)
+        {
+          compressedSize += it->GetCompressedSize();
+        }
+
+        // Possibly apply the recycling mechanism while preserving this patient
+        assert(transaction.GetResourceType(patientId) == ResourceType_Patient);
+        transaction.Recycle(maximumStorageSize_, maximumPatientCount_,
+                            compressedSize, transaction.GetPublicId(patientId));
+
+        for (Attachments::const_iterator it = attachments_.begin(); it != attachments_.end(); ++it)
+        {
+          std::map<FileContentType, int64_t>::const_iterator found = newRevisions.find(it->GetContentType());
+          transaction.AddAttachment(instanceId, *it, (found == newRevisions.end() ? 0 : found->second));
+        }
+
+        transaction.GetTransactionContext().SignalAttachmentsAdded(compressedSize);
+
+        ReplaceMetadata(transaction, instanceId, MetadataType_Instance_TransferSyntax,
+                        GetTransferSyntaxUid(transferSyntax_));
+
+        if (hasPixelDataOffset_)
+        {
+          ReplaceMetadata(transaction, instanceId, MetadataType_Instance_PixelDataOffset,
+                          boost::lexical_cast<std::string>(pixelDataOffset_));
+        }
+        else
+        {
+          transaction.DeleteMetadata(instanceId, MetadataType_Instance_PixelDataOffset);
+        }
+
+        transaction.DeleteMetadata(instanceId, MetadataType_Instance_PendingTranscoding);
+
+        success_ = true;
+      }
+    };
+
+    Operations operations(instancePublicId, attachments, transferSyntax, hasPixelDataOffset, pixelDataOffset,
+                          oldRevision, oldMD5, maximumStorageSize, maximumPatients);
+    Apply(operations);
+    return operations.IsSuccess();
+  }
 }
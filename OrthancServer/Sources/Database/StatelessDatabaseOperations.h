@@ -35,6 +35,7 @@ namespace Orthanc
 {
   class DatabaseLookup;
   class ParsedDicomFile;
+  class ResourcesBatch;
   struct ServerIndexChange;
 
   struct ExpandedResource : public boost::noncopyable
@@ -80,6 +81,7 @@ namespace Orthanc
   {
   public:
     typedef std::list<FileInfo> Attachments;
+    typedef std::map<std::string, boost::shared_ptr<ExpandedResource> >  ExpandedResources;
     typedef std::map<std::pair<ResourceType, MetadataType>, std::string>  MetadataMap;
 
     class ITransactionContext : public IDatabaseListener
@@ -162,6 +164,17 @@ namespace Orthanc
         return transaction_.ApplyLookupResources(resourcesId, instancesId, lookup, queryLevel, limit);
       }
 
+      void ApplyLookupResources(std::list<std::string>& resourcesId,
+                                std::list<std::string>* instancesId, // Can be NULL if not needed
+                                std::list<int64_t>& internalIds,
+                                const std::vector<DatabaseConstraint>& lookup,
+                                ResourceType queryLevel,
+                                int64_t since,
+                                size_t limit)
+      {
+        return transaction_.ApplyLookupResources(resourcesId, instancesId, internalIds, lookup, queryLevel, since, limit);
+      }
+
       void GetAllMetadata(std::map<MetadataType, std::string>& target,
                           int64_t id)
       {
@@ -182,6 +195,15 @@ namespace Orthanc
         return transaction_.GetAllPublicIds(target, resourceType, since, limit);
       }  
 
+      void GetAllPublicIds(std::list<std::string>& publicIds,
+                           std::list<int64_t>& internalIds,
+                           ResourceType resourceType,
+                           int64_t since,
+                           size_t limit)
+      {
+        return transaction_.GetAllPublicIds(publicIds, internalIds, resourceType, since, limit);
+      }
+
       void GetChanges(std::list<ServerIndexChange>& target /*out*/,
                       bool& done /*out*/,
                       int64_t since,
@@ -310,6 +332,15 @@ namespace Orthanc
       {
         return transaction_.LookupResourceAndParent(id, type, parentPublicId, publicId);
       }
+
+
+      void ExpandResources(ResourcesBatch& target,
+                           bool includeMainDicomTags,
+                           bool includeMetadata,
+                           bool includeChildren)
+      {
+        transaction_.ExpandResources(target, includeMainDicomTags, includeMetadata, includeChildren);
+      }
     };
 
 
@@ -454,6 +485,7 @@ namespace Orthanc
     IDatabaseWrapper&                            db_;
     boost::shared_ptr<MainDicomTagsRegistry>     mainDicomTagsRegistry_;  // "shared_ptr" because of PImpl
     bool                                         hasFlushToDisk_;
+    bool                                         hasKeysetPagination_;
 
     // Mutex to protect the configuration options
     boost::shared_mutex                          mutex_;
@@ -495,6 +527,13 @@ namespace Orthanc
       return hasFlushToDisk_;
     }
 
+    // Whether "GetAllUuids()" and "LookupInstancesWithMetadata()"
+    // have a cost that is independent of the position of the cursor
+    bool HasKeysetPaginationSupport() const
+    {
+      return hasKeysetPagination_;
+    }
+
     void Apply(IReadOnlyOperations& operations);
   
     void Apply(IReadWriteOperations& operations);
@@ -505,6 +544,18 @@ namespace Orthanc
                         const std::set<DicomTag>& requestedTags,
                         ExpandResourceDbFlags expandFlags);
 
+    /**
+     * Batched version of "ExpandResource()" that expands a list of
+     * resources of the same level inside one single read-only
+     * transaction. The resources that do not exist (anymore) are
+     * absent from "target".
+     **/
+    void ExpandResources(ExpandedResources& target,
+                         const std::list<std::string>& publicIds,
+                         ResourceType level,
+                         const std::set<DicomTag>& requestedTags,
+                         ExpandResourceDbFlags expandFlags);
+
     void GetAllMetadata(std::map<MetadataType, std::string>& target,
                         const std::string& publicId,
                         ResourceType level);
@@ -517,6 +568,29 @@ namespace Orthanc
                      size_t since,
                      size_t limit);
 
+    /**
+     * Keyset pagination (new in Orthanc 1.11.3): The resources are
+     * listed after the position "cursor" (0 to start from the
+     * beginning). On exit, "cursor" points to the next page, and
+     * "done" is set to "true" iff. there is no more resource.
+     **/
+    void GetAllUuids(std::list<std::string>& target,
+                     int64_t& cursor,
+                     bool& done,
+                     ResourceType resourceType,
+                     size_t limit);
+
+    /**
+     * Lists the instances that are associated with the given
+     * metadata, using the same keyset pagination as "GetAllUuids()"
+     * (new in Orthanc 1.11.3).
+     **/
+    void LookupInstancesWithMetadata(std::list<std::string>& target,
+                                     int64_t& cursor,
+                                     bool& done,
+                                     MetadataType type,
+                                     size_t limit);
+
     void GetGlobalStatistics(/* out */ uint64_t& diskSize,
                              /* out */ uint64_t& uncompressedSize,
                              /* out */ uint64_t& countPatients, 
@@ -607,6 +681,15 @@ namespace Orthanc
                               ResourceType queryLevel,
                               size_t limit);
 
+    // Keyset pagination (new in Orthanc 1.11.3)
+    void ApplyLookupResources(std::vector<std::string>& resourcesId,
+                              std::vector<std::string>* instancesId,  // Can be NULL if not needed
+                              std::vector<int64_t>& internalIds,
+                              const DatabaseLookup& lookup,
+                              ResourceType queryLevel,
+                              int64_t since,
+                              size_t limit);
+
     bool DeleteResource(Json::Value& remainingAncestor /* out */,
                         const std::string& uuid,
                         ResourceType expectedType);
@@ -683,5 +766,22 @@ namespace Orthanc
                               bool hasOldRevision,
                               int64_t oldRevision,
                               const std::string& oldMd5);
+
+    /**
+     * Replaces the DICOM file of one instance, together with the
+     * attachments and the metadata that are derived from it, in one
+     * single transaction. Returns "false" if the instance was deleted
+     * or if its DICOM file was modified in the meantime. New in
+     * Orthanc 1.11.3.
+     **/
+    bool ReplaceDicomAttachment(const std::string& instancePublicId,
+                                const Attachments& attachments,
+                                DicomTransferSyntax transferSyntax,
+                                bool hasPixelDataOffset,
+                                uint64_t pixelDataOffset,
+                                int64_t oldRevision,
+                                const std::string& oldMD5,
+                                uint64_t maximumStorageSize,
+                                unsigned int maximumPatients);
   };
 }
@@ -38,7 +38,7 @@
 
 namespace Orthanc
 {
-  static void AddAnswer(DicomFindAnswers& answers,
+  static void AddAnswer(IFindRequestHandler::IAnswersStream& answers,
                         ServerContext& context,
                         const std::string& publicId,
                         const std::string& instanceId,
@@ -227,10 +227,50 @@ namespace Orthanc
   }
 
 
+  namespace
+  {
+    // Adapter to store the answers of a non-streaming C-FIND into "DicomFindAnswers"
+    class BufferedAnswers : public IFindRequestHandler::IAnswersStream
+    {
+    private:
+      DicomFindAnswers&  answers_;
+
+    public:
+      explicit BufferedAnswers(DicomFindAnswers& answers) :
+        answers_(answers)
+      {
+      }
+
+      virtual bool Add(const DicomMap& map) ORTHANC_OVERRIDE
+      {
+        answers_.Add(map);
+        return true;
+      }
+
+      virtual bool Add(const ParsedDicomFile& dicom) ORTHANC_OVERRIDE
+      {
+        answers_.Add(dicom);
+        return true;
+      }
+
+      virtual bool IsCancelled() ORTHANC_OVERRIDE
+      {
+        return false;
+      }
+
+      virtual void SetComplete(bool isComplete) ORTHANC_OVERRIDE
+      {
+        answers_.SetComplete(isComplete);
+      }
+    };
+  }
+
+
   OrthancFindRequestHandler::OrthancFindRequestHandler(ServerContext& context) :
     context_(context),
     maxResults_(0),
-    maxInstances_(0)
+    maxInstances_(0),
+    streaming_(false)
   {
   }
 
@@ -238,7 +278,7 @@ namespace Orthanc
   class OrthancFindRequestHandler::LookupVisitor : public ServerContext::ILookupVisitor
   {
   private:
-    DicomFindAnswers&           answers_;
+    IAnswersStream&             answers_;
     ServerContext&              context_;
     ResourceType                level_;
     const DicomMap&             query_;
@@ -250,7 +290,7 @@ namespace Orthanc
     FindStorageAccessMode       findStorageAccessMode_;
 
   public:
-    LookupVisitor(DicomFindAnswers&  answers,
+    LookupVisitor(IAnswersStream& answers,
                   ServerContext& context,
                   ResourceType level,
                   const DicomMap& query,
@@ -306,6 +346,11 @@ namespace Orthanc
       answers_.SetComplete(true);
     }
 
+    virtual bool IsCancelled() ORTHANC_OVERRIDE
+    {
+      return answers_.IsCancelled();
+    }
+
     virtual void Visit(const std::string& publicId,
                        const std::string& instanceId,
                        const DicomMap& mainDicomTags,
@@ -324,6 +369,19 @@ namespace Orthanc
                                          const std::string& remoteAet,
                                          const std::string& calledAet,
                                          ModalityManufacturer manufacturer)
+  {
+    BufferedAnswers buffered(answers);
+    HandleStream(buffered, input, sequencesToReturn, remoteIp, remoteAet, calledAet, manufacturer);
+  }
+
+
+  void OrthancFindRequestHandler::HandleStream(IAnswersStream& answers,
+                                               const DicomMap& input,
+                                               const std::list<DicomTag>& sequencesToReturn,
+                                               const std::string& remoteIp,
+                                               const std::string& remoteAet,
+                                               const std::string& calledAet,
+                                               ModalityManufacturer manufacturer)
   {
     MetricsRegistry::Timer timer(context_.GetMetricsRegistry(), "orthanc_find_scp_duration_ms");
 
@@ -35,6 +35,7 @@ namespace Orthanc
     ServerContext& context_;
     unsigned int   maxResults_;
     unsigned int   maxInstances_;
+    bool           streaming_;
 
     bool HasReachedLimit(const DicomFindAnswers& answers,
                          ResourceType level) const;
@@ -62,6 +63,25 @@ namespace Orthanc
                         const std::string& calledAet,
                         ModalityManufacturer manufacturer) ORTHANC_OVERRIDE;
 
+    virtual bool IsStreaming() const ORTHANC_OVERRIDE
+    {
+      return streaming_;
+    }
+
+    virtual void HandleStream(IAnswersStream& answers,
+                              const DicomMap& input,
+                              const std::list<DicomTag>& sequencesToReturn,
+                              const std::string& remoteIp,
+                              const std::string& remoteAet,
+                              const std::string& calledAet,
+                              ModalityManufacturer manufacturer) ORTHANC_OVERRIDE;
+
+    // Send the answers to the C-FIND SCU while the lookup is running
+    void SetStreaming(bool streaming)
+    {
+      streaming_ = streaming;
+    }
+
     unsigned int GetMaxResults() const
     {
       return maxResults_;
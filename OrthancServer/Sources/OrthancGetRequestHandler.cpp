@@ -23,6 +23,9 @@
 #include "OrthancGetRequestHandler.h"
 
 #include "../../OrthancFramework/Sources/DicomFormat/DicomArray.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomStreamReader.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomAssociation.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomStoreUserConnection.h"
 #include "../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../OrthancFramework/Sources/Logging.h"
 #include "../../OrthancFramework/Sources/MetricsRegistry.h"
@@ -56,6 +59,78 @@ namespace Orthanc
   }
 
 
+  /**
+   * Counterpart of "DIMSE_storeUser()" that sends the bytes of a DICOM
+   * file following its meta-header, without parsing them, as in
+   * "DicomStoreUserConnection" (new in Orthanc 1.11.3). The transfer
+   * syntax of the file must be the one of the presentation context.
+   **/
+  static OFCondition StoreWithoutParsing(T_ASC_Association* assoc,
+                                         T_ASC_PresentationContextID presId,
+                                         T_DIMSE_C_StoreRQ& req,
+                                         const std::string& dicom,
+                                         uint64_t datasetOffset,
+                                         uint32_t timeout,
+                                         T_DIMSE_C_StoreRSP& rsp,
+                                         std::unique_ptr<DcmDataset>& stDetail,
+                                         T_DIMSE_DetectedCancelParameters& cancelParameters)
+  {
+    assert(datasetOffset <= dicom.size());
+
+    {
+      OFString str;
+      CLOG(TRACE, DICOM) << "Sending Store Request following a C-GET:" << std::endl
+                         << DIMSE_dumpMessage(str, req, DIMSE_OUTGOING);
+    }
+
+    std::string command;
+    DicomStoreUserConnection::EncodeStoreCommand(command, req.AffectedSOPClassUID, req.AffectedSOPInstanceUID,
+                                                 req.MessageID, false /* no move originator */, "", 0);
+
+    OFCondition cond = DicomAssociation::WritePDVs(*assoc, presId, DUL_COMMANDPDV, command.c_str(), command.size());
+
+    if (cond.good())
+    {
+      cond = DicomAssociation::WritePDVs(*assoc, presId, DUL_DATASETPDV, dicom.c_str() + datasetOffset,
+                                         dicom.size() - static_cast<size_t>(datasetOffset));
+    }
+
+    while (cond.good())
+    {
+      T_DIMSE_Message response;
+      T_ASC_PresentationContextID responsePresId = 0;
+      DcmDataset* stDetailTmp = NULL;
+      cond = DIMSE_receiveCommand(assoc, (timeout > 0 ? DIMSE_NONBLOCKING : DIMSE_BLOCKING), timeout,
+                                  &responsePresId, &response, &stDetailTmp);
+      stDetail.reset(stDetailTmp);
+
+      if (cond.bad())
+      {
+        break;
+      }
+      else if (response.CommandField == DIMSE_C_CANCEL_RQ)
+      {
+        // As in "DIMSE_storeUser()", the C-CANCEL is recorded, and the response is still awaited
+        cancelParameters.cancelEncountered = OFTrue;
+        cancelParameters.presId = responsePresId;
+        cancelParameters.req = response.msg.CCancelRQ;
+      }
+      else if (response.CommandField == DIMSE_C_STORE_RSP &&
+               response.msg.CStoreRSP.MessageIDBeingRespondedTo == req.MessageID)
+      {
+        rsp = response.msg.CStoreRSP;
+        break;
+      }
+      else
+      {
+        cond = DIMSE_UNEXPECTEDRESPONSE;
+      }
+    }
+
+    return cond;
+  }
+
+
   bool OrthancGetRequestHandler::DoNext(T_ASC_Association* assoc)
   {
     if (position_ >= instances_.size())
@@ -73,6 +148,18 @@ namespace Orthanc
       throw OrthancException(ErrorCode_BadFileFormat);
     }
 
+    std::string sopClassUid, sopInstanceUid;
+    DicomTransferSyntax sourceSyntax;
+    uint64_t datasetOffset;
+
+    if (DicomStreamReader::LookupMetaHeader(sopClassUid, sopInstanceUid, sourceSyntax,
+                                            datasetOffset, dicom.c_str(), dicom.size()) &&
+        sourceSyntax != DicomTransferSyntax_DeflatedLittleEndianExplicit)
+    {
+      // The file will only be parsed if transcoding is needed (new in Orthanc 1.11.3)
+      return PerformGetSubOp(assoc, sopClassUid, sopInstanceUid, sourceSyntax, dicom, datasetOffset, NULL);
+    }
+
     std::unique_ptr<DcmFileFormat> parsed(
       FromDcmtkBridge::LoadFromMemoryBuffer(dicom.c_str(), dicom.size()));
 
@@ -93,10 +180,20 @@ namespace Orthanc
                              originatorAet_);
     }
 
-    std::string sopClassUid(a.c_str());
-    std::string sopInstanceUid(b.c_str());
+    sopClassUid.assign(a.c_str());
+    sopInstanceUid.assign(b.c_str());
+
+    if (!FromDcmtkBridge::LookupOrthancTransferSyntax(sourceSyntax, *parsed))
+    {
+      failedCount_++;
+      AddFailedUIDInstance(sopInstanceUid);
+      throw OrthancException(ErrorCode_NetworkProtocol, 
+                             "C-GET SCP: Unknown transfer syntax: (" +
+                             std::string(dcmSOPClassUIDToModality(sopClassUid.c_str(), "OT")) +
+                             ") " + sopClassUid);
+    }
     
-    return PerformGetSubOp(assoc, sopClassUid, sopInstanceUid, parsed.release());
+    return PerformGetSubOp(assoc, sopClassUid, sopInstanceUid, sourceSyntax, dicom, 0, parsed.release());
   }
 
   
@@ -215,21 +312,12 @@ namespace Orthanc
   bool OrthancGetRequestHandler::PerformGetSubOp(T_ASC_Association* assoc,
                                                  const std::string& sopClassUid,
                                                  const std::string& sopInstanceUid,
-                                                 DcmFileFormat* dicomRaw)
+                                                 DicomTransferSyntax sourceSyntax,
+                                                 const std::string& dicom,
+                                                 uint64_t datasetOffset,
+                                                 DcmFileFormat* parsedRaw)
   {
-    assert(dicomRaw != NULL);
-    std::unique_ptr<DcmFileFormat> dicom(dicomRaw);
-    
-    DicomTransferSyntax sourceSyntax;
-    if (!FromDcmtkBridge::LookupOrthancTransferSyntax(sourceSyntax, *dicom))
-    {
-      failedCount_++;
-      AddFailedUIDInstance(sopInstanceUid);
-      throw OrthancException(ErrorCode_NetworkProtocol, 
-                             "C-GET SCP: Unknown transfer syntax: (" +
-                             std::string(dcmSOPClassUIDToModality(sopClassUid.c_str(), "OT")) +
-                             ") " + sopClassUid);
-    }
+    std::unique_ptr<DcmFileFormat> parsed(parsedRaw);
 
     T_ASC_PresentationContextID presId = 0;  // Unnecessary initialization, makes code clearer
     DicomTransferSyntax selectedSyntax;
@@ -293,12 +381,19 @@ namespace Orthanc
 
     OFCondition cond;
 
-    if (sourceSyntax == selectedSyntax)
+    if (sourceSyntax == selectedSyntax &&
+        parsed.get() == NULL)
+    {
+      // No transcoding is required: Send the dataset of the file "as is"
+      cond = StoreWithoutParsing(assoc, presId, req, dicom, datasetOffset,
+                                 timeout_, rsp, stDetail, cancelParameters);
+    }
+    else if (sourceSyntax == selectedSyntax)
     {
       // No transcoding is required
       DcmDataset *stDetailTmp = NULL;
       cond = DIMSE_storeUser(
-        assoc, presId, &req, NULL /* imageFileName */, dicom->getDataset(),
+        assoc, presId, &req, NULL /* imageFileName */, parsed->getDataset(),
         ProgressCallback, NULL /* callbackData */,
         (timeout_ > 0 ? DIMSE_NONBLOCKING : DIMSE_BLOCKING), timeout_,
         &rsp, &stDetailTmp, &cancelParameters);
@@ -306,9 +401,20 @@ namespace Orthanc
     }
     else
     {
+      if (parsed.get() == NULL)
+      {
+        parsed.reset(FromDcmtkBridge::LoadFromMemoryBuffer(dicom.c_str(), dicom.size()));
+
+        if (parsed.get() == NULL ||
+            parsed->getDataset() == NULL)
+        {
+          throw OrthancException(ErrorCode_InternalError);
+        }
+      }
+
       // Transcoding to the selected uncompressed transfer syntax
       IDicomTranscoder::DicomImage source, transcoded;
-      source.AcquireParsed(dicom.release());
+      source.AcquireParsed(parsed.release());
 
       std::set<DicomTransferSyntax> ts;
       ts.insert(selectedSyntax);
@@ -56,11 +56,15 @@ namespace Orthanc
                            ResourceType level,
                            const DicomMap& input) const;
     
-    // Returns "false" iff cancel
+    // Returns "false" iff cancel. "parsedRaw" is NULL if the DICOM
+    // file is only to be parsed if transcoding is needed.
     bool PerformGetSubOp(T_ASC_Association *assoc,
                          const std::string& sopClassUid,
                          const std::string& sopInstanceUid,
-                         DcmFileFormat* datasetRaw);
+                         DicomTransferSyntax sourceSyntax,
+                         const std::string& dicom,
+                         uint64_t datasetOffset,
+                         DcmFileFormat* parsedRaw);
     
     void AddFailedUIDInstance(const std::string& sopInstance);
 
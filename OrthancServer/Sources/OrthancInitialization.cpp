@@ -39,10 +39,12 @@
 
 #include "../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../OrthancFramework/Sources/FileStorage/FilesystemStorage.h"
+#include "../../OrthancFramework/Sources/FileStorage/TieredStorageArea.h"
 #include "../../OrthancFramework/Sources/HttpClient.h"
 #include "../../OrthancFramework/Sources/Logging.h"
 #include "../../OrthancFramework/Sources/OrthancException.h"
 #include "../../OrthancFramework/Sources/SerializationToolbox.h"
+#include "../../OrthancFramework/Sources/SystemToolbox.h"
 
 #include "Database/SQLiteDatabaseWrapper.h"
 #include "OrthancConfiguration.h"
@@ -530,6 +532,154 @@ namespace Orthanc
   }
 
 
+  IStorageArea* CreateTieredStorageArea(IStorageArea* storage)
+  {
+    static const char* const STORAGE_TIER_DIRECTORY = "StorageTierDirectory";
+    static const char* const STORAGE_TIER_MAXIMUM_SIZE = "StorageTierMaximumSize";
+    static const char* const STORAGE_TIER_EVICTION = "StorageTierEviction";
+    static const char* const STORAGE_TIER_WRITE_POLICY = "StorageTierWritePolicy";
+    static const char* const STORAGE_TIER_WRITE_BACK_MARKER = "WriteBack.txt";
+    static const char* const STORAGE_TIER_CONTENT_TYPES = "ContentTypes";
+    static const char* const SYNC_STORAGE_AREA = "SyncStorageArea";
+
+    std::unique_ptr<IStorageArea> remote(storage);
+
+    if (remote.get() == NULL)
+    {
+      throw OrthancException(ErrorCode_NullPointer);
+    }
+
+    OrthancConfiguration::ReaderLock lock;
+
+    const std::string directory = lock.GetConfiguration().GetStringParameter(STORAGE_TIER_DIRECTORY, "");
+
+    if (directory.empty())
+    {
+      return remote.release();  // No local storage tier
+    }
+
+    boost::filesystem::path tierDirectory = lock.GetConfiguration().InterpretStringParameterAsPath(directory);
+
+    boost::filesystem::path storageDirectory = lock.GetConfiguration().InterpretStringParameterAsPath(
+      lock.GetConfiguration().GetStringParameter(STORAGE_DIRECTORY, ORTHANC_STORAGE));
+
+    if (boost::filesystem::exists(tierDirectory) &&
+        boost::filesystem::exists(storageDirectory) &&
+        boost::filesystem::equivalent(tierDirectory, storageDirectory))
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange, "Configuration option \"" +
+                             std::string(STORAGE_TIER_DIRECTORY) + "\" must differ from \"" +
+                             std::string(STORAGE_DIRECTORY) + "\"");
+    }
+
+    const uint64_t maximumSize = lock.GetConfiguration().GetUnsignedIntegerParameter(STORAGE_TIER_MAXIMUM_SIZE, 1024);
+    if (maximumSize == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange, "Configuration option \"" +
+                             std::string(STORAGE_TIER_MAXIMUM_SIZE) + "\" must be positive");
+    }
+
+    TieredStorageArea::EvictionPolicy eviction;
+    const std::string evictionString = lock.GetConfiguration().GetStringParameter(STORAGE_TIER_EVICTION, "LRU");
+    if (evictionString == "LRU")
+    {
+      eviction = TieredStorageArea::EvictionPolicy_LeastRecentlyUsed;
+    }
+    else if (evictionString == "LFU")
+    {
+      eviction = TieredStorageArea::EvictionPolicy_LeastFrequentlyUsed;
+    }
+    else
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange, "Configuration option \"" +
+                             std::string(STORAGE_TIER_EVICTION) + "\" must be \"LRU\" or \"LFU\", found: " +
+                             evictionString);
+    }
+
+    TieredStorageArea::WritePolicy writePolicy;
+    const std::string writePolicyString = lock.GetConfiguration().GetStringParameter(STORAGE_TIER_WRITE_POLICY, "WriteThrough");
+    if (writePolicyString == "WriteThrough")
+    {
+      writePolicy = TieredStorageArea::WritePolicy_WriteThrough;
+    }
+    else if (writePolicyString == "WriteBack")
+    {
+      writePolicy = TieredStorageArea::WritePolicy_WriteBack;
+    }
+    else
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange, "Configuration option \"" +
+                             std::string(STORAGE_TIER_WRITE_POLICY) + "\" must be \"WriteThrough\" or \"WriteBack\", found: " +
+                             writePolicyString);
+    }
+
+    std::unique_ptr<FilesystemStorage> local;
+
+    if (writePolicy == TieredStorageArea::WritePolicy_WriteBack)
+    {
+      // In write-back mode, the local tier temporarily holds the only copy of the new files
+      local.reset(new FilesystemStorage(tierDirectory.string(),
+                                        lock.GetConfiguration().GetBooleanParameter(SYNC_STORAGE_AREA, true)));
+    }
+    else
+    {
+      // In write-through mode, the local tier is a mere cache
+      local.reset(new FilesystemStorage(tierDirectory.string(), false /* no fsync */));
+    }
+
+    /**
+     * This marker file is present iff the local tier was last used in
+     * write-back mode, in which case the files that are left in the
+     * local tier might have never been uploaded to the storage area
+     * (e.g. after a crash, or if the storage area was unavailable).
+     **/
+    const boost::filesystem::path marker = tierDirectory / STORAGE_TIER_WRITE_BACK_MARKER;
+    const bool pendingWrites = boost::filesystem::exists(marker);
+
+    std::set<std::string> leftovers;
+    local->ListAllFiles(leftovers);
+
+    LOG(WARNING) << "Storage tier directory: " << tierDirectory << " (maximum size: "
+                 << maximumSize << "MB, eviction: " << evictionString << ", " << writePolicyString << ")";
+
+    std::unique_ptr<TieredStorageArea> tier(new TieredStorageArea(remote.release(), local.release(),
+                                                                  maximumSize * 1024 * 1024,
+                                                                  eviction, writePolicy));
+
+    // Not a subfolder of the form "xx/yy/", so it is ignored by "FilesystemStorage"
+    tier->SetContentTypesDirectory((tierDirectory / STORAGE_TIER_CONTENT_TYPES).string());
+
+    if (writePolicy == TieredStorageArea::WritePolicy_WriteBack)
+    {
+      // The marker must be written before the first new file
+      SystemToolbox::WriteFile(std::string("The local tier of Orthanc is used in write-back mode\n"),
+                               marker.string(), true /* fsync */);
+      tier->RecoverLocalFiles(leftovers, pendingWrites);
+    }
+    else
+    {
+      try
+      {
+        // Throws if some file cannot be uploaded, in which case the marker is kept
+        tier->RecoverLocalFiles(leftovers, pendingWrites);
+      }
+      catch (OrthancException& e)
+      {
+        throw OrthancException(e.GetErrorCode(),
+                               "Cannot upload the files that were left in the storage tier by the "
+                               "write-back mode, Orthanc will not start: " + std::string(e.What()));
+      }
+
+      if (pendingWrites)
+      {
+        SystemToolbox::RemoveFile(marker.string());
+      }
+    }
+
+    return tier.release();
+  }
+
+
   static void SetDcmtkVerbosity(Verbosity verbosity)
   {
     // INFO_LOG_LEVEL was the DCMTK log level in Orthanc <= 1.8.0    
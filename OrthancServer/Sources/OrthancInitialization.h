@@ -36,6 +36,10 @@ namespace Orthanc
 
   IStorageArea* CreateStorageArea();
 
+  // Wraps the given storage area (whose ownership is transferred) in a
+  // "TieredStorageArea" if option "StorageTierDirectory" is set
+  IStorageArea* CreateTieredStorageArea(IStorageArea* storage);
+
   void SetGlobalVerbosity(Verbosity verbosity);
 
   Verbosity GetGlobalVerbosity();
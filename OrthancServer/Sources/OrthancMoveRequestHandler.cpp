@@ -32,6 +32,10 @@
 #include "ServerContext.h"
 #include "ServerJobs/DicomModalityStoreJob.h"
 
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <queue>
+
 
 namespace Orthanc
 {
@@ -123,6 +127,7 @@ namespace Orthanc
       std::unique_ptr<DicomModalityStoreJob>  job_;
       size_t                                  position_;
       size_t                                  countInstances_;
+      std::string                             jobId_;
       
     public:
       AsynchronousMove(ServerContext& context,
@@ -132,7 +137,8 @@ namespace Orthanc
                        uint16_t originatorId) :
         context_(context),
         job_(new DicomModalityStoreJob(context)),
-        position_(0)
+        position_(0),
+        countInstances_(0)
       {
         job_->SetDescription("C-MOVE");
         //job_->SetPermissive(true);  // This was the behavior of Orthanc < 1.6.0
@@ -157,7 +163,7 @@ namespace Orthanc
           std::list<std::string> tmp;
           context_.GetIndex().GetChildInstances(tmp, publicIds[i]);
 
-          countInstances_ = tmp.size();
+          countInstances_ += tmp.size();
 
           job_->Reserve(job_->GetCommandsCount() + tmp.size());
 
@@ -182,12 +188,240 @@ namespace Orthanc
         
         if (position_ == 0)
         {
-          context_.GetJobsEngine().GetRegistry().Submit(job_.release(), 0 /* priority */);
+          context_.GetJobsEngine().GetRegistry().Submit(jobId_, job_.release(), 0 /* priority */);
         }
         
         position_ ++;
         return Status_Success;
       }
+
+      virtual void Cancel()
+      {
+        /**
+         * The job is submitted by the first sub-operation, after
+         * which all the sub-operations are reported as successful
+         * without waiting for the job. A C-CANCEL can therefore only
+         * prevent the submission of the job: Once submitted, the job
+         * is only controlled through the jobs engine.
+         **/
+        if (jobId_.empty())
+        {
+          job_.reset(NULL);
+        }
+      }
+    };
+
+
+    /**
+     * This iterator fans out the C-STORE sub-operations over a pool
+     * of threads, each of them owning its own association to the
+     * target modality. "DoNext()" waits for the completion of any of
+     * the running sub-operations, which gives an accurate report of
+     * the progress to the C-MOVE SCU (new in Orthanc 1.11.3).
+     **/
+    class ParallelMove : public IMoveRequestIterator
+    {
+    private:
+      ServerContext&              context_;
+      std::string                 localAet_;
+      RemoteModalityParameters    remote_;
+      std::string                 originatorAet_;
+      uint16_t                    originatorId_;
+      std::vector<std::string>    instances_;
+      unsigned int                associationsCount_;
+
+      boost::mutex                mutex_;
+      boost::condition_variable   completed_;
+      size_t                      nextInstance_;
+      size_t                      reported_;
+      std::queue<Status>          results_;
+      bool                        cancelled_;
+      std::vector<boost::thread*> workers_;
+
+      bool DequeueInstance(std::string& instance)
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (cancelled_ ||
+            nextInstance_ >= instances_.size())
+        {
+          return false;
+        }
+        else
+        {
+          instance = instances_[nextInstance_++];
+          return true;
+        }
+      }
+
+      void SignalResult(Status status)
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        results_.push(status);
+        completed_.notify_one();
+      }
+
+      static void Worker(ParallelMove* that)
+      {
+        std::unique_ptr<DicomStoreUserConnection> connection;
+
+        std::string instance;
+        while (that->DequeueInstance(instance))
+        {
+          Status status = Status_Success;
+
+          try
+          {
+            std::string dicom;
+            that->context_.ReadDicom(dicom, instance);
+
+            if (connection.get() == NULL)
+            {
+              DicomAssociationParameters params(that->localAet_, that->remote_);
+              connection.reset(new DicomStoreUserConnection(params));
+            }
+
+            std::string sopClassUid, sopInstanceUid;  // Unused
+            that->context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, *connection, dicom,
+                                                true, that->originatorAet_, that->originatorId_);
+          }
+          catch (OrthancException& e)
+          {
+            CLOG(ERROR, DICOM) << "Cannot send instance " << instance << " to modality \""
+                               << that->remote_.GetApplicationEntityTitle()
+                               << "\" during a C-MOVE: " << e.What();
+            status = Status_Failure;
+
+            // Open a new association for the next sub-operation
+            connection.reset(NULL);
+          }
+          catch (...)
+          {
+            CLOG(ERROR, DICOM) << "Native exception while sending instance " << instance
+                               << " during a C-MOVE";
+            status = Status_Failure;
+            connection.reset(NULL);
+          }
+
+          that->SignalResult(status);
+        }
+      }
+
+      void StopWorkers()
+      {
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          cancelled_ = true;
+        }
+
+        for (size_t i = 0; i < workers_.size(); i++)
+        {
+          if (workers_[i] != NULL)
+          {
+            if (workers_[i]->joinable())
+            {
+              workers_[i]->join();
+            }
+
+            delete workers_[i];
+          }
+        }
+
+        workers_.clear();
+      }
+
+    public:
+      ParallelMove(ServerContext& context,
+                   const std::string& targetAet,
+                   const std::vector<std::string>& publicIds,
+                   const std::string& originatorAet,
+                   uint16_t originatorId,
+                   unsigned int associationsCount) :
+        context_(context),
+        localAet_(context.GetDefaultLocalApplicationEntityTitle()),
+        originatorAet_(originatorAet),
+        originatorId_(originatorId),
+        associationsCount_(associationsCount),
+        nextInstance_(0),
+        reported_(0),
+        cancelled_(false)
+      {
+        if (associationsCount == 0)
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange);
+        }
+
+        {
+          OrthancConfiguration::ReaderLock lock;
+          remote_ = lock.GetConfiguration().GetModalityUsingAet(targetAet);
+        }
+
+        for (size_t i = 0; i < publicIds.size(); i++)
+        {
+          CLOG(INFO, DICOM) << "Sending resource " << publicIds[i] << " to modality \""
+                            << targetAet << "\" using up to " << associationsCount
+                            << " parallel associations";
+
+          std::list<std::string> tmp;
+          context_.GetIndex().GetChildInstances(tmp, publicIds[i]);
+
+          instances_.reserve(instances_.size() + tmp.size());
+          for (std::list<std::string>::iterator it = tmp.begin(); it != tmp.end(); ++it)
+          {
+            instances_.push_back(*it);
+          }
+        }
+      }
+
+      virtual ~ParallelMove()
+      {
+        StopWorkers();
+      }
+
+      virtual unsigned int GetSubOperationCount() const
+      {
+        return instances_.size();
+      }
+
+      virtual Status DoNext()
+      {
+        if (reported_ >= instances_.size())
+        {
+          return Status_Failure;
+        }
+
+        if (workers_.empty())
+        {
+          // Lazily start the workers on the first sub-operation
+          const size_t count = std::min(static_cast<size_t>(associationsCount_), instances_.size());
+
+          workers_.resize(count, NULL);
+          for (size_t i = 0; i < count; i++)
+          {
+            workers_[i] = new boost::thread(Worker, this);
+          }
+        }
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        while (results_.empty())
+        {
+          completed_.wait(lock);
+        }
+
+        Status status = results_.front();
+        results_.pop();
+        reported_++;
+
+        return status;
+      }
+
+      virtual void Cancel()
+      {
+        // The sub-operations that are running are completed, but no
+        // other instance is sent
+        StopWorkers();
+      }
     };
   }
 
@@ -284,6 +518,10 @@ namespace Orthanc
   }
 
 
+  // Upper bound on "CMoveAssociationsCount", as each association to
+  // the target modality is served by its own thread
+  static const unsigned int MAX_CMOVE_ASSOCIATIONS_COUNT = 32;
+
   static IMoveRequestIterator* CreateIterator(ServerContext& context,
                                               const std::string& targetAet,
                                               const std::vector<std::string>& publicIds,
@@ -297,16 +535,28 @@ namespace Orthanc
     }
     
     bool synchronous;
+    unsigned int associationsCount;
 
     {
       OrthancConfiguration::ReaderLock lock;
       synchronous = lock.GetConfiguration().GetBooleanParameter("SynchronousCMove", true);
+      associationsCount = lock.GetConfiguration().GetUnsignedIntegerParameter("CMoveAssociationsCount", 1);
     }
 
     if (synchronous)
     {
       return new SynchronousMove(context, targetAet, publicIds, originatorAet, originatorId);
     }
+    else if (associationsCount > MAX_CMOVE_ASSOCIATIONS_COUNT)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "The configuration option \"CMoveAssociationsCount\" cannot exceed " +
+                             boost::lexical_cast<std::string>(MAX_CMOVE_ASSOCIATIONS_COUNT));
+    }
+    else if (associationsCount > 1)
+    {
+      return new ParallelMove(context, targetAet, publicIds, originatorAet, originatorId, associationsCount);
+    }
     else
     {
       return new AsynchronousMove(context, targetAet, publicIds, originatorAet, originatorId);
@@ -25,14 +25,20 @@
 
 #include "../../../OrthancFramework/Sources/Compression/GzipCompressor.h"
 #include "../../../OrthancFramework/Sources/Compression/ZipReader.h"
+#include "../../../OrthancFramework/Sources/HttpServer/JsonStreamAnswer.h"
+#include "../../../OrthancFramework/Sources/HttpServer/MultipartStreamReader.h"
 #include "../../../OrthancFramework/Sources/Logging.h"
 #include "../../../OrthancFramework/Sources/MetricsRegistry.h"
 #include "../../../OrthancFramework/Sources/SerializationToolbox.h"
+#include "../../../OrthancFramework/Sources/TemporaryFile.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../OrthancConfiguration.h"
 #include "../ServerContext.h"
+#include "../UploadWorkersPool.h"
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
 
 namespace Orthanc
 {
@@ -144,10 +150,14 @@ namespace Orthanc
       call.GetDocumentation()
         .SetTag("Instances")
         .SetSummary("Upload DICOM instances")
+        .SetDescription("Upload DICOM instances. If the body is a multipart message (e.g. `multipart/related`, new in "
+                        "Orthanc 1.11.3) or if its `Content-Type` is `application/zip`, the DICOM files are stored in "
+                        "parallel by a pool of `UploadThreadsCount` threads while the body is received. As for ZIP archives, "
+                        "the non-DICOM files are ignored, but the request fails if some DICOM file cannot be stored.")
         .AddRequestType(MimeType_Dicom, "DICOM file to be uploaded")
         .AddRequestType(MimeType_Zip, "ZIP archive containing DICOM files (new in Orthanc 1.8.2)")
         .AddAnswerType(MimeType_Json, "Information about the uploaded instance, "
-                       "or list of information for each uploaded instance in the case of ZIP archive")
+                       "or list of information for each uploaded instance in the case of ZIP archive or multipart message")
         .SetAnswerField("ID", RestApiCallDocumentation::Type_String, "Orthanc identifier of the new instance")
         .SetAnswerField("Path", RestApiCallDocumentation::Type_String, "Path to the new instance in the REST API")
         .SetAnswerField("Status", RestApiCallDocumentation::Type_String, "Can be `Success`, `AlreadyStored`, `Failure`, or `FilteredOut` (removed by some `NewInstanceFilter`)")
@@ -250,6 +260,264 @@ namespace Orthanc
 
 
 
+  // Streamed upload of DICOM files through HTTP (new in Orthanc 1.11.3) ------
+
+  namespace
+  {
+    class UploadFileHandler : public UploadWorkersPool::IFileHandler
+    {
+    private:
+      ServerContext&       context_;
+      DicomInstanceOrigin  origin_;
+
+    public:
+      UploadFileHandler(ServerContext& context,
+                        const DicomInstanceOrigin& origin) :
+        context_(context),
+        origin_(origin)
+      {
+      }
+
+      virtual bool Store(Json::Value& answer,
+                         const std::string& filename,
+                         const std::string& content) ORTHANC_OVERRIDE
+      {
+        try
+        {
+          std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromBuffer(content));
+          toStore->SetOrigin(origin_);
+
+          std::string publicId;
+          ServerContext::StoreResult result = context_.Store(publicId, *toStore, StoreInstanceMode_Default);
+
+          SetupResourceAnswer(answer, *toStore, result.GetStatus(), publicId);
+          return true;
+        }
+        catch (OrthancException& e)
+        {
+          if (e.GetErrorCode() == ErrorCode_BadFileFormat)
+          {
+            LOG(ERROR) << "Cannot import non-DICOM file from HTTP upload: " << filename;
+            return false;
+          }
+          else if (e.GetErrorCode() == ErrorCode_InexistentTag)
+          {
+            // Same behavior as for the upload of ZIP archives containing a DICOMDIR
+            LOG(ERROR) << "Ignoring what is probably a DICOMDIR file within an HTTP upload: \"" << filename << "\"";
+            return false;
+          }
+          else
+          {
+            throw;
+          }
+        }
+      }
+    };
+
+
+    /**
+     * Must be called once the full HTTP body has been read. As with
+     * the buffered upload of ZIP archives, the request fails if some
+     * file could not be stored for another reason than not being a
+     * DICOM file (e.g. full storage area or database error). The
+     * error is only reported once the files that are in the hands of
+     * the workers have been stored. Otherwise, the JSON array with
+     * the information about the stored instances is streamed.
+     **/
+    static void AnswerUpload(HttpOutput& output,
+                             UploadWorkersPool::Upload& upload)
+    {
+      upload.Close();
+      upload.WaitCompletion();
+
+      JsonStreamAnswer stream(upload, false /* JSON array */);
+      stream.SetChunkSize(0);
+      output.AnswerWithoutBuffering(stream);
+    }
+
+    class MultipartUploadReader :
+      public IHttpHandler::IChunkedRequestReader,
+      private MultipartStreamReader::IHandler
+    {
+    private:
+      UploadWorkersPool::Upload  upload_;
+      MultipartStreamReader      reader_;
+      unsigned int               countParts_;
+
+      virtual void HandlePart(const MultipartStreamReader::HttpHeaders& headers,
+                              const void* part,
+                              size_t size) ORTHANC_OVERRIDE
+      {
+        countParts_++;
+
+        if (size > 0)
+        {
+          CLOG(INFO, HTTP) << "Received part " << countParts_ << " of " << size
+                           << " bytes in a multipart HTTP upload";
+          
+          std::string dicom(reinterpret_cast<const char*>(part), size);
+          upload_.Submit("part " + boost::lexical_cast<std::string>(countParts_), dicom);
+        }
+      }
+
+    public:
+      MultipartUploadReader(ServerContext& context,
+                            const DicomInstanceOrigin& origin,
+                            const std::string& boundary) :
+        upload_(context.GetUploadWorkersPool(), new UploadFileHandler(context, origin)),
+        reader_(boundary),
+        countParts_(0)
+      {
+        reader_.SetHandler(*this);
+      }
+
+      virtual void AddBodyChunk(const void* data,
+                                size_t size) ORTHANC_OVERRIDE
+      {
+        reader_.AddChunk(data, size);
+      }
+
+      virtual void Execute(HttpOutput& output) ORTHANC_OVERRIDE
+      {
+        reader_.CloseStream();
+        AnswerUpload(output, upload_);
+      }
+    };
+
+
+    /**
+     * The central directory of a ZIP archive is located at its end,
+     * so the entries cannot be extracted before the full body is
+     * received. The body is spooled to a temporary file instead of
+     * RAM, and the entries are then stored in parallel.
+     **/
+    class ZipUploadReader : public IHttpHandler::IChunkedRequestReader
+    {
+    private:
+      ServerContext&                   context_;
+      DicomInstanceOrigin              origin_;
+      std::unique_ptr<TemporaryFile>   archive_;
+      boost::filesystem::ofstream      stream_;
+      uint64_t                         size_;
+
+    public:
+      ZipUploadReader(ServerContext& context,
+                      const DicomInstanceOrigin& origin) :
+        context_(context),
+        origin_(origin),
+        size_(0)
+      {
+        {
+          OrthancConfiguration::ReaderLock lock;
+          archive_.reset(lock.GetConfiguration().CreateTemporaryFile());
+        }
+
+        stream_.open(archive_->GetPath(), std::ofstream::out | std::ofstream::binary);
+        if (!stream_.good())
+        {
+          throw OrthancException(ErrorCode_CannotWriteFile);
+        }
+      }
+
+      virtual void AddBodyChunk(const void* data,
+                                size_t size) ORTHANC_OVERRIDE
+      {
+        if (size > 0)
+        {
+          stream_.write(reinterpret_cast<const char*>(data), size);
+          if (!stream_.good())
+          {
+            throw OrthancException(ErrorCode_CannotWriteFile);
+          }
+
+          size_ += size;
+        }
+      }
+
+      virtual void Execute(HttpOutput& output) ORTHANC_OVERRIDE
+      {
+        stream_.close();
+
+        CLOG(INFO, HTTP) << "Receiving a ZIP archive of " << size_ << " bytes through HTTP";
+
+        std::unique_ptr<ZipReader> reader(ZipReader::CreateFromFile(archive_->GetPath()));
+
+        UploadWorkersPool::Upload upload(context_.GetUploadWorkersPool(), new UploadFileHandler(context_, origin_));
+
+        std::string filename, content;
+        while (reader->ReadNextFile(filename, content))
+        {
+          if (!content.empty())
+          {
+            LOG(INFO) << "Uploading DICOM file from ZIP archive: " << filename;
+            upload.Submit(filename, content);
+          }
+        }
+
+        AnswerUpload(output, upload);
+      }
+    };
+  }
+
+
+  bool OrthancRestApi::CreateRouteChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
+                                                       RequestOrigin origin,
+                                                       const char* remoteIp,
+                                                       const char* username,
+                                                       HttpMethod method,
+                                                       const UriComponents& uri,
+                                                       const HttpToolbox::Arguments& headers)
+  {
+    if (method != HttpMethod_Post ||
+        uri.size() != 1 ||
+        uri[0] != "instances")
+    {
+      return false;
+    }
+
+    HttpToolbox::Arguments::const_iterator encoding = headers.find("content-encoding");
+    if (encoding != headers.end() &&
+        !encoding->second.empty() &&
+        !boost::iequals(encoding->second, "identity"))
+    {
+      return false;  // Compressed bodies are handled by "UploadDicomFile()"
+    }
+
+    HttpToolbox::Arguments::const_iterator contentType = headers.find("content-type");
+    if (contentType == headers.end())
+    {
+      return false;
+    }
+
+    if (context_.GetUploadThreadsCount() == 0)
+    {
+      return false;  // Streamed uploads are disabled
+    }
+
+    std::string type, subType, boundary, mime;
+    Toolbox::ToLowerCase(mime, contentType->second);
+
+    if (MultipartStreamReader::ParseMultipartContentType(type, subType, boundary, contentType->second) &&
+        boost::starts_with(type, "multipart/"))
+    {
+      CLOG(INFO, HTTP) << "Streaming the DICOM files of a multipart HTTP upload";
+      target.reset(new MultipartUploadReader(context_, DicomInstanceOrigin::FromHttp(remoteIp, username),
+                                             boundary));
+      return true;
+    }
+    else if (boost::starts_with(mime, EnumerationToString(MimeType_Zip)))
+    {
+      target.reset(new ZipUploadReader(context_, DicomInstanceOrigin::FromHttp(remoteIp, username)));
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+
   // Registration of the various REST handlers --------------------------------
 
   OrthancRestApi::OrthancRestApi(ServerContext& context, 
@@ -261,6 +529,8 @@ namespace Orthanc
                     "orthanc_rest_api_active_requests", 
                     MetricsType_MaxOver10Seconds)
   {
+    SetMetricsRegistry(&context.GetMetricsRegistry());
+
     RegisterSystem(orthancExplorerEnabled);
 
     RegisterChanges();
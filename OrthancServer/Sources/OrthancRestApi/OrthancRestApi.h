@@ -63,6 +63,16 @@ namespace Orthanc
 
     static void ShutdownOrthanc(RestApiPostCall& call);
 
+  protected:
+    // Streamed upload of multipart bodies and ZIP archives to "/instances"
+    virtual bool CreateRouteChunkedRequestReader(std::unique_ptr<IChunkedRequestReader>& target,
+                                                 RequestOrigin origin,
+                                                 const char* remoteIp,
+                                                 const char* username,
+                                                 HttpMethod method,
+                                                 const UriComponents& uri,
+                                                 const HttpToolbox::Arguments& headers) ORTHANC_OVERRIDE;
+
   public:
     explicit OrthancRestApi(ServerContext& context,
                             bool orthancExplorerEnabled);
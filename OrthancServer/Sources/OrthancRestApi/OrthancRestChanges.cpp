@@ -23,11 +23,14 @@
 #include "../PrecompiledHeadersServer.h"
 #include "OrthancRestApi.h"
 
+#include "../../../OrthancFramework/Sources/HttpServer/IHttpStreamAnswer.h"
 #include "../ServerContext.h"
 
 namespace Orthanc
 {
   // Changes API --------------------------------------------------------------
+
+  static const unsigned int MAX_WAIT_SECONDS = 600;
  
   static void GetSinceAndLimit(int64_t& since,
                                unsigned int& limit,
@@ -46,7 +49,18 @@ namespace Orthanc
 
     try
     {
-      since = boost::lexical_cast<int64_t>(call.GetArgument("since", "0"));
+      // Since Orthanc 1.11.3, "cursor" is accepted as an alias for
+      // "since", for consistency with the lists of resources: The
+      // changes and the exports are already paginated by their
+      // sequence number, which is returned in the "Last" field
+      if (call.HasArgument("cursor"))
+      {
+        since = boost::lexical_cast<int64_t>(call.GetArgument("cursor", "0"));
+      }
+      else
+      {
+        since = boost::lexical_cast<int64_t>(call.GetArgument("since", "0"));
+      }
       limit = boost::lexical_cast<unsigned int>(call.GetArgument("limit", boost::lexical_cast<std::string>(DEFAULT_LIMIT)));
     }
     catch (boost::bad_lexical_cast&)
@@ -67,7 +81,12 @@ namespace Orthanc
         .SetDescription("Whenever Orthanc receives a new DICOM instance, this event is recorded in the so-called _Changes Log_. This enables remote scripts to react to the arrival of new DICOM resources. A typical application is auto-routing, where an external script waits for a new DICOM instance to arrive into Orthanc, then forward this instance to another modality.")
         .SetHttpGetArgument("limit", RestApiCallDocumentation::Type_Number, "Limit the number of results", false)
         .SetHttpGetArgument("since", RestApiCallDocumentation::Type_Number, "Show only the resources since the provided index", false)
+        .SetHttpGetArgument("cursor", RestApiCallDocumentation::Type_Number, "Alias for `since`, to be provided with the `Last` field of the previous page (new in Orthanc 1.11.3)", false)
         .AddAnswerType(MimeType_Json, "The list of changes")
+        .SetHttpGetArgument("wait", RestApiCallDocumentation::Type_Number,
+                            "Long polling: If no change is available after `since`, wait for at most this number "
+                            "of seconds for new changes to be logged, before answering (maximum: " +
+                            boost::lexical_cast<std::string>(MAX_WAIT_SECONDS) + ", new in Orthanc 1.11.3)", false)
         .SetAnswerField("Changes", RestApiCallDocumentation::Type_JsonListOfObjects, "The individual changes")
         .SetAnswerField("Done", RestApiCallDocumentation::Type_Boolean,
                         "Whether the last reported change is the last of the full history")
@@ -92,13 +111,211 @@ namespace Orthanc
     }
     else
     {
+      unsigned int wait = 0;
+      if (call.HasArgument("wait"))
+      {
+        try
+        {
+          wait = std::min(MAX_WAIT_SECONDS, boost::lexical_cast<unsigned int>(call.GetArgument("wait", "")));
+        }
+        catch (boost::bad_lexical_cast&)
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange,
+                                 "The \"wait\" argument must be a number of seconds");
+        }
+      }
+
+      // The generation must be read before the database, in order not
+      // to miss a change that would be committed in between
+      uint64_t generation = context.GetChangesGeneration();
       context.GetIndex().GetChanges(result, since, limit);
+
+      if (wait > 0)
+      {
+        const boost::posix_time::ptime deadline = (boost::posix_time::microsec_clock::universal_time() +
+                                                   boost::posix_time::seconds(wait));
+
+        while (result["Changes"].empty())
+        {
+          const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+          if (now >= deadline ||
+              !context.WaitForChanges(generation, static_cast<unsigned int>((deadline - now).total_milliseconds())))
+          {
+            break;  // Timeout, or Orthanc is stopping
+          }
+
+          generation = context.GetChangesGeneration();
+          context.GetIndex().GetChanges(result, since, limit);
+        }
+      }
     }
 
     call.GetOutput().AnswerJson(result);
   }
 
 
+  namespace
+  {
+    /**
+     * Stream of "server-sent events" (SSE) that pushes the changes as
+     * soon as they are logged. The stream only ends if the HTTP
+     * client disconnects (which is detected by the keep-alive
+     * comments), or if Orthanc is stopping.
+     **/
+    class ChangesEventStream : public IHttpStreamAnswer
+    {
+    private:
+      static const unsigned int BATCH_SIZE = 100;
+      static const unsigned int KEEP_ALIVE_MILLISECONDS = 15000;
+
+      ServerContext&  context_;
+      int64_t         since_;
+      std::string     chunk_;
+
+      static void FormatEvent(std::string& target,
+                              const Json::Value& change)
+      {
+        std::string json;
+        Toolbox::WriteFastJson(json, change);
+
+        // The JSON must fit on one single "data:" line
+        while (!json.empty() &&
+               (json[json.size() - 1] == '\n' ||
+                json[json.size() - 1] == '\r'))
+        {
+          json.resize(json.size() - 1);
+        }
+
+        target += "id: " + boost::lexical_cast<std::string>(change["Seq"].asInt64()) + "\n";
+        target += "data: " + json + "\n\n";
+      }
+
+    public:
+      ChangesEventStream(ServerContext& context,
+                         int64_t since) :
+        context_(context),
+        since_(since)
+      {
+      }
+
+      virtual HttpCompression SetupHttpCompression(bool gzipAllowed,
+                                                   bool deflateAllowed) ORTHANC_OVERRIDE
+      {
+        return HttpCompression_None;
+      }
+
+      virtual bool HasContentFilename(std::string& filename) ORTHANC_OVERRIDE
+      {
+        return false;
+      }
+
+      virtual std::string GetContentType() ORTHANC_OVERRIDE
+      {
+        return "text/event-stream";
+      }
+
+      virtual uint64_t GetContentLength() ORTHANC_OVERRIDE
+      {
+        throw OrthancException(ErrorCode_InternalError);  // The length of the stream is unknown
+      }
+
+      virtual bool ReadNextChunk() ORTHANC_OVERRIDE
+      {
+        chunk_.clear();
+
+        while (!context_.IsWaitForChangesInterrupted())
+        {
+          const uint64_t generation = context_.GetChangesGeneration();
+
+          Json::Value changes;
+          context_.GetIndex().GetChanges(changes, since_, BATCH_SIZE);
+
+          if (!changes["Changes"].empty())
+          {
+            for (Json::Value::ArrayIndex i = 0; i < changes["Changes"].size(); i++)
+            {
+              FormatEvent(chunk_, changes["Changes"][i]);
+            }
+
+            since_ = changes["Last"].asInt64();
+            return true;
+          }
+          else if (!context_.WaitForChanges(generation, KEEP_ALIVE_MILLISECONDS) &&
+                   !context_.IsWaitForChangesInterrupted())
+          {
+            // SSE comment, whose write fails if the client has disconnected
+            chunk_ = ": keep-alive\n\n";
+            return true;
+          }
+        }
+
+        return false;  // Orthanc is stopping
+      }
+
+      virtual const char* GetChunkContent() ORTHANC_OVERRIDE
+      {
+        return chunk_.c_str();
+      }
+
+      virtual size_t GetChunkSize() ORTHANC_OVERRIDE
+      {
+        return chunk_.size();
+      }
+    };
+  }
+
+
+  static void StreamChanges(RestApiGetCall& call)
+  {
+    if (call.IsDocumentation())
+    {
+      call.GetDocumentation()
+        .SetTag("Tracking changes")
+        .SetSummary("Stream changes")
+        .SetDescription("Push the changes as soon as they are logged, as server-sent events (SSE). The `id` of each "
+                        "event is the index of the change, and its `data` is the same JSON object as in `/changes`. "
+                        "Note that each connected client holds one thread of the HTTP server. "
+                        "New in Orthanc 1.11.3.")
+        .SetHttpGetArgument("since", RestApiCallDocumentation::Type_Number,
+                            "Also push the changes that were logged after the provided index. By default, only "
+                            "the changes logged after the connection are pushed. If absent, the standard "
+                            "`Last-Event-ID` HTTP header is used if present, so that SSE clients resume after reconnection.", false)
+        .AddAnswerType(MimeType_PlainText, "The stream of events, with MIME type `text/event-stream`");
+      return;
+    }
+
+    ServerContext& context = OrthancRestApi::GetContext(call);
+
+    int64_t since;
+
+    try
+    {
+      if (call.HasArgument("since"))
+      {
+        since = boost::lexical_cast<int64_t>(call.GetArgument("since", ""));
+      }
+      else if (!call.GetHttpHeader("last-event-id", "").empty())
+      {
+        since = boost::lexical_cast<int64_t>(call.GetHttpHeader("last-event-id", ""));
+      }
+      else
+      {
+        Json::Value last;
+        context.GetIndex().GetLastChange(last);
+        since = last["Last"].asInt64();
+      }
+    }
+    catch (boost::bad_lexical_cast&)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange, "Invalid index of change");
+    }
+
+    ChangesEventStream stream(context, since);
+    call.GetOutput().GetLowLevelOutput().AddHeader("Cache-Control", "no-cache");
+    call.GetOutput().AnswerWithoutBuffering(stream);
+  }
+
+
   static void DeleteChanges(RestApiDeleteCall& call)
   {
     if (call.IsDocumentation())
@@ -132,6 +349,7 @@ namespace Orthanc
                         "might be removed in future versions of Orthanc.")
         .SetHttpGetArgument("limit", RestApiCallDocumentation::Type_Number, "Limit the number of results", false)
         .SetHttpGetArgument("since", RestApiCallDocumentation::Type_Number, "Show only the resources since the provided index", false)
+        .SetHttpGetArgument("cursor", RestApiCallDocumentation::Type_Number, "Alias for `since`, to be provided with the `Last` field of the previous page (new in Orthanc 1.11.3)", false)
         .AddAnswerType(MimeType_Json, "The list of exports");
       return;
     }
@@ -177,6 +395,7 @@ namespace Orthanc
   {
     Register("/changes", GetChanges);
     Register("/changes", DeleteChanges);
+    Register("/changes/stream", StreamChanges);
     Register("/exports", GetExports);
     Register("/exports", DeleteExports);
   }
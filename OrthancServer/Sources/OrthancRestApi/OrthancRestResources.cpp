@@ -124,8 +124,254 @@ namespace Orthanc
   }
 
 
+  static unsigned int GetJsonStreamingThreshold()
+  {
+    OrthancConfiguration::ReaderLock lock;
+    return lock.GetConfiguration().GetUnsignedIntegerParameter("JsonStreamingThreshold", 1000);  // New in Orthanc 1.11.3
+  }
+
+
+  static bool IsJsonStreamingEnabled(size_t countItems)
+  {
+    unsigned int threshold = GetJsonStreamingThreshold();
+    return (threshold != 0 &&
+            countItems >= threshold);
+  }
+
+
   // List all the patients, studies, series or instances ----------------------
- 
+
+  namespace
+  {
+    class ResourcesListSource : public JsonStreamAnswer::IItemsSource
+    {
+    private:
+      typedef std::list<std::string>  Resources;
+
+      // Number of resources that are read from the database in one single transaction
+      static const size_t EXPAND_BATCH_SIZE = 100;
+
+      ServerContext&                                                context_;
+      const Resources&                                              resources_;
+      const std::map<std::string, std::string>&                     instancesIds_;
+      const std::map<std::string, boost::shared_ptr<DicomMap> >&    resourcesMainDicomTags_;
+      const std::map<std::string, boost::shared_ptr<Json::Value> >& resourcesDicomAsJson_;
+      ResourceType                                                  level_;
+      bool                                                          expand_;
+      DicomToJsonFormat                                             format_;
+      const std::set<DicomTag>&                                     requestedTags_;
+      bool                                                          allowStorageAccess_;
+      Resources::const_iterator                                     current_;
+      Resources::const_iterator                                     batchEnd_;
+      Json::Value                                                   batch_;
+
+      // Expand at once the next resources for which nothing was collected before
+      void ExpandNextBatch()
+      {
+        Resources toExpand;
+
+        while (batchEnd_ != resources_.end() &&
+               toExpand.size() < EXPAND_BATCH_SIZE)
+        {
+          if (instancesIds_.find(*batchEnd_) == instancesIds_.end())
+          {
+            toExpand.push_back(*batchEnd_);
+          }
+
+          ++batchEnd_;
+        }
+
+        batch_ = Json::objectValue;
+
+        if (!toExpand.empty())
+        {
+          context_.ExpandResources(batch_, toExpand, level_, format_, requestedTags_, allowStorageAccess_);
+        }
+      }
+
+    public:
+      ResourcesListSource(ServerContext& context,
+                          const Resources& resources,
+                          const std::map<std::string, std::string>& instancesIds,
+                          const std::map<std::string, boost::shared_ptr<DicomMap> >& resourcesMainDicomTags,
+                          const std::map<std::string, boost::shared_ptr<Json::Value> >& resourcesDicomAsJson,
+                          ResourceType level,
+                          bool expand,
+                          DicomToJsonFormat format,
+                          const std::set<DicomTag>& requestedTags,
+                          bool allowStorageAccess) :
+        context_(context),
+        resources_(resources),
+        instancesIds_(instancesIds),
+        resourcesMainDicomTags_(resourcesMainDicomTags),
+        resourcesDicomAsJson_(resourcesDicomAsJson),
+        level_(level),
+        expand_(expand),
+        format_(format),
+        requestedTags_(requestedTags),
+        allowStorageAccess_(allowStorageAccess),
+        current_(resources.begin()),
+        batchEnd_(resources.begin()),
+        batch_(Json::objectValue)
+      {
+      }
+
+      virtual bool ReadNextItem(std::string& key,
+                                Json::Value& item) ORTHANC_OVERRIDE
+      {
+        while (current_ != resources_.end())
+        {
+          const std::string& resource = *current_;
+
+          if (!expand_)
+          {
+            item = resource;
+            ++current_;
+            return true;
+          }
+
+          if (current_ == batchEnd_)
+          {
+            ExpandNextBatch();
+          }
+
+          ++current_;
+
+          item = Json::nullValue;
+
+          std::map<std::string, std::string>::const_iterator instanceId = instancesIds_.find(resource);
+          if (instanceId != instancesIds_.end())  // if it is found in instancesIds, it is also in resourcesDicomAsJson and mainDicomTags
+          {
+            // reuse data already collected before (e.g during lookup)
+            std::map<std::string, boost::shared_ptr<DicomMap> >::const_iterator mainDicomTags = resourcesMainDicomTags_.find(resource);
+            std::map<std::string, boost::shared_ptr<Json::Value> >::const_iterator dicomAsJson = resourcesDicomAsJson_.find(resource);
+
+            context_.ExpandResource(item, resource,
+                                    *(mainDicomTags->second.get()),
+                                    instanceId->second,
+                                    dicomAsJson->second.get(),
+                                    level_, format_, requestedTags_, allowStorageAccess_);
+          }
+          else if (batch_.isMember(resource))
+          {
+            item.swap(batch_[resource]);
+            batch_.removeMember(resource);
+          }
+
+          if (item.type() == Json::objectValue)
+          {
+            return true;
+          }
+        }
+
+        return false;
+      }
+    };
+
+
+    /**
+     * Lists all the resources of one level. The identifiers are read
+     * from the database by pages using keyset pagination, so that the
+     * full list of identifiers is never loaded in memory. As each page
+     * is read in a separate transaction, the resources that are
+     * created or deleted during the listing may or may not be
+     * reported.
+     **/
+    class AllResourcesSource : public JsonStreamAnswer::IItemsSource
+    {
+    private:
+      // Number of identifiers that are read from the database in one single transaction
+      static const size_t PAGE_SIZE = 1000;
+
+      ServerIndex&                                            index_;
+      ServerContext&                                          context_;
+      ResourceType                                            level_;
+      bool                                                    expand_;
+      DicomToJsonFormat                                       format_;
+      const std::set<DicomTag>&                               requestedTags_;
+      int64_t                                                 cursor_;
+      bool                                                    done_;
+      std::list<std::string>                                  page_;
+      std::map<std::string, std::string>                      unusedInstancesIds_;
+      std::map<std::string, boost::shared_ptr<DicomMap> >     unusedResourcesMainDicomTags_;
+      std::map<std::string, boost::shared_ptr<Json::Value> >  unusedResourcesDicomAsJson_;
+      std::unique_ptr<ResourcesListSource>                    source_;
+
+      void ReadNextPage(size_t limit)
+      {
+        source_.reset(NULL);  // "source_" refers to "page_"
+
+        if (index_.HasKeysetPaginationSupport())
+        {
+          index_.GetAllUuids(page_, cursor_, done_, level_, limit);
+        }
+        else
+        {
+          // Reading by pages would have a quadratic cost with the
+          // database plugins: Read all the identifiers at once
+          index_.GetAllUuids(page_, level_, 0 /* since */, 0 /* no limit */);
+          done_ = true;
+        }
+
+        source_.reset(new ResourcesListSource(context_, page_, unusedInstancesIds_, unusedResourcesMainDicomTags_,
+                                              unusedResourcesDicomAsJson_, level_, expand_, format_, requestedTags_,
+                                              true /* allowStorageAccess */));
+      }
+
+    public:
+      AllResourcesSource(ServerIndex& index,
+                         ServerContext& context,
+                         ResourceType level,
+                         bool expand,
+                         DicomToJsonFormat format,
+                         const std::set<DicomTag>& requestedTags,
+                         size_t firstPageSize) :
+        index_(index),
+        context_(context),
+        level_(level),
+        expand_(expand),
+        format_(format),
+        requestedTags_(requestedTags),
+        cursor_(0),
+        done_(false)
+      {
+        ReadNextPage(firstPageSize > PAGE_SIZE ? firstPageSize : static_cast<size_t>(PAGE_SIZE));
+      }
+
+      // Whether all the resources were found in the first page
+      bool IsComplete() const
+      {
+        return done_;
+      }
+
+      size_t GetFirstPageSize() const
+      {
+        return page_.size();
+      }
+
+      virtual bool ReadNextItem(std::string& key,
+                                Json::Value& item) ORTHANC_OVERRIDE
+      {
+        for (;;)
+        {
+          if (source_->ReadNextItem(key, item))
+          {
+            return true;
+          }
+          else if (done_)
+          {
+            return false;
+          }
+          else
+          {
+            ReadNextPage(PAGE_SIZE);
+          }
+        }
+      }
+    };
+  }
+
+
   static void AnswerListOfResources(RestApiOutput& output,
                                     ServerContext& context,
                                     const std::list<std::string>& resources,
@@ -138,45 +384,72 @@ namespace Orthanc
                                     const std::set<DicomTag>& requestedTags,
                                     bool allowStorageAccess)
   {
-    Json::Value answer = Json::arrayValue;
+    ResourcesListSource source(context, resources, instancesIds, resourcesMainDicomTags, resourcesDicomAsJson,
+                               level, expand, format, requestedTags, allowStorageAccess);
 
-    for (std::list<std::string>::const_iterator
-           resource = resources.begin(); resource != resources.end(); ++resource)
+    JsonStreamAnswer stream(source, false /* JSON array */);
+    output.AnswerJson(stream, IsJsonStreamingEnabled(resources.size()));
+  }
+
+
+  // Answer one page of resources, in the case of keyset pagination (new in Orthanc 1.11.3)
+  static void AnswerPageOfResources(RestApiOutput& output,
+                                    ServerContext& context,
+                                    const std::list<std::string>& resources,
+                                    const std::map<std::string, std::string>& instancesIds,
+                                    const std::map<std::string, boost::shared_ptr<DicomMap> >& resourcesMainDicomTags,
+                                    const std::map<std::string, boost::shared_ptr<Json::Value> >& resourcesDicomAsJson,
+                                    ResourceType level,
+                                    bool expand,
+                                    DicomToJsonFormat format,
+                                    const std::set<DicomTag>& requestedTags,
+                                    bool allowStorageAccess,
+                                    int64_t cursor,
+                                    bool done)
+  {
+    ResourcesListSource source(context, resources, instancesIds, resourcesMainDicomTags, resourcesDicomAsJson,
+                               level, expand, format, requestedTags, allowStorageAccess);
+
+    Json::Value answer = Json::objectValue;
+
+    JsonStreamAnswer stream(source, false /* JSON array */);
+    stream.Flatten(answer["Resources"]);
+
+    answer["Cursor"] = boost::lexical_cast<std::string>(cursor);
+    answer["Done"] = done;
+
+    output.AnswerJson(answer);
+  }
+
+
+  static int64_t ParseCursor(const ServerIndex& index,
+                             const std::string& cursor)
+  {
+    if (!index.HasKeysetPaginationSupport())
     {
-      if (expand)
-      {
-        Json::Value expanded;
+      // Each page would have a linear cost in the emulation of the cursors
+      throw OrthancException(ErrorCode_NotImplemented,
+                             "The database back-end does not support keyset pagination, use \"since\" instead");
+    }
 
-        std::map<std::string, std::string>::const_iterator instanceId = instancesIds.find(*resource);
-        if (instanceId != instancesIds.end())  // if it is found in instancesIds, it is also in resourcesDicomAsJson and mainDicomTags
-        {
-          // reuse data already collected before (e.g during lookup)
-          std::map<std::string, boost::shared_ptr<DicomMap> >::const_iterator mainDicomTags = resourcesMainDicomTags.find(*resource);
-          std::map<std::string, boost::shared_ptr<Json::Value> >::const_iterator dicomAsJson = resourcesDicomAsJson.find(*resource);
-
-          context.ExpandResource(expanded, *resource, 
-                                 *(mainDicomTags->second.get()),
-                                 instanceId->second,
-                                 dicomAsJson->second.get(),
-                                 level, format, requestedTags, allowStorageAccess);
-        }
-        else
-        {
-          context.ExpandResource(expanded, *resource, level, format, requestedTags, allowStorageAccess);
-        }
+    if (cursor.empty())
+    {
+      return 0;  // Start from the beginning
+    }
 
-        if (expanded.type() == Json::objectValue)
-        {
-          answer.append(expanded);
-        }
-      }
-      else
+    try
+    {
+      int64_t value = boost::lexical_cast<int64_t>(cursor);
+      if (value >= 0)
       {
-        answer.append(*resource);
+        return value;
       }
     }
+    catch (boost::bad_lexical_cast&)
+    {
+    }
 
-    output.AnswerJson(answer);
+    throw OrthancException(ErrorCode_ParameterOutOfRange, "Invalid cursor: " + cursor);
   }
 
 
@@ -212,6 +485,12 @@ namespace Orthanc
         .SetDescription("List the Orthanc identifiers of all the available DICOM " + resources)
         .SetHttpGetArgument("limit", RestApiCallDocumentation::Type_Number, "Limit the number of results", false)
         .SetHttpGetArgument("since", RestApiCallDocumentation::Type_Number, "Show only the resources since the provided index", false)
+        .SetHttpGetArgument("cursor", RestApiCallDocumentation::Type_String,
+                            "If present, use keyset pagination: Only show the resources after the provided cursor, that "
+                            "was returned in the `Cursor` field of the previous page (empty to get the first page). "
+                            "The answer is then a JSON object with fields `Resources`, `Cursor` and `Done`. "
+                            "Contrarily to `since`, the cost of each page is independent of its position. "
+                            "Only available with the built-in SQLite database.", false)
         .SetHttpGetArgument("expand", RestApiCallDocumentation::Type_String,
                             "If present, retrieve detailed information about the individual " + resources, false)
         .AddAnswerType(MimeType_Json, "JSON array containing either the Orthanc identifiers, or detailed information "
@@ -228,8 +507,35 @@ namespace Orthanc
     std::set<DicomTag> requestedTags;
     OrthancRestApi::GetRequestedTags(requestedTags, call);
 
-    if (call.HasArgument("limit") ||
-        call.HasArgument("since"))
+    if (call.HasArgument("cursor"))
+    {
+      static const size_t DEFAULT_LIMIT = 100;
+
+      if (call.HasArgument("since"))
+      {
+        throw OrthancException(ErrorCode_BadRequest,
+                               "The \"since\" and \"cursor\" arguments cannot be used together");
+      }
+
+      int64_t cursor = ParseCursor(index, call.GetArgument("cursor", ""));
+      size_t limit = (call.HasArgument("limit") ?
+                      boost::lexical_cast<size_t>(call.GetArgument("limit", "")) : DEFAULT_LIMIT);
+
+      bool done;
+      index.GetAllUuids(result, cursor, done, resourceType, limit);
+
+      std::map<std::string, std::string> unusedInstancesIds;
+      std::map<std::string, boost::shared_ptr<DicomMap> > unusedResourcesMainDicomTags;
+      std::map<std::string, boost::shared_ptr<Json::Value> > unusedResourcesDicomAsJson;
+
+      AnswerPageOfResources(call.GetOutput(), context, result, unusedInstancesIds, unusedResourcesMainDicomTags,
+                            unusedResourcesDicomAsJson, resourceType, call.HasArgument("expand"),
+                            OrthancRestApi::GetDicomFormat(call, DicomToJsonFormat_Human),
+                            requestedTags, true /* allowStorageAccess */, cursor, done);
+      return;
+    }
+    else if (call.HasArgument("limit") ||
+             call.HasArgument("since"))
     {
       if (!call.HasArgument("limit"))
       {
@@ -248,16 +554,26 @@ namespace Orthanc
       size_t since = boost::lexical_cast<size_t>(call.GetArgument("since", ""));
       size_t limit = boost::lexical_cast<size_t>(call.GetArgument("limit", ""));
       index.GetAllUuids(result, resourceType, since, limit);
+
+      AnswerListOfResources(call.GetOutput(), context, result, resourceType, call.HasArgument("expand"),
+                            OrthancRestApi::GetDicomFormat(call, DicomToJsonFormat_Human),
+                            requestedTags,
+                            true /* allowStorageAccess */);
     }
     else
     {
-      index.GetAllUuids(result, resourceType);
-    }
+      // The first page contains enough identifiers to decide whether the answer must be streamed
+      const unsigned int threshold = GetJsonStreamingThreshold();
 
-    AnswerListOfResources(call.GetOutput(), context, result, resourceType, call.HasArgument("expand"),
-                          OrthancRestApi::GetDicomFormat(call, DicomToJsonFormat_Human),
-                          requestedTags,
-                          true /* allowStorageAccess */);
+      AllResourcesSource source(index, context, resourceType, call.HasArgument("expand"),
+                                OrthancRestApi::GetDicomFormat(call, DicomToJsonFormat_Human),
+                                requestedTags, threshold);
+
+      JsonStreamAnswer stream(source, false /* JSON array */);
+      call.GetOutput().AnswerJson(stream, (threshold != 0 &&
+                                           (!source.IsComplete() ||
+                                            source.GetFirstPageSize() >= threshold)));
+    }
   }
 
 
@@ -358,6 +674,111 @@ namespace Orthanc
 
 
   // Get information about a single instance ----------------------------------
+
+  static bool IsMatchingETag(const std::string& ifNoneMatch,
+                             const std::string& etag)
+  {
+    std::vector<std::string> tokens;
+    Toolbox::TokenizeString(tokens, ifNoneMatch, ',');
+
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+      std::string token = Toolbox::StripSpaces(tokens[i]);
+
+      // "If-None-Match" uses the weak comparison (RFC 7232, Section 3.2)
+      if (token.size() > 2 &&
+          token[0] == 'W' &&
+          token[1] == '/')
+      {
+        token = token.substr(2);
+      }
+
+      if (token == "*" ||
+          token == etag)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  /**
+   * Set the strong ETag of a representation of a DICOM instance (new
+   * in Orthanc 1.11.3). The ETag combines the revision of the "dicom"
+   * attachment with a hash of its UUID and MD5 (as read from the
+   * database), of the route, of its GET arguments and of the
+   * "Accept" HTTP header. Returns "false" if the "If-None-Match" HTTP
+   * header matches, in which case "304 Not Modified" has been
+   * answered without accessing the storage area.
+   **/
+  static bool SetInstanceETag(std::string& etag /* out */,
+                              RestApiGetCall& call)
+  {
+    ServerContext& context = OrthancRestApi::GetContext(call);
+
+    FileInfo info;
+    int64_t revision;
+    if (!context.GetIndex().LookupAttachment(info, revision, call.GetUriComponent("id", ""), FileContentType_Dicom))
+    {
+      throw OrthancException(ErrorCode_UnknownResource);
+    }
+
+    std::string fingerprint = (info.GetUuid() + "|" + info.GetUncompressedMD5() + "|" +
+                               call.FlattenUri() + "|" + call.GetHttpHeader("accept", ""));
+
+    // "HttpToolbox::Arguments" is a sorted map, hence a stable order
+    for (HttpToolbox::Arguments::const_iterator it = call.GetArguments().begin();
+         it != call.GetArguments().end(); ++it)
+    {
+      fingerprint += "|" + it->first + "=" + it->second;
+    }
+
+    std::string md5;
+    Toolbox::ComputeMD5(md5, fingerprint);
+
+    etag = "\"" + boost::lexical_cast<std::string>(revision) + "-" + md5 + "\"";
+
+    const std::string& cacheControl = OrthancRestApi::GetContext(call).GetInstancesCacheControl();
+
+    HttpOutput& output = call.GetOutput().GetLowLevelOutput();
+    output.AddHeader("ETag", etag);
+    output.AddHeader("Vary", "Accept");
+
+    if (!cacheControl.empty())
+    {
+      output.AddHeader("Cache-Control", cacheControl);
+    }
+
+    HttpToolbox::Arguments::const_iterator found = call.GetHttpHeaders().find("if-none-match");
+    if (found != call.GetHttpHeaders().end() &&
+        IsMatchingETag(found->second, etag))
+    {
+      call.GetOutput().AnswerNotModified();
+      return false;
+    }
+    else
+    {
+      return true;
+    }
+  }
+
+
+  static bool SetInstanceETag(RestApiGetCall& call)
+  {
+    std::string etag;
+    return SetInstanceETag(etag, call);
+  }
+
+
+  static void DocumentInstanceETag(RestApiGetCall& call)
+  {
+    call.GetDocumentation()
+      .SetHttpHeader("If-None-Match", "Optional ETag of a previous answer, to check if the content has changed (new in Orthanc 1.11.3)")
+      .SetAnswerHeader("ETag", "Strong ETag of the answer (new in Orthanc 1.11.3)");
+  }
+
  
   static void GetInstanceFile(RestApiGetCall& call)
   {
@@ -372,6 +793,7 @@ namespace Orthanc
         .AddAnswerType(MimeType_Dicom, "The DICOM instance")
         .AddAnswerType(MimeType_DicomWebJson, "The DICOM instance, in DICOMweb JSON format")
         .AddAnswerType(MimeType_DicomWebXml, "The DICOM instance, in DICOMweb XML format");
+      DocumentInstanceETag(call);
       return;
     }
 
@@ -379,6 +801,11 @@ namespace Orthanc
 
     std::string publicId = call.GetUriComponent("id", "");
 
+    if (!SetInstanceETag(call))
+    {
+      return;  // New in Orthanc 1.11.3: "304 Not Modified"
+    }
+
     HttpToolbox::Arguments::const_iterator accept = call.GetHttpHeaders().find("accept");
     if (accept != call.GetHttpHeaders().end())
     {
@@ -452,19 +879,40 @@ namespace Orthanc
   template <DicomToJsonFormat format>
   static void GetInstanceTagsInternal(RestApiGetCall& call)
   {
+    std::string etag;
+    if (!SetInstanceETag(etag, call))
+    {
+      return;  // New in Orthanc 1.11.3: "304 Not Modified"
+    }
+
     ServerContext& context = OrthancRestApi::GetContext(call);
 
+    // The ETag identifies this answer, whose compressed version might
+    // already be cached (new in Orthanc 1.11.3)
+    if (context.AnswerFromCompressedCache(call.GetOutput(), etag))
+    {
+      return;
+    }
+
     std::string publicId = call.GetUriComponent("id", "");
 
     std::set<DicomTag> ignoreTagLength;
     ParseSetOfTags(ignoreTagLength, call, IGNORE_LENGTH);
     
-    if (format != DicomToJsonFormat_Full ||
-        !ignoreTagLength.empty())
+    if (format != DicomToJsonFormat_Full)
     {
       Json::Value full;
       context.ReadDicomAsJson(full, publicId, ignoreTagLength);
-      AnswerDicomAsJson(call, full, format);
+
+      Json::Value simplified;
+      Toolbox::SimplifyDicomAsJson(simplified, full, format);
+      context.AnswerJsonWithCompressedCache(call.GetOutput(), etag, simplified);
+    }
+    else if (!ignoreTagLength.empty())
+    {
+      Json::Value full;
+      context.ReadDicomAsJson(full, publicId, ignoreTagLength);
+      context.AnswerJsonWithCompressedCache(call.GetOutput(), etag, full);
     }
     else
     {
@@ -473,7 +921,7 @@ namespace Orthanc
       // is present
       Json::Value full;
       context.ReadDicomAsJson(full, publicId);
-      call.GetOutput().AnswerJson(full);
+      context.AnswerJsonWithCompressedCache(call.GetOutput(), etag, full);
     }
   }
 
@@ -493,6 +941,7 @@ namespace Orthanc
                             "Also include the DICOM tags that are provided in this list, even if their associated value is long", false)
         .AddAnswerType(MimeType_Json, "JSON object containing the DICOM tags and their associated value")
         .SetTruncatedJsonHttpGetSample("https://demo.orthanc-server.com/instances/7c92ce8e-bbf67ed2-ffa3b8c1-a3b35d94-7ff3ae26/tags", 10);
+      DocumentInstanceETag(call);
       return;
     }
 
@@ -529,6 +978,7 @@ namespace Orthanc
                             "Also include the DICOM tags that are provided in this list, even if their associated value is long", false)
         .AddAnswerType(MimeType_Json, "JSON object containing the DICOM tags and their associated value")
         .SetTruncatedJsonHttpGetSample("https://demo.orthanc-server.com/instances/7c92ce8e-bbf67ed2-ffa3b8c1-a3b35d94-7ff3ae26/simplified-tags", 10);
+      DocumentInstanceETag(call);
       return;
     }
     else
@@ -804,6 +1254,7 @@ namespace Orthanc
             .AddAnswerType(MimeType_Jpeg, "JPEG image")
             .AddAnswerType(MimeType_Pam, "PAM image (Portable Arbitrary Map)")
             .SetDescription(description);
+          DocumentInstanceETag(call);
 
           return;
         }
@@ -822,6 +1273,11 @@ namespace Orthanc
           return;
         }
 
+        if (!SetInstanceETag(call))
+        {
+          return;  // New in Orthanc 1.11.3: "304 Not Modified", without decoding
+        }
+
         std::unique_ptr<ImageAccessor> decoded;
 
         try
@@ -1508,6 +1964,8 @@ namespace Orthanc
       {
         call.GetDocumentation().AddAnswerType(MimeType_Binary, "The raw frame");
       }
+
+      DocumentInstanceETag(call);
       return;
     }
     
@@ -1523,10 +1981,16 @@ namespace Orthanc
       return;
     }
 
+    if (!SetInstanceETag(call))
+    {
+      return;  // New in Orthanc 1.11.3: "304 Not Modified"
+    }
+
     std::string publicId = call.GetUriComponent("id", "");
     std::string raw;
     MimeType mime;
 
+    if (!OrthancRestApi::GetContext(call).ReadRawFrame(raw, mime, publicId, frame))
     {
       ServerContext::DicomCacheLocker locker(OrthancRestApi::GetContext(call), publicId);
       locker.GetDicom().GetRawFrame(raw, mime, frame);
@@ -1823,7 +2287,7 @@ namespace Orthanc
           userRevision == revision &&
           userMD5 == GetMD5(value))
       {
-        call.GetOutput().GetLowLevelOutput().SendStatus(HttpStatus_304_NotModified);
+        call.GetOutput().AnswerNotModified();
       }
       else
       {
@@ -2043,7 +2507,7 @@ namespace Orthanc
           revision == userRevision &&
           info.GetUncompressedMD5() == userMD5)
       {
-        call.GetOutput().GetLowLevelOutput().SendStatus(HttpStatus_304_NotModified);
+        call.GetOutput().AnswerNotModified();
         return false;
       }
       else
@@ -2162,7 +2626,7 @@ namespace Orthanc
             revision == userRevision &&
             info.GetUncompressedMD5() == userMD5)
         {
-          call.GetOutput().GetLowLevelOutput().SendStatus(HttpStatus_304_NotModified);
+          call.GetOutput().AnswerNotModified();
         }
         else
         {
@@ -2463,15 +2927,17 @@ namespace Orthanc
       OrthancConfiguration::ReaderLock lock;
 
       if (lock.GetConfiguration().GetBooleanParameter("StoreDicom", true) &&
-          contentType == FileContentType_DicomAsJson)
+          (contentType == FileContentType_DicomAsJson ||
+           contentType == FileContentType_DicomFrameOffsetTable))
       {
         allowed = true;
       }
       else
       {
         // It is forbidden to delete internal attachments, except for
-        // the "DICOM as JSON" summary as of Orthanc 1.2.0 (this summary
-        // would be automatically reconstructed on the next GET call)
+        // the "DICOM as JSON" summary as of Orthanc 1.2.0 and for the
+        // frame offset table as of Orthanc 1.11.3 (these would be
+        // automatically reconstructed on the next GET call)
         allowed = false;
       }
     }
@@ -2894,7 +3360,7 @@ namespace Orthanc
       
       virtual void MarkAsComplete() ORTHANC_OVERRIDE
       {
-        isComplete_ = true;  // Unused information as of Orthanc 1.5.0
+        isComplete_ = true;  // Only used by keyset pagination (new in Orthanc 1.11.3)
       }
 
       virtual void Visit(const std::string& publicId,
@@ -2923,6 +3389,16 @@ namespace Orthanc
       {
         AnswerListOfResources(output, context, resources_, instancesIds_, resourcesMainDicomTags_, resourcesDicomAsJson_, level, expand, format_, requestedTags, IsStorageAccessAllowedForAnswers(findStorageAccessMode_));
       }
+
+      void AnswerPage(RestApiOutput& output,
+                      ServerContext& context,
+                      ResourceType level,
+                      bool expand,
+                      const std::set<DicomTag>& requestedTags,
+                      int64_t cursor) const
+      {
+        AnswerPageOfResources(output, context, resources_, instancesIds_, resourcesMainDicomTags_, resourcesDicomAsJson_, level, expand, format_, requestedTags, IsStorageAccessAllowedForAnswers(findStorageAccessMode_), cursor, isComplete_);
+      }
     };
   }
 
@@ -2930,6 +3406,7 @@ namespace Orthanc
   static void Find(RestApiPostCall& call)
   {
     static const char* const KEY_CASE_SENSITIVE = "CaseSensitive";
+    static const char* const KEY_CURSOR = "Cursor";
     static const char* const KEY_EXPAND = "Expand";
     static const char* const KEY_LEVEL = "Level";
     static const char* const KEY_LIMIT = "Limit";
@@ -2957,6 +3434,12 @@ namespace Orthanc
                          "Limit the number of reported resources", false)
         .SetRequestField(KEY_SINCE, RestApiCallDocumentation::Type_Number,
                          "Show only the resources since the provided index (in conjunction with `Limit`)", false)
+        .SetRequestField(KEY_CURSOR, RestApiCallDocumentation::Type_String,
+                         "Use keyset pagination: Only show the resources after the provided cursor, that was returned in "
+                         "the `Cursor` field of the previous page (empty to get the first page). The answer is then a JSON "
+                         "object with fields `Resources`, `Cursor` and `Done`. Cannot be used together with `Since`. "
+                         "A page might contain less than `Limit` resources even if `Done` is `false`. Only available with "
+                         "the built-in SQLite database (new in Orthanc 1.11.3)", false)
         .SetRequestField(KEY_REQUESTED_TAGS, RestApiCallDocumentation::Type_JsonListOfStrings,
                          "A list of DICOM tags to include in the response (applicable only if \"Expand\" is set to true).  "
                          "The tags requested tags are returned in the 'RequestedTags' field in the response.  "
@@ -3009,6 +3492,14 @@ namespace Orthanc
       throw OrthancException(ErrorCode_BadRequest, 
                              "Field \"" + std::string(KEY_SINCE) + "\" should be an integer");
     }
+    else if (request.isMember(KEY_CURSOR) &&
+             (request[KEY_CURSOR].type() != Json::stringValue ||
+              request.isMember(KEY_SINCE)))
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_CURSOR) + "\" should be a string, and cannot be used together with \"" +
+                             std::string(KEY_SINCE) + "\"");
+    }
     else if (request.isMember(KEY_REQUESTED_TAGS) &&
              request[KEY_REQUESTED_TAGS].type() != Json::arrayValue)
     {
@@ -3088,8 +3579,18 @@ namespace Orthanc
       }
 
       FindVisitor visitor(OrthancRestApi::GetDicomFormat(request, DicomToJsonFormat_Human), context.GetFindStorageAccessMode());
-      context.Apply(visitor, query, level, since, limit);
-      visitor.Answer(call.GetOutput(), context, level, expand, requestedTags);
+
+      if (request.isMember(KEY_CURSOR))
+      {
+        int64_t cursor = ParseCursor(context.GetIndex(), request[KEY_CURSOR].asString());
+        context.ApplyWithCursor(visitor, query, level, cursor, limit);
+        visitor.AnswerPage(call.GetOutput(), context, level, expand, requestedTags, cursor);
+      }
+      else
+      {
+        context.Apply(visitor, query, level, since, limit);
+        visitor.Answer(call.GetOutput(), context, level, expand, requestedTags);
+      }
     }
   }
 
@@ -3160,6 +3661,59 @@ namespace Orthanc
   }
 
 
+  namespace
+  {
+    class InstancesTagsSource : public JsonStreamAnswer::IItemsSource
+    {
+    private:
+      ServerContext&                          context_;
+      const std::list<std::string>&           instances_;
+      DicomToJsonFormat                       format_;
+      const std::set<DicomTag>&               ignoreTagLength_;
+      std::list<std::string>::const_iterator  current_;
+
+    public:
+      InstancesTagsSource(ServerContext& context,
+                          const std::list<std::string>& instances,
+                          DicomToJsonFormat format,
+                          const std::set<DicomTag>& ignoreTagLength) :
+        context_(context),
+        instances_(instances),
+        format_(format),
+        ignoreTagLength_(ignoreTagLength),
+        current_(instances.begin())
+      {
+      }
+
+      virtual bool ReadNextItem(std::string& key,
+                                Json::Value& item) ORTHANC_OVERRIDE
+      {
+        if (current_ == instances_.end())
+        {
+          return false;
+        }
+
+        key = *current_;
+        ++current_;
+
+        Json::Value full;
+        context_.ReadDicomAsJson(full, key, ignoreTagLength_);
+
+        if (format_ != DicomToJsonFormat_Full)
+        {
+          Toolbox::SimplifyDicomAsJson(item, full, format_);
+        }
+        else
+        {
+          item.swap(full);
+        }
+
+        return true;
+      }
+    };
+  }
+
+
   static void GetChildInstancesTags(RestApiGetCall& call)
   {
     if (call.IsDocumentation())
@@ -3189,32 +3743,13 @@ namespace Orthanc
     ParseSetOfTags(ignoreTagLength, call, IGNORE_LENGTH);
 
     // Retrieve all the instances of this patient/study/series
-    typedef std::list<std::string> Instances;
-    Instances instances;
-
+    std::list<std::string> instances;
     context.GetIndex().GetChildInstances(instances, publicId);  // (*)
 
-    Json::Value result = Json::objectValue;
-
-    for (Instances::const_iterator it = instances.begin();
-         it != instances.end(); ++it)
-    {
-      Json::Value full;
-      context.ReadDicomAsJson(full, *it, ignoreTagLength);
+    InstancesTagsSource source(context, instances, format, ignoreTagLength);
 
-      if (format != DicomToJsonFormat_Full)
-      {
-        Json::Value simplified;
-        Toolbox::SimplifyDicomAsJson(simplified, full, format);
-        result[*it] = simplified;
-      }
-      else
-      {
-        result[*it] = full;
-      }
-    }
-    
-    call.GetOutput().AnswerJson(result);
+    JsonStreamAnswer stream(source, true /* JSON object */);
+    call.GetOutput().AnswerJson(stream, IsJsonStreamingEnabled(instances.size()));
   }
 
 
@@ -3475,7 +4010,8 @@ namespace Orthanc
                         "This is notably useful after the deletion of resources whose children resources have inconsistent "
                         "values with their sibling resources. Beware that this is a highly time-consuming operation, "
                         "as all the DICOM instances will be parsed again, and as all the Orthanc index will be regenerated. "
-                        "If you have a large database to process, it is advised to use the Housekeeper plugin to perform "
+                        "The index of the frames of compressed pixel data is also computed for instances that were "
+                        "stored by Orthanc <= 1.11.2. If you have a large database to process, it is advised to use the Housekeeper plugin to perform "
                         "this action resource by resource");
         DocumentReconstructFilesField(call);
 
@@ -0,0 +1,306 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "PrecompiledHeadersServer.h"
+#include "QueryRetrieveCache.h"
+
+#include "../../OrthancFramework/Sources/OrthancException.h"
+
+
+namespace Orthanc
+{
+  class QueryRetrieveCache::Entry : public boost::noncopyable
+  {
+  private:
+    boost::shared_ptr<const Answers>  answers_;
+    boost::posix_time::ptime          expiration_;
+
+  public:
+    Entry(const boost::shared_ptr<const Answers>& answers,
+          unsigned int timeToLive) :
+      answers_(answers),
+      expiration_(boost::posix_time::microsec_clock::universal_time() +
+                  boost::posix_time::seconds(timeToLive))
+    {
+    }
+
+    const boost::shared_ptr<const Answers>& GetAnswers() const
+    {
+      return answers_;
+    }
+
+    bool IsExpired(const boost::posix_time::ptime& now) const
+    {
+      return now >= expiration_;
+    }
+  };
+
+
+  // Query that is being run by one thread, and awaited by others
+  class QueryRetrieveCache::PendingQuery : public boost::noncopyable
+  {
+  private:
+    bool                              done_;
+    boost::shared_ptr<const Answers>  answers_;  // NULL if the query has failed
+
+  public:
+    PendingQuery() :
+      done_(false)
+    {
+    }
+
+    bool IsDone() const
+    {
+      return done_;
+    }
+
+    void SetDone(const boost::shared_ptr<const Answers>& answers)
+    {
+      done_ = true;
+      answers_ = answers;
+    }
+
+    const boost::shared_ptr<const Answers>& GetAnswers() const
+    {
+      return answers_;
+    }
+  };
+
+
+  QueryRetrieveCache::Answers::~Answers()
+  {
+    for (size_t i = 0; i < answers_.size(); i++)
+    {
+      assert(answers_[i] != NULL);
+      delete answers_[i];
+    }
+  }
+
+
+  void QueryRetrieveCache::Answers::Add(const DicomMap& answer)
+  {
+    answers_.push_back(answer.Clone());
+  }
+
+
+  void QueryRetrieveCache::Answers::GetAnswer(DicomMap& target,
+                                              size_t index) const
+  {
+    if (index >= answers_.size())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+    else
+    {
+      assert(answers_[index] != NULL);
+      target.Assign(*answers_[index]);
+    }
+  }
+
+
+  void QueryRetrieveCache::RemoveOldest()
+  {
+    Entry* entry = NULL;
+    index_.RemoveOldest(entry);
+
+    assert(entry != NULL);
+    delete entry;
+  }
+
+
+  void QueryRetrieveCache::FinishPending(const std::string& key,
+                                         PendingQuery& query,
+                                         const boost::shared_ptr<const Answers>& answers)
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (answers.get() != NULL &&
+          maximumSize_ != 0 &&
+          timeToLive_ != 0)
+      {
+        assert(!index_.Contains(key));
+
+        while (index_.GetSize() >= maximumSize_)
+        {
+          RemoveOldest();
+        }
+
+        index_.Add(key, new Entry(answers, timeToLive_));
+      }
+
+      query.SetDone(answers);
+      pending_.erase(key);
+    }
+
+    pendingChanged_.notify_all();
+  }
+
+
+  QueryRetrieveCache::QueryRetrieveCache() :
+    maximumSize_(0),
+    timeToLive_(0)
+  {
+  }
+
+
+  QueryRetrieveCache::~QueryRetrieveCache()
+  {
+    Clear();
+  }
+
+
+  void QueryRetrieveCache::SetMaximumSize(size_t size)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    maximumSize_ = size;
+
+    while (index_.GetSize() > maximumSize_)
+    {
+      RemoveOldest();
+    }
+  }
+
+
+  void QueryRetrieveCache::SetTimeToLive(unsigned int seconds)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    timeToLive_ = seconds;
+
+    if (timeToLive_ == 0)
+    {
+      while (!index_.IsEmpty())
+      {
+        RemoveOldest();
+      }
+    }
+  }
+
+
+  bool QueryRetrieveCache::IsEnabled()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return (maximumSize_ != 0 &&
+            timeToLive_ != 0);
+  }
+
+
+  void QueryRetrieveCache::Clear()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    while (!index_.IsEmpty())
+    {
+      RemoveOldest();
+    }
+  }
+
+
+  size_t QueryRetrieveCache::GetSize()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return index_.GetSize();
+  }
+
+
+  boost::shared_ptr<const QueryRetrieveCache::Answers>
+  QueryRetrieveCache::Find(LookupStatus& status,
+                           const std::string& key,
+                           IFinder& finder)
+  {
+    boost::shared_ptr<PendingQuery> query;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      for (;;)
+      {
+        Entry* entry = NULL;
+        if (index_.Contains(key, entry))
+        {
+          assert(entry != NULL);
+
+          if (entry->IsExpired(boost::posix_time::microsec_clock::universal_time()))
+          {
+            delete index_.Invalidate(key);
+          }
+          else
+          {
+            index_.MakeMostRecent(key);
+            status = LookupStatus_Hit;
+            return entry->GetAnswers();
+          }
+        }
+
+        PendingQueries::const_iterator found = pending_.find(key);
+
+        if (found == pending_.end())
+        {
+          // Nobody is running this query, so this thread becomes responsible for it
+          query.reset(new PendingQuery);
+          pending_[key] = query;
+          break;
+        }
+        else
+        {
+          // Another thread is running the same query, wait for its answers
+          boost::shared_ptr<PendingQuery> other = found->second;
+          assert(other.get() != NULL);
+
+          while (!other->IsDone())
+          {
+            pendingChanged_.wait(lock);
+          }
+
+          if (other->GetAnswers().get() != NULL)
+          {
+            status = LookupStatus_Coalesced;
+            return other->GetAnswers();
+          }
+
+          // The other thread has failed, try again
+        }
+      }
+    }
+
+    assert(query.get() != NULL);
+
+    boost::shared_ptr<Answers> answers(new Answers);
+
+    try
+    {
+      finder.Find(*answers);
+    }
+    catch (...)
+    {
+      FinishPending(key, *query, boost::shared_ptr<const Answers>());
+      throw;
+    }
+
+    FinishPending(key, *query, answers);
+
+    status = LookupStatus_Miss;
+    return answers;
+  }
+}
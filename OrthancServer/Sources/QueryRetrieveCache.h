@@ -0,0 +1,134 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../../OrthancFramework/Sources/Cache/LeastRecentlyUsedIndex.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomMap.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Orthanc
+{
+  /**
+   * Cache of the answers to the C-FIND queries that are issued by
+   * Orthanc against remote modalities (new in Orthanc 1.11.3). The
+   * entries are identified by a key that must encode the remote
+   * modality, the query level and the query itself. The entries
+   * expire after a configurable time-to-live, and the least recently
+   * used entries are removed if the cache is full. Concurrent lookups
+   * for the same key are coalesced: Only one C-FIND is sent to the
+   * remote modality, and the other callers wait for its answers.
+   **/
+  class QueryRetrieveCache : public boost::noncopyable
+  {
+  public:
+    // Immutable once stored in the cache, so it can be shared between threads
+    class Answers : public boost::noncopyable
+    {
+    private:
+      std::vector<DicomMap*>  answers_;
+
+    public:
+      ~Answers();
+
+      void Add(const DicomMap& answer);
+
+      size_t GetSize() const
+      {
+        return answers_.size();
+      }
+
+      void GetAnswer(DicomMap& target,
+                     size_t index) const;
+    };
+
+    class IFinder : public boost::noncopyable
+    {
+    public:
+      virtual ~IFinder()
+      {
+      }
+
+      virtual void Find(Answers& target) = 0;
+    };
+
+    enum LookupStatus
+    {
+      LookupStatus_Miss,       // The finder was called by this thread
+      LookupStatus_Hit,        // The answers were already in the cache
+      LookupStatus_Coalesced   // The answers were computed by a concurrent thread
+    };
+
+  private:
+    class Entry;
+    class PendingQuery;
+
+    typedef LeastRecentlyUsedIndex<std::string, Entry*>                 Index;
+    typedef std::map<std::string, boost::shared_ptr<PendingQuery> >  PendingQueries;
+
+    boost::mutex               mutex_;
+    boost::condition_variable  pendingChanged_;
+    Index                      index_;
+    PendingQueries             pending_;
+    size_t                     maximumSize_;
+    unsigned int               timeToLive_;
+
+    void RemoveOldest();
+
+    void FinishPending(const std::string& key,
+                       PendingQuery& query,
+                       const boost::shared_ptr<const Answers>& answers);
+
+  public:
+    QueryRetrieveCache();
+
+    ~QueryRetrieveCache();
+
+    // Maximum number of queries in the cache, "0" disables the cache
+    void SetMaximumSize(size_t size);
+
+    // Time-to-live of the answers in seconds, "0" disables the cache
+    void SetTimeToLive(unsigned int seconds);
+
+    bool IsEnabled();
+
+    void Clear();
+
+    size_t GetSize();
+
+    /**
+     * Returns the answers associated with "key", calling the finder
+     * if they are not available in the cache yet. This works even if
+     * the cache is disabled, in which case concurrent lookups are
+     * still coalesced. The exceptions of the finder are propagated to
+     * the caller.
+     **/
+    boost::shared_ptr<const Answers> Find(LookupStatus& status,
+                                          const std::string& key,
+                                          IFinder& finder);
+  };
+}
@@ -26,8 +26,11 @@
 #include "OrthancConfiguration.h"
 
 #include "../../OrthancFramework/Sources/DicomNetworking/DicomControlUserConnection.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomFindAnswers.h"
 #include "../../OrthancFramework/Sources/Logging.h"
 #include "../../OrthancFramework/Sources/Lua/LuaFunctionCall.h"
+#include "../../OrthancFramework/Sources/MetricsRegistry.h"
+#include "../../OrthancFramework/Sources/Toolbox.h"
 #include "LuaScripting.h"
 #include "ServerContext.h"
 
@@ -52,10 +55,74 @@ namespace Orthanc
   }
 
 
+  class QueryRetrieveHandler::Finder : public QueryRetrieveCache::IFinder
+  {
+  private:
+    const QueryRetrieveHandler&  that_;
+    const DicomMap&              fixedQuery_;
+
+  public:
+    Finder(const QueryRetrieveHandler& that,
+           const DicomMap& fixedQuery) :
+      that_(that),
+      fixedQuery_(fixedQuery)
+    {
+    }
+
+    virtual void Find(QueryRetrieveCache::Answers& target) ORTHANC_OVERRIDE
+    {
+      DicomFindAnswers answers(false);
+
+      {
+        DicomAssociationParameters params(that_.localAet_, that_.modality_);
+
+        if (that_.timeout_ != 0)
+        {
+          params.SetTimeout(that_.timeout_);
+        }
+        
+        DicomControlUserConnection connection(params);
+        connection.Find(answers, that_.level_, fixedQuery_, that_.findNormalized_);
+      }
+
+      for (size_t i = 0; i < answers.GetSize(); i++)
+      {
+        DicomMap summary;
+        answers.GetAnswer(i).ExtractDicomSummary(summary, 0 /* don't truncate tags */);
+        target.Add(summary);
+      }
+    }
+  };
+
+
   void QueryRetrieveHandler::Invalidate()
   {
     done_ = false;
-    answers_.Clear();
+    answers_.reset();
+  }
+
+
+  std::string QueryRetrieveHandler::FormatCacheKey(const DicomMap& fixedQuery) const
+  {
+    /**
+     * The key identifies the remote modality by its parameters (and
+     * not only by its symbolic name, that might be redefined through
+     * the REST API), as well as the query after it has been fixed by
+     * the Lua callback.
+     **/
+    Json::Value key = Json::objectValue;
+    key["Modality"] = modalityName_;
+    key["AET"] = modality_.GetApplicationEntityTitle();
+    key["Host"] = modality_.GetHost();
+    key["Port"] = static_cast<unsigned int>(modality_.GetPortNumber());
+    key["LocalAet"] = localAet_;
+    key["Level"] = EnumerationToString(level_);
+    key["Normalize"] = findNormalized_;
+    fixedQuery.Serialize(key["Query"]);
+
+    std::string s;
+    Toolbox::WriteFastJson(s, key);
+    return s;
   }
 
 
@@ -70,16 +137,44 @@ namespace Orthanc
       // Secondly, possibly fix the query with the user-provider Lua callback
       FixQueryLua(fixed, context_, modality_.GetApplicationEntityTitle()); 
 
+      Finder finder(*this, fixed);
+
+      QueryRetrieveCache& cache = context_.GetQueryRetrieveCache();
+
+      if (cache.IsEnabled())
       {
-        DicomAssociationParameters params(localAet_, modality_);
+        QueryRetrieveCache::LookupStatus status;
+        answers_ = cache.Find(status, FormatCacheKey(fixed), finder);
+
+        MetricsRegistry::Labels labels;
+        labels["modality"] = modalityName_;
 
-        if (timeout_ != 0)
+        switch (status)
         {
-          params.SetTimeout(timeout_);
+          case QueryRetrieveCache::LookupStatus_Miss:
+            context_.GetMetricsRegistry().IncrementCounter("orthanc_query_retrieve_cache_misses_total", labels, 1);
+            break;
+
+          case QueryRetrieveCache::LookupStatus_Hit:
+            context_.GetMetricsRegistry().IncrementCounter("orthanc_query_retrieve_cache_hits_total", labels, 1);
+            break;
+
+          case QueryRetrieveCache::LookupStatus_Coalesced:
+            context_.GetMetricsRegistry().IncrementCounter("orthanc_query_retrieve_cache_coalesced_total", labels, 1);
+            break;
+
+          default:
+            throw OrthancException(ErrorCode_InternalError);
         }
-        
-        DicomControlUserConnection connection(params);
-        connection.Find(answers_, level_, fixed, findNormalized_);
+
+        context_.GetMetricsRegistry().SetValue("orthanc_query_retrieve_cache_count",
+                                               static_cast<float>(cache.GetSize()));
+      }
+      else
+      {
+        boost::shared_ptr<QueryRetrieveCache::Answers> answers(new QueryRetrieveCache::Answers);
+        finder.Find(*answers);
+        answers_ = answers;
       }
 
       done_ = true;
@@ -92,7 +187,6 @@ namespace Orthanc
     localAet_(context.GetDefaultLocalApplicationEntityTitle()),
     done_(false),
     level_(ResourceType_Study),
-    answers_(false),
     findNormalized_(true),
     timeout_(0)
   {
@@ -154,7 +248,8 @@ namespace Orthanc
   size_t QueryRetrieveHandler::GetAnswersCount()
   {
     Run();
-    return answers_.GetSize();
+    assert(answers_.get() != NULL);
+    return answers_->GetSize();
   }
 
 
@@ -162,7 +257,8 @@ namespace Orthanc
                                        size_t i)
   {
     Run();
-    answers_.GetAnswer(i).ExtractDicomSummary(target, 0 /* don't truncate tags */);
+    assert(answers_.get() != NULL);
+    answers_->GetAnswer(target, i);
   }
 
   
@@ -22,8 +22,9 @@
 
 #pragma once
 
-#include "../../OrthancFramework/Sources/DicomNetworking/DicomFindAnswers.h"
 #include "../../OrthancFramework/Sources/DicomNetworking/RemoteModalityParameters.h"
+#include "../../OrthancFramework/Sources/IDynamicObject.h"
+#include "QueryRetrieveCache.h"
 
 namespace Orthanc
 {
@@ -32,19 +33,23 @@ namespace Orthanc
   class QueryRetrieveHandler : public IDynamicObject
   {
   private:
+    class Finder;
+
     ServerContext&             context_;
     std::string                localAet_;
     bool                       done_;
     RemoteModalityParameters   modality_;
     ResourceType               level_;
     DicomMap                   query_;
-    DicomFindAnswers           answers_;
+    boost::shared_ptr<const QueryRetrieveCache::Answers>  answers_;
     std::string                modalityName_;
     bool                       findNormalized_;
     uint32_t                   timeout_;  // New in Orthanc 1.9.1
 
     void Invalidate();
 
+    std::string FormatCacheKey(const DicomMap& fixedQuery) const;
+
   public:
     explicit QueryRetrieveHandler(ServerContext& context);
 
@@ -90,6 +90,8 @@ namespace Orthanc
                                Encoding encoding,
                                bool hasCodeExtensions) const
   {
+    const std::set<DicomTag> ignoreTagLength;
+
     for (size_t i = 0; i < constraints_.size(); i++)
     {
       assert(constraints_[i] != NULL);
@@ -108,7 +110,6 @@ namespace Orthanc
         return false;
       }
 
-      std::set<DicomTag> ignoreTagLength;
       std::unique_ptr<DicomValue> value(FromDcmtkBridge::ConvertLeafElement
                                         (*element, DicomToJsonFlags_None, 
                                          0, encoding, hasCodeExtensions, ignoreTagLength));
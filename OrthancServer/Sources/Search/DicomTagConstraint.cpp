@@ -31,7 +31,7 @@
 #include "../../../OrthancFramework/Sources/Toolbox.h"
 #include "DatabaseConstraint.h"
 
-#include <boost/regex.hpp>
+#include <cassert>
 
 namespace Orthanc
 {
@@ -68,22 +68,237 @@ namespace Orthanc
   };
 
 
-  class DicomTagConstraint::RegularExpression : public boost::noncopyable
+  /**
+   * Compiled version of a constraint, created once per query. The
+   * reference values are normalized (i.e. made uppercase if the
+   * constraint is case-insensitive) only once, and the wildcard
+   * patterns are turned into prefix/suffix/substring matchers if
+   * possible, or into a glob matcher otherwise. This avoids the
+   * costly construction and evaluation of regular expressions
+   * against each candidate of a C-FIND or worklist query.
+   **/
+  class DicomTagConstraint::Matcher : public boost::noncopyable
   {
   private:
-    boost::regex  regex_;
+    enum Mode
+    {
+      Mode_Equal,
+      Mode_SmallerOrEqual,
+      Mode_GreaterOrEqual,
+      Mode_Universal,     // Wildcard "*"
+      Mode_Prefix,        // Wildcard "abc*"
+      Mode_Suffix,        // Wildcard "*abc"
+      Mode_Substring,     // Wildcard "*abc*"
+      Mode_Glob,          // Any other wildcard
+      Mode_List
+    };
+
+    Mode                   mode_;
+    bool                   caseSensitive_;
+    std::string            reference_;
+    std::set<std::string>  values_;
+
+    void CompileWildcard(const std::string& pattern)
+    {
+      if (pattern.find('?') != std::string::npos)
+      {
+        mode_ = Mode_Glob;
+        reference_ = pattern;
+        return;
+      }
+
+      size_t first = pattern.find_first_not_of('*');
+      if (pattern.empty())
+      {
+        mode_ = Mode_Equal;  // Only matches the empty string
+        return;
+      }
+      else if (first == std::string::npos)
+      {
+        mode_ = Mode_Universal;
+        return;
+      }
+
+      size_t last = pattern.find_last_not_of('*');
+      assert(last != std::string::npos && first <= last);
+
+      std::string inner = pattern.substr(first, last - first + 1);
+      if (inner.find('*') != std::string::npos)
+      {
+        mode_ = Mode_Glob;
+        reference_ = pattern;
+        return;
+      }
+
+      const bool leading = (first > 0);
+      const bool trailing = (last + 1 < pattern.size());
+
+      reference_.swap(inner);
+
+      if (leading && trailing)
+      {
+        mode_ = Mode_Substring;
+      }
+      else if (leading)
+      {
+        mode_ = Mode_Suffix;
+      }
+      else if (trailing)
+      {
+        mode_ = Mode_Prefix;
+      }
+      else
+      {
+        mode_ = Mode_Equal;  // No wildcard at all
+      }
+    }
 
   public:
-    RegularExpression(const std::string& source,
-                      bool caseSensitive)
+    Matcher(ConstraintType type,
+            const std::set<std::string>& values,
+            bool caseSensitive) :
+      caseSensitive_(caseSensitive)
+    {
+      if (type == ConstraintType_List)
+      {
+        mode_ = Mode_List;
+
+        for (std::set<std::string>::const_iterator
+               it = values.begin(); it != values.end(); ++it)
+        {
+          NormalizedString reference(*it, caseSensitive);
+          values_.insert(reference.GetValue());
+        }
+
+        return;
+      }
+
+      if (values.size() != 1)
+      {
+        throw OrthancException(ErrorCode_InternalError);
+      }
+
+      NormalizedString reference(*values.begin(), caseSensitive);
+
+      switch (type)
+      {
+        case ConstraintType_Equal:
+          mode_ = Mode_Equal;
+          reference_ = reference.GetValue();
+          break;
+
+        case ConstraintType_SmallerOrEqual:
+          mode_ = Mode_SmallerOrEqual;
+          reference_ = reference.GetValue();
+          break;
+
+        case ConstraintType_GreaterOrEqual:
+          mode_ = Mode_GreaterOrEqual;
+          reference_ = reference.GetValue();
+          break;
+
+        case ConstraintType_Wildcard:
+          CompileWildcard(reference.GetValue());
+          break;
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
+    }
+
+    /**
+     * Byte-wise matching of "*" (any sequence) and "?" (any single
+     * character), with the same semantics as the regular expression
+     * produced by "Toolbox::WildcardToRegularExpression()". This is
+     * the classical greedy algorithm with backtracking on the last
+     * star, which runs in linear time on usual patterns.
+     **/
+    static bool MatchGlob(const std::string& value,
+                          const std::string& pattern)
     {
-      NormalizedString normalized(source, caseSensitive);
-      regex_ = boost::regex(Toolbox::WildcardToRegularExpression(normalized.GetValue()));
+      size_t v = 0;
+      size_t p = 0;
+      size_t star = std::string::npos;
+      size_t starValue = 0;
+
+      while (v < value.size())
+      {
+        if (p < pattern.size() &&
+            (pattern[p] == '?' || pattern[p] == value[v]))
+        {
+          v++;
+          p++;
+        }
+        else if (p < pattern.size() &&
+                 pattern[p] == '*')
+        {
+          star = p;
+          starValue = v;
+          p++;
+        }
+        else if (star != std::string::npos)
+        {
+          p = star + 1;
+          starValue++;
+          v = starValue;
+        }
+        else
+        {
+          return false;
+        }
+      }
+
+      while (p < pattern.size() &&
+             pattern[p] == '*')
+      {
+        p++;
+      }
+
+      return (p == pattern.size());
     }
 
-    const boost::regex& GetValue() const
+    bool IsMatch(const std::string& value) const
     {
-      return regex_;
+      if (mode_ == Mode_Universal)
+      {
+        return true;  // No need to normalize the value
+      }
+
+      NormalizedString normalized(value, caseSensitive_);
+      const std::string& source = normalized.GetValue();
+
+      switch (mode_)
+      {
+        case Mode_Equal:
+          return source == reference_;
+
+        case Mode_SmallerOrEqual:
+          return source <= reference_;
+
+        case Mode_GreaterOrEqual:
+          return source >= reference_;
+
+        case Mode_Prefix:
+          return (source.size() >= reference_.size() &&
+                  source.compare(0, reference_.size(), reference_) == 0);
+
+        case Mode_Suffix:
+          return (source.size() >= reference_.size() &&
+                  source.compare(source.size() - reference_.size(),
+                                 reference_.size(), reference_) == 0);
+
+        case Mode_Substring:
+          return source.find(reference_) != std::string::npos;
+
+        case Mode_Glob:
+          return MatchGlob(source, reference_);
+
+        case Mode_List:
+          return values_.find(source) != values_.end();
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
     }
   };
 
@@ -105,6 +320,7 @@ namespace Orthanc
     {
       values_.clear();
       values_.insert(value);
+      matcher_.reset();
     }
     else
     {
@@ -193,6 +409,17 @@ namespace Orthanc
     else
     {
       values_.insert(value);
+      matcher_.reset();
+    }
+  }
+
+
+  void DicomTagConstraint::SetCaseSensitive(bool caseSensitive)
+  {
+    if (caseSensitive_ != caseSensitive)
+    {
+      caseSensitive_ = caseSensitive;
+      matcher_.reset();
     }
   }
 
@@ -216,56 +443,12 @@ namespace Orthanc
 
   bool DicomTagConstraint::IsMatch(const std::string& value) const
   {
-    NormalizedString source(value, caseSensitive_);
-
-    switch (constraintType_)
+    if (matcher_.get() == NULL)
     {
-      case ConstraintType_Equal:
-      {
-        NormalizedString reference(GetValue(), caseSensitive_);
-        return source.GetValue() == reference.GetValue();
-      }
-
-      case ConstraintType_SmallerOrEqual:
-      {
-        NormalizedString reference(GetValue(), caseSensitive_);
-        return source.GetValue() <= reference.GetValue();
-      }
-
-      case ConstraintType_GreaterOrEqual:
-      {
-        NormalizedString reference(GetValue(), caseSensitive_);
-        return source.GetValue() >= reference.GetValue();
-      }
-
-      case ConstraintType_Wildcard:
-      {
-        if (regex_.get() == NULL)
-        {
-          regex_.reset(new RegularExpression(GetValue(), caseSensitive_));
-        }
-
-        return boost::regex_match(source.GetValue(), regex_->GetValue());
-      }
-
-      case ConstraintType_List:
-      {
-        for (std::set<std::string>::const_iterator
-               it = values_.begin(); it != values_.end(); ++it)
-        {
-          NormalizedString reference(*it, caseSensitive_);
-          if (source.GetValue() == reference.GetValue())
-          {
-            return true;
-          }
-        }
-
-        return false;
-      }
-
-      default:
-        throw OrthancException(ErrorCode_InternalError);
+      matcher_.reset(new Matcher(constraintType_, values_, caseSensitive_));
     }
+
+    return matcher_->IsMatch(value);
   }
 
 
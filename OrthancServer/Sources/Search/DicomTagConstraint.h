@@ -34,7 +34,7 @@ namespace Orthanc
   {
   private:
     class NormalizedString;
-    class RegularExpression;
+    class Matcher;
 
     DicomTag                tag_;
     ConstraintType          constraintType_;
@@ -42,7 +42,7 @@ namespace Orthanc
     bool                    caseSensitive_;
     bool                    mandatory_;
 
-    mutable boost::shared_ptr<RegularExpression>  regex_;  // mutable because the regex is an internal object created only when required (in IsMatch const method)
+    mutable boost::shared_ptr<Matcher>  matcher_;  // mutable because the matcher is an internal object compiled only when required (in IsMatch const method)
 
     void AssignSingleValue(const std::string& value);
 
@@ -83,10 +83,7 @@ namespace Orthanc
       return caseSensitive_;
     }
 
-    void SetCaseSensitive(bool caseSensitive)
-    {
-      caseSensitive_ = caseSensitive;
-    }
+    void SetCaseSensitive(bool caseSensitive);
 
     bool IsMandatory() const
     {
@@ -270,11 +270,12 @@ namespace Orthanc
   }
   
 
-  void ISqlLookupFormatter::Apply(std::string& sql,
-                                  ISqlLookupFormatter& formatter,
-                                  const std::vector<DatabaseConstraint>& lookup,
-                                  ResourceType queryLevel,
-                                  size_t limit)
+  static void ApplyInternal(std::string& sql,
+                            ISqlLookupFormatter& formatter,
+                            const std::vector<DatabaseConstraint>& lookup,
+                            ResourceType queryLevel,
+                            const int64_t* since,  // NULL if no cursor
+                            size_t limit)
   {
     assert(ResourceType_Patient < ResourceType_Study &&
            ResourceType_Study < ResourceType_Series &&
@@ -326,7 +327,10 @@ namespace Orthanc
       }
     }
 
-    sql = ("SELECT " +
+    // With a cursor, the same resource must not be reported twice
+    // (which might happen if constraining its child resources), as
+    // the limit must correspond to the number of distinct resources
+    sql = ((since == NULL ? "SELECT " : "SELECT DISTINCT ") +
            FormatLevel(queryLevel) + ".publicId, " +
            FormatLevel(queryLevel) + ".internalId" +
            " FROM Resources AS " + FormatLevel(queryLevel));
@@ -350,9 +354,37 @@ namespace Orthanc
     sql += (joins + " WHERE " + FormatLevel(queryLevel) + ".resourceType = " +
             formatter.FormatResourceType(queryLevel) + comparisons);
 
+    if (since != NULL)
+    {
+      sql += (" AND " + FormatLevel(queryLevel) + ".internalId > " +
+              boost::lexical_cast<std::string>(*since) +
+              " ORDER BY " + FormatLevel(queryLevel) + ".internalId");
+    }
+
     if (limit != 0)
     {
       sql += " LIMIT " + boost::lexical_cast<std::string>(limit);
     }
   }
+
+
+  void ISqlLookupFormatter::Apply(std::string& sql,
+                                  ISqlLookupFormatter& formatter,
+                                  const std::vector<DatabaseConstraint>& lookup,
+                                  ResourceType queryLevel,
+                                  size_t limit)
+  {
+    ApplyInternal(sql, formatter, lookup, queryLevel, NULL, limit);
+  }
+
+
+  void ISqlLookupFormatter::ApplyWithCursor(std::string& sql,
+                                            ISqlLookupFormatter& formatter,
+                                            const std::vector<DatabaseConstraint>& lookup,
+                                            ResourceType queryLevel,
+                                            int64_t since,
+                                            size_t limit)
+  {
+    ApplyInternal(sql, formatter, lookup, queryLevel, &since, limit);
+  }
 }
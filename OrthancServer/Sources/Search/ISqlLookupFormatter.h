@@ -29,6 +29,7 @@
 #endif
 
 #include <boost/noncopyable.hpp>
+#include <stdint.h>
 #include <vector>
 
 namespace Orthanc
@@ -61,5 +62,18 @@ namespace Orthanc
                       const std::vector<DatabaseConstraint>& lookup,
                       ResourceType queryLevel,
                       size_t limit);
+
+    /**
+     * Keyset pagination (new in Orthanc 1.11.3): Only select the
+     * resources whose internal ID is strictly greater than "since",
+     * sorted by increasing internal ID. The cost of one page is thus
+     * independent of its position in the full list of results.
+     **/
+    static void ApplyWithCursor(std::string& sql,
+                                ISqlLookupFormatter& formatter,
+                                const std::vector<DatabaseConstraint>& lookup,
+                                ResourceType queryLevel,
+                                int64_t since,
+                                size_t limit);
   };
 }
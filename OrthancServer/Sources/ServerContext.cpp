@@ -25,6 +25,7 @@
 
 #include "../../OrthancFramework/Sources/Cache/SharedArchive.h"
 #include "../../OrthancFramework/Sources/DicomFormat/DicomElement.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomFrameOffsetTable.h"
 #include "../../OrthancFramework/Sources/DicomFormat/DicomStreamReader.h"
 #include "../../OrthancFramework/Sources/DicomParsing/DcmtkTranscoder.h"
 #include "../../OrthancFramework/Sources/DicomParsing/DicomModification.h"
@@ -51,6 +52,7 @@
 
 
 static size_t DICOM_CACHE_SIZE = 128 * 1024 * 1024;  // 128 MB
+static size_t FRAME_OFFSET_TABLES_CACHE_SIZE = 16 * 1024 * 1024;  // 16 MB
 
 
 /**
@@ -64,6 +66,151 @@ static size_t DICOM_CACHE_SIZE = 128 * 1024 * 1024;  // 128 MB
 
 namespace Orthanc
 {
+  /**
+   * Measures the successive stages of the ingestion of one DICOM
+   * instance (parsing, transcoding, filters, writing to the storage
+   * area, indexing, callbacks). The durations are published as
+   * histograms in the metrics registry, and the slow ingestions are
+   * logged together with the name of their slowest stage.
+   **/
+  class ServerContext::IngestTimer : public boost::noncopyable
+  {
+  private:
+    typedef std::vector< std::pair<const char*, double> >  Durations;  // In seconds
+
+    MetricsRegistry&          registry_;
+    unsigned int              slowThreshold_;
+    bool                      active_;
+    boost::posix_time::ptime  start_;
+    const char*               stage_;
+    boost::posix_time::ptime  stageStart_;
+    Durations                 durations_;
+    std::string               instanceId_;
+
+    static boost::posix_time::ptime GetNow()
+    {
+      return boost::posix_time::microsec_clock::universal_time();
+    }
+
+    static double GetSeconds(const boost::posix_time::ptime& start,
+                             const boost::posix_time::ptime& end)
+    {
+      return static_cast<double>((end - start).total_microseconds()) / 1000000.0;
+    }
+
+  public:
+    IngestTimer(MetricsRegistry& registry,
+                unsigned int slowThreshold /* in milliseconds */) :
+      registry_(registry),
+      slowThreshold_(slowThreshold),
+      active_(registry.IsEnabled() || slowThreshold > 0),
+      stage_(NULL)
+    {
+      if (active_)
+      {
+        start_ = GetNow();
+      }
+    }
+
+    ~IngestTimer()
+    {
+      if (!active_)
+      {
+        return;
+      }
+
+      try
+      {
+        EndStage();
+
+        const double total = GetSeconds(start_, GetNow());
+
+        MetricsRegistry::Labels labels;
+        for (Durations::const_iterator it = durations_.begin(); it != durations_.end(); ++it)
+        {
+          labels["stage"] = it->first;
+          registry_.ObserveHistogram("orthanc_store_stage_duration_seconds", labels, it->second);
+        }
+
+        registry_.ObserveHistogram("orthanc_store_duration_seconds", MetricsRegistry::Labels(), total);
+
+        if (slowThreshold_ > 0 &&
+            total * 1000.0 >= static_cast<double>(slowThreshold_))
+        {
+          const char* slowest = "none";
+          double slowestDuration = 0;
+          std::string details;
+
+          for (Durations::const_iterator it = durations_.begin(); it != durations_.end(); ++it)
+          {
+            if (it->second >= slowestDuration)
+            {
+              slowest = it->first;
+              slowestDuration = it->second;
+            }
+
+            details += (std::string(details.empty() ? "" : ", ") + it->first + "=" +
+                        boost::lexical_cast<std::string>(static_cast<int64_t>(it->second * 1000.0)) + "ms");
+          }
+
+          LOG(WARNING) << "Slow ingestion of instance " << (instanceId_.empty() ? "(unknown)" : instanceId_)
+                       << " in " << static_cast<int64_t>(total * 1000.0) << "ms, the slowest stage is \""
+                       << slowest << "\" (" << details << ")";
+        }
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Cannot publish the ingestion metrics: " << e.What();
+      }
+    }
+
+    void SetInstanceId(const std::string& instanceId)
+    {
+      instanceId_ = instanceId;
+    }
+
+    // Ends the current stage, if any. The durations of the stages
+    // that are started several times are summed.
+    void EndStage()
+    {
+      if (active_ &&
+          stage_ != NULL)
+      {
+        const double duration = GetSeconds(stageStart_, GetNow());
+
+        bool found = false;
+        for (Durations::iterator it = durations_.begin(); it != durations_.end(); ++it)
+        {
+          if (std::string(it->first) == stage_)
+          {
+            it->second += duration;
+            found = true;
+            break;
+          }
+        }
+
+        if (!found)
+        {
+          durations_.push_back(std::make_pair(stage_, duration));
+        }
+
+        stage_ = NULL;
+      }
+    }
+
+    // The "stage" must be a string literal
+    void StartStage(const char* stage)
+    {
+      if (active_)
+      {
+        EndStage();
+        stage_ = stage;
+        stageStart_ = GetNow();
+      }
+    }
+  };
+
+
   static void ComputeStudyTags(ExpandedResource& resource,
                                ServerContext& context,
                                const std::string& studyPublicId,
@@ -98,6 +245,36 @@ namespace Orthanc
   }
 
 
+  static void CheckDeferredIngestTranscoding(DicomTransferSyntax transferSyntax)
+  {
+    /**
+     * The deferred ingest transcoding cannot change the
+     * SOPInstanceUID, as the instance is already indexed under its
+     * Orthanc identifier: Only the lossless transfer syntaxes are
+     * allowed (new in Orthanc 1.11.3).
+     **/
+    switch (transferSyntax)
+    {
+      case DicomTransferSyntax_LittleEndianImplicit:
+      case DicomTransferSyntax_LittleEndianExplicit:
+      case DicomTransferSyntax_BigEndianExplicit:
+      case DicomTransferSyntax_DeflatedLittleEndianExplicit:
+      case DicomTransferSyntax_JPEGProcess14:
+      case DicomTransferSyntax_JPEGProcess14SV1:
+      case DicomTransferSyntax_JPEGLSLossless:
+      case DicomTransferSyntax_JPEG2000LosslessOnly:
+      case DicomTransferSyntax_JPEG2000MulticomponentLosslessOnly:
+      case DicomTransferSyntax_RLELossless:
+        return;
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange,
+                               "The ingest transcoding to a lossy transfer syntax cannot be deferred: " +
+                               std::string(GetTransferSyntaxUid(transferSyntax)));
+    }
+  }
+
+
   ServerContext::StoreResult::StoreResult() :
     status_(StoreStatus_Failure),
     cstoreStatusCode_(0)
@@ -147,6 +324,317 @@ namespace Orthanc
   }
 
 
+  namespace
+  {
+    class DeferredTranscodingItem : public IDynamicObject
+    {
+    private:
+      std::string  instancePublicId_;
+      uint64_t     size_;
+
+    public:
+      DeferredTranscodingItem(const std::string& instancePublicId,
+                              uint64_t size) :
+        instancePublicId_(instancePublicId),
+        size_(size)
+      {
+      }
+
+      const std::string& GetInstancePublicId() const
+      {
+        return instancePublicId_;
+      }
+
+      uint64_t GetSize() const
+      {
+        return size_;
+      }
+    };
+  }
+
+
+  void ServerContext::DeferredTranscodingThread(ServerContext* that,
+                                                unsigned int sleepDelay)
+  {
+    try
+    {
+      that->EnqueuePendingTranscodings();
+    }
+    catch (OrthancException& e)
+    {
+      LOG(ERROR) << "Cannot look for the instances waiting for the deferred ingest transcoding: " << e.What();
+    }
+
+    while (!that->done_)
+    {
+      std::unique_ptr<IDynamicObject> obj(that->deferredTranscodingQueue_.Dequeue(sleepDelay));
+
+      if (obj.get() != NULL)
+      {
+        const DeferredTranscodingItem& item = dynamic_cast<const DeferredTranscodingItem&>(*obj);
+
+        /**
+         * In the case of an error, the "PendingTranscoding" metadata
+         * is kept, and the instance will be processed again at the
+         * next startup of Orthanc.
+         **/
+        try
+        {
+          that->ApplyDeferredTranscoding(item.GetInstancePublicId());
+          that->RemovePendingTranscoding();
+        }
+        catch (OrthancException& e)
+        {
+          LOG(ERROR) << "Error during the deferred ingest transcoding of instance "
+                     << item.GetInstancePublicId() << ": " << e.What();
+        }
+        catch (std::bad_alloc&)
+        {
+          LOG(ERROR) << "Not enough memory for the deferred ingest transcoding of instance "
+                     << item.GetInstancePublicId();
+        }
+
+        that->UpdateDeferredTranscodingMetrics(-static_cast<int64_t>(item.GetSize()));
+      }
+    }
+  }
+
+
+  void ServerContext::EnqueueDeferredTranscoding(const std::string& instancePublicId,
+                                                 uint64_t size)
+  {
+    deferredTranscodingQueue_.Enqueue(new DeferredTranscodingItem(instancePublicId, size));
+    UpdateDeferredTranscodingMetrics(static_cast<int64_t>(size));
+  }
+
+
+  void ServerContext::UpdateDeferredTranscodingMetrics(int64_t backlogDelta)
+  {
+    uint64_t backlog;
+
+    {
+      boost::mutex::scoped_lock lock(deferredTranscodingMutex_);
+      deferredTranscodingBacklog_ = static_cast<uint64_t>(static_cast<int64_t>(deferredTranscodingBacklog_) + backlogDelta);
+      backlog = deferredTranscodingBacklog_;
+    }
+
+    metricsRegistry_->SetValue("orthanc_deferred_transcoding_queue_length",
+                               static_cast<float>(deferredTranscodingQueue_.GetSize()));
+    metricsRegistry_->SetValue("orthanc_deferred_transcoding_backlog_mb",
+                               static_cast<float>(backlog) / static_cast<float>(1024 * 1024));
+  }
+
+
+  void ServerContext::AddPendingTranscoding()
+  {
+    boost::mutex::scoped_lock lock(deferredTranscodingMutex_);
+
+    if (pendingTranscodingCount_ == 0)
+    {
+      // Tell the next startup of Orthanc to look for the instances
+      // that still have the "PendingTranscoding" metadata
+      index_.SetGlobalProperty(GlobalProperty_PendingTranscoding, false /* not shared */, "1");
+    }
+
+    pendingTranscodingCount_++;
+  }
+
+
+  void ServerContext::RemovePendingTranscoding()
+  {
+    boost::mutex::scoped_lock lock(deferredTranscodingMutex_);
+
+    if (pendingTranscodingCount_ == 0)
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    pendingTranscodingCount_--;
+
+    if (pendingTranscodingCount_ == 0)
+    {
+      index_.SetGlobalProperty(GlobalProperty_PendingTranscoding, false /* not shared */, "0");
+    }
+  }
+
+
+  void ServerContext::EnqueuePendingTranscodings()
+  {
+    std::string value;
+    if (!index_.LookupGlobalProperty(value, GlobalProperty_PendingTranscoding, false /* not shared */) ||
+        value != "1")
+    {
+      return;  // The previous execution of Orthanc has applied all the deferred transcodings
+    }
+
+    LOG(WARNING) << "Looking for the instances whose deferred ingest transcoding was "
+                 << "interrupted by the previous stop of Orthanc";
+
+    // Without native keyset pagination, each page would have a linear
+    // cost: All the instances are then read in one single page
+    const size_t pageSize = (index_.HasKeysetPaginationSupport() ? 1000 : 0 /* no limit */);
+
+    int64_t cursor = 0;
+    bool done = false;
+    size_t count = 0;
+
+    while (!done &&
+           !done_)
+    {
+      std::list<std::string> instances;
+      index_.LookupInstancesWithMetadata(instances, cursor, done, MetadataType_Instance_PendingTranscoding, pageSize);
+
+      for (std::list<std::string>::const_iterator it = instances.begin(); it != instances.end(); ++it)
+      {
+        FileInfo attachment;
+        int64_t revision;
+        if (index_.LookupAttachment(attachment, revision, *it, FileContentType_Dicom))
+        {
+          AddPendingTranscoding();
+          EnqueueDeferredTranscoding(*it, attachment.GetUncompressedSize());
+          count++;
+        }
+      }
+    }
+
+    if (done)
+    {
+      LOG(WARNING) << "Number of instances whose deferred ingest transcoding is resumed: " << count;
+
+      boost::mutex::scoped_lock lock(deferredTranscodingMutex_);
+
+      if (pendingTranscodingCount_ == 0)
+      {
+        index_.SetGlobalProperty(GlobalProperty_PendingTranscoding, false /* not shared */, "0");
+      }
+    }
+  }
+
+
+  void ServerContext::ApplyDeferredTranscoding(const std::string& instancePublicId)
+  {
+    std::string marker;
+    int64_t revision;
+    if (!index_.LookupMetadata(marker, revision, instancePublicId, ResourceType_Instance,
+                               MetadataType_Instance_PendingTranscoding))
+    {
+      // The instance was deleted or already transcoded in the meantime
+      return;
+    }
+
+    FileInfo attachment;
+    if (!index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom))
+    {
+      // The instance was deleted in the meantime
+      return;
+    }
+
+    std::string dicom;
+
+    StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
+    accessor.Read(dicom, attachment);
+
+    std::set<DicomTransferSyntax> syntaxes;
+    syntaxes.insert(ingestTransferSyntax_);
+
+    IDicomTranscoder::DicomImage source;
+    source.SetExternalBuffer(dicom);
+
+    /**
+     * The SOPInstanceUID must be kept, otherwise the Orthanc
+     * identifier of the instance would change: Lossy transcoding is
+     * thus impossible in the deferred mode.
+     **/
+    IDicomTranscoder::DicomImage transcoded;
+    if (!Transcode(transcoded, source, syntaxes, false /* don't allow new SOP instance UID */))
+    {
+      LOG(WARNING) << "Cannot apply the deferred ingest transcoding to instance "
+                   << instancePublicId << ", keeping the original file";
+      index_.DeleteMetadata(instancePublicId, MetadataType_Instance_PendingTranscoding,
+                            false /* no revision */, -1 /* dummy revision */, "" /* dummy MD5 */);
+      return;
+    }
+
+    const void* data = transcoded.GetBufferData();
+    const size_t size = transcoded.GetBufferSize();
+
+    uint64_t pixelDataOffset;
+    bool hasPixelDataOffset = (DicomStreamReader::LookupPixelDataOffset(pixelDataOffset, data, size) &&
+                               pixelDataOffset < size);
+
+    /**
+     * Write the new DICOM file and the attachments that are derived
+     * from it, then swap them with the old ones in one single
+     * transaction, together with the "TransferSyntax" and
+     * "PixelDataOffset" metadata. This way, the database never refers
+     * to a mix of the original and of the transcoded file.
+     **/
+    CompressionType compression = (compressionEnabled_ ? CompressionType_ZlibWithSize : CompressionType_None);
+
+    ServerIndex::Attachments attachments;
+
+    try
+    {
+      attachments.push_back(accessor.Write(data, size, FileContentType_Dicom, compression, storeMD5_));
+
+      if (hasPixelDataOffset &&
+          (!area_.HasReadRange() ||
+           compressionEnabled_))
+      {
+        attachments.push_back(accessor.Write(data, pixelDataOffset, FileContentType_DicomUntilPixelData,
+                                             compression, storeMD5_));
+      }
+
+      if (area_.HasReadRange() &&
+          !compressionEnabled_ &&
+          DicomFrameOffsetTable::IsEncapsulatedTransferSyntax(ingestTransferSyntax_))
+      {
+        DicomFrameOffsetTable table;
+        if (table.Parse(data, size))
+        {
+          table.SetSourceUuid(attachments.front().GetUuid());
+
+          std::string serialized;
+          table.Serialize(serialized);
+          attachments.push_back(accessor.Write(serialized, FileContentType_DicomFrameOffsetTable,
+                                               compression, storeMD5_));
+        }
+      }
+
+      if (!index_.ReplaceDicomAttachment(instancePublicId, attachments, ingestTransferSyntax_,
+                                         hasPixelDataOffset, pixelDataOffset, revision,
+                                         attachment.GetUncompressedMD5()))
+      {
+        LOG(WARNING) << "Cannot replace the DICOM file of instance " << instancePublicId
+                     << " after deferred ingest transcoding, as it was modified in the meantime";
+
+        for (ServerIndex::Attachments::const_iterator it = attachments.begin(); it != attachments.end(); ++it)
+        {
+          accessor.Remove(*it);
+        }
+
+        return;
+      }
+    }
+    catch (OrthancException&)
+    {
+      for (ServerIndex::Attachments::const_iterator it = attachments.begin(); it != attachments.end(); ++it)
+      {
+        accessor.Remove(*it);
+      }
+
+      throw;
+    }
+
+    dicomCache_.Invalidate(instancePublicId);
+    PublishDicomCacheMetrics();
+
+    LOG(INFO) << "Deferred ingest transcoding of instance " << instancePublicId << " to "
+              << GetTransferSyntaxUid(ingestTransferSyntax_) << ": " << dicom.size()
+              << " bytes => " << size << " bytes";
+  }
+
+
   void ServerContext::SaveJobsThread(ServerContext* that,
                                      unsigned int sleepDelay)
   {
@@ -290,6 +778,7 @@ namespace Orthanc
                                size_t maxCompletedJobs) :
     index_(*this, database, (unitTesting ? 20 : 500)),
     area_(area),
+    uploadThreadsCount_(0),
     compressionEnabled_(false),
     storeMD5_(true),
     largeDicomThrottler_(1),
@@ -312,12 +801,19 @@ namespace Orthanc
     isIngestTranscoding_(false),
     ingestTranscodingOfUncompressed_(true),
     ingestTranscodingOfCompressed_(true),
+    isIngestTranscodingDeferred_(false),
+    deferredTranscodingBacklog_(0),
+    pendingTranscodingCount_(0),
+    changesGeneration_(0),
+    isWaitForChangesInterrupted_(false),
     preferredTransferSyntax_(DicomTransferSyntax_LittleEndianExplicit),
+    slowStoreThreshold_(0),
     deidentifyLogs_(false)
   {
     try
     {
       unsigned int lossyQuality;
+      unsigned int transcodingThreadsCount;
 
       {
         OrthancConfiguration::ReaderLock lock;
@@ -344,6 +840,12 @@ namespace Orthanc
         builtinDecoderTranscoderOrder_ = StringToBuiltinDecoderTranscoderOrder(lock.GetConfiguration().GetStringParameter("BuiltinDecoderTranscoderOrder", "After"));
         lossyQuality = lock.GetConfiguration().GetUnsignedIntegerParameter("DicomLossyTranscodingQuality", 90);
 
+        // New options in Orthanc 1.11.3
+        transcodingThreadsCount = lock.GetConfiguration().GetUnsignedIntegerParameter("TranscodingThreadsCount", 4);
+        slowStoreThreshold_ = lock.GetConfiguration().GetUnsignedIntegerParameter("SlowStoreThreshold", 0);
+        uploadThreadsCount_ = lock.GetConfiguration().GetUnsignedIntegerParameter("UploadThreadsCount", 4);
+        frameOffsetTables_.SetMaximumSize(FRAME_OFFSET_TABLES_CACHE_SIZE);
+
         std::string s;
         if (lock.GetConfiguration().LookupStringParameter(s, "IngestTranscoding"))
         {
@@ -364,6 +866,15 @@ namespace Orthanc
             LOG(WARNING) << "  Ingest transcoding will "
                          << (ingestTranscodingOfCompressed_ ? "be applied" : "*not* be applied")
                          << " to compressed transfer syntaxes";
+
+            // New option in Orthanc 1.11.3
+            isIngestTranscodingDeferred_ = lock.GetConfiguration().GetBooleanParameter("IngestTranscodingDeferred", false);
+
+            if (isIngestTranscodingDeferred_)
+            {
+              CheckDeferredIngestTranscoding(ingestTransferSyntax_);
+              LOG(WARNING) << "  Ingest transcoding is deferred to a background thread";
+            }
           }
           else
           {
@@ -416,8 +927,14 @@ namespace Orthanc
 
       listeners_.push_back(ServerListener(luaListener_, "Lua"));
       changeThread_ = boost::thread(ChangeThread, this, (unitTesting ? 20 : 100));
+
+      if (isIngestTranscodingDeferred_)
+      {
+        deferredTranscodingThread_ = boost::thread(DeferredTranscodingThread, this, (unitTesting ? 20 : 100));
+      }
     
       dynamic_cast<DcmtkTranscoder&>(*dcmtkTranscoder_).SetLossyQuality(lossyQuality);
+      dynamic_cast<DcmtkTranscoder&>(*dcmtkTranscoder_).SetThreadsCount(transcodingThreadsCount);
     }
     catch (OrthancException&)
     {
@@ -449,6 +966,8 @@ namespace Orthanc
 
       done_ = true;
 
+      InterruptWaitForChanges();
+
       if (changeThread_.joinable())
       {
         changeThread_.join();
@@ -459,6 +978,24 @@ namespace Orthanc
         saveJobsThread_.join();
       }
 
+      if (deferredTranscodingThread_.joinable())
+      {
+        deferredTranscodingThread_.join();
+
+        if (deferredTranscodingQueue_.GetSize() > 0)
+        {
+          LOG(WARNING) << "Stopping while " << deferredTranscodingQueue_.GetSize()
+                       << " instance(s) are still waiting for the deferred ingest transcoding, "
+                       << "which will be resumed at the next startup";
+        }
+      }
+
+      {
+        // The files that are waiting for an upload worker are dropped
+        boost::mutex::scoped_lock lock(uploadWorkersMutex_);
+        uploadWorkers_.reset(NULL);
+      }
+
       jobsEngine_.GetRegistry().ResetObserver();
 
       if (isJobsEngineUnserialized_)
@@ -474,6 +1011,29 @@ namespace Orthanc
   }
 
 
+  UploadWorkersPool& ServerContext::GetUploadWorkersPool()
+  {
+    boost::mutex::scoped_lock lock(uploadWorkersMutex_);
+
+    if (done_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls, "Orthanc is stopping");
+    }
+
+    if (uploadWorkers_.get() == NULL)
+    {
+      if (uploadThreadsCount_ == 0)
+      {
+        throw OrthancException(ErrorCode_BadSequenceOfCalls, "Streamed uploads are disabled");
+      }
+
+      uploadWorkers_.reset(new UploadWorkersPool(uploadThreadsCount_));
+    }
+
+    return *uploadWorkers_;
+  }
+
+
   void ServerContext::SetCompressionEnabled(bool enabled)
   {
     if (enabled)
@@ -485,6 +1045,27 @@ namespace Orthanc
   }
 
 
+  void ServerContext::SetIngestTranscoding(DicomTransferSyntax syntax,
+                                           bool deferred)
+  {
+    if (deferred)
+    {
+      CheckDeferredIngestTranscoding(syntax);
+    }
+
+    isIngestTranscoding_ = true;
+    ingestTransferSyntax_ = syntax;
+    isIngestTranscodingDeferred_ = deferred;
+
+    if (deferred &&
+        !done_ &&
+        !deferredTranscodingThread_.joinable())
+    {
+      deferredTranscodingThread_ = boost::thread(DeferredTranscodingThread, this, 100);
+    }
+  }
+
+
   void ServerContext::RemoveFile(const std::string& fileUuid,
                                  FileContentType type)
   {
@@ -496,7 +1077,8 @@ namespace Orthanc
   ServerContext::StoreResult ServerContext::StoreAfterTranscoding(std::string& resultPublicId,
                                                                   DicomInstanceToStore& dicom,
                                                                   StoreInstanceMode mode,
-                                                                  bool isReconstruct)
+                                                                  bool isReconstruct,
+                                                                  IngestTimer& timer)
   {
     bool overwrite;
     switch (mode)
@@ -517,6 +1099,8 @@ namespace Orthanc
         throw OrthancException(ErrorCode_ParameterOutOfRange);
     }
 
+    timer.StartStage("parse");
+
     bool hasPixelDataOffset;
     uint64_t pixelDataOffset;
     hasPixelDataOffset = DicomStreamReader::LookupPixelDataOffset(
@@ -532,11 +1116,12 @@ namespace Orthanc
 
     try
     {
-      MetricsRegistry::Timer timer(GetMetricsRegistry(), "orthanc_store_dicom_duration_ms");
+      MetricsRegistry::Timer storeTimer(GetMetricsRegistry(), "orthanc_store_dicom_duration_ms");
       StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
 
       DicomInstanceHasher hasher(summary);
       resultPublicId = hasher.HashInstance();
+      timer.SetInstanceId(resultPublicId);
 
       Json::Value dicomAsJson;
       dicom.GetDicomAsJson(dicomAsJson, allMainDicomTags);  // don't crop any main dicom tags
@@ -544,11 +1129,14 @@ namespace Orthanc
       Json::Value simplifiedTags;
       Toolbox::SimplifyDicomAsJson(simplifiedTags, dicomAsJson, DicomToJsonFormat_Human);
 
+      timer.EndStage();
+
       // Test if the instance must be filtered out
       StoreResult result;
 
       if (!isReconstruct) // skip all filters if this is a reconstruction
       {
+        timer.StartStage("filter");
         boost::shared_lock<boost::shared_mutex> lock(listenersMutex_);
 
         for (ServerListeners::iterator it = listeners_.begin(); it != listeners_.end(); ++it)
@@ -585,6 +1173,8 @@ namespace Orthanc
         }
       }
 
+      timer.EndStage();
+
       if (result.GetStatus() == StoreStatus_FilteredOut)
       {
         LOG(INFO) << "An incoming instance has been discarded by the filter";
@@ -599,6 +1189,8 @@ namespace Orthanc
       // TODO Should we use "gzip" instead?
       CompressionType compression = (compressionEnabled_ ? CompressionType_ZlibWithSize : CompressionType_None);
 
+      timer.StartStage("write");
+
       FileInfo dicomInfo = accessor.Write(dicom.GetBufferData(), dicom.GetBufferSize(), 
                                           FileContentType_Dicom, compression, storeMD5_);
 
@@ -615,11 +1207,34 @@ namespace Orthanc
         attachments.push_back(dicomUntilPixelData);
       }
 
+      FileInfo frameOffsetTable;
+      if (hasTransferSyntax &&
+          area_.HasReadRange() &&
+          !compressionEnabled_ &&
+          DicomFrameOffsetTable::IsEncapsulatedTransferSyntax(transferSyntax))
+      {
+        // New in Orthanc 1.11.3: Index the frames of the compressed
+        // pixel data, for fast access to the raw frames
+        DicomFrameOffsetTable table;
+        if (table.Parse(dicom.GetBufferData(), dicom.GetBufferSize()))
+        {
+          table.SetSourceUuid(dicomInfo.GetUuid());
+
+          std::string serialized;
+          table.Serialize(serialized);
+          frameOffsetTable = accessor.Write(serialized, FileContentType_DicomFrameOffsetTable, compression, storeMD5_);
+          attachments.push_back(frameOffsetTable);
+        }
+      }
+
       typedef std::map<MetadataType, std::string>  InstanceMetadata;
       InstanceMetadata  instanceMetadata;
+
+      timer.StartStage("index");
       result.SetStatus(index_.Store(
         instanceMetadata, summary, attachments, dicom.GetMetadata(), dicom.GetOrigin(), overwrite,
         hasTransferSyntax, transferSyntax, hasPixelDataOffset, pixelDataOffset, isReconstruct));
+      timer.EndStage();
 
       // Only keep the metadata for the "instance" level
       dicom.ClearMetadata();
@@ -638,6 +1253,11 @@ namespace Orthanc
         {
           accessor.Remove(dicomUntilPixelData);
         }
+
+        if (frameOffsetTable.IsValid())
+        {
+          accessor.Remove(frameOffsetTable);
+        }
       }
 
       if (!isReconstruct) 
@@ -666,6 +1286,7 @@ namespace Orthanc
         if (result.GetStatus() == StoreStatus_Success ||
             result.GetStatus() == StoreStatus_AlreadyStored)
         {
+          timer.StartStage("stored_callbacks");
           boost::shared_lock<boost::shared_mutex> lock(listenersMutex_);
 
           for (ServerListeners::iterator it = listeners_.begin(); it != listeners_.end(); ++it)
@@ -681,6 +1302,8 @@ namespace Orthanc
                         << " (code " << e.GetErrorCode() << ")";
             }
           }
+
+          timer.EndStage();
         }
       }
 
@@ -704,6 +1327,8 @@ namespace Orthanc
   { 
     DicomInstanceToStore* dicom = &receivedDicom;
 
+    IngestTimer timer(GetMetricsRegistry(), slowStoreThreshold_);
+
     // WARNING: The scope of "modifiedBuffer" and "modifiedDicom" must
     // be the same as that of "dicom"
     MallocMemoryBuffer modifiedBuffer;
@@ -714,8 +1339,10 @@ namespace Orthanc
     {
       // New in Orthanc 1.10.0
 
+      timer.StartStage("received_callbacks");
       OrthancPluginReceivedInstanceAction action = GetPlugins().ApplyReceivedInstanceCallbacks(
         modifiedBuffer, receivedDicom.GetBufferData(), receivedDicom.GetBufferSize(), receivedDicom.GetOrigin().GetRequestOrigin());
+      timer.EndStage();
 
       switch (action)
       {
@@ -752,19 +1379,31 @@ namespace Orthanc
     }
 #endif
 
-    return TranscodeAndStore(resultPublicId, dicom, mode);
+    return TranscodeAndStore(resultPublicId, dicom, mode, false /* not a reconstruction */, timer);
   }
 
+
   ServerContext::StoreResult ServerContext::TranscodeAndStore(std::string& resultPublicId,
                                                               DicomInstanceToStore* dicom,
                                                               StoreInstanceMode mode,
                                                               bool isReconstruct)
   {
+    IngestTimer timer(GetMetricsRegistry(), slowStoreThreshold_);
+    return TranscodeAndStore(resultPublicId, dicom, mode, isReconstruct, timer);
+  }
+
+
+  ServerContext::StoreResult ServerContext::TranscodeAndStore(std::string& resultPublicId,
+                                                              DicomInstanceToStore* dicom,
+                                                              StoreInstanceMode mode,
+                                                              bool isReconstruct,
+                                                              IngestTimer& timer)
+  {
 
     if (!isIngestTranscoding_)
     {
       // No automated transcoding. This was the only path in Orthanc <= 1.6.1.
-      return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct);
+      return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, timer);
     }
     else
     {
@@ -800,7 +1439,43 @@ namespace Orthanc
       if (!transcode)
       {
         // No transcoding
-        return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct);
+        return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, timer);
+      }
+      else if (isIngestTranscodingDeferred_ &&
+               !isReconstruct)
+      {
+        /**
+         * Store the original file, and transcode it later in the
+         * background thread (new in Orthanc 1.11.3). The
+         * "PendingTranscoding" metadata is stored in the same
+         * transaction as the instance, which allows to resume the
+         * transcoding if Orthanc is stopped before the queue is empty.
+         **/
+        dicom->AddMetadata(ResourceType_Instance, MetadataType_Instance_PendingTranscoding, "1");
+        AddPendingTranscoding();
+
+        StoreResult result;
+
+        try
+        {
+          result = StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, timer);
+        }
+        catch (OrthancException&)
+        {
+          RemovePendingTranscoding();
+          throw;
+        }
+
+        if (result.GetStatus() == StoreStatus_Success)
+        {
+          EnqueueDeferredTranscoding(resultPublicId, dicom->GetBufferSize());
+        }
+        else
+        {
+          RemovePendingTranscoding();
+        }
+
+        return result;
       }
       else
       {
@@ -811,6 +1486,8 @@ namespace Orthanc
         IDicomTranscoder::DicomImage source;
         source.SetExternalBuffer(dicom->GetBufferData(), dicom->GetBufferSize());
         
+        timer.StartStage("transcode");
+
         IDicomTranscoder::DicomImage transcoded;
         if (Transcode(transcoded, source, syntaxes, true /* allow new SOP instance UID */))
         {
@@ -818,13 +1495,14 @@ namespace Orthanc
 
           std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(*tmp));
           toStore->SetOrigin(dicom->GetOrigin());
+          timer.EndStage();
 
           if (isReconstruct) // the initial instance to store already has its own metadata
           {
             toStore->CopyMetadata(dicom->GetMetadata());
           }
 
-          StoreResult result = StoreAfterTranscoding(resultPublicId, *toStore, mode, isReconstruct);
+          StoreResult result = StoreAfterTranscoding(resultPublicId, *toStore, mode, isReconstruct, timer);
           assert(resultPublicId == tmp->GetHasher().HashInstance());
 
           return result;
@@ -832,7 +1510,7 @@ namespace Orthanc
         else
         {
           // Cannot transcode => store the original file
-          return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct);
+          return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, timer);
         }
       }
     }
@@ -1081,71 +1759,285 @@ namespace Orthanc
   }
 
 
-  void ServerContext::ReadDicomAsJson(Json::Value& result,
-                                      const std::string& instancePublicId)
+  void ServerContext::ReadDicomAsJson(Json::Value& result,
+                                      const std::string& instancePublicId)
+  {
+    std::set<DicomTag> ignoreTagLength;
+    ReadDicomAsJson(result, instancePublicId, ignoreTagLength);
+  }
+
+
+  void ServerContext::ReadDicom(std::string& dicom,
+                                const std::string& instancePublicId)
+  {
+    int64_t revision;
+    ReadAttachment(dicom, revision, instancePublicId, FileContentType_Dicom, true /* uncompress */);
+  }
+
+  void ServerContext::ReadDicomForHeader(std::string& dicom,
+                                         const std::string& instancePublicId)
+  {
+    if (!ReadDicomUntilPixelData(dicom, instancePublicId))
+    {
+      ReadDicom(dicom, instancePublicId);
+    }
+  }
+
+  bool ServerContext::ReadDicomUntilPixelData(std::string& dicom,
+                                              const std::string& instancePublicId)
+  {
+    if (!area_.HasReadRange())
+    {
+      return false;
+    }
+    
+    FileInfo attachment;
+    int64_t revision;  // Ignored
+    if (!index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom))
+    {
+      throw OrthancException(ErrorCode_InternalError,
+                             "Unable to read the DICOM file of instance " + instancePublicId);
+    }
+
+    std::string s;
+
+    if (attachment.GetCompressionType() == CompressionType_None &&
+        index_.LookupMetadata(s, revision, instancePublicId, ResourceType_Instance,
+                              MetadataType_Instance_PixelDataOffset) &&
+        !s.empty())
+    {
+      try
+      {
+        uint64_t pixelDataOffset = boost::lexical_cast<uint64_t>(s);
+
+        StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
+
+        accessor.ReadStartRange(dicom, attachment.GetUuid(), attachment.GetContentType(), pixelDataOffset);
+        assert(dicom.size() == pixelDataOffset);
+        
+        return true;   // Success
+      }
+      catch (boost::bad_lexical_cast&)
+      {
+        LOG(ERROR) << "Metadata \"PixelDataOffset\" is corrupted for instance: " << instancePublicId;
+      }
+    }
+
+    return false;
+  }
+
+
+  bool ServerContext::ReadRawFrame(std::string& target,
+                                   MimeType& mime,
+                                   const std::string& instancePublicId,
+                                   unsigned int frameIndex)
+  {
+    /**
+     * Fast path to extract a raw frame from an encapsulated pixel
+     * data, using one range read in the storage area instead of
+     * parsing the full DICOM file with DCMTK. This is only possible
+     * if the DICOM file is stored uncompressed. Returns "false" if
+     * the caller must fallback to "ParsedDicomFile::GetRawFrame()".
+     **/
+
+    FileInfo dicomAttachment;
+    if (!LookupDicomForFrameOffsetTable(dicomAttachment, instancePublicId))
+    {
+      return false;
+    }
+
+    DicomFrameOffsetTable table;
+    std::string dicom;
+    if (!LookupFrameOffsetTable(table, dicom, dicomAttachment, instancePublicId))
+    {
+      return false;
+    }
+
+    if (frameIndex >= table.GetFramesCount())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    if (dicom.empty())
+    {
+      uint64_t start, end;
+      table.GetFrameRange(start, end, frameIndex);
+
+      std::string range;
+      StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
+      accessor.ReadRange(range, dicomAttachment.GetUuid(), FileContentType_Dicom, start, end);
+
+      table.ExtractFrame(target, frameIndex, range.empty() ? NULL : range.c_str(), range.size(), start);
+    }
+    else
+    {
+      // The full DICOM file was just read to compute the table
+      table.ExtractFrame(target, frameIndex, dicom.c_str(), dicom.size(), 0);
+    }
+
+    mime = table.GetFrameMimeType();
+    return true;
+  }
+
+
+  bool ServerContext::LookupDicomForFrameOffsetTable(FileInfo& dicomAttachment,
+                                                     const std::string& instancePublicId)
+  {
+    // Range reads are impossible if "StorageCompression" is enabled
+    int64_t revision;  // Ignored
+    return (area_.HasReadRange() &&
+            index_.LookupAttachment(dicomAttachment, revision, instancePublicId, FileContentType_Dicom) &&
+            dicomAttachment.GetCompressionType() == CompressionType_None);
+  }
+
+
+  bool ServerContext::ComputeFrameOffsetTable(DicomFrameOffsetTable& table,
+                                              std::string& dicom,
+                                              const FileInfo& dicomAttachment,
+                                              const std::string& instancePublicId)
+  {
+    /**
+     * Only try to compute the table if the pixel data is known to be
+     * encapsulated, as this requires reading the full DICOM file.
+     **/
+
+    std::string s;
+    int64_t revision;  // Ignored
+    DicomTransferSyntax transferSyntax;
+    if (!index_.LookupMetadata(s, revision, instancePublicId, ResourceType_Instance,
+                               MetadataType_Instance_TransferSyntax) ||
+        !LookupTransferSyntax(transferSyntax, s) ||
+        !DicomFrameOffsetTable::IsEncapsulatedTransferSyntax(transferSyntax))
+    {
+      return false;
+    }
+
+    {
+      StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
+      accessor.Read(dicom, dicomAttachment);
+    }
+
+    if (table.Parse(dicom))
+    {
+      table.SetSourceUuid(dicomAttachment.GetUuid());
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  bool ServerContext::LookupFrameOffsetTable(DicomFrameOffsetTable& table,
+                                             std::string& dicom,
+                                             const FileInfo& dicomAttachment,
+                                             const std::string& instancePublicId)
   {
-    std::set<DicomTag> ignoreTagLength;
-    ReadDicomAsJson(result, instancePublicId, ignoreTagLength);
-  }
+    /**
+     * The table is only valid for the DICOM file it was computed
+     * from, which is identified by the UUID of its attachment: A new
+     * DICOM file (e.g. after transcoding) always gets a new UUID.
+     * "dicom" is only filled if the full DICOM file had to be read.
+     **/
 
+    dicom.clear();
 
-  void ServerContext::ReadDicom(std::string& dicom,
-                                const std::string& instancePublicId)
-  {
-    int64_t revision;
-    ReadAttachment(dicom, revision, instancePublicId, FileContentType_Dicom, true /* uncompress */);
-  }
+    FileInfo tableAttachment;
+    int64_t revision;  // Ignored
+    if (index_.LookupAttachment(tableAttachment, revision, instancePublicId, FileContentType_DicomFrameOffsetTable))
+    {
+      std::string serialized;
 
-  void ServerContext::ReadDicomForHeader(std::string& dicom,
-                                         const std::string& instancePublicId)
-  {
-    if (!ReadDicomUntilPixelData(dicom, instancePublicId))
+      {
+        StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
+        accessor.Read(serialized, tableAttachment);
+      }
+
+      bool valid;
+
+      try
+      {
+        table.Unserialize(serialized);
+        valid = (table.GetSourceUuid() == dicomAttachment.GetUuid() &&
+                 table.GetFileSize() == dicomAttachment.GetUncompressedSize());
+      }
+      catch (OrthancException&)
+      {
+        valid = false;
+      }
+
+      if (valid)
+      {
+        return true;
+      }
+      else
+      {
+        LOG(WARNING) << "The frame offset table is outdated for instance " << instancePublicId
+                     << ", call \"/instances/" << instancePublicId << "/reconstruct\" to update it";
+      }
+    }
+
+    /**
+     * The table was never stored for this DICOM file, which indicates
+     * that the instance was created using Orthanc <= 1.11.2. The table
+     * is computed and kept in memory, but is not written to the
+     * database, as this is a GET request: It will be stored by the
+     * next reconstruction of the instance. An empty string in the
+     * cache indicates that no table can be computed for this file.
+     **/
+
+    std::string cached;
+    if (frameOffsetTables_.Fetch(cached, dicomAttachment.GetUuid()))
     {
-      ReadDicom(dicom, instancePublicId);
+      if (cached.empty())
+      {
+        return false;
+      }
+      else
+      {
+        table.Unserialize(cached);
+        return true;
+      }
     }
-  }
 
-  bool ServerContext::ReadDicomUntilPixelData(std::string& dicom,
-                                              const std::string& instancePublicId)
-  {
-    if (!area_.HasReadRange())
+    if (ComputeFrameOffsetTable(table, dicom, dicomAttachment, instancePublicId))
     {
-      return false;
+      std::string serialized;
+      table.Serialize(serialized);
+      frameOffsetTables_.Add(dicomAttachment.GetUuid(), serialized);
+      return true;
     }
-    
-    FileInfo attachment;
-    int64_t revision;  // Ignored
-    if (!index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom))
+    else
     {
-      throw OrthancException(ErrorCode_InternalError,
-                             "Unable to read the DICOM file of instance " + instancePublicId);
+      dicom.clear();
+      frameOffsetTables_.Add(dicomAttachment.GetUuid(), "");
+      return false;
     }
+  }
 
-    std::string s;
 
-    if (attachment.GetCompressionType() == CompressionType_None &&
-        index_.LookupMetadata(s, revision, instancePublicId, ResourceType_Instance,
-                              MetadataType_Instance_PixelDataOffset) &&
-        !s.empty())
+  void ServerContext::ReconstructFrameOffsetTable(const std::string& instancePublicId)
+  {
+    index_.DeleteAttachment(instancePublicId, FileContentType_DicomFrameOffsetTable,
+                            false /* no revision */, -1 /* dummy revision */, "" /* dummy MD5 */);
+
+    FileInfo dicomAttachment;
+    if (LookupDicomForFrameOffsetTable(dicomAttachment, instancePublicId))
     {
-      try
+      DicomFrameOffsetTable table;
+      std::string dicom;
+      if (ComputeFrameOffsetTable(table, dicom, dicomAttachment, instancePublicId))
       {
-        uint64_t pixelDataOffset = boost::lexical_cast<uint64_t>(s);
-
-        StorageAccessor accessor(area_, &storageCache_, GetMetricsRegistry());
+        std::string serialized;
+        table.Serialize(serialized);
 
-        accessor.ReadStartRange(dicom, attachment.GetUuid(), attachment.GetContentType(), pixelDataOffset);
-        assert(dicom.size() == pixelDataOffset);
-        
-        return true;   // Success
-      }
-      catch (boost::bad_lexical_cast&)
-      {
-        LOG(ERROR) << "Metadata \"PixelDataOffset\" is corrupted for instance: " << instancePublicId;
+        int64_t newRevision;
+        AddAttachment(newRevision, instancePublicId, FileContentType_DicomFrameOffsetTable,
+                      serialized.c_str(), serialized.size(),
+                      false /* no old revision */, -1 /* dummy revision */, "" /* dummy MD5 */);
       }
     }
-
-    return false;
   }
   
 
@@ -1325,6 +2217,130 @@ namespace Orthanc
     }
     
     pendingChanges_.Enqueue(change.Clone());
+
+    {
+      boost::mutex::scoped_lock lock(changesMutex_);
+      changesGeneration_++;
+    }
+
+    changesCondition_.notify_all();
+  }
+
+
+  static bool GetCompressedCacheKey(std::string& target,
+                                    HttpCompression& compression,
+                                    const RestApiOutput& output,
+                                    const std::string& key)
+  {
+    if (output.IsConvertJsonToXml())
+    {
+      return false;
+    }
+
+    compression = output.GetLowLevelOutput().GetPreferredCompression(0);
+
+    switch (compression)
+    {
+      case HttpCompression_Gzip:
+        target = key + "|gzip";
+        return true;
+
+      case HttpCompression_Deflate:
+        target = key + "|deflate";
+        return true;
+
+      default:
+        return false;
+    }
+  }
+
+
+  bool ServerContext::AnswerFromCompressedCache(RestApiOutput& output,
+                                                const std::string& key)
+  {
+    std::string cacheKey, compressed;
+    HttpCompression compression;
+
+    if (GetCompressedCacheKey(cacheKey, compression, output, key) &&
+        compressedAnswersCache_.Fetch(compressed, cacheKey))
+    {
+      output.AnswerPrecompressedBuffer(compressed, compression, MIME_JSON_UTF8);
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  void ServerContext::AnswerJsonWithCompressedCache(RestApiOutput& output,
+                                                    const std::string& key,
+                                                    const Json::Value& value)
+  {
+    std::string cacheKey;
+    HttpCompression compression;
+
+    if (GetCompressedCacheKey(cacheKey, compression, output, key) &&
+        compressedAnswersCache_.GetMaximumSize() > 0)
+    {
+      std::string json, compressed;
+      Toolbox::WriteStyledJson(json, value);
+      HttpOutput::Compress(compressed, json.empty() ? NULL : json.c_str(), json.size(), compression);
+
+      compressedAnswersCache_.Add(cacheKey, compressed);
+      output.AnswerPrecompressedBuffer(compressed, compression, MIME_JSON_UTF8);
+    }
+    else
+    {
+      output.AnswerJson(value);
+    }
+  }
+
+
+  uint64_t ServerContext::GetChangesGeneration()
+  {
+    boost::mutex::scoped_lock lock(changesMutex_);
+    return changesGeneration_;
+  }
+
+
+  bool ServerContext::WaitForChanges(uint64_t generation,
+                                     unsigned int timeoutMilliseconds)
+  {
+    const boost::system_time deadline = (boost::get_system_time() +
+                                         boost::posix_time::milliseconds(timeoutMilliseconds));
+
+    boost::mutex::scoped_lock lock(changesMutex_);
+
+    while (changesGeneration_ == generation &&
+           !isWaitForChangesInterrupted_)
+    {
+      if (!changesCondition_.timed_wait(lock, deadline))
+      {
+        break;  // Timeout
+      }
+    }
+
+    return (changesGeneration_ != generation);
+  }
+
+
+  void ServerContext::InterruptWaitForChanges()
+  {
+    {
+      boost::mutex::scoped_lock lock(changesMutex_);
+      isWaitForChangesInterrupted_ = true;
+    }
+
+    changesCondition_.notify_all();
+  }
+
+
+  bool ServerContext::IsWaitForChangesInterrupted()
+  {
+    boost::mutex::scoped_lock lock(changesMutex_);
+    return isWaitForChangesInterrupted_;
   }
 
 
@@ -1391,11 +2407,12 @@ namespace Orthanc
   }
 
 
-  void ServerContext::Apply(ILookupVisitor& visitor,
-                            const DatabaseLookup& lookup,
-                            ResourceType queryLevel,
-                            size_t since,
-                            size_t limit)
+  void ServerContext::ApplyInternal(ILookupVisitor& visitor,
+                                    const DatabaseLookup& lookup,
+                                    ResourceType queryLevel,
+                                    size_t since,
+                                    size_t limit,
+                                    int64_t* cursor)
   {    
     unsigned int databaseLimit = (queryLevel == ResourceType_Instance ?
                                   limitFindInstances_ : limitFindResults_);
@@ -1415,13 +2432,40 @@ namespace Orthanc
       fastLookup->RemoveConstraint(DICOM_TAG_MODALITIES_IN_STUDY);
     }
 
+    std::vector<int64_t> internalIds;
+    bool complete;
+
+    if (cursor == NULL)
     {
       const size_t lookupLimit = (databaseLimit == 0 ? 0 : databaseLimit + 1);      
       GetIndex().ApplyLookupResources(resources, &instances, *fastLookup, queryLevel, lookupLimit);
+
+      complete = (databaseLimit == 0 ||
+                  resources.size() <= databaseLimit);
     }
+    else
+    {
+      /**
+       * With keyset pagination, there is no need to read more than
+       * one page of candidates: If some candidates are discarded
+       * below, the page is simply shorter, and the next page will
+       * start after the last examined candidate. One more candidate
+       * is read to know whether other resources remain.
+       **/
+      size_t lookupLimit = (databaseLimit == 0 ? 0 : databaseLimit + 1);
+
+      if (limit != 0 &&
+          (lookupLimit == 0 || limit + 1 < lookupLimit))
+      {
+        lookupLimit = limit + 1;
+      }
+
+      GetIndex().ApplyLookupResources(resources, &instances, internalIds, *fastLookup, queryLevel, *cursor, lookupLimit);
+      assert(internalIds.size() == resources.size());
 
-    bool complete = (databaseLimit == 0 ||
-                     resources.size() <= databaseLimit);
+      complete = (lookupLimit == 0 ||
+                  resources.size() < lookupLimit);
+    }
 
     LOG(INFO) << "Number of candidate resources after fast DB filtering on main DICOM tags: " << resources.size();
 
@@ -1439,6 +2483,26 @@ namespace Orthanc
     
     for (size_t i = 0; i < instances.size(); i++)
     {
+      if (visitor.IsCancelled())
+      {
+        LOG(INFO) << "The lookup has been cancelled after " << countResults << " matching resources";
+        complete = false;
+        break;
+      }
+
+      if (cursor != NULL)
+      {
+        if (limit != 0 &&
+            countResults >= limit)
+        {
+          // The page is full, the next page will start at this candidate
+          complete = false;
+          break;
+        }
+
+        *cursor = internalIds[i];
+      }
+
       // Optimization in Orthanc 1.5.1 - Don't read the full JSON from
       // the disk if only "main DICOM tags" are to be returned
 
@@ -1574,6 +2638,26 @@ namespace Orthanc
     LOG(INFO) << "Number of matching resources: " << countResults;
   }
 
+
+  void ServerContext::Apply(ILookupVisitor& visitor,
+                            const DatabaseLookup& lookup,
+                            ResourceType queryLevel,
+                            size_t since,
+                            size_t limit)
+  {
+    ApplyInternal(visitor, lookup, queryLevel, since, limit, NULL);
+  }
+
+
+  void ServerContext::ApplyWithCursor(ILookupVisitor& visitor,
+                                      const DatabaseLookup& lookup,
+                                      ResourceType queryLevel,
+                                      int64_t& cursor,
+                                      size_t limit)
+  {
+    ApplyInternal(visitor, lookup, queryLevel, 0 /* since */, limit, &cursor);
+  }
+
   bool ServerContext::LookupOrReconstructMetadata(std::string& target,
                                                   const std::string& publicId,
                                                   ResourceType level,
@@ -2410,84 +3494,120 @@ namespace Orthanc
     if (expandFlags != ExpandResourceDbFlags_None
         && GetIndex().ExpandResource(resource, publicId, level, requestedTags, static_cast<ExpandResourceDbFlags>(expandFlags | ExpandResourceDbFlags_IncludeMetadata)))  // we always need the metadata to get the mainDicomTagsSignature
     {
-      // check the main dicom tags list has not changed since the resource was stored
-      if (resource.mainDicomTagsSignature_ != DicomMap::GetMainDicomTagsSignature(resource.type_))
+      CompleteExpandedResource(resource, publicId, instanceId, dicomAsJson, level, requestedTags, allowStorageAccess);
+    }
+    else
+    {
+      return false;
+    }
+
+    return true;
+  }
+
+
+  void ServerContext::CompleteExpandedResource(ExpandedResource& resource,
+                                               const std::string& publicId,
+                                               const std::string& instanceId,
+                                               const Json::Value* dicomAsJson,
+                                               ResourceType level,
+                                               const std::set<DicomTag>& requestedTags,
+                                               bool allowStorageAccess)
+  {
+    // check the main dicom tags list has not changed since the resource was stored
+    if (resource.mainDicomTagsSignature_ != DicomMap::GetMainDicomTagsSignature(resource.type_))
+    {
+      OrthancConfiguration::ReaderLock lock;
+      if (lock.GetConfiguration().IsWarningEnabled(Warnings_002_InconsistentDicomTagsInDb))
       {
-        OrthancConfiguration::ReaderLock lock;
-        if (lock.GetConfiguration().IsWarningEnabled(Warnings_002_InconsistentDicomTagsInDb))
-        {
-          LOG(WARNING) << "W002: " << Orthanc::GetResourceTypeText(resource.type_, false , false) << " has been stored with another version of Main Dicom Tags list, you should POST to /" << Orthanc::GetResourceTypeText(resource.type_, true, false) << "/" << resource.id_ << "/reconstruct to update the list of tags saved in DB.  Some MainDicomTags might be missing from this answer.";
-        }
+        LOG(WARNING) << "W002: " << Orthanc::GetResourceTypeText(resource.type_, false , false) << " has been stored with another version of Main Dicom Tags list, you should POST to /" << Orthanc::GetResourceTypeText(resource.type_, true, false) << "/" << resource.id_ << "/reconstruct to update the list of tags saved in DB.  Some MainDicomTags might be missing from this answer.";
       }
+    }
 
-      // possibly merge missing requested tags from dicom-as-json
-      if (allowStorageAccess
-          && !resource.missingRequestedTags_.empty() && !DicomMap::HasOnlyComputedTags(resource.missingRequestedTags_))
+    // possibly merge missing requested tags from dicom-as-json
+    if (allowStorageAccess
+        && !resource.missingRequestedTags_.empty() && !DicomMap::HasOnlyComputedTags(resource.missingRequestedTags_))
+    {
+      OrthancConfiguration::ReaderLock lock;
+      if (lock.GetConfiguration().IsWarningEnabled(Warnings_001_TagsBeingReadFromStorage))
       {
-        OrthancConfiguration::ReaderLock lock;
-        if (lock.GetConfiguration().IsWarningEnabled(Warnings_001_TagsBeingReadFromStorage))
+        std::set<DicomTag> missingTags;
+        Toolbox::AppendSets(missingTags, resource.missingRequestedTags_);
+        for (std::set<DicomTag>::const_iterator it = resource.missingRequestedTags_.begin(); it != resource.missingRequestedTags_.end(); ++it)
         {
-          std::set<DicomTag> missingTags;
-          Toolbox::AppendSets(missingTags, resource.missingRequestedTags_);
-          for (std::set<DicomTag>::const_iterator it = resource.missingRequestedTags_.begin(); it != resource.missingRequestedTags_.end(); ++it)
+          if (DicomMap::IsComputedTag(*it))
           {
-            if (DicomMap::IsComputedTag(*it))
-            {
-              missingTags.erase(*it);
-            }
+            missingTags.erase(*it);
           }
+        }
 
-          std::string missings;
-          FromDcmtkBridge::FormatListOfTags(missings, missingTags);
+        std::string missings;
+        FromDcmtkBridge::FormatListOfTags(missings, missingTags);
 
-          LOG(WARNING) << "W001: Accessing Dicom tags from storage when accessing " << Orthanc::GetResourceTypeText(resource.type_, false , false) << " : " << missings;
-        }
+        LOG(WARNING) << "W001: Accessing Dicom tags from storage when accessing " << Orthanc::GetResourceTypeText(resource.type_, false , false) << " : " << missings;
+      }
 
 
-        std::string instanceId_ = instanceId;
-        DicomMap tagsFromJson;
+      std::string instanceId_ = instanceId;
+      DicomMap tagsFromJson;
 
-        if (dicomAsJson == NULL)
+      if (dicomAsJson == NULL)
+      {
+        if (instanceId_.empty())
         {
-          if (instanceId_.empty())
+          if (level == ResourceType_Instance)
           {
-            if (level == ResourceType_Instance)
-            {
-              instanceId_ = publicId;
-            }
-            else
+            instanceId_ = publicId;
+          }
+          else
+          {
+            std::list<std::string> instancesIds;
+            GetIndex().GetChildInstances(instancesIds, publicId);
+            if (instancesIds.size() < 1)
             {
-              std::list<std::string> instancesIds;
-              GetIndex().GetChildInstances(instancesIds, publicId);
-              if (instancesIds.size() < 1)
-              {
-                throw OrthancException(ErrorCode_InternalError, "ExpandResource: no instances found");
-              }
-              instanceId_ = instancesIds.front();
+              throw OrthancException(ErrorCode_InternalError, "ExpandResource: no instances found");
             }
+            instanceId_ = instancesIds.front();
           }
-  
-          Json::Value tmpDicomAsJson;
-          ReadDicomAsJson(tmpDicomAsJson, instanceId_, resource.missingRequestedTags_ /* ignoreTagLength */);  // read all tags from DICOM and avoid cropping requested tags
-          tagsFromJson.FromDicomAsJson(tmpDicomAsJson, false /* append */, true /* parseSequences*/);
-        }
-        else
-        {
-          tagsFromJson.FromDicomAsJson(*dicomAsJson, false /* append */, true /* parseSequences*/);
         }
 
-        resource.tags_.Merge(tagsFromJson);
+        Json::Value tmpDicomAsJson;
+        ReadDicomAsJson(tmpDicomAsJson, instanceId_, resource.missingRequestedTags_ /* ignoreTagLength */);  // read all tags from DICOM and avoid cropping requested tags
+        tagsFromJson.FromDicomAsJson(tmpDicomAsJson, false /* append */, true /* parseSequences*/);
+      }
+      else
+      {
+        tagsFromJson.FromDicomAsJson(*dicomAsJson, false /* append */, true /* parseSequences*/);
       }
 
-      // compute the requested tags
-      ComputeTags(resource, *this, publicId, level, requestedTags);
-    }
-    else
-    {
-      return false;
+      resource.tags_.Merge(tagsFromJson);
     }
 
-    return true;
+    // compute the requested tags
+    ComputeTags(resource, *this, publicId, level, requestedTags);
   }
 
+
+  void ServerContext::ExpandResources(Json::Value& target,
+                                      const std::list<std::string>& publicIds,
+                                      ResourceType level,
+                                      DicomToJsonFormat format,
+                                      const std::set<DicomTag>& requestedTags,
+                                      bool allowStorageAccess)
+  {
+    // Read the database content of all the resources at once, instead of one transaction per resource
+    StatelessDatabaseOperations::ExpandedResources resources;
+    GetIndex().ExpandResources(resources, publicIds, level, requestedTags, ExpandResourceDbFlags_Default);
+
+    target = Json::objectValue;
+
+    for (StatelessDatabaseOperations::ExpandedResources::const_iterator
+           it = resources.begin(); it != resources.end(); ++it)
+    {
+      assert(it->second.get() != NULL);
+
+      CompleteExpandedResource(*it->second, it->first, "" /* no instance ID */, NULL /* no DICOM-as-JSON */,
+                               level, requestedTags, allowStorageAccess);
+      SerializeExpandedResource(target[it->first], *it->second, format, requestedTags);
+    }
+  }
 }
@@ -25,9 +25,12 @@
 #include "IServerListener.h"
 #include "LuaScripting.h"
 #include "OrthancHttpHandler.h"
+#include "QueryRetrieveCache.h"
 #include "ServerIndex.h"
 #include "ServerJobs/IStorageCommitmentFactory.h"
+#include "UploadWorkersPool.h"
 
+#include "../../OrthancFramework/Sources/Cache/MemoryStringCache.h"
 #include "../../OrthancFramework/Sources/DicomFormat/DicomElement.h"
 #include "../../OrthancFramework/Sources/DicomParsing/DicomModification.h"
 #include "../../OrthancFramework/Sources/DicomParsing/IDicomTranscoder.h"
@@ -38,6 +41,7 @@
 
 namespace Orthanc
 {
+  class DicomFrameOffsetTable;
   class DicomInstanceToStore;
   class IStorageArea;
   class JobsEngine;
@@ -81,6 +85,13 @@ namespace Orthanc
                          const std::string& instanceId,
                          const DicomMap& mainDicomTags,
                          const Json::Value* dicomAsJson) = 0;
+
+      // Return "true" to stop the lookup before all the candidates
+      // are examined (new in Orthanc 1.11.3)
+      virtual bool IsCancelled()
+      {
+        return false;
+      }
     };
     
     struct StoreResult
@@ -186,6 +197,22 @@ namespace Orthanc
     static void SaveJobsThread(ServerContext* that,
                                unsigned int sleepDelay);
 
+    static void DeferredTranscodingThread(ServerContext* that,
+                                          unsigned int sleepDelay);
+
+    void EnqueueDeferredTranscoding(const std::string& instancePublicId,
+                                    uint64_t size);
+
+    void UpdateDeferredTranscodingMetrics(int64_t backlogDelta);
+
+    void ApplyDeferredTranscoding(const std::string& instancePublicId);
+
+    void AddPendingTranscoding();
+
+    void RemovePendingTranscoding();
+
+    void EnqueuePendingTranscodings();
+
     void SaveJobsEngine();
 
     virtual void SignalJobSubmitted(const std::string& jobId) ORTHANC_OVERRIDE;
@@ -197,6 +224,13 @@ namespace Orthanc
     ServerIndex index_;
     IStorageArea& area_;
     StorageCache storageCache_;
+    MemoryStringCache compressedAnswersCache_;  // New in Orthanc 1.11.3
+    MemoryStringCache frameOffsetTables_;       // New in Orthanc 1.11.3
+    QueryRetrieveCache queryRetrieveCache_;     // New in Orthanc 1.11.3
+    std::string instancesCacheControl_;         // New in Orthanc 1.11.3
+    unsigned int uploadThreadsCount_;           // New in Orthanc 1.11.3
+    boost::mutex uploadWorkersMutex_;
+    std::unique_ptr<UploadWorkersPool> uploadWorkers_;
 
     bool compressionEnabled_;
     bool storeMD5_;
@@ -253,19 +287,74 @@ namespace Orthanc
     bool ingestTranscodingOfUncompressed_;
     bool ingestTranscodingOfCompressed_;
 
+    // New in Orthanc 1.11.3
+    bool isIngestTranscodingDeferred_;
+    SharedMessageQueue deferredTranscodingQueue_;
+    boost::thread deferredTranscodingThread_;
+    boost::mutex deferredTranscodingMutex_;
+    uint64_t deferredTranscodingBacklog_;  // Total size of the queued DICOM files
+    uint64_t pendingTranscodingCount_;     // Number of instances with the "PendingTranscoding" metadata
+
+    // New in Orthanc 1.11.3, for long-polling of the changes log
+    boost::mutex changesMutex_;
+    boost::condition_variable changesCondition_;
+    uint64_t changesGeneration_;
+    bool isWaitForChangesInterrupted_;
+
     // New in Orthanc 1.9.0
     DicomTransferSyntax preferredTransferSyntax_;
     boost::mutex dynamicOptionsMutex_;
     bool isUnknownSopClassAccepted_;
     std::set<DicomTransferSyntax>  acceptedTransferSyntaxes_;
 
+    // New in Orthanc 1.11.3, to time the stages of the ingestion
+    class IngestTimer;
+    unsigned int slowStoreThreshold_;  // In milliseconds, "0" means disabled
+
     StoreResult StoreAfterTranscoding(std::string& resultPublicId,
                                       DicomInstanceToStore& dicom,
                                       StoreInstanceMode mode,
-                                      bool isReconstruct);
+                                      bool isReconstruct,
+                                      IngestTimer& timer);
+
+    StoreResult TranscodeAndStore(std::string& resultPublicId,
+                                  DicomInstanceToStore* dicom,
+                                  StoreInstanceMode mode,
+                                  bool isReconstruct,
+                                  IngestTimer& timer);
 
     void PublishDicomCacheMetrics();
 
+    bool LookupDicomForFrameOffsetTable(FileInfo& dicomAttachment,
+                                        const std::string& instancePublicId);
+
+    bool ComputeFrameOffsetTable(DicomFrameOffsetTable& table,
+                                 std::string& dicom,
+                                 const FileInfo& dicomAttachment,
+                                 const std::string& instancePublicId);
+
+    bool LookupFrameOffsetTable(DicomFrameOffsetTable& table,
+                                std::string& dicom,
+                                const FileInfo& dicomAttachment,
+                                const std::string& instancePublicId);
+
+    // Part of "ExpandResource()" that runs after the database was read
+    void CompleteExpandedResource(ExpandedResource& resource,
+                                  const std::string& publicId,
+                                  const std::string& instanceId,
+                                  const Json::Value* dicomAsJson,
+                                  ResourceType level,
+                                  const std::set<DicomTag>& requestedTags,
+                                  bool allowStorageAccess);
+
+    // "cursor" is NULL if not using keyset pagination
+    void ApplyInternal(ILookupVisitor& visitor,
+                       const DatabaseLookup& lookup,
+                       ResourceType queryLevel,
+                       size_t since,
+                       size_t limit,
+                       int64_t* cursor);
+
     // This method must only be called from "ServerIndex"!
     void RemoveFile(const std::string& fileUuid,
                     FileContentType type);
@@ -316,8 +405,66 @@ namespace Orthanc
       return storageCache_.SetMaximumSize(size);
     }
 
+    void SetMaximumCompressedAnswersCacheSize(size_t size)
+    {
+      compressedAnswersCache_.SetMaximumSize(size);
+    }
+
+    // Cache of the answers to the C-FIND SCU queries (new in Orthanc 1.11.3)
+    QueryRetrieveCache& GetQueryRetrieveCache()
+    {
+      return queryRetrieveCache_;
+    }
+
+    /**
+     * Cache of the compressed HTTP answers of the REST API (new in
+     * Orthanc 1.11.3). This is only applicable to the answers that
+     * only depend on "key", which is typically the ETag of an
+     * immutable resource. "AnswerFromCompressedCache()" returns
+     * "false" if the answer is not cached, or if the HTTP client
+     * doesn't accept compression.
+     **/
+    bool AnswerFromCompressedCache(RestApiOutput& output,
+                                   const std::string& key);
+
+    void AnswerJsonWithCompressedCache(RestApiOutput& output,
+                                       const std::string& key,
+                                       const Json::Value& value);
+
+    // Value of the "Cache-Control" HTTP header for the routes of DICOM
+    // instances (new in Orthanc 1.11.3). Must be set before the REST
+    // API is started, as it is not protected by a mutex.
+    void SetInstancesCacheControl(const std::string& value)
+    {
+      instancesCacheControl_ = value;
+    }
+
+    const std::string& GetInstancesCacheControl() const
+    {
+      return instancesCacheControl_;
+    }
+
+    // Value of "UploadThreadsCount", "0" if the streamed uploads are
+    // disabled (new in Orthanc 1.11.3)
+    unsigned int GetUploadThreadsCount() const
+    {
+      return uploadThreadsCount_;
+    }
+
+    /**
+     * Pool of threads that is shared by all the streamed uploads of
+     * the REST API (new in Orthanc 1.11.3). It is created at the first
+     * upload, and throws an exception if "UploadThreadsCount" is zero.
+     **/
+    UploadWorkersPool& GetUploadWorkersPool();
+
     void SetCompressionEnabled(bool enabled);
 
+    // New in Orthanc 1.11.3. Must be invoked before receiving the
+    // first DICOM instance (this is notably used by unit tests).
+    void SetIngestTranscoding(DicomTransferSyntax syntax,
+                              bool deferred);
+
     bool IsCompressionEnabled() const
     {
       return compressionEnabled_;
@@ -365,6 +512,15 @@ namespace Orthanc
     bool ReadDicomUntilPixelData(std::string& dicom,
                                  const std::string& instancePublicId);
 
+    bool ReadRawFrame(std::string& target,
+                      MimeType& mime,
+                      const std::string& instancePublicId,
+                      unsigned int frameIndex);
+
+    // (Re)compute the "dicom-frame-offset-table" attachment of one
+    // instance, for instances stored by Orthanc <= 1.11.2
+    void ReconstructFrameOffsetTable(const std::string& instancePublicId);
+
     // This method is for low-level operations on "/instances/.../attachments/..."
     void ReadAttachment(std::string& result,
                         int64_t& revision,
@@ -391,6 +547,24 @@ namespace Orthanc
 
     void SignalChange(const ServerIndexChange& change);
 
+    /**
+     * Long-polling of the changes log (new in Orthanc 1.11.3). The
+     * generation is incremented each time "SignalChange()" is called,
+     * i.e. once the transaction that logged the change is committed.
+     * "WaitForChanges()" returns "true" iff the generation has been
+     * incremented since the provided value, before the timeout.
+     **/
+    uint64_t GetChangesGeneration();
+
+    bool WaitForChanges(uint64_t generation,
+                        unsigned int timeoutMilliseconds);
+
+    // Wake up all the threads that are waiting for changes, and make
+    // subsequent calls to "WaitForChanges()" return immediately
+    void InterruptWaitForChanges();
+
+    bool IsWaitForChangesInterrupted();
+
     SharedArchive& GetQueryRetrieveArchive()
     {
       return *queryRetrieveArchive_;
@@ -424,6 +598,19 @@ namespace Orthanc
                size_t since,
                size_t limit);
 
+    /**
+     * Keyset pagination (new in Orthanc 1.11.3): Only the resources
+     * after "cursor" are visited (0 to start from the beginning). On
+     * exit, "cursor" is updated to point after the last resource
+     * that was examined, and "visitor.MarkAsComplete()" is called if
+     * no resource remains after this page.
+     **/
+    void ApplyWithCursor(ILookupVisitor& visitor,
+                         const DatabaseLookup& lookup,
+                         ResourceType queryLevel,
+                         int64_t& cursor,
+                         size_t limit);
+
     bool LookupOrReconstructMetadata(std::string& target,
                                      const std::string& publicId,
                                      ResourceType level,
@@ -568,6 +755,19 @@ namespace Orthanc
                         ExpandResourceDbFlags expandFlags,
                         bool allowStorageAccess);
 
+    /**
+     * Expand a list of resources of the same level, reading the
+     * database in a single transaction. "target" is a JSON object
+     * that maps the public ID of each resource that still exists to
+     * its expanded JSON description.
+     **/
+    void ExpandResources(Json::Value& target,
+                         const std::list<std::string>& publicIds,
+                         ResourceType level,
+                         DicomToJsonFormat format,
+                         const std::set<DicomTag>& requestedTags,
+                         bool allowStorageAccess);
+
     FindStorageAccessMode GetFindStorageAccessMode() const
     {
       return findStorageAccessMode_;
@@ -62,10 +62,12 @@ namespace Orthanc
     dictMetadataType_.Add(MetadataType_Instance_PixelDataOffset, "PixelDataOffset");
     dictMetadataType_.Add(MetadataType_MainDicomTagsSignature, "MainDicomTagsSignature");
     dictMetadataType_.Add(MetadataType_MainDicomSequences, "MainDicomSequences");
+    dictMetadataType_.Add(MetadataType_Instance_PendingTranscoding, "PendingTranscoding");
 
     dictContentType_.Add(FileContentType_Dicom, "dicom");
     dictContentType_.Add(FileContentType_DicomAsJson, "dicom-as-json");
     dictContentType_.Add(FileContentType_DicomUntilPixelData, "dicom-until-pixel-data");
+    dictContentType_.Add(FileContentType_DicomFrameOffsetTable, "dicom-frame-offset-table");
   }
 
   void RegisterUserMetadata(int metadata,
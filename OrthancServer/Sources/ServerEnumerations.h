@@ -127,6 +127,7 @@ namespace Orthanc
     GlobalProperty_GetTotalSizeIsFast = 6,      // New in Orthanc 1.5.2
     GlobalProperty_Modalities = 20,             // New in Orthanc 1.5.0
     GlobalProperty_Peers = 21,                  // New in Orthanc 1.5.0
+    GlobalProperty_PendingTranscoding = 22,     // New in Orthanc 1.11.3
 
     // Reserved values for internal use by the database plugins
     GlobalProperty_DatabasePatchLevel = 4,
@@ -160,6 +161,7 @@ namespace Orthanc
     MetadataType_Instance_PixelDataOffset = 14,  // New in Orthanc 1.9.0
     MetadataType_MainDicomTagsSignature = 15,    // New in Orthanc 1.11.0
     MetadataType_MainDicomSequences = 16,        // New in Orthanc 1.11.1
+    MetadataType_Instance_PendingTranscoding = 17,  // New in Orthanc 1.11.3
     
     // Make sure that the value "65535" can be stored into this enumeration
     MetadataType_StartUser = 1024,
@@ -577,4 +577,27 @@ namespace Orthanc
       newRevision, attachment, publicId, maximumStorageSize, maximumPatients,
       hasOldRevision, oldRevision, oldMD5);
   }
+
+
+  bool ServerIndex::ReplaceDicomAttachment(const std::string& instancePublicId,
+                                           const Attachments& attachments,
+                                           DicomTransferSyntax transferSyntax,
+                                           bool hasPixelDataOffset,
+                                           uint64_t pixelDataOffset,
+                                           int64_t oldRevision,
+                                           const std::string& oldMD5)
+  {
+    uint64_t maximumStorageSize;
+    unsigned int maximumPatients;
+    
+    {
+      boost::mutex::scoped_lock lock(monitoringMutex_);
+      maximumStorageSize = maximumStorageSize_;
+      maximumPatients = maximumPatients_;
+    }
+
+    return StatelessDatabaseOperations::ReplaceDicomAttachment(
+      instancePublicId, attachments, transferSyntax, hasPixelDataOffset, pixelDataOffset,
+      oldRevision, oldMD5, maximumStorageSize, maximumPatients);
+  }
 }
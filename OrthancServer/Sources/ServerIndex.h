@@ -96,5 +96,13 @@ namespace Orthanc
                               bool hasOldRevision,
                               int64_t oldRevision,
                               const std::string& oldMD5);
+
+    bool ReplaceDicomAttachment(const std::string& instancePublicId,
+                                const Attachments& attachments,
+                                DicomTransferSyntax transferSyntax,
+                                bool hasPixelDataOffset,
+                                uint64_t pixelDataOffset,
+                                int64_t oldRevision,
+                                const std::string& oldMD5);
   };
 }
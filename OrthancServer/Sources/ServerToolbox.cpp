@@ -291,6 +291,12 @@ namespace Orthanc
 
           context.TranscodeAndStore(resultPublicId, dicomInstancetoStore.get(), StoreInstanceMode_OverwriteDuplicate, true);
         }
+        else
+        {
+          // The frame offset table is automatically computed while
+          // storing the files, otherwise backfill it (new in Orthanc 1.11.3)
+          context.ReconstructFrameOffsetTable(*it);
+        }
       }
     }
   }
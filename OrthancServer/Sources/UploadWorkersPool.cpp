@@ -0,0 +1,311 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "PrecompiledHeadersServer.h"
+#include "UploadWorkersPool.h"
+
+#include "../../OrthancFramework/Sources/Compatibility.h"
+#include "../../OrthancFramework/Sources/OrthancException.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+
+
+namespace Orthanc
+{
+  class UploadWorkersPool::Upload::State : public boost::noncopyable
+  {
+  private:
+    struct Result
+    {
+      bool         hasAnswer_;
+      Json::Value  answer_;
+      ErrorCode    error_;
+      std::string  details_;
+    };
+
+    typedef std::map<size_t, Result>  Results;
+
+    std::unique_ptr<IFileHandler>  handler_;
+    size_t                         maxPending_;
+    boost::mutex                   mutex_;
+    boost::condition_variable      pendingDecreased_;
+    boost::condition_variable      resultAvailable_;
+    size_t                         countSubmitted_;
+    size_t                         countPending_;
+    size_t                         nextResult_;
+    Results                        results_;
+    bool                           closed_;
+
+    void AddResult(size_t index,
+                   const Result& result)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      assert(countPending_ > 0);
+      countPending_--;
+      results_[index] = result;
+
+      pendingDecreased_.notify_all();
+      resultAvailable_.notify_one();
+    }
+
+  public:
+    State(IFileHandler* handler,
+          size_t maxPending) :
+      handler_(handler),
+      maxPending_(maxPending),
+      countSubmitted_(0),
+      countPending_(0),
+      nextResult_(0),
+      closed_(false)
+    {
+      if (handler == NULL)
+      {
+        throw OrthancException(ErrorCode_NullPointer);
+      }
+    }
+
+    IFileHandler& GetHandler()
+    {
+      return *handler_;
+    }
+
+    // Returns the index of the new file in the upload
+    size_t Reserve()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (closed_)
+      {
+        throw OrthancException(ErrorCode_BadSequenceOfCalls);
+      }
+
+      while (countPending_ >= maxPending_)
+      {
+        pendingDecreased_.wait(lock);
+      }
+
+      countPending_++;
+      return countSubmitted_++;
+    }
+
+    void SetAnswer(size_t index,
+                   bool hasAnswer,
+                   const Json::Value& answer)
+    {
+      Result result;
+      result.hasAnswer_ = hasAnswer;
+      result.answer_ = answer;
+      result.error_ = ErrorCode_Success;
+      AddResult(index, result);
+    }
+
+    void SetError(size_t index,
+                  ErrorCode error,
+                  const std::string& details)
+    {
+      Result result;
+      result.hasAnswer_ = false;
+      result.error_ = error;
+      result.details_ = details;
+      AddResult(index, result);
+    }
+
+    void Close()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      closed_ = true;
+      resultAvailable_.notify_all();
+    }
+
+    void WaitCompletion()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (countPending_ > 0)
+      {
+        pendingDecreased_.wait(lock);
+      }
+
+      for (Results::const_iterator it = results_.begin(); it != results_.end(); ++it)
+      {
+        if (it->second.error_ != ErrorCode_Success)
+        {
+          throw OrthancException(it->second.error_, it->second.details_);
+        }
+      }
+    }
+
+    bool ReadNextAnswer(Json::Value& answer)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      for (;;)
+      {
+        Results::iterator found = results_.find(nextResult_);
+
+        if (found != results_.end())
+        {
+          Result result = found->second;
+          results_.erase(found);
+          nextResult_++;
+
+          if (result.error_ != ErrorCode_Success)
+          {
+            throw OrthancException(result.error_, result.details_);
+          }
+          else if (result.hasAnswer_)
+          {
+            answer = result.answer_;
+            return true;
+          }
+        }
+        else if (closed_ &&
+                 nextResult_ == countSubmitted_)
+        {
+          return false;
+        }
+        else
+        {
+          resultAvailable_.wait(lock);
+        }
+      }
+    }
+  };
+
+
+  class UploadWorkersPool::Upload::StoreFileRunnable : public IRunnableBySteps
+  {
+  private:
+    boost::shared_ptr<State>  state_;
+    size_t                    index_;
+    std::string               filename_;
+    std::string               content_;
+    bool                      done_;
+
+  public:
+    StoreFileRunnable(const boost::shared_ptr<State>& state,
+                      size_t index,
+                      const std::string& filename,
+                      std::string& content) :
+      state_(state),
+      index_(index),
+      filename_(filename),
+      done_(false)
+    {
+      content_.swap(content);
+    }
+
+    virtual ~StoreFileRunnable()
+    {
+      if (!done_)
+      {
+        // The pool was stopped before this file could be stored
+        state_->SetError(index_, ErrorCode_InternalError, "Orthanc is stopping, cannot store: " + filename_);
+      }
+    }
+
+    virtual bool Step() ORTHANC_OVERRIDE
+    {
+      done_ = true;
+
+      try
+      {
+        Json::Value answer;
+        bool hasAnswer = state_->GetHandler().Store(answer, filename_, content_);
+        state_->SetAnswer(index_, hasAnswer, answer);
+      }
+      catch (OrthancException& e)
+      {
+        state_->SetError(index_, e.GetErrorCode(), (e.HasDetails() ? e.GetDetails() : ""));
+      }
+      catch (std::bad_alloc&)
+      {
+        state_->SetError(index_, ErrorCode_NotEnoughMemory, "Cannot store: " + filename_);
+      }
+      catch (std::exception& e)
+      {
+        state_->SetError(index_, ErrorCode_InternalError, e.what());
+      }
+      catch (...)
+      {
+        state_->SetError(index_, ErrorCode_InternalError, "Native exception while storing: " + filename_);
+      }
+
+      return false;  // Done with this file
+    }
+  };
+
+
+  UploadWorkersPool::Upload::Upload(UploadWorkersPool& pool,
+                                    IFileHandler* handler) :
+    pool_(pool),
+    state_(new State(handler, 2 * pool.GetThreadsCount()))
+  {
+  }
+
+
+  UploadWorkersPool::Upload::~Upload()
+  {
+    Close();
+  }
+
+
+  void UploadWorkersPool::Upload::Submit(const std::string& filename,
+                                         std::string& content)
+  {
+    size_t index = state_->Reserve();
+
+    std::unique_ptr<StoreFileRunnable> runnable(new StoreFileRunnable(state_, index, filename, content));
+    pool_.workers_.Add(runnable.get());
+    runnable.release();  // The pool has taken the ownership
+  }
+
+
+  void UploadWorkersPool::Upload::Close()
+  {
+    state_->Close();
+  }
+
+
+  void UploadWorkersPool::Upload::WaitCompletion()
+  {
+    state_->WaitCompletion();
+  }
+
+
+  bool UploadWorkersPool::Upload::ReadNextItem(std::string& key,
+                                               Json::Value& item)
+  {
+    return state_->ReadNextAnswer(item);
+  }
+
+
+  UploadWorkersPool::UploadWorkersPool(unsigned int threadsCount) :
+    threadsCount_(threadsCount),
+    workers_(threadsCount)
+  {
+  }
+}
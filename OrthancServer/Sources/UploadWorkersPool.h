@@ -0,0 +1,120 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../../OrthancFramework/Sources/HttpServer/JsonStreamAnswer.h"
+#include "../../OrthancFramework/Sources/MultiThreading/RunnableWorkersPool.h"
+
+#include <boost/shared_ptr.hpp>
+
+namespace Orthanc
+{
+  /**
+   * Server-wide pool of threads that store the DICOM files of the
+   * streamed uploads of the REST API (new in Orthanc 1.11.3). As all
+   * the uploads share the same threads, the number of files that are
+   * stored at once is bounded by "UploadThreadsCount", whatever the
+   * number of concurrent uploads.
+   **/
+  class UploadWorkersPool : public boost::noncopyable
+  {
+  public:
+    class IFileHandler : public boost::noncopyable
+    {
+    public:
+      virtual ~IFileHandler()
+      {
+      }
+
+      /**
+       * Stores one file of the upload. Returns "false" if the file
+       * must not be reported in the answer. This method is invoked
+       * concurrently by the workers.
+       **/
+      virtual bool Store(Json::Value& answer,
+                         const std::string& filename,
+                         const std::string& content) = 0;
+    };
+
+
+    /**
+     * One upload, whose files are stored by the workers of the pool.
+     * The number of files waiting for a worker is bounded: If the
+     * storage is slower than the network, "Submit()" blocks, which
+     * throttles the reading of the HTTP body instead of accumulating
+     * the files in RAM. The answers are read in the order of
+     * submission. If the upload is interrupted, the files that were
+     * already submitted are still stored.
+     **/
+    class Upload : public JsonStreamAnswer::IItemsSource
+    {
+    private:
+      class State;
+      class StoreFileRunnable;
+
+      UploadWorkersPool&        pool_;
+      boost::shared_ptr<State>  state_;
+
+    public:
+      Upload(UploadWorkersPool& pool,
+             IFileHandler* handler /* takes ownership */);
+
+      virtual ~Upload();
+
+      // The content of "content" is moved into the pool
+      void Submit(const std::string& filename,
+                  std::string& content);
+
+      void Close();
+
+      /**
+       * Blocks until all the submitted files have been stored. If the
+       * handler has thrown an exception for some file, the exception
+       * of the first such file in the order of submission is
+       * rethrown. The answers are still available for reading.
+       **/
+      void WaitCompletion();
+
+      /**
+       * Blocks until the answer for the next file is available. If
+       * the handler has thrown an exception for this file, the
+       * exception is rethrown.
+       **/
+      virtual bool ReadNextItem(std::string& key,
+                                Json::Value& item) ORTHANC_OVERRIDE;
+    };
+
+  private:
+    unsigned int         threadsCount_;
+    RunnableWorkersPool  workers_;
+
+  public:
+    explicit UploadWorkersPool(unsigned int threadsCount);
+
+    unsigned int GetThreadsCount() const
+    {
+      return threadsCount_;
+    }
+  };
+}
@@ -29,6 +29,7 @@
 #include "../../OrthancFramework/Sources/DicomNetworking/DicomServer.h"
 #include "../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../OrthancFramework/Sources/FileStorage/MemoryStorageArea.h"
+#include "../../OrthancFramework/Sources/FileStorage/TieredStorageArea.h"
 #include "../../OrthancFramework/Sources/HttpServer/FilesystemHttpHandler.h"
 #include "../../OrthancFramework/Sources/HttpServer/HttpServer.h"
 #include "../../OrthancFramework/Sources/Logging.h"
@@ -66,11 +67,23 @@ class OrthancStoreRequestHandler : public IStoreRequestHandler
 {
 private:
   ServerContext& context_;
+  bool           bitPreserving_;
 
 public:
   explicit OrthancStoreRequestHandler(ServerContext& context) :
-    context_(context)
+    context_(context),
+    bitPreserving_(false)
+  {
+  }
+
+  void SetBitPreserving(bool bitPreserving)
+  {
+    bitPreserving_ = bitPreserving;
+  }
+
+  virtual bool IsBitPreserving() const ORTHANC_OVERRIDE
   {
+    return bitPreserving_;
   }
 
 
@@ -93,6 +106,21 @@ public:
 
     return STATUS_STORE_Error_CannotUnderstand;
   }
+
+
+  virtual uint16_t HandleBuffer(const std::string& dicom,
+                                const std::string& remoteIp,
+                                const std::string& remoteAet,
+                                const std::string& calledAet) ORTHANC_OVERRIDE 
+  {
+    std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromBuffer(dicom));
+    toStore->SetOrigin(DicomInstanceOrigin::FromDicomProtocol
+                       (remoteIp.c_str(), remoteAet.c_str(), calledAet.c_str()));
+
+    std::string id;
+    ServerContext::StoreResult result = context_.Store(id, *toStore, StoreInstanceMode_Default);
+    return result.GetCStoreStatusCode();
+  }
 };
 
 
@@ -207,7 +235,14 @@ public:
 
   virtual IStoreRequestHandler* ConstructStoreRequestHandler() ORTHANC_OVERRIDE
   {
-    return new OrthancStoreRequestHandler(context_);
+    std::unique_ptr<OrthancStoreRequestHandler> result(new OrthancStoreRequestHandler(context_));
+
+    {
+      OrthancConfiguration::ReaderLock lock;
+      result->SetBitPreserving(lock.GetConfiguration().GetBooleanParameter("DicomBitPreservingStore", false));
+    }
+
+    return result.release();
   }
 
   virtual IFindRequestHandler* ConstructFindRequestHandler() ORTHANC_OVERRIDE
@@ -218,6 +253,7 @@ public:
       OrthancConfiguration::ReaderLock lock;
       result->SetMaxResults(lock.GetConfiguration().GetUnsignedIntegerParameter("LimitFindResults", 0));
       result->SetMaxInstances(lock.GetConfiguration().GetUnsignedIntegerParameter("LimitFindInstances", 0));
+      result->SetStreaming(lock.GetConfiguration().GetBooleanParameter("DicomStreamFindAnswers", true));
     }
 
     if (result->GetMaxResults() == 0)
@@ -966,6 +1002,10 @@ static bool WaitForExit(ServerContext& context,
     }
   }
 
+  // Close the long-polling requests to "/changes", otherwise the
+  // HTTP server would wait for them while stopping
+  context.InterruptWaitForChanges();
+
   context.GetLuaScripting().Execute("Finalize");
   context.GetLuaScripting().Stop();
 
@@ -1483,6 +1523,34 @@ namespace
 #endif
     }
   };
+
+
+  // Publishes the hit ratio of the local storage tier, if any, in the
+  // metrics of the server context as long as the latter is alive
+  class StorageTierMetricsConfigurator : public boost::noncopyable
+  {
+  private:
+    TieredStorageArea*  tier_;
+
+  public:
+    StorageTierMetricsConfigurator(IStorageArea& storageArea,
+                                   MetricsRegistry& registry) :
+      tier_(dynamic_cast<TieredStorageArea*>(&storageArea))
+    {
+      if (tier_ != NULL)
+      {
+        tier_->SetMetricsRegistry(&registry);
+      }
+    }
+
+    ~StorageTierMetricsConfigurator()
+    {
+      if (tier_ != NULL)
+      {
+        tier_->SetMetricsRegistry(NULL);
+      }
+    }
+  };
 }
 
 
@@ -1531,6 +1599,10 @@ static bool ConfigureServerContext(IDatabaseWrapper& database,
     // New option in Orthanc 1.9.3
     DicomAssociationParameters::SetDefaultRemoteCertificateRequired(
       lock.GetConfiguration().GetBooleanParameter(KEY_DICOM_TLS_REMOTE_CERTIFICATE_REQUIRED, true));
+
+    // New option in Orthanc 1.11.3, shared by Orthanc SCU and Orthanc SCP
+    DicomAssociationParameters::SetTcpBufferLength(
+      lock.GetConfiguration().GetUnsignedIntegerParameter("DicomTcpBufferLength", 0));
   }
   
   ServerContext context(database, storageArea, false /* not running unit tests */, maxCompletedJobs);
@@ -1582,10 +1654,28 @@ static bool ConfigureServerContext(IDatabaseWrapper& database,
     {
       context.SetMaximumStorageCacheSize(128);
     }
+
+    try
+    {
+      uint64_t size = lock.GetConfiguration().GetUnsignedIntegerParameter("CompressedAnswersCacheSize", 16);
+      context.SetMaximumCompressedAnswersCacheSize(size * 1024 * 1024);
+    }
+    catch (...)
+    {
+      context.SetMaximumCompressedAnswersCacheSize(16 * 1024 * 1024);
+    }
+
+    context.SetInstancesCacheControl(lock.GetConfiguration().GetStringParameter("InstancesCacheControl", ""));
+
+    context.GetQueryRetrieveCache().SetMaximumSize(
+      lock.GetConfiguration().GetUnsignedIntegerParameter("QueryRetrieveCacheSize", 100));
+    context.GetQueryRetrieveCache().SetTimeToLive(
+      lock.GetConfiguration().GetUnsignedIntegerParameter("QueryRetrieveCacheTTL", 0));
   }
 
   {
     ServerContextConfigurator configurator(context, plugins);  // This calls "OrthancConfiguration::SetServerIndex()"
+    StorageTierMetricsConfigurator tierMetrics(storageArea, context.GetMetricsRegistry());
 
     {
       OrthancConfiguration::WriterLock lock;
@@ -1701,6 +1791,8 @@ static bool ConfigurePlugins(int argc,
     storage.reset(CreateStorageArea());
   }
 
+  storage.reset(CreateTieredStorageArea(storage.release()));
+
   assert(database != NULL);
   assert(storage.get() != NULL);
 
@@ -1711,7 +1803,7 @@ static bool ConfigurePlugins(int argc,
   // The plugins are disabled
 
   databasePtr.reset(CreateDatabaseWrapper());
-  storage.reset(CreateStorageArea());
+  storage.reset(CreateTieredStorageArea(CreateStorageArea()));
 
   assert(databasePtr.get() != NULL);
   assert(storage.get() != NULL);
@@ -130,6 +130,77 @@ TEST(DatabaseLookup, SingleConstraint)
     ASSERT_TRUE(tag.IsMatch("ct"));
     ASSERT_TRUE(tag.IsMatch("mr"));
   }
+
+  {
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "*", true, true);
+    ASSERT_TRUE(tag.IsMatch(""));
+    ASSERT_TRUE(tag.IsMatch("HELLO"));
+  }
+
+  {
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "", true, true);
+    ASSERT_TRUE(tag.IsMatch(""));
+    ASSERT_FALSE(tag.IsMatch("HELLO"));
+  }
+
+  {
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "HEL", true, true);
+    ASSERT_TRUE(tag.IsMatch("HEL"));
+    ASSERT_FALSE(tag.IsMatch("HELLO"));
+    ASSERT_FALSE(tag.IsMatch("xHEL"));
+  }
+
+  {
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "HEL**", true, true);
+    ASSERT_TRUE(tag.IsMatch("HEL"));
+    ASSERT_TRUE(tag.IsMatch("HELLO"));
+    ASSERT_FALSE(tag.IsMatch("xHELLO"));
+    ASSERT_FALSE(tag.IsMatch("HE"));
+  }
+
+  {
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "*llo", false, true);
+    ASSERT_TRUE(tag.IsMatch("HELLO"));
+    ASSERT_TRUE(tag.IsMatch("llo"));
+    ASSERT_FALSE(tag.IsMatch("HELLOx"));
+    ASSERT_FALSE(tag.IsMatch("LO"));
+  }
+
+  {
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "*ELL*", true, true);
+    ASSERT_TRUE(tag.IsMatch("HELLO"));
+    ASSERT_TRUE(tag.IsMatch("ELL"));
+    ASSERT_FALSE(tag.IsMatch("HELO"));
+    ASSERT_FALSE(tag.IsMatch("hello"));
+  }
+
+  {
+    // Regular expression characters must be matched literally
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "A.B*(C)?", true, true);
+    ASSERT_TRUE(tag.IsMatch("A.B(C)D"));
+    ASSERT_TRUE(tag.IsMatch("A.Bxyz(C)D"));
+    ASSERT_FALSE(tag.IsMatch("AxB(C)D"));
+    ASSERT_FALSE(tag.IsMatch("A.B(C)"));
+  }
+
+  {
+    // Backtracking on the last star
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "*A*B?", true, true);
+    ASSERT_TRUE(tag.IsMatch("AAB1"));
+    ASSERT_TRUE(tag.IsMatch("xAyBzB1"));
+    ASSERT_FALSE(tag.IsMatch("xAyBzB"));
+    ASSERT_FALSE(tag.IsMatch("BA1"));
+  }
+
+  {
+    // The compiled matcher must be updated if the constraint changes
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "he*", true, true);
+    ASSERT_FALSE(tag.IsMatch("HELLO"));
+    tag.SetCaseSensitive(false);
+    ASSERT_TRUE(tag.IsMatch("HELLO"));
+    tag.SetCaseSensitive(true);
+    ASSERT_FALSE(tag.IsMatch("HELLO"));
+  }
 }
 
 
@@ -24,19 +24,26 @@
 #include <gtest/gtest.h>
 
 #include "../../OrthancFramework/Sources/Compatibility.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomStreamReader.h"
 #include "../../OrthancFramework/Sources/FileStorage/FilesystemStorage.h"
 #include "../../OrthancFramework/Sources/FileStorage/MemoryStorageArea.h"
 #include "../../OrthancFramework/Sources/Images/Image.h"
+#include "../../OrthancFramework/Sources/Images/ImageProcessing.h"
 #include "../../OrthancFramework/Sources/Logging.h"
+#include "../../OrthancFramework/Sources/SystemToolbox.h"
 
+#include "../Sources/Database/ResourcesBatch.h"
 #include "../Sources/Database/SQLiteDatabaseWrapper.h"
 #include "../Sources/OrthancConfiguration.h"
+#include "../Sources/QueryRetrieveCache.h"
 #include "../Sources/Search/DatabaseLookup.h"
 #include "../Sources/ServerContext.h"
 #include "../Sources/ServerToolbox.h"
+#include "../Sources/UploadWorkersPool.h"
 
 #include <ctype.h>
 #include <algorithm>
+#include <boost/thread.hpp>
 
 using namespace Orthanc;
 
@@ -465,6 +472,124 @@ TEST_F(DatabaseWrapperTest, Upward)
 }
 
 
+TEST_F(DatabaseWrapperTest, ExpandResources)
+{
+  int64_t patient = transaction_->CreateResource("patient", ResourceType_Patient);
+  int64_t study1 = transaction_->CreateResource("study1", ResourceType_Study);
+  int64_t study2 = transaction_->CreateResource("study2", ResourceType_Study);
+  int64_t series = transaction_->CreateResource("series", ResourceType_Series);
+  transaction_->AttachChild(patient, study1);
+  transaction_->AttachChild(patient, study2);
+  transaction_->AttachChild(study1, series);
+
+  transaction_->SetMainDicomTag(patient, DICOM_TAG_PATIENT_NAME, "Alice");
+  transaction_->SetMainDicomTag(study1, DICOM_TAG_STUDY_DESCRIPTION, "First");
+  transaction_->SetMainDicomTag(study2, DICOM_TAG_STUDY_DESCRIPTION, "Second");
+  transaction_->SetMetadata(study1, MetadataType_LastUpdate, "20221001T120000", 0);
+  transaction_->SetMetadata(study2, MetadataType_LastUpdate, "20221002T120000", 0);
+  transaction_->SetMetadata(study2, MetadataType_ModifiedFrom, "study1", 0);
+
+  {
+    ResourcesBatch batch;
+    batch.AddResource(patient);
+    batch.AddResource(study1);
+    batch.AddResource(study2);
+    transaction_->ExpandResources(batch, true, true, true);
+
+    ASSERT_EQ(3u, batch.GetSize());
+
+    std::string s;
+    ASSERT_TRUE(batch.GetItem(patient).GetMainDicomTags().LookupStringValue(s, DICOM_TAG_PATIENT_NAME, false));
+    ASSERT_EQ("Alice", s);
+    ASSERT_EQ(1u, batch.GetItem(patient).GetMainDicomTags().GetSize());
+    ASSERT_TRUE(batch.GetItem(patient).GetMetadata().empty());
+    ASSERT_EQ(2u, batch.GetItem(patient).GetChildrenPublicIds().size());
+
+    ASSERT_TRUE(batch.GetItem(study1).GetMainDicomTags().LookupStringValue(s, DICOM_TAG_STUDY_DESCRIPTION, false));
+    ASSERT_EQ("First", s);
+    ASSERT_EQ(1u, batch.GetItem(study1).GetMetadata().size());
+    ASSERT_EQ(1u, batch.GetItem(study1).GetChildrenPublicIds().size());
+    ASSERT_EQ("series", batch.GetItem(study1).GetChildrenPublicIds().front());
+
+    ASSERT_TRUE(batch.GetItem(study2).GetMainDicomTags().LookupStringValue(s, DICOM_TAG_STUDY_DESCRIPTION, false));
+    ASSERT_EQ("Second", s);
+    ASSERT_EQ(2u, batch.GetItem(study2).GetMetadata().size());
+    ASSERT_EQ("study1", batch.GetItem(study2).GetMetadata().find(MetadataType_ModifiedFrom)->second);
+    ASSERT_TRUE(batch.GetItem(study2).GetChildrenPublicIds().empty());
+
+    ASSERT_FALSE(batch.HasResource(series));
+    ASSERT_THROW(batch.GetItem(series), OrthancException);
+  }
+
+  {
+    ResourcesBatch batch;
+    batch.AddResource(study1);
+    transaction_->ExpandResources(batch, false, true, false);
+    ASSERT_EQ(0u, batch.GetItem(study1).GetMainDicomTags().GetSize());
+    ASSERT_EQ(1u, batch.GetItem(study1).GetMetadata().size());
+    ASSERT_TRUE(batch.GetItem(study1).GetChildrenPublicIds().empty());
+  }
+}
+
+
+TEST_F(DatabaseWrapperTest, KeysetPagination)
+{
+  std::vector<int64_t> patients;
+  for (int i = 0; i < 5; i++)
+  {
+    patients.push_back(transaction_->CreateResource("patient" + boost::lexical_cast<std::string>(i),
+                                                    ResourceType_Patient));
+  }
+
+  transaction_->CreateResource("study", ResourceType_Study);
+
+  {
+    std::list<std::string> publicIds;
+    std::list<int64_t> internalIds;
+    transaction_->GetAllPublicIds(publicIds, internalIds, ResourceType_Patient, 0, 2);
+    ASSERT_EQ(2u, publicIds.size());
+    ASSERT_EQ(2u, internalIds.size());
+    ASSERT_EQ("patient0", publicIds.front());
+    ASSERT_EQ("patient1", publicIds.back());
+    ASSERT_EQ(patients[1], internalIds.back());
+
+    transaction_->GetAllPublicIds(publicIds, internalIds, ResourceType_Patient, internalIds.back(), 2);
+    ASSERT_EQ(2u, publicIds.size());
+    ASSERT_EQ("patient2", publicIds.front());
+    ASSERT_EQ("patient3", publicIds.back());
+
+    transaction_->GetAllPublicIds(publicIds, internalIds, ResourceType_Patient, internalIds.back(), 2);
+    ASSERT_EQ(1u, publicIds.size());
+    ASSERT_EQ("patient4", publicIds.front());
+    ASSERT_EQ(patients[4], internalIds.front());
+
+    transaction_->GetAllPublicIds(publicIds, internalIds, ResourceType_Patient, internalIds.back(), 2);
+    ASSERT_TRUE(publicIds.empty());
+    ASSERT_TRUE(internalIds.empty());
+
+    transaction_->GetAllPublicIds(publicIds, internalIds, ResourceType_Patient, 0, 0 /* no limit */);
+    ASSERT_EQ(5u, publicIds.size());
+  }
+
+  {
+    std::vector<DatabaseConstraint> lookup;
+    std::list<std::string> resourcesId;
+    std::list<int64_t> internalIds;
+    transaction_->ApplyLookupResources(resourcesId, NULL, internalIds, lookup, ResourceType_Patient, patients[2], 10);
+    ASSERT_EQ(2u, resourcesId.size());
+    ASSERT_EQ(2u, internalIds.size());
+    ASSERT_EQ("patient3", resourcesId.front());
+    ASSERT_EQ("patient4", resourcesId.back());
+    ASSERT_EQ(patients[3], internalIds.front());
+    ASSERT_EQ(patients[4], internalIds.back());
+
+    transaction_->ApplyLookupResources(resourcesId, NULL, internalIds, lookup, ResourceType_Patient, 0, 1);
+    ASSERT_EQ(1u, resourcesId.size());
+    ASSERT_EQ("patient0", resourcesId.front());
+  }
+}
+
+
 TEST_F(DatabaseWrapperTest, PatientRecycling)
 {
   std::vector<int64_t> patients;
@@ -631,6 +756,35 @@ TEST(ServerIndex, Sequence)
 }
 
 
+TEST(ServerIndex, WaitForChanges)
+{
+  const std::string path = "UnitTestsStorage";
+
+  SystemToolbox::RemoveFile(path + "/index");
+  FilesystemStorage storage(path);
+  SQLiteDatabaseWrapper db;   // The SQLite DB is in memory
+  db.Open();
+  ServerContext context(db, storage, true /* running unit tests */, 10);
+  context.SetupJobsEngine(true, false);
+
+  uint64_t generation = context.GetChangesGeneration();
+  ASSERT_FALSE(context.WaitForChanges(generation, 10));
+
+  context.SignalChange(ServerIndexChange(ChangeType_NewPatient, ResourceType_Patient, "patient"));
+  ASSERT_TRUE(context.WaitForChanges(generation, 10));
+  ASSERT_EQ(generation + 1, context.GetChangesGeneration());
+
+  generation = context.GetChangesGeneration();
+  ASSERT_FALSE(context.IsWaitForChangesInterrupted());
+  context.InterruptWaitForChanges();
+  ASSERT_TRUE(context.IsWaitForChangesInterrupted());
+  ASSERT_FALSE(context.WaitForChanges(generation, 60000));  // Returns immediately
+
+  context.Stop();
+  db.Close();
+}
+
+
 TEST_F(DatabaseWrapperTest, LookupIdentifier)
 {
   int64_t a[] = {
@@ -1038,3 +1192,653 @@ TEST(ServerIndex, DicomUntilPixelData)
     }
   }
 }
+
+
+static bool IsTranscodingPending(ServerContext& context,
+                                 const std::string& instance)
+{
+  std::string s;
+  int64_t revision;
+  return context.GetIndex().LookupMetadata(s, revision, instance, ResourceType_Instance,
+                                           MetadataType_Instance_PendingTranscoding);
+}
+
+
+TEST(ServerIndex, DeferredTranscoding)
+{
+  // Create a dummy 2x2 image
+  Image image(PixelFormat_Grayscale8, 2, 2, false);
+  ImageProcessing::Set(image, 128);
+
+  MemoryStorageArea storage;
+  SQLiteDatabaseWrapper db;   // The SQLite DB is in memory
+  db.Open();
+
+  std::string interrupted;
+
+  {
+    // Simulate an instance whose deferred transcoding was
+    // interrupted by a stop of Orthanc
+    ServerContext context(db, storage, true /* running unit tests */, 10);
+    context.SetupJobsEngine(true, false);
+    context.SetCompressionEnabled(true);
+
+    ParsedDicomFile dicom(true);
+    dicom.EmbedImage(image);
+
+    std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(dicom));
+    toStore->SetOrigin(DicomInstanceOrigin::FromPlugins());
+    toStore->AddMetadata(ResourceType_Instance, MetadataType_Instance_PendingTranscoding, "1");
+    ASSERT_EQ(StoreStatus_Success, context.Store(interrupted, *toStore, StoreInstanceMode_Default).GetStatus());
+    context.GetIndex().SetGlobalProperty(GlobalProperty_PendingTranscoding, false, "1");
+
+    ASSERT_TRUE(IsTranscodingPending(context, interrupted));
+    context.Stop();
+  }
+
+  {
+    ServerContext context(db, storage, true /* running unit tests */, 10);
+    context.SetupJobsEngine(true, false);
+    context.SetCompressionEnabled(true);
+
+    // Lossy transcoding would change the SOP instance UID
+    ASSERT_THROW(context.SetIngestTranscoding(DicomTransferSyntax_JPEGProcess1, true), OrthancException);
+
+    // This resumes the transcoding of "interrupted"
+    context.SetIngestTranscoding(DicomTransferSyntax_LittleEndianImplicit, true);
+
+    std::string stored;
+
+    {
+      ParsedDicomFile dicom(true);
+      dicom.EmbedImage(image);
+
+      std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(dicom));
+      toStore->SetOrigin(DicomInstanceOrigin::FromPlugins());
+      ASSERT_EQ(StoreStatus_Success, context.Store(stored, *toStore, StoreInstanceMode_Default).GetStatus());
+    }
+
+    // Wait for the background thread to transcode both instances
+    for (unsigned int i = 0; i < 200; i++)
+    {
+      std::string property;
+      if (context.GetIndex().LookupGlobalProperty(property, GlobalProperty_PendingTranscoding, false) &&
+          property == "0")
+      {
+        break;
+      }
+
+      SystemToolbox::USleep(50000);
+    }
+
+    std::string property;
+    ASSERT_TRUE(context.GetIndex().LookupGlobalProperty(property, GlobalProperty_PendingTranscoding, false));
+    ASSERT_EQ("0", property);
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+      const std::string& id = (i == 0 ? interrupted : stored);
+
+      ASSERT_FALSE(IsTranscodingPending(context, id));
+
+      std::string s;
+      int64_t revision;
+      ASSERT_TRUE(context.GetIndex().LookupMetadata(s, revision, id, ResourceType_Instance,
+                                                    MetadataType_Instance_TransferSyntax));
+      ASSERT_EQ(GetTransferSyntaxUid(DicomTransferSyntax_LittleEndianImplicit), s);
+
+      std::string file;
+      context.ReadDicom(file, id);
+
+      DicomTransferSyntax syntax;
+      ParsedDicomFile parsed(file);
+      ASSERT_TRUE(parsed.LookupTransferSyntax(syntax));
+      ASSERT_EQ(DicomTransferSyntax_LittleEndianImplicit, syntax);
+
+      uint64_t offset;
+      ASSERT_TRUE(DicomStreamReader::LookupPixelDataOffset(offset, file));
+      ASSERT_TRUE(context.GetIndex().LookupMetadata(s, revision, id, ResourceType_Instance,
+                                                    MetadataType_Instance_PixelDataOffset));
+      ASSERT_EQ(offset, boost::lexical_cast<uint64_t>(s));
+
+      // The attachments derived from the DICOM file must match the transcoded file
+      std::string untilPixelData;
+      context.ReadAttachment(untilPixelData, revision, id, FileContentType_DicomUntilPixelData,
+                             true /* uncompress */, true /* skip cache */);
+      ASSERT_EQ(file.substr(0, offset), untilPixelData);
+
+      std::set<FileContentType> attachments;
+      context.GetIndex().ListAvailableAttachments(attachments, id, ResourceType_Instance);
+      ASSERT_EQ(2u, attachments.size());
+      ASSERT_TRUE(attachments.find(FileContentType_Dicom) != attachments.end());
+      ASSERT_TRUE(attachments.find(FileContentType_DicomUntilPixelData) != attachments.end());
+    }
+
+    context.Stop();
+  }
+
+  db.Close();
+}
+
+
+namespace
+{
+  class CountingFinder : public QueryRetrieveCache::IFinder
+  {
+  private:
+    boost::mutex  mutex_;
+    unsigned int  count_;
+    unsigned int  delay_;
+    bool          failure_;
+
+  public:
+    explicit CountingFinder(unsigned int delay = 0) :
+      count_(0),
+      delay_(delay),
+      failure_(false)
+    {
+    }
+
+    void SetFailure(bool failure)
+    {
+      failure_ = failure;
+    }
+
+    unsigned int GetCount()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      return count_;
+    }
+
+    virtual void Find(QueryRetrieveCache::Answers& target) ORTHANC_OVERRIDE
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        count_++;
+      }
+
+      if (delay_ != 0)
+      {
+        SystemToolbox::USleep(delay_);
+      }
+
+      if (failure_)
+      {
+        throw OrthancException(ErrorCode_NetworkProtocol);
+      }
+
+      DicomMap m;
+      m.SetValue(DICOM_TAG_PATIENT_ID, "patient", false);
+      target.Add(m);
+    }
+  };
+
+
+  class CoalescingThread : public boost::noncopyable
+  {
+  private:
+    QueryRetrieveCache&               cache_;
+    CountingFinder&                   finder_;
+    QueryRetrieveCache::LookupStatus  status_;
+    size_t                            size_;
+
+  public:
+    CoalescingThread(QueryRetrieveCache& cache,
+                     CountingFinder& finder) :
+      cache_(cache),
+      finder_(finder),
+      status_(QueryRetrieveCache::LookupStatus_Miss),
+      size_(0)
+    {
+    }
+
+    void operator() ()
+    {
+      size_ = cache_.Find(status_, "key", finder_)->GetSize();
+    }
+
+    QueryRetrieveCache::LookupStatus GetStatus() const
+    {
+      return status_;
+    }
+
+    size_t GetSize() const
+    {
+      return size_;
+    }
+  };
+}
+
+
+TEST(QueryRetrieveCache, Basic)
+{
+  QueryRetrieveCache cache;
+  ASSERT_FALSE(cache.IsEnabled());
+
+  CountingFinder finder;
+  QueryRetrieveCache::LookupStatus status;
+
+  // The cache is disabled
+  ASSERT_EQ(1u, cache.Find(status, "a", finder)->GetSize());
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(1u, cache.Find(status, "a", finder)->GetSize());
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(2u, finder.GetCount());
+  ASSERT_EQ(0u, cache.GetSize());
+
+  cache.SetMaximumSize(2);
+  cache.SetTimeToLive(60);
+  ASSERT_TRUE(cache.IsEnabled());
+
+  boost::shared_ptr<const QueryRetrieveCache::Answers> answers = cache.Find(status, "a", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(3u, finder.GetCount());
+
+  DicomMap m;
+  answers->GetAnswer(m, 0);
+  ASSERT_EQ("patient", m.GetStringValue(DICOM_TAG_PATIENT_ID, "", false));
+  ASSERT_THROW(answers->GetAnswer(m, 1), OrthancException);
+
+  ASSERT_EQ(answers.get(), cache.Find(status, "a", finder).get());
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Hit, status);
+  ASSERT_EQ(3u, finder.GetCount());
+
+  cache.Find(status, "b", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  cache.Find(status, "a", finder);  // "a" becomes the most recent entry
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Hit, status);
+  cache.Find(status, "c", finder);  // "b" is removed
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(2u, cache.GetSize());
+  ASSERT_EQ(5u, finder.GetCount());
+
+  cache.Find(status, "a", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Hit, status);
+  cache.Find(status, "b", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(6u, finder.GetCount());
+
+  // Failures are not cached
+  finder.SetFailure(true);
+  ASSERT_THROW(cache.Find(status, "d", finder), OrthancException);
+  ASSERT_EQ(7u, finder.GetCount());
+  finder.SetFailure(false);
+  cache.Find(status, "d", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(8u, finder.GetCount());
+
+  cache.Clear();
+  ASSERT_EQ(0u, cache.GetSize());
+  cache.Find(status, "d", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(9u, finder.GetCount());
+}
+
+
+TEST(QueryRetrieveCache, TimeToLive)
+{
+  QueryRetrieveCache cache;
+  cache.SetMaximumSize(10);
+  cache.SetTimeToLive(1);
+
+  CountingFinder finder;
+  QueryRetrieveCache::LookupStatus status;
+
+  cache.Find(status, "a", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  cache.Find(status, "a", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Hit, status);
+
+  SystemToolbox::USleep(1100000);
+
+  cache.Find(status, "a", finder);
+  ASSERT_EQ(QueryRetrieveCache::LookupStatus_Miss, status);
+  ASSERT_EQ(2u, finder.GetCount());
+  ASSERT_EQ(1u, cache.GetSize());
+}
+
+
+TEST(QueryRetrieveCache, Coalescing)
+{
+  QueryRetrieveCache cache;
+  cache.SetMaximumSize(10);
+  cache.SetTimeToLive(60);
+
+  CountingFinder finder(200000 /* 200ms */);
+
+  std::vector<CoalescingThread*> workers;
+  boost::thread_group threads;
+
+  for (size_t i = 0; i < 5; i++)
+  {
+    workers.push_back(new CoalescingThread(cache, finder));
+    threads.create_thread(boost::ref(*workers.back()));
+  }
+
+  threads.join_all();
+
+  ASSERT_EQ(1u, finder.GetCount());
+
+  size_t misses = 0;
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    ASSERT_EQ(1u, workers[i]->GetSize());
+    if (workers[i]->GetStatus() == QueryRetrieveCache::LookupStatus_Miss)
+    {
+      misses++;
+    }
+
+    delete workers[i];
+  }
+
+  ASSERT_EQ(1u, misses);
+}
+
+
+namespace
+{
+  class ConcurrencyCounter : public boost::noncopyable
+  {
+  private:
+    boost::mutex  mutex_;
+    unsigned int  current_;
+    unsigned int  maximum_;
+    unsigned int  total_;
+
+  public:
+    ConcurrencyCounter() :
+      current_(0),
+      maximum_(0),
+      total_(0)
+    {
+    }
+
+    void Enter()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      current_++;
+      total_++;
+      maximum_ = std::max(maximum_, current_);
+    }
+
+    void Leave()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      current_--;
+    }
+
+    unsigned int GetMaximum()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      return maximum_;
+    }
+
+    unsigned int GetTotal()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      return total_;
+    }
+  };
+
+
+  /**
+   * The content of the files is the delay in milliseconds before the
+   * file is stored. The files named "skip" are not reported in the
+   * answer, the files named "error" throw an Orthanc exception, and
+   * the files named "native" throw a standard exception.
+   **/
+  class SleepingFileHandler : public UploadWorkersPool::IFileHandler
+  {
+  private:
+    ConcurrencyCounter&  counter_;
+
+  public:
+    explicit SleepingFileHandler(ConcurrencyCounter& counter) :
+      counter_(counter)
+    {
+    }
+
+    virtual bool Store(Json::Value& answer,
+                       const std::string& filename,
+                       const std::string& content) ORTHANC_OVERRIDE
+    {
+      counter_.Enter();
+      SystemToolbox::USleep(1000 * boost::lexical_cast<unsigned int>(content));
+      counter_.Leave();
+
+      if (filename == "error")
+      {
+        throw OrthancException(ErrorCode_NetworkProtocol, "Simulated failure");
+      }
+      else if (filename == "native")
+      {
+        throw std::runtime_error("Simulated native failure");
+      }
+
+      answer = filename;
+      return (filename != "skip");
+    }
+  };
+
+
+  class UploadThread : public boost::noncopyable
+  {
+  private:
+    UploadWorkersPool&   pool_;
+    ConcurrencyCounter&  counter_;
+    size_t               countFiles_;
+    bool                 success_;
+
+  public:
+    UploadThread(UploadWorkersPool& pool,
+                 ConcurrencyCounter& counter,
+                 size_t countFiles) :
+      pool_(pool),
+      counter_(counter),
+      countFiles_(countFiles),
+      success_(false)
+    {
+    }
+
+    void operator() ()
+    {
+      UploadWorkersPool::Upload upload(pool_, new SleepingFileHandler(counter_));
+
+      for (size_t i = 0; i < countFiles_; i++)
+      {
+        std::string content = "10";
+        upload.Submit(boost::lexical_cast<std::string>(i), content);
+      }
+
+      upload.Close();
+
+      std::string key;
+      Json::Value item;
+      size_t count = 0;
+      while (upload.ReadNextItem(key, item))
+      {
+        if (item.asString() != boost::lexical_cast<std::string>(count))
+        {
+          return;
+        }
+
+        count++;
+      }
+
+      success_ = (count == countFiles_);
+    }
+
+    bool IsSuccess() const
+    {
+      return success_;
+    }
+  };
+}
+
+
+TEST(UploadWorkersPool, Ordering)
+{
+  ConcurrencyCounter counter;
+  UploadWorkersPool pool(4);
+  ASSERT_EQ(4u, pool.GetThreadsCount());
+
+  UploadWorkersPool::Upload upload(pool, new SleepingFileHandler(counter));
+
+  // The first files are the slowest to store, but their answers must
+  // nevertheless come first
+  for (unsigned int i = 0; i < 20; i++)
+  {
+    std::string content = boost::lexical_cast<std::string>(20 - i);
+    upload.Submit(i % 5 == 2 ? "skip" : boost::lexical_cast<std::string>(i), content);
+  }
+
+  upload.Close();
+
+  std::string content = "0";
+  ASSERT_THROW(upload.Submit("closed", content), OrthancException);
+
+  std::string key;
+  Json::Value item;
+
+  for (unsigned int i = 0; i < 20; i++)
+  {
+    if (i % 5 != 2)
+    {
+      ASSERT_TRUE(upload.ReadNextItem(key, item));
+      ASSERT_EQ(boost::lexical_cast<std::string>(i), item.asString());
+    }
+  }
+
+  ASSERT_FALSE(upload.ReadNextItem(key, item));
+  ASSERT_FALSE(upload.ReadNextItem(key, item));
+  ASSERT_EQ(20u, counter.GetTotal());
+}
+
+
+TEST(UploadWorkersPool, Errors)
+{
+  ASSERT_THROW(UploadWorkersPool(0), OrthancException);
+
+  ConcurrencyCounter counter;
+  UploadWorkersPool pool(2);
+  UploadWorkersPool::Upload upload(pool, new SleepingFileHandler(counter));
+
+  std::string content;
+  content = "20";  upload.Submit("a", content);
+  content = "0";   upload.Submit("error", content);
+  content = "0";   upload.Submit("b", content);
+  content = "0";   upload.Submit("native", content);
+  content = "0";   upload.Submit("c", content);
+  upload.Close();
+
+  std::string key;
+  Json::Value item;
+  ASSERT_TRUE(upload.ReadNextItem(key, item));
+  ASSERT_EQ("a", item.asString());
+
+  try
+  {
+    upload.ReadNextItem(key, item);
+    ASSERT_TRUE(false);
+  }
+  catch (OrthancException& e)
+  {
+    ASSERT_EQ(ErrorCode_NetworkProtocol, e.GetErrorCode());
+  }
+
+  // The failure of one file doesn't prevent the other files from being stored
+  ASSERT_TRUE(upload.ReadNextItem(key, item));
+  ASSERT_EQ("b", item.asString());
+
+  try
+  {
+    upload.ReadNextItem(key, item);
+    ASSERT_TRUE(false);
+  }
+  catch (OrthancException& e)
+  {
+    ASSERT_EQ(ErrorCode_InternalError, e.GetErrorCode());
+  }
+
+  ASSERT_TRUE(upload.ReadNextItem(key, item));
+  ASSERT_EQ("c", item.asString());
+  ASSERT_FALSE(upload.ReadNextItem(key, item));
+}
+
+
+TEST(UploadWorkersPool, WaitCompletion)
+{
+  ConcurrencyCounter counter;
+  UploadWorkersPool pool(2);
+
+  {
+    UploadWorkersPool::Upload upload(pool, new SleepingFileHandler(counter));
+
+    std::string content;
+    content = "20";  upload.Submit("a", content);
+    content = "0";   upload.Submit("skip", content);
+    content = "10";  upload.Submit("b", content);
+    upload.Close();
+    upload.WaitCompletion();
+
+    std::string key;
+    Json::Value item;
+    ASSERT_TRUE(upload.ReadNextItem(key, item));
+    ASSERT_EQ("a", item.asString());
+    ASSERT_TRUE(upload.ReadNextItem(key, item));
+    ASSERT_EQ("b", item.asString());
+    ASSERT_FALSE(upload.ReadNextItem(key, item));
+  }
+
+  {
+    UploadWorkersPool::Upload upload(pool, new SleepingFileHandler(counter));
+
+    std::string content;
+    content = "0";   upload.Submit("a", content);
+    content = "20";  upload.Submit("native", content);
+    content = "0";   upload.Submit("error", content);
+    upload.Close();
+
+    // The first error in the order of submission is reported, once
+    // all the files have been handled
+    try
+    {
+      upload.WaitCompletion();
+      ASSERT_TRUE(false);
+    }
+    catch (OrthancException& e)
+    {
+      ASSERT_EQ(ErrorCode_InternalError, e.GetErrorCode());
+    }
+  }
+}
+
+
+TEST(UploadWorkersPool, Cap)
+{
+  ConcurrencyCounter counter;
+  UploadWorkersPool pool(3);
+
+  std::vector<UploadThread*> uploads;
+  boost::thread_group threads;
+
+  // Whatever the number of concurrent uploads, at most 3 files are
+  // stored at once, as the workers are shared by the uploads
+  for (size_t i = 0; i < 4; i++)
+  {
+    uploads.push_back(new UploadThread(pool, counter, 10));
+    threads.create_thread(boost::ref(*uploads.back()));
+  }
+
+  threads.join_all();
+
+  for (size_t i = 0; i < uploads.size(); i++)
+  {
+    ASSERT_TRUE(uploads[i]->IsSuccess());
+    delete uploads[i];
+  }
+
+  ASSERT_EQ(40u, counter.GetTotal());
+  ASSERT_LE(counter.GetMaximum(), 3u);
+  ASSERT_GE(counter.GetMaximum(), 2u);
+}